@@ -0,0 +1,289 @@
+/*
+** Copyright (c) 2026 D. Richard Hipp
+**
+** This program is free software; you can redistribute it and/or
+** modify it under the terms of the Simplified BSD License (also
+** known as the "2-Clause License" or "FreeBSD License".)
+**
+** This program is distributed in the hope that it will be useful,
+** but without any warranty; without even the implied warranty of
+** merchantability or fitness for a particular purpose.
+**
+** Author contact information:
+**   drh@sqlite.org
+**
+*******************************************************************************
+**
+** This file implements a region allocator for the many small, short-lived
+** allocations made while handling a single request: TH1 values and
+** variables, and copies of CGI parameter names and values.
+**
+** Memory is carved out of a small number of large chunks.  Each chunk is
+** twice the size of the one before it, so a busy request needs only a
+** handful of calls to malloc().  Every block is rounded up to a power-of-two
+** size class and is preceded by a 16-byte header that records the class.
+** A block that is freed goes onto a free list for its class and is handed
+** out again by the next allocation of that class.  Requests larger than the
+** biggest class fall through to the ordinary heap.
+**
+** fossil_free() and fossil_realloc() recognize arena blocks by looking
+** the address up in a sorted table of chunk bounds, so callers do not
+** need to know which allocator produced the memory they hold.  Chunks
+** are obtained from malloc() and carved up only by the arena, so any
+** address inside a chunk belongs to the arena.  Nothing stored in the
+** memory itself is consulted.  fossil_arena_reset() releases every chunk
+** at once.  It must only be called at a request boundary, when nothing
+** still refers to arena memory.
+*/
+#include "config.h"
+#include "arena.h"
+#include <assert.h>
+
+/*
+** Size classes run from 16 bytes (class 0) through 4096 bytes (class 8).
+*/
+#define ARENA_NCLASS     9
+#define ARENA_MIN_SHIFT  4
+#define ARENA_MAX_BLOCK  (1<<(ARENA_MIN_SHIFT+ARENA_NCLASS-1))
+#define ARENA_HDR        16
+#define ARENA_MIN_CHUNK  65536
+#define ARENA_MAX_CHUNKS 48
+
+/*
+** One chunk of arena memory.  The usable space immediately follows
+** this header.
+*/
+typedef struct ArenaChunk ArenaChunk;
+struct ArenaChunk {
+  ArenaChunk *pNext;        /* Next older chunk */
+  char *zStart;             /* First byte of usable space */
+  char *zEnd;               /* One byte past the end of usable space */
+  char *zFree;              /* First unused byte */
+};
+
+/* Size of the chunk header, rounded up to keep blocks 16-byte aligned */
+#define ARENA_CHUNK_HDR  ((sizeof(ArenaChunk)+ARENA_HDR-1)&~(ARENA_HDR-1))
+
+/*
+** Header that precedes every block handed out by the arena.  The union
+** keeps the block body aligned to 16 bytes.
+*/
+typedef union ArenaHdr ArenaHdr;
+union ArenaHdr {
+  struct {
+    int iClass;             /* Size class of this block */
+    ArenaHdr *pNextFree;    /* Next block on the free list, when free */
+  } s;
+  char aPad[ARENA_HDR];
+};
+
+/*
+** State of the arena.
+*/
+static struct {
+  ArenaChunk *pChunk;                  /* Most recent chunk */
+  const char *zLo, *zHi;               /* Bounds of all chunks */
+  int nChunk;                          /* Number of entries in aChunk[] */
+  ArenaChunk *aChunk[ARENA_MAX_CHUNKS];  /* Chunks sorted by address */
+  size_t szNext;                       /* Size of the next chunk */
+  ArenaHdr *aFree[ARENA_NCLASS];       /* Free lists, one per size class */
+  sqlite3_int64 nByte;                 /* Bytes requested since last reset */
+  sqlite3_int64 nAlloc;                /* Allocations since last reset */
+  sqlite3_int64 nChunkByte;            /* Bytes currently held in chunks */
+} arena;
+
+/*
+** Return the size class needed to hold n bytes.
+*/
+static int arena_class(size_t n){
+  int iClass = 0;
+  size_t sz = 1<<ARENA_MIN_SHIFT;
+  while( sz<n ){
+    sz <<= 1;
+    iClass++;
+  }
+  return iClass;
+}
+
+/*
+** Return the number of usable bytes in a block of size class iClass.
+*/
+static size_t arena_class_size(int iClass){
+  return ((size_t)1)<<(iClass+ARENA_MIN_SHIFT);
+}
+
+/*
+** Return true if p was allocated by the arena.  This is called for
+** every fossil_free() and fossil_realloc().  A pointer outside the span
+** of all chunks is rejected at once.  Otherwise a binary search of
+** aChunk[] finds the only chunk that could hold p, and p belongs to the
+** arena if it lies within the part of that chunk handed out so far.
+*/
+int fossil_arena_owns(const void *p){
+  const char *z = (const char*)p;
+  int lwr, upr;
+  if( z==0 || z<arena.zLo || z>=arena.zHi ) return 0;
+  lwr = 0;
+  upr = arena.nChunk-1;
+  while( lwr<upr ){
+    int mid = (lwr+upr+1)/2;
+    if( arena.aChunk[mid]->zStart<=z ){
+      lwr = mid;
+    }else{
+      upr = mid-1;
+    }
+  }
+  return z>arena.aChunk[lwr]->zStart && z<arena.aChunk[lwr]->zFree;
+}
+
+/*
+** Record a new chunk in aChunk[], keeping the table sorted by address.
+*/
+static void arena_add_chunk(ArenaChunk *pChunk){
+  int i = arena.nChunk;
+  assert( arena.nChunk<ARENA_MAX_CHUNKS );
+  while( i>0 && arena.aChunk[i-1]->zStart>pChunk->zStart ){
+    arena.aChunk[i] = arena.aChunk[i-1];
+    i--;
+  }
+  arena.aChunk[i] = pChunk;
+  arena.nChunk++;
+  if( arena.zLo==0 || pChunk->zStart<arena.zLo ) arena.zLo = pChunk->zStart;
+  if( pChunk->zEnd>arena.zHi ) arena.zHi = pChunk->zEnd;
+}
+
+/*
+** Allocate n bytes from the arena.  The memory is not initialized.
+** Never returns NULL.
+*/
+void *fossil_arena_malloc(size_t n){
+  int iClass;
+  size_t szBlock;
+  ArenaHdr *pHdr;
+  ArenaChunk *pChunk = arena.pChunk;
+
+  arena.nByte += n;
+  arena.nAlloc++;
+  if( n>ARENA_MAX_BLOCK ) return fossil_malloc(n);
+  iClass = arena_class(n);
+  pHdr = arena.aFree[iClass];
+  if( pHdr ){
+    arena.aFree[iClass] = pHdr->s.pNextFree;
+    return (void*)&pHdr[1];
+  }
+  szBlock = ARENA_HDR + arena_class_size(iClass);
+  if( pChunk==0 || (size_t)(pChunk->zEnd - pChunk->zFree)<szBlock ){
+    size_t sz;
+    if( arena.szNext<ARENA_MIN_CHUNK ) arena.szNext = ARENA_MIN_CHUNK;
+    sz = arena.szNext;
+    arena.szNext *= 2;
+    pChunk = fossil_malloc(ARENA_CHUNK_HDR + sz);
+    pChunk->zStart = ((char*)pChunk) + ARENA_CHUNK_HDR;
+    pChunk->zEnd = pChunk->zStart + sz;
+    pChunk->zFree = pChunk->zStart;
+    pChunk->pNext = arena.pChunk;
+    arena.pChunk = pChunk;
+    arena.nChunkByte += sz;
+    arena_add_chunk(pChunk);
+  }
+  pHdr = (ArenaHdr*)pChunk->zFree;
+  pChunk->zFree += szBlock;
+  pHdr->s.iClass = iClass;
+  pHdr->s.pNextFree = 0;
+  return (void*)&pHdr[1];
+}
+
+/*
+** Allocate n bytes of zeroed memory from the arena.
+*/
+void *fossil_arena_malloc_zero(size_t n){
+  void *p = fossil_arena_malloc(n);
+  memset(p, 0, n);
+  return p;
+}
+
+/*
+** Return a block to the free list for its size class.  p must have
+** been allocated by the arena.
+*/
+void fossil_arena_free(void *p){
+  ArenaHdr *pHdr = &((ArenaHdr*)p)[-1];
+  assert( fossil_arena_owns(p) );
+  assert( pHdr->s.iClass>=0 && pHdr->s.iClass<ARENA_NCLASS );
+  pHdr->s.pNextFree = arena.aFree[pHdr->s.iClass];
+  arena.aFree[pHdr->s.iClass] = pHdr;
+}
+
+/*
+** Resize a block that was allocated by the arena.  The block is reused
+** when its size class is already large enough.
+*/
+void *fossil_arena_realloc(void *p, size_t n){
+  ArenaHdr *pHdr = &((ArenaHdr*)p)[-1];
+  size_t szOld = arena_class_size(pHdr->s.iClass);
+  void *pNew;
+  if( n<=szOld ) return p;
+  pNew = fossil_arena_malloc(n);
+  memcpy(pNew, p, szOld);
+  fossil_arena_free(p);
+  return pNew;
+}
+
+/*
+** Make a copy of a string in arena memory.  Return NULL if z is NULL.
+*/
+char *fossil_arena_strdup(const char *z){
+  char *zCopy;
+  size_t n;
+  if( z==0 ) return 0;
+  n = strlen(z);
+  zCopy = fossil_arena_malloc(n+1);
+  memcpy(zCopy, z, n+1);
+  return zCopy;
+}
+
+/*
+** Like mprintf() except that the result is held in arena memory.
+*/
+char *fossil_arena_mprintf(const char *zFormat, ...){
+  Blob x;
+  va_list ap;
+  char *z;
+  blob_init(&x, 0, 0);
+  va_start(ap, zFormat);
+  vxprintf(&x, zFormat, ap);
+  va_end(ap);
+  z = fossil_arena_malloc(blob_size(&x)+1);
+  memcpy(z, blob_buffer(&x), blob_size(&x));
+  z[blob_size(&x)] = 0;
+  blob_reset(&x);
+  return z;
+}
+
+/*
+** Release all arena memory and zero the counters.  Any pointer into
+** the arena becomes invalid.
+*/
+void fossil_arena_reset(void){
+  ArenaChunk *pChunk, *pNext;
+  for(pChunk=arena.pChunk; pChunk; pChunk=pNext){
+    pNext = pChunk->pNext;
+    free(pChunk);
+  }
+  memset(&arena, 0, sizeof(arena));
+}
+
+/*
+** Report the number of bytes and the number of allocations requested
+** from the arena since the last reset, and the number of bytes currently
+** held in arena chunks.  Any of the pointers may be NULL.
+*/
+void fossil_arena_stats(
+  sqlite3_int64 *pnByte,
+  sqlite3_int64 *pnAlloc,
+  sqlite3_int64 *pnChunkByte
+){
+  if( pnByte ) *pnByte = arena.nByte;
+  if( pnAlloc ) *pnAlloc = arena.nAlloc;
+  if( pnChunkByte ) *pnChunkByte = arena.nChunkByte;
+}
@@ -647,6 +647,8 @@ void backoffice_work(void){
   if( nThis ){ backoffice_log("%d alerts", nThis); nTotal += nThis; }
   nThis = hook_backoffice();
   if( nThis ){ backoffice_log("%d hooks", nThis); nTotal += nThis; }
+  nThis = repack_backoffice();
+  if( nThis ){ backoffice_log("%d repacked", nThis); nTotal += nThis; }
 
   /* Close the log */
   if( backofficeFILE ){
@@ -860,6 +862,7 @@ void backoffice_run_if_needed(void){
       g.fDebug = 0;
       g.httpIn = 0;
       g.httpOut = 0;
+      cgi_end_request();
       db_open_repository(backofficeDb);
       backofficeDb = "x";
       backoffice_thread();
@@ -875,6 +878,7 @@ void backoffice_run_if_needed(void){
   ** do so with the no-delay setting.
   */
   backofficeNoDelay = 1;
+  cgi_end_request();
   db_open_repository(backofficeDb);
   backofficeDb = "x";
   backoffice_thread();
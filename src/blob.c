@@ -195,6 +195,34 @@ static void blob_assert_safe_size(i64 n){
   }
 }
 
+/*
+** Smallest buffer that a growing blob will allocate.  Most blobs that
+** grow at all grow past this size, so starting smaller only adds
+** reallocations.
+*/
+#define BLOB_MIN_ALLOC 128
+
+/*
+** Number of times a blob buffer has been allocated or resized.  Used
+** by test-blob-speed.
+*/
+static int nBlobRealloc = 0;
+
+/*
+** Return the buffer size to use for a blob that currently has nAlloc
+** bytes allocated and needs room for at least nNeed bytes.  The buffer
+** grows by at least its current size each time, so a long run of appends
+** costs a logarithmic number of reallocations.
+*/
+static i64 blob_grow_size(unsigned int nAlloc, i64 nNeed){
+  i64 nNew = nNeed + nAlloc;
+  if( nNew<BLOB_MIN_ALLOC ) nNew = BLOB_MIN_ALLOC;
+  if( nNew>=(i64)MAX_BLOB_SIZE && nNeed<(i64)MAX_BLOB_SIZE ){
+    nNew = MAX_BLOB_SIZE - 1;
+  }
+  return nNew;
+}
+
 /*
 ** A reallocation function that assumes that aData came from malloc().
 ** This function attempts to resize the buffer of the blob to hold
@@ -215,6 +243,7 @@ void blobReallocMalloc(Blob *pBlob, unsigned int newSize){
   }else if( newSize>pBlob->nAlloc || newSize+4000<pBlob->nAlloc ){
     char *pNew;
     blob_assert_safe_size((i64)newSize);
+    nBlobRealloc++;
     pNew = fossil_realloc(pBlob->aData, newSize);
     pBlob->aData = pNew;
     pBlob->nAlloc = newSize;
@@ -242,6 +271,7 @@ static void blobReallocStatic(Blob *pBlob, unsigned int newSize){
   }else{
     char *pNew;
     blob_assert_safe_size((i64)newSize);
+    nBlobRealloc++;
     pNew = fossil_malloc( newSize );
     if( pBlob->nUsed>newSize ) pBlob->nUsed = newSize;
     memcpy(pNew, pBlob->aData, pBlob->nUsed);
@@ -307,6 +337,29 @@ void blob_set_dynamic(Blob *pBlob, char *zStr){
   pBlob->xRealloc = blobReallocMalloc;
 }
 
+/*
+** Initialize a blob to use the caller-supplied buffer aBuf[] of nBuf
+** bytes, typically an array on the stack.  Appends go directly into
+** aBuf[] until it fills, at which point the content moves to memory
+** obtained from fossil_malloc() and aBuf[] is no longer used.
+**
+** This gives short-lived blobs that usually stay small a way to avoid
+** the heap entirely.  The buffer cannot be part of the Blob object
+** itself because Blobs are routinely copied by value.  aBuf[] must
+** outlive every use of the blob, and blob_reset() must still be called.
+*/
+void blob_init_buffer(Blob *pBlob, char *aBuf, unsigned int nBuf){
+  assert_blob_is_reset(pBlob);
+  assert( nBuf>0 );
+  aBuf[0] = 0;
+  pBlob->nUsed = 0;
+  pBlob->nAlloc = nBuf;
+  pBlob->aData = aBuf;
+  pBlob->iCursor = 0;
+  pBlob->blobFlags = 0;
+  pBlob->xRealloc = blobReallocStatic;
+}
+
 /*
 ** Initialize a blob to an empty string.
 */
@@ -350,8 +403,7 @@ static void blob_append_full(Blob *pBlob, const char *aData, int nData){
   nNew = pBlob->nUsed;
   nNew += nData;
   if( nNew >= pBlob->nAlloc ){
-    nNew += pBlob->nAlloc;
-    nNew += 100;
+    nNew = blob_grow_size(pBlob->nAlloc, nNew+1);
     blob_assert_safe_size(nNew);
     pBlob->xRealloc(pBlob, (unsigned)nNew);
     if( pBlob->nUsed + nData >= pBlob->nAlloc ){
@@ -643,6 +695,21 @@ void blob_reserve(Blob *pBlob, unsigned int newSize){
   }
 }
 
+/*
+** Ensure that at least nExtra more bytes, plus a nul terminator, can be
+** appended to pBlob without another reallocation.  Unlike blob_reserve(),
+** the buffer grows geometrically, so calling this before each of a long
+** series of appends is cheap.
+*/
+void blob_reserve_extra(Blob *pBlob, unsigned int nExtra){
+  i64 nNeed = (i64)pBlob->nUsed + nExtra + 1;
+  if( nNeed>pBlob->nAlloc ){
+    i64 nNew = blob_grow_size(pBlob->nAlloc, nNeed);
+    blob_assert_safe_size(nNew);
+    pBlob->xRealloc(pBlob, (unsigned)nNew);
+  }
+}
+
 /*
 ** Make sure a blob is nul-terminated and is not a pointer to unmanaged
 ** space.  Return a pointer to the data.
@@ -1306,6 +1373,52 @@ void blob_compress(Blob *pIn, Blob *pOut){
   blob_resize(pOut, nOut2+4);
 }
 
+/*
+** Like blob_compress() except that the zlib stream is primed with the
+** preset dictionary pDict.  The dictionary identifier, the Adler-32
+** checksum of pDict, is recorded in the stream header so that
+** blob_uncompress() can find the same dictionary again.
+*/
+void blob_compress_dict(Blob *pIn, Blob *pOut, Blob *pDict){
+  unsigned int nIn = blob_size(pIn);
+  unsigned int nOut;
+  unsigned char *outBuf;
+  z_stream stream;
+  Blob temp;
+  memset(&stream, 0, sizeof(stream));
+  deflateInit(&stream, Z_DEFAULT_COMPRESSION);
+  deflateSetDictionary(&stream, (unsigned char*)blob_buffer(pDict),
+                       blob_size(pDict));
+  nOut = deflateBound(&stream, nIn);
+  blob_zero(&temp);
+  blob_resize(&temp, nOut+4);
+  outBuf = (unsigned char*)blob_buffer(&temp);
+  outBuf[0] = nIn>>24 & 0xff;
+  outBuf[1] = nIn>>16 & 0xff;
+  outBuf[2] = nIn>>8 & 0xff;
+  outBuf[3] = nIn & 0xff;
+  stream.avail_out = nOut;
+  stream.next_out = &outBuf[4];
+  stream.avail_in = nIn;
+  stream.next_in = (unsigned char*)blob_buffer(pIn);
+  deflate(&stream, Z_FINISH);
+  blob_resize(&temp, stream.total_out + 4);
+  deflateEnd(&stream);
+  if( pOut==pIn ) blob_reset(pOut);
+  assert_blob_is_reset(pOut);
+  *pOut = temp;
+}
+
+/*
+** If the n bytes of z are the output of blob_compress_dict(), return the
+** identifier of the dictionary that was used.  Otherwise return 0.
+*/
+unsigned int blob_compressed_dictid(const char *z, int n){
+  const unsigned char *a = (const unsigned char*)z;
+  if( n<10 || (a[4]&0x0f)!=Z_DEFLATED || (a[5]&0x20)==0 ) return 0;
+  return (a[6]<<24) | (a[7]<<16) | (a[8]<<8) | a[9];
+}
+
 /*
 ** COMMAND: test-compress
 **
@@ -1383,6 +1496,44 @@ void compress2_cmd(void){
   blob_write_to_file(&f1, g.argv[4]);
 }
 
+/*
+** Inflate a zlib stream that was compressed with a preset dictionary.
+** The dictionary is found by cmprdict_find().  The interface is the
+** same as for uncompress() from zlib.
+*/
+static int blob_inflate_dict(
+  unsigned char *pOut,
+  unsigned long int *pnOut,
+  const unsigned char *pIn,
+  unsigned long int nIn
+){
+  z_stream stream;
+  Blob *pDict;
+  int rc;
+  memset(&stream, 0, sizeof(stream));
+  stream.next_in = (unsigned char*)pIn;
+  stream.avail_in = nIn;
+  stream.next_out = pOut;
+  stream.avail_out = *pnOut;
+  rc = inflateInit(&stream);
+  if( rc!=Z_OK ) return rc;
+  rc = inflate(&stream, Z_FINISH);
+  if( rc==Z_NEED_DICT ){
+    pDict = cmprdict_find(stream.adler);
+    if( pDict==0 ){
+      rc = Z_DATA_ERROR;
+    }else{
+      inflateSetDictionary(&stream, (unsigned char*)blob_buffer(pDict),
+                           blob_size(pDict));
+      rc = inflate(&stream, Z_FINISH);
+    }
+  }
+  *pnOut = stream.total_out;
+  inflateEnd(&stream);
+  if( rc==Z_STREAM_END ) return Z_OK;
+  return rc==Z_OK ? Z_BUF_ERROR : rc;
+}
+
 /*
 ** Uncompress blob pIn and store the result in pOut.  It is ok for pIn and
 ** pOut to be the same blob.
@@ -1404,8 +1555,13 @@ int blob_uncompress(Blob *pIn, Blob *pOut){
   blob_zero(&temp);
   blob_resize(&temp, nOut+1);
   nOut2 = (long int)nOut;
-  rc = uncompress((unsigned char*)blob_buffer(&temp), &nOut2,
-                  &inBuf[4], nIn - 4);
+  if( blob_compressed_dictid((const char*)inBuf, nIn)==0 ){
+    rc = uncompress((unsigned char*)blob_buffer(&temp), &nOut2,
+                    &inBuf[4], nIn - 4);
+  }else{
+    rc = blob_inflate_dict((unsigned char*)blob_buffer(&temp), &nOut2,
+                           &inBuf[4], nIn - 4);
+  }
   if( rc!=Z_OK ){
     blob_reset(&temp);
     return 1;
@@ -1457,6 +1613,100 @@ void test_cycle_compress(void){
   fossil_print("ok\n");
 }
 
+/*
+** Render a synthetic page of nRow table rows into the CGI reply buffer,
+** using the same mix of literal text and %h/%d substitutions as a
+** typical report page, plus one SQL statement assembled a clause at a
+** time.  Return the size of the page.
+*/
+static int blob_speed_page(int nRow){
+  Blob sql;
+  int i, n;
+  cgi_printf("<table class='sortable'>\n<thead><tr>"
+             "<th>Name</th><th>Size</th></tr></thead>\n");
+  for(i=0; i<nRow; i++){
+    cgi_printf("<tr><td><a href='/info/%d'>%h</a></td>"
+               "<td class='num'>%,d</td></tr>\n",
+               i, "file<name>.c", i*37);
+  }
+  cgi_printf("</table>\n");
+  blob_init(&sql, 0, 0);
+  blob_append_sql(&sql, "SELECT rid, uuid FROM blob WHERE rid IN (");
+  for(i=0; i<nRow; i++){
+    blob_append_sql(&sql, "%s%d", i ? "," : "", i);
+  }
+  blob_append_sql(&sql, ")");
+  blob_reset(&sql);
+  n = blob_size(cgi_output_blob());
+  cgi_reset_content();
+  return n;
+}
+
+/*
+** COMMAND: test-blob-speed
+**
+** Usage: %fossil test-blob-speed ?OPTIONS? ?ORIGIN TARGET?
+**
+** Time two workloads that stress Blob growth and report the CPU time
+** and the number of buffer allocations for each.  The first renders a
+** synthetic page through cgi_printf().  The second runs
+** blob_delta_create() on ORIGIN and TARGET, or on synthetic text if
+** no files are named.
+**
+** Options:
+**    --rounds N      Repeat each workload N times.  Default: 200
+**    --rows N        Table rows in each synthetic page.  Default: 1000
+*/
+void test_blob_speed(void){
+  const char *z;
+  int nRound = 200;
+  int nRow = 1000;
+  int i, iTimer, nStart;
+  Blob orig, target, delta;
+  sqlite3_uint64 nUs;
+  i64 nOut = 0;
+
+  if( (z = find_option("rounds",0,1))!=0 ) nRound = atoi(z);
+  if( (z = find_option("rows",0,1))!=0 ) nRow = atoi(z);
+  verify_all_options();
+  if( g.argc==4 ){
+    blob_read_from_file(&orig, g.argv[2], ExtFILE);
+    blob_read_from_file(&target, g.argv[3], ExtFILE);
+  }else if( g.argc==2 ){
+    blob_zero(&orig);
+    blob_zero(&target);
+    for(i=0; i<5000; i++){
+      blob_appendf(&orig, "line %d of the original text\n", i);
+      blob_appendf(&target, "line %d of the %s text\n",
+                   i, i%50==0 ? "edited" : "original");
+    }
+  }else{
+    usage("?OPTIONS? ?ORIGIN TARGET?");
+  }
+
+  iTimer = fossil_timer_start();
+  nStart = nBlobRealloc;
+  for(i=0; i<nRound; i++){
+    nOut += blob_speed_page(nRow);
+  }
+  nUs = fossil_timer_reset(iTimer);
+  fossil_print("page-render:  %d rounds, %lld bytes, %d allocations,"
+               " %.3f ms\n", nRound, nOut, nBlobRealloc-nStart, nUs/1000.0);
+
+  nOut = 0;
+  nStart = nBlobRealloc;
+  for(i=0; i<nRound; i++){
+    blob_delta_create(&orig, &target, &delta);
+    nOut += blob_size(&delta);
+    blob_reset(&delta);
+  }
+  nUs = fossil_timer_stop(iTimer);
+  fossil_print("delta-create: %d rounds, %lld bytes, %d allocations,"
+               " %.3f ms\n", nRound, nOut, nBlobRealloc-nStart, nUs/1000.0);
+  blob_reset(&orig);
+  blob_reset(&target);
+}
+
 /*
 ** Convert every \n character in the given blob into \r\n.
 */
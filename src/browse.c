@@ -118,6 +118,158 @@ void hyperlinked_path(
   }
 }
 
+/*
+** Return true if this process may add to the derived indexes used for
+** browsing: the repository must be writable and the request must not be
+** limited to reading.
+*/
+static int browse_index_writable(void){
+  return !db_is_protected(PROTECT_READONLY) && db_is_writeable("repository");
+}
+
+/*
+** Begin the transaction used to add to a browsing index.  Ask for the
+** write lock up front unless some caller already holds a transaction.
+*/
+static void browse_index_begin(void){
+  if( db_transaction_nesting_depth()==0 ){
+    db_begin_write();
+  }else{
+    db_begin_transaction();
+  }
+}
+
+/*
+** SETTING: max-dir-index    width=10 default=20
+**
+** The /dir page keeps the directory hierarchy of this many of the most
+** recently browsed check-ins, so that moving between directories of the
+** same check-in does not need to parse its manifest again.
+*/
+
+/*
+** Mark check-in mid of the directory index as just used, so that it is
+** among the last to be forgotten.  Do nothing if the repository cannot
+** be written.
+*/
+void dirindex_touch(int mid){
+  if( browse_index_writable() ){
+    db_multi_exec(
+      "UPDATE dirindex SET atime=julianday('now') WHERE mid=%d", mid
+    );
+  }
+}
+
+/*
+** Make sure the directory index holds check-in rid.  Return true if it
+** does, or false if rid is not a check-in or the repository is read-only,
+** in which case the caller must work from the manifest.
+*/
+int dirindex_build(int rid){
+  Manifest *pM;
+  ManifestFile *pFile;
+  Stmt ins, sz;
+  int mx;
+
+  if( db_table_exists("repository","dirent")
+   && db_exists("SELECT 1 FROM dirindex WHERE mid=%d", rid)
+  ){
+    dirindex_touch(rid);
+    return 1;
+  }
+  if( !browse_index_writable() ) return 0;
+  pM = manifest_get(rid, CFTYPE_MANIFEST, 0);
+  if( pM==0 ) return 0;
+  browse_index_begin();
+  schema_dirindex();
+  db_prepare(&ins,
+    "INSERT INTO dirent(mid,dname,ename,fid,nfile,sz)"
+    " VALUES(%d,:dname,:ename,:fid,1,:sz)"
+    " ON CONFLICT DO UPDATE SET nfile=nfile+1, sz=sz+excluded.sz", rid
+  );
+  db_prepare(&sz, "SELECT rid, max(size,0) FROM blob WHERE uuid=:uuid");
+  manifest_file_rewind(pM);
+  while( (pFile = manifest_file_next(pM,0))!=0 ){
+    const char *zName = pFile->zName;
+    int fid = 0;
+    i64 nByte = 0;
+    int i, iStart;
+    db_bind_text(&sz, ":uuid", pFile->zUuid);
+    if( db_step(&sz)==SQLITE_ROW ){
+      fid = db_column_int(&sz, 0);
+      nByte = db_column_int64(&sz, 1);
+    }
+    db_reset(&sz);
+    /* One entry for each directory on the path, then one for the file */
+    for(i=iStart=0; zName[i]; iStart=i+1){
+      int isDir;
+      for(i=iStart; zName[i] && zName[i]!='/'; i++){}
+      isDir = zName[i]=='/';
+      sqlite3_bind_text(ins.pStmt, 1, zName, iStart>0 ? iStart-1 : 0,
+                        SQLITE_STATIC);
+      sqlite3_bind_text(ins.pStmt, 2, &zName[iStart], i-iStart,
+                        SQLITE_STATIC);
+      db_bind_int(&ins, ":fid", isDir ? 0 : fid);
+      db_bind_int64(&ins, ":sz", nByte);
+      db_step(&ins);
+      db_reset(&ins);
+      if( !isDir ) break;
+    }
+  }
+  db_finalize(&sz);
+  db_finalize(&ins);
+  manifest_destroy(pM);
+  db_multi_exec(
+    "INSERT INTO dirindex(mid,atime) VALUES(%d,julianday('now'))", rid
+  );
+
+  /* Forget the least recently used check-ins */
+  mx = db_get_int("max-dir-index", 20);
+  if( mx<1 ) mx = 1;
+  db_multi_exec(
+    "CREATE TEMP TABLE IF NOT EXISTS dirindex_old(mid INTEGER PRIMARY KEY);"
+    "DELETE FROM dirindex_old;"
+    "INSERT INTO dirindex_old"
+    "  SELECT mid FROM dirindex ORDER BY atime DESC LIMIT -1 OFFSET %d;"
+    "DELETE FROM dirent WHERE mid IN dirindex_old;"
+    "DELETE FROM dirindex WHERE mid IN dirindex_old;",
+    mx
+  );
+  db_end_transaction(0);
+  return 1;
+}
+
+/*
+** Return the RID of the file named zName in check-in vid, as recorded
+** in the directory index.  Return 0 if there is no such file, or -1 if
+** vid is not in the index.  This only reads the database.
+*/
+int dirindex_lookup(int vid, const char *zName){
+  const char *zTail;
+  char *zDir;
+  int rid;
+  if( !db_table_exists("repository","dirent")
+   || !db_exists("SELECT 1 FROM dirindex WHERE mid=%d", vid)
+  ){
+    return -1;
+  }
+  zTail = strrchr(zName, '/');
+  if( zTail ){
+    zDir = mprintf("%.*s", (int)(zTail-zName), zName);
+    zTail++;
+  }else{
+    zDir = fossil_strdup("");
+    zTail = zName;
+  }
+  rid = db_int(0,
+    "SELECT fid FROM dirent"
+    " WHERE mid=%d AND dname=%Q AND ename=%Q AND fid>0",
+    vid, zDir, zTail
+  );
+  fossil_free(zDir);
+  return rid;
+}
+
 /*
 ** WEBPAGE: docdir
 **
@@ -182,6 +334,7 @@ void page_dir(void){
   const char *zRegexp;    /* The re= query parameter */
   char *zMatch;           /* Extra title text describing the match */
   int bDocDir = PB("dx") || strncmp(g.zPath, "docdir", 6)==0;
+  int bDirIndex = 0;      /* True if the directory index holds ci= */
 
   if( zCI && strlen(zCI)==0 ){ zCI = 0; }
   if( strcmp(PD("type","flat"),"tree")==0 ){ page_tree(); return; }
@@ -198,8 +351,10 @@ void page_dir(void){
   */
   if( bDocDir && zCI==0 ) zCI = "trunk";
   if( zCI ){
-    pM = manifest_get_by_name(zCI, &rid);
-    if( pM ){
+    rid = name_to_typed_rid(zCI, "ci");
+    bDirIndex = dirindex_build(rid);
+    if( !bDirIndex ) pM = manifest_get_by_name(zCI, &rid);
+    if( bDirIndex || pM ){
       int trunkRid = symbolic_name_to_rid("tag:trunk", "ci");
       linkTrunk = trunkRid && rid != trunkRid;
       linkTip = rid != symbolic_name_to_rid("tip", "ci");
@@ -309,13 +464,23 @@ void page_dir(void){
   ** from directories in the loop that follows.
   */
   db_multi_exec(
-     "CREATE TEMP TABLE localfiles(x UNIQUE NOT NULL, u);"
+     "CREATE TEMP TABLE localfiles(x UNIQUE NOT NULL, u, n, sz);"
   );
-  if( zCI ){
+  if( bDirIndex ){
+    /* Entries of the zD directory of check-in zCI, from the index */
+    db_multi_exec(
+      "INSERT OR IGNORE INTO localfiles(x,u,n,sz)"
+      " SELECT iif(fid=0,'/'||ename,ename),"
+      "        (SELECT uuid FROM blob WHERE rid=fid), nfile, sz"
+      "   FROM dirent"
+      "  WHERE mid=%d AND dname=%Q",
+      rid, zD ? zD : ""
+    );
+  }else if( zCI ){
     /* Files in the specific checked given by zCI */
     if( zD ){
       db_multi_exec(
-        "INSERT OR IGNORE INTO localfiles"
+        "INSERT OR IGNORE INTO localfiles(x,u)"
         " SELECT pathelement(filename,%d), uuid"
         "   FROM files_of_checkin(%Q)"
         "  WHERE filename GLOB '%q/*'",
@@ -323,7 +488,7 @@ void page_dir(void){
       );
     }else{
       db_multi_exec(
-        "INSERT OR IGNORE INTO localfiles"
+        "INSERT OR IGNORE INTO localfiles(x,u)"
         " SELECT pathelement(filename,%d), uuid"
         "   FROM files_of_checkin(%Q)",
         nD, zCI
@@ -333,14 +498,14 @@ void page_dir(void){
     /* All files across all check-ins */
     if( zD ){
       db_multi_exec(
-        "INSERT OR IGNORE INTO localfiles"
+        "INSERT OR IGNORE INTO localfiles(x,u)"
         " SELECT pathelement(name,%d), NULL FROM filename"
         "  WHERE name GLOB '%q/*'",
         nD, zD
       );
     }else{
       db_multi_exec(
-        "INSERT OR IGNORE INTO localfiles"
+        "INSERT OR IGNORE INTO localfiles(x,u)"
         " SELECT pathelement(name,0), NULL FROM filename"
       );
     }
@@ -361,7 +526,8 @@ void page_dir(void){
   if( mxLen<12 ) mxLen = 12;
   mxLen += (mxLen+9)/10;
   db_prepare(&q,
-     "SELECT x, u FROM localfiles ORDER BY x COLLATE uintnocase /*scan*/");
+     "SELECT x, u, n, sz FROM localfiles"
+     " ORDER BY x COLLATE uintnocase /*scan*/");
   @ <div class="columns files" style="columns: %d(mxLen)ex auto">
   @ <ul class="browser">
   while( db_step(&q)==SQLITE_ROW ){
@@ -369,7 +535,14 @@ void page_dir(void){
     zFN = db_column_text(&q, 0);
     if( zFN[0]=='/' ){
       zFN++;
-      @ <li class="dir">%z(href("%s%T",zSubdirLink,zFN))%h(zFN)</a></li>
+      if( db_column_type(&q, 2)!=SQLITE_NULL ){
+        int nFile = db_column_int(&q, 2);
+        @ <li class="dir" title="%d(nFile) file%s(nFile==1?"":"s"), \
+        @ %,lld(db_column_int64(&q,3)) bytes">\
+        @ %z(href("%s%T",zSubdirLink,zFN))%h(zFN)</a></li>
+      }else{
+        @ <li class="dir">%z(href("%s%T",zSubdirLink,zFN))%h(zFN)</a></li>
+      }
     }else{
       const char *zLink;
       if( bDocDir ){
@@ -702,7 +875,6 @@ void page_tree(void){
   int rid = 0;
   char *zUuid = 0;
   Blob dirname;
-  Manifest *pM = 0;
   double rNow = 0;
   char *zNow = 0;
   int useMtime = atoi(PD("mtime","0"));
@@ -757,13 +929,14 @@ void page_tree(void){
   /* If the name= parameter is an empty string, make it a NULL pointer */
   if( zD && strlen(zD)==0 ){ zD = 0; }
 
-  /* If a specific check-in is requested, fetch and parse it.  If the
+  /* If a specific check-in is requested, look it up.  The manifest is
+  ** not needed since the files come from the file-age index.  If the
   ** specific check-in does not exist, clear zCI.  zCI==0 will cause all
   ** files from all check-ins to be displayed.
   */
   if( zCI ){
-    pM = manifest_get_by_name(zCI, &rid);
-    if( pM ){
+    rid = name_to_typed_rid(zCI, "ci");
+    if( is_a_version(rid) ){
       int trunkRid = symbolic_name_to_rid("tag:trunk", "ci");
       linkTrunk = trunkRid && rid != trunkRid;
       linkTip = rid != symbolic_name_to_rid("tip", "ci");
@@ -839,7 +1012,9 @@ void page_tree(void){
   */
   if( zCI ){
     Stmt q;
-    compute_fileage(rid, 0);
+    char *zGlob = zD ? mprintf("%s/*", zD) : 0;
+    compute_fileage(rid, zGlob);
+    fossil_free(zGlob);
     db_prepare(&q,
        "SELECT filename.name, blob.uuid, blob.size, fileage.mtime\n"
        "  FROM fileage, filename, blob\n"
@@ -1059,21 +1234,282 @@ static const char zComputeFileAgeRun[] =
 @  ORDER BY event.mtime ASC;
 ;
 
+/*
+** A check-in that is FILEAGE_SPAN steps from the nearest full list of
+** files in the file-age index gets a full list of its own.
+*/
+#define FILEAGE_SPAN 64
+
+/*
+** Common table expression that walks from check-in :ckin back to the
+** nearest full list of files in the file-age index.  chain.n is the
+** number of steps taken.
+*/
+static const char zFileAgeChain[] =
+@ WITH RECURSIVE chain(x,n) AS (
+@   VALUES(:ckin,0)
+@   UNION ALL
+@   SELECT base, n+1 FROM chain, ckinagebase
+@    WHERE ckinagebase.mid=chain.x AND base>0
+@ )
+;
+
+/*
+** Return true if rid is a check-in that has been crosslinked.
+*/
+static int fileage_is_checkin(int rid){
+  static Stmt q;
+  int rc;
+  db_static_prepare(&q,
+    "SELECT 1 FROM event WHERE objid=:rid AND type='ci'"
+  );
+  db_bind_int(&q, ":rid", rid);
+  rc = db_step(&q);
+  db_reset(&q);
+  return rc==SQLITE_ROW;
+}
+
+/*
+** Look up the file named fnid in check-in mid using the file-age index.
+** Return the file content id, or 0 if the file does not exist in mid or
+** mid is not indexed.  Write the check-in where the file last changed
+** into *pAmid.
+*/
+static int fileage_lookup(int mid, int fnid, int *pAmid){
+  Stmt q;
+  int fid = 0;
+  db_prepare(&q,
+    "%s SELECT fid, amid FROM chain, ckinage"
+    " WHERE ckinage.mid=chain.x AND ckinage.fnid=:fnid"
+    " ORDER BY n LIMIT 1", zFileAgeChain/*safe-for-%s*/
+  );
+  db_bind_int(&q, ":ckin", mid);
+  db_bind_int(&q, ":fnid", fnid);
+  if( db_step(&q)==SQLITE_ROW ){
+    fid = db_column_int(&q, 0);
+    *pAmid = db_column_int(&q, 1);
+  }
+  db_finalize(&q);
+  return fid;
+}
+
+/*
+** File fnid changed from fpid to fid between primary parent pid and
+** check-in mid.  Work out the check-in in which content fid was last
+** changed.
+*/
+static int fileage_origin(
+  int mid,              /* The check-in */
+  int pid,              /* Its primary parent */
+  int fnid,             /* Name of the file in mid */
+  int fid,              /* Content of the file in mid */
+  int fpid,             /* Content of the file in pid */
+  int pfnid             /* Name of the file in pid, if renamed */
+){
+  Stmt q;
+  int amid;
+
+  /* Content brought in by a merge keeps the age it had on the other side */
+  db_prepare(&q, "SELECT pid FROM plink WHERE cid=%d AND NOT isprim", mid);
+  while( db_step(&q)==SQLITE_ROW ){
+    if( fileage_lookup(db_column_int(&q,0), fnid, &amid)==fid ){
+      db_finalize(&q);
+      return amid;
+    }
+  }
+  db_finalize(&q);
+
+  /* A rename or a change of permissions does not change the content */
+  if( fpid==fid && fileage_lookup(pid, pfnid ? pfnid : fnid, &amid)==fid ){
+    return amid;
+  }
+  return mid;
+}
+
+/*
+** Add check-in mid to the file-age index, after first adding any of its
+** parents that are missing.
+*/
+static void fileage_index_one(int mid){
+  Stmt q;
+  int pid = 0;
+  int depth = 0;
+  int isFull;
+
+  if( db_exists("SELECT 1 FROM ckinagebase WHERE mid=%d", mid) ) return;
+  db_prepare(&q, "SELECT pid, isprim FROM plink WHERE cid=%d", mid);
+  while( db_step(&q)==SQLITE_ROW ){
+    int p = db_column_int(&q, 0);
+    if( !fileage_is_checkin(p) ) continue;
+    fileage_index_one(p);
+    if( db_column_int(&q, 1) ) pid = p;
+  }
+  db_finalize(&q);
+  if( pid ){
+    depth = db_int(0, "SELECT depth FROM ckinagebase WHERE mid=%d", pid)+1;
+  }
+  isFull = pid==0 || depth>=FILEAGE_SPAN;
+
+  if( pid==0 ){
+    /* No parent to inherit from.  Every file is as old as mid. */
+    db_multi_exec(
+      "CREATE VIRTUAL TABLE IF NOT EXISTS temp.foci USING files_of_checkin;"
+      "INSERT OR IGNORE INTO filename(name)"
+      "  SELECT filename FROM foci WHERE checkinID=%d;"
+      "INSERT OR IGNORE INTO ckinage(mid,fnid,fid,amid)"
+      "  SELECT %d, filename.fnid, blob.rid, %d"
+      "    FROM foci, filename, blob"
+      "   WHERE foci.checkinID=%d"
+      "     AND filename.name=foci.filename"
+      "     AND blob.uuid=foci.uuid;",
+      mid, mid, mid, mid
+    );
+  }else{
+    /* Record the files that differ from the primary parent */
+    Stmt ins;
+    db_prepare(&ins,
+      "REPLACE INTO ckinage(mid,fnid,fid,amid)"
+      " VALUES(%d,:fnid,:fid,:amid)", mid
+    );
+    db_prepare(&q,
+      "SELECT fnid, fid, pid, pfnid FROM mlink"
+      " WHERE mid=%d AND pmid=%d AND NOT isaux", mid, pid
+    );
+    while( db_step(&q)==SQLITE_ROW ){
+      int fnid = db_column_int(&q, 0);
+      int fid = db_column_int(&q, 1);
+      int amid = 0;
+      if( fid>0 ){
+        amid = fileage_origin(mid, pid, fnid, fid,
+                              db_column_int(&q, 2), db_column_int(&q, 3));
+      }
+      db_bind_int(&ins, ":fnid", fnid);
+      db_bind_int(&ins, ":fid", fid);
+      db_bind_int(&ins, ":amid", amid);
+      db_step(&ins);
+      db_reset(&ins);
+    }
+    db_finalize(&q);
+    db_finalize(&ins);
+    if( isFull ){
+      /* Fold in everything inherited from the parent */
+      db_prepare(&q,
+        "%s INSERT OR IGNORE INTO ckinage(mid,fnid,fid,amid)"
+        "  SELECT %d, fnid, fid, amid FROM chain, ckinage"
+        "   WHERE ckinage.mid=chain.x"
+        "   ORDER BY n", zFileAgeChain/*safe-for-%s*/, mid
+      );
+      db_bind_int(&q, ":ckin", pid);
+      db_exec(&q);
+      db_finalize(&q);
+      db_multi_exec("DELETE FROM ckinage WHERE mid=%d AND fid=0", mid);
+    }
+  }
+  db_multi_exec(
+    "INSERT INTO ckinagebase(mid,base,depth) VALUES(%d,%d,%d)",
+    mid, isFull ? 0 : pid, isFull ? 0 : depth
+  );
+}
+
+/*
+** Make sure the file-age index covers check-in vid, building the index
+** as far back as necessary.  Return true if vid is covered, or false if
+** the index cannot be used, either because vid is not a check-in or
+** because the repository is read-only.
+*/
+int fileage_index_checkin(int vid){
+  Stmt q;
+  if( !fileage_is_checkin(vid) ) return 0;
+  if( db_table_exists("repository","ckinage") ){
+    if( db_exists("SELECT 1 FROM ckinagebase WHERE mid=%d", vid) ) return 1;
+  }
+  if( !browse_index_writable() ) return 0;
+  browse_index_begin();
+  schema_fileage();
+  /* Add the missing ancestors oldest first, so that the recursion in
+  ** fileage_index_one() stays shallow */
+  db_prepare(&q,
+    "WITH RECURSIVE anc(x) AS ("
+    "  VALUES(%d)"
+    "  UNION"
+    "  SELECT plink.pid FROM anc, plink"
+    "   WHERE plink.cid=anc.x"
+    "     AND plink.pid NOT IN (SELECT mid FROM ckinagebase)"
+    ")"
+    "SELECT x FROM anc, event"
+    " WHERE event.objid=anc.x AND event.type='ci'"
+    " ORDER BY event.mtime", vid
+  );
+  while( db_step(&q)==SQLITE_ROW ){
+    fileage_index_one(db_column_int(&q, 0));
+  }
+  db_finalize(&q);
+  db_end_transaction(0);
+  return 1;
+}
+
+/*
+** Forget the whole file-age index.  It is rebuilt on demand.
+*/
+void fileage_index_reset(void){
+  if( db_table_exists("repository","ckinage") ){
+    db_multi_exec("DELETE FROM ckinage; DELETE FROM ckinagebase;");
+  }
+}
+
+/*
+** Check-in rid has just been crosslinked.  If the file-age index is in
+** use and already covers every parent of rid, add rid to it as well.
+*/
+void fileage_crosslink(int rid){
+  if( !db_table_exists("repository","ckinage") ) return;
+  if( db_exists("SELECT 1 FROM plink, ckinagebase"
+                " WHERE plink.pid=%d AND ckinagebase.mid=plink.cid", rid) ){
+    /* Descendants of rid were indexed before rid arrived, so their
+    ** entries did not take rid into account */
+    fileage_index_reset();
+    return;
+  }
+  if( db_exists("SELECT 1 FROM plink WHERE cid=%d"
+                "   AND pid NOT IN (SELECT mid FROM ckinagebase)", rid) ){
+    return;
+  }
+  fileage_index_one(rid);
+}
+
 /*
 ** Look at all file containing in the version "vid".  Construct a
 ** temporary table named "fileage" that contains the file-id for each
-** files, the pathname, the check-in where the file was added, and the
-** mtime on that check-in. If zGlob and *zGlob then only files matching
+** files, the pathname, the check-in where the file was last changed, and
+** the mtime on that check-in. If zGlob and *zGlob then only files matching
 ** the given glob are computed.
+**
+** The answer normally comes from the file-age index.  The ancestry of
+** vid is only walked when the index cannot be used.
 */
 int compute_fileage(int vid, const char* zGlob){
   Stmt q;
   db_exec_sql(zComputeFileAgeSetup);
-  db_prepare(&q, zComputeFileAgeRun  /*works-like:"constant"*/);
+  if( fileage_index_checkin(vid) ){
+    db_prepare(&q,
+      "%s INSERT OR IGNORE INTO fileage(fnid, fid, mid, mtime, pathname)"
+      "  SELECT ckinage.fnid, ckinage.fid, ckinage.amid, event.mtime,"
+      "         filename.name"
+      "    FROM chain, ckinage, filename"
+      "         LEFT JOIN event ON event.objid=ckinage.amid"
+      "   WHERE ckinage.mid=chain.x"
+      "     AND filename.fnid=ckinage.fnid"
+      "     AND filename.name GLOB :glob"
+      "   ORDER BY chain.n", zFileAgeChain/*safe-for-%s*/
+    );
+  }else{
+    db_prepare(&q, zComputeFileAgeRun  /*works-like:"constant"*/);
+  }
   db_bind_int(&q, ":ckin", vid);
   db_bind_text(&q, ":glob", zGlob && zGlob[0] ? zGlob : "*");
   db_exec(&q);
   db_finalize(&q);
+  db_multi_exec("DELETE FROM fileage WHERE fid=0");
   return 0;
 }
 
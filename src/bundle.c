@@ -333,10 +333,30 @@ static void bundle_export_cmd(void){
     "   (SELECT summary FROM description WHERE rid=blob.rid)"
     " FROM tobundle, blob, delta"
     " WHERE blob.rid=tobundle.rid"
+    "   AND blob.content IS NOT NULL"
     "   AND delta.rid=tobundle.rid"
     "   AND delta.srcid IN tobundle;"
   );
 
+  /* Content compressed with the preset dictionary of this repository
+  ** cannot be read anywhere else */
+  db_prepare(&q, "SELECT blobid, data FROM bblob");
+  while( db_step(&q)==SQLITE_ROW ){
+    Blob x;
+    db_column_blob(&q, 1, &x);
+    if( blob_compressed_dictid(blob_buffer(&x), blob_size(&x)) ){
+      Stmt upd;
+      cmprdict_make_portable(&x);
+      db_prepare(&upd, "UPDATE bblob SET data=:data WHERE blobid=%d",
+                 db_column_int(&q, 0));
+      db_bind_blob(&upd, ":data", &x);
+      db_exec(&upd);
+      db_finalize(&upd);
+    }
+    blob_reset(&x);
+  }
+  db_finalize(&q);
+
   /* For all the remaining artifacts, we need to construct their deltas
   ** manually.
   */
@@ -775,6 +775,66 @@ static struct QParam {   /* One entry for each query parameter or cookie */
   char cTag;                /* Tag on query parameters */
   char isFetched;           /* 1 if the var is requested via P/PD() */
 } *aParamQP;             /* An array of all parameters and cookies */
+static int *aHashQP = 0; /* Hash of names to aParamQP[] indexes, or -1 */
+static int nHashQP = 0;  /* Number of slots in aHashQP[].  A power of 2 */
+
+/*
+** Hash a parameter name.
+*/
+static unsigned int qparam_hash(const char *z){
+  unsigned int h = 0;
+  if( z ){
+    while( *z ){ h = (h<<3) ^ h ^ (unsigned char)*(z++); }
+  }
+  return h;
+}
+
+/*
+** Return the index in aParamQP[] of the parameter named zName, or -1
+** if there is no such parameter.  When the same name has been added
+** more than once, the first one added is returned.
+*/
+static int qparam_find(const char *zName){
+  unsigned int h;
+  int i;
+  if( nHashQP==0 ) return -1;
+  h = qparam_hash(zName) & (nHashQP-1);
+  while( (i = aHashQP[h])>=0 ){
+    if( fossil_strcmp(aParamQP[i].zName, zName)==0 ) return i;
+    h = (h+1) & (nHashQP-1);
+  }
+  return -1;
+}
+
+/*
+** Add aParamQP[iQP] to the hash table, unless a parameter of the
+** same name is already there.
+*/
+static void qparam_hash_insert(int iQP){
+  unsigned int h = qparam_hash(aParamQP[iQP].zName) & (nHashQP-1);
+  int i;
+  while( (i = aHashQP[h])>=0 ){
+    if( fossil_strcmp(aParamQP[i].zName, aParamQP[iQP].zName)==0 ) return;
+    h = (h+1) & (nHashQP-1);
+  }
+  aHashQP[h] = iQP;
+}
+
+/*
+** Rebuild the hash table from scratch.  This is needed whenever the
+** entries of aParamQP[] move, and whenever the table becomes more
+** than half full.
+*/
+static void qparam_rehash(void){
+  int i;
+  if( nHashQP<nUsedQP*2 || nHashQP==0 ){
+    if( nHashQP==0 ) nHashQP = 64;
+    while( nHashQP<nUsedQP*2 ) nHashQP *= 2;
+    aHashQP = fossil_realloc(aHashQP, nHashQP*sizeof(aHashQP[0]));
+  }
+  for(i=0; i<nHashQP; i++) aHashQP[i] = -1;
+  for(i=0; i<nUsedQP; i++) qparam_hash_insert(i);
+}
 
 /*
 ** Add another query parameter or cookie to the parameter set.
@@ -804,6 +864,11 @@ void cgi_set_parameter_nocopy(const char *zName, const char *zValue, int isQP){
   aParamQP[nUsedQP].isFetched = 0;
   nUsedQP++;
   sortQP = 1;
+  if( nUsedQP*2>nHashQP ){
+    qparam_rehash();
+  }else{
+    qparam_hash_insert(nUsedQP-1);
+  }
 }
 
 /*
@@ -832,36 +897,35 @@ void cgi_set_parameter_nocopy_tolower(
 ** zName is the name of the query parameter or cookie and zValue
 ** is its fully decoded value.
 **
-** Copies are made of both the zName and zValue parameters.
+** Copies are made of both the zName and zValue parameters.  The copies
+** live in the request arena.
 */
 void cgi_set_parameter(const char *zName, const char *zValue){
-  cgi_set_parameter_nocopy(fossil_strdup(zName),fossil_strdup(zValue), 0);
+  cgi_set_parameter_nocopy(fossil_arena_strdup(zName),
+                           fossil_arena_strdup(zValue), 0);
 }
 void cgi_set_query_parameter(const char *zName, const char *zValue){
-  cgi_set_parameter_nocopy(fossil_strdup(zName),fossil_strdup(zValue), 1);
+  cgi_set_parameter_nocopy(fossil_arena_strdup(zName),
+                           fossil_arena_strdup(zValue), 1);
 }
 
 /*
 ** Replace a parameter with a new value.
 */
 void cgi_replace_parameter(const char *zName, const char *zValue){
-  int i;
-  for(i=0; i<nUsedQP; i++){
-    if( fossil_strcmp(aParamQP[i].zName,zName)==0 ){
-      aParamQP[i].zValue = zValue;
-      return;
-    }
+  int i = qparam_find(zName);
+  if( i>=0 ){
+    aParamQP[i].zValue = zValue;
+    return;
   }
   cgi_set_parameter_nocopy(zName, zValue, 0);
 }
 void cgi_replace_query_parameter(const char *zName, const char *zValue){
-  int i;
-  for(i=0; i<nUsedQP; i++){
-    if( fossil_strcmp(aParamQP[i].zName,zName)==0 ){
-      aParamQP[i].zValue = zValue;
-      assert( aParamQP[i].isQP );
-      return;
-    }
+  int i = qparam_find(zName);
+  if( i>=0 ){
+    aParamQP[i].zValue = zValue;
+    assert( aParamQP[i].isQP );
+    return;
   }
   cgi_set_parameter_nocopy(zName, zValue, 1);
 }
@@ -872,32 +936,48 @@ void cgi_replace_query_parameter_tolower(char *zName, const char *zValue){
 }
 
 /*
-** Delete a parameter.
+** Delete a parameter.  Every copy of the parameter is removed, so that
+** a name supplied more than once in the request cannot reappear after
+** the first copy is gone.
 */
-void cgi_delete_parameter(const char *zName){
-  int i;
-  for(i=0; i<nUsedQP; i++){
-    if( fossil_strcmp(aParamQP[i].zName,zName)==0 ){
-      --nUsedQP;
-      if( i<nUsedQP ){
-        memmove(aParamQP+i, aParamQP+i+1, sizeof(*aParamQP)*(nUsedQP-i));
-      }
-      return;
+static void qparam_delete(const char *zName, int isQP){
+  int i, j;
+  if( qparam_find(zName)<0 ) return;
+  for(i=j=0; i<nUsedQP; i++){
+    if( fossil_strcmp(aParamQP[i].zName, zName)==0 ){
+      assert( !isQP || aParamQP[i].isQP );
+      continue;
     }
+    if( i>j ) aParamQP[j] = aParamQP[i];
+    j++;
   }
+  nUsedQP = j;
+  qparam_rehash();
+}
+void cgi_delete_parameter(const char *zName){
+  qparam_delete(zName, 0);
 }
 void cgi_delete_query_parameter(const char *zName){
+  qparam_delete(zName, 1);
+}
+
+/*
+** Forget every query parameter, cookie and CGI environment value, and
+** release the request arena that holds them together with the TH1
+** interpreter.  Call this only after the reply to the current request
+** has been sent, when nothing else refers to that memory.
+*/
+void cgi_end_request(void){
   int i;
-  for(i=0; i<nUsedQP; i++){
-    if( fossil_strcmp(aParamQP[i].zName,zName)==0 ){
-      assert( aParamQP[i].isQP );
-      --nUsedQP;
-      if( i<nUsedQP ){
-        memmove(aParamQP+i, aParamQP+i+1, sizeof(*aParamQP)*(nUsedQP-i));
-      }
-      return;
-    }
+  nUsedQP = 0;
+  sortQP = 0;
+  for(i=0; i<nHashQP; i++) aHashQP[i] = -1;
+  g.zContentType = 0;
+  if( g.interp ){
+    Th_DeleteInterp(g.interp);
+    g.interp = 0;
   }
+  fossil_arena_reset();
 }
 
 /*
@@ -905,7 +985,7 @@ void cgi_delete_query_parameter(const char *zName){
 ** portion is fixed but a copy is be made of zValue.
 */
 void cgi_setenv(const char *zName, const char *zValue){
-  cgi_set_parameter_nocopy(zName, fossil_strdup(zValue), 0);
+  cgi_set_parameter_nocopy(zName, fossil_arena_strdup(zValue), 0);
 }
 
 /*
@@ -1113,14 +1193,16 @@ static void process_multipart_form_data(char *z, int len){
         if( fossil_islower(zName[0]) ){
           cgi_set_parameter_nocopy(zName, zValue, 1);
           if( showBytes ){
-            cgi_set_parameter_nocopy(mprintf("%s:bytes", zName),
-                 mprintf("%d",nContent), 1);
+            cgi_set_parameter_nocopy(
+                 fossil_arena_mprintf("%s:bytes", zName),
+                 fossil_arena_mprintf("%d",nContent), 1);
           }
         }else if( fossil_isupper(zName[0]) ){
           cgi_set_parameter_nocopy_tolower(zName, zValue, 1);
           if( showBytes ){
-            cgi_set_parameter_nocopy_tolower(mprintf("%s:bytes", zName),
-                 mprintf("%d",nContent), 1);
+            cgi_set_parameter_nocopy_tolower(
+                 fossil_arena_mprintf("%s:bytes", zName),
+                 fossil_arena_mprintf("%d",nContent), 1);
           }
         }
       }
@@ -1139,10 +1221,11 @@ static void process_multipart_form_data(char *z, int len){
           char *z = azArg[++i];
           if( zName && z ){
             if( fossil_islower(zName[0]) ){
-              cgi_set_parameter_nocopy(mprintf("%s:filename",zName), z, 1);
+              cgi_set_parameter_nocopy(
+                   fossil_arena_mprintf("%s:filename",zName), z, 1);
             }else if( fossil_isupper(zName[0]) ){
-              cgi_set_parameter_nocopy_tolower(mprintf("%s:filename",zName),
-                                               z, 1);
+              cgi_set_parameter_nocopy_tolower(
+                   fossil_arena_mprintf("%s:filename",zName), z, 1);
             }
           }
           showBytes = 1;
@@ -1150,10 +1233,11 @@ static void process_multipart_form_data(char *z, int len){
           char *z = azArg[++i];
           if( zName && z ){
             if( fossil_islower(zName[0]) ){
-              cgi_set_parameter_nocopy(mprintf("%s:mimetype",zName), z, 1);
+              cgi_set_parameter_nocopy(
+                   fossil_arena_mprintf("%s:mimetype",zName), z, 1);
             }else if( fossil_isupper(zName[0]) ){
-              cgi_set_parameter_nocopy_tolower(mprintf("%s:mimetype",zName),
-                                               z, 1);
+              cgi_set_parameter_nocopy_tolower(
+                   fossil_arena_mprintf("%s:mimetype",zName), z, 1);
             }
           }
         }
@@ -1254,7 +1338,7 @@ int cgi_setup_query_string(void){
   char * z = (char*)P("QUERY_STRING");
   if( z ){
     ++rc;
-    z = fossil_strdup(z);
+    z = fossil_arena_strdup(z);
     add_param_list(z, '&');
     z = (char*)P("skin");
     if( z ){
@@ -1406,7 +1490,7 @@ void cgi_init(void){
 #endif
   z = (char*)P("HTTP_COOKIE");
   if( z ){
-    z = fossil_strdup(z);
+    z = fossil_arena_strdup(z);
     add_param_list(z, ';');
     z = (char*)cookie_value("skin",0);
     if(z){
@@ -1493,6 +1577,36 @@ static int qparam_compare(const void *a, const void *b){
   return c;
 }
 
+/*
+** Put aParamQP[] in order by name and remove duplicates.  Lookups go
+** through the hash table and do not need this, but routines that walk
+** the whole parameter list present it in sorted order.
+*/
+static void cgi_sort_parameters(void){
+  int i, j;
+  /* The sortQP flag is set whenever a new query parameter is inserted.
+  ** It indicates that we need to resort the query parameters.
+  */
+  if( !sortQP ) return;
+  qsort(aParamQP, nUsedQP, sizeof(aParamQP[0]), qparam_compare);
+  sortQP = 0;
+  /* After sorting, remove duplicate parameters.  The secondary sort
+  ** key is aParamQP[].seq and we keep the first entry.  That means
+  ** with duplicate calls to cgi_set_parameter() the second and
+  ** subsequent calls are effectively no-ops. */
+  for(i=j=1; i<nUsedQP; i++){
+    if( fossil_strcmp(aParamQP[i].zName,aParamQP[i-1].zName)==0 ){
+      continue;
+    }
+    if( j<i ){
+      memcpy(&aParamQP[j], &aParamQP[i], sizeof(aParamQP[j]));
+    }
+    j++;
+  }
+  if( nUsedQP>0 ) nUsedQP = j;
+  qparam_rehash();
+}
+
 /*
 ** Return the value of a query parameter or cookie whose name is zName.
 ** If there is no query parameter or cookie named zName and the first
@@ -1501,50 +1615,21 @@ static int qparam_compare(const void *a, const void *b){
 ** a last resort when nothing else matches, return zDefault.
 */
 const char *cgi_parameter(const char *zName, const char *zDefault){
-  int lo, hi, mid, c;
-
-  /* The sortQP flag is set whenever a new query parameter is inserted.
-  ** It indicates that we need to resort the query parameters.
-  */
-  if( sortQP ){
-    int i, j;
-    qsort(aParamQP, nUsedQP, sizeof(aParamQP[0]), qparam_compare);
-    sortQP = 0;
-    /* After sorting, remove duplicate parameters.  The secondary sort
-    ** key is aParamQP[].seq and we keep the first entry.  That means
-    ** with duplicate calls to cgi_set_parameter() the second and
-    ** subsequent calls are effectively no-ops. */
-    for(i=j=1; i<nUsedQP; i++){
-      if( fossil_strcmp(aParamQP[i].zName,aParamQP[i-1].zName)==0 ){
-        continue;
-      }
-      if( j<i ){
-        memcpy(&aParamQP[j], &aParamQP[i], sizeof(aParamQP[j]));
-      }
-      j++;
-    }
-    nUsedQP = j;
-  }
+  int i;
 
   /* Invoking with a NULL zName is just a way to cause the parameters
   ** to be sorted.  So go ahead and bail out in that case */
-  if( zName==0 || zName[0]==0 ) return 0;
-
-  /* Do a binary search for a matching query parameter */
-  lo = 0;
-  hi = nUsedQP-1;
-  while( lo<=hi ){
-    mid = (lo+hi)/2;
-    c = fossil_strcmp(aParamQP[mid].zName, zName);
-    if( c==0 ){
-      CGIDEBUG(("mem-match [%s] = [%s]\n", zName, aParamQP[mid].zValue));
-      aParamQP[mid].isFetched = 1;
-      return aParamQP[mid].zValue;
-    }else if( c>0 ){
-      hi = mid-1;
-    }else{
-      lo = mid+1;
-    }
+  if( zName==0 || zName[0]==0 ){
+    cgi_sort_parameters();
+    return 0;
+  }
+
+  /* Look up the name in the hash table */
+  i = qparam_find(zName);
+  if( i>=0 ){
+    CGIDEBUG(("mem-match [%s] = [%s]\n", zName, aParamQP[i].zValue));
+    aParamQP[i].isFetched = 1;
+    return aParamQP[i].zValue;
   }
 
   /* If no match is found and the name begins with an upper-case
@@ -1701,6 +1786,7 @@ const char *cgi_parameter_checked(const char *zName, int iValue){
 ** are fewer than i registered CGI parameters.
 */
 const char *cgi_parameter_name(int i){
+  cgi_sort_parameters();
   if( i>=0 && i<nUsedQP ){
     return aParamQP[i].zName;
   }else{
@@ -1844,6 +1930,7 @@ int cgi_param_info(
   const char **pzValue,
   int *pbIsQP
 ){
+  cgi_sort_parameters();
   if( N>=0 && N<nUsedQP ){
     *pzName = aParamQP[N].zName;
     *pzValue = aParamQP[N].zValue;
@@ -1864,6 +1951,7 @@ int cgi_param_info(
 void cgi_query_parameters_to_hidden(void){
   int i;
   const char *zN, *zV;
+  cgi_sort_parameters();
   for(i=0; i<nUsedQP; i++){
     if( aParamQP[i].isQP==0 || aParamQP[i].cTag ) continue;
     zN = aParamQP[i].zName;
@@ -1878,6 +1966,7 @@ void cgi_query_parameters_to_hidden(void){
 */
 void cgi_query_parameters_to_url(HQuery *p){
   int i;
+  cgi_sort_parameters();
   for(i=0; i<nUsedQP; i++){
     if( aParamQP[i].isQP==0 || aParamQP[i].cTag ) continue;
     url_add_parameter(p, aParamQP[i].zName, aParamQP[i].zValue);
@@ -1900,12 +1989,35 @@ void cgi_tag_query_parameter(const char *zName){
   }
 }
 
+/*
+** Initial size of a reply content buffer.  Nearly every page is larger
+** than this, so starting here skips the first several reallocations.
+*/
+#define CGI_CONTENT_INITIAL 16384
+
+/*
+** Make room in the current content buffer for the output of zFormat.
+** The literal text of the format is a lower bound on what will be
+** appended, so reserving it up front lets vxprintf() append each piece
+** without checking for growth again.
+*/
+static void cgi_reserve_for(const char *zFormat){
+  unsigned int n = (unsigned int)strlen(zFormat);
+  if( pContent->nAlloc<CGI_CONTENT_INITIAL
+   && n<CGI_CONTENT_INITIAL - pContent->nUsed
+  ){
+    n = CGI_CONTENT_INITIAL - pContent->nUsed;
+  }
+  blob_reserve_extra(pContent, n);
+}
+
 /*
 ** This routine works like "printf" except that it has the
 ** extra formatting capabilities such as %h and %t.
 */
 void cgi_printf(const char *zFormat, ...){
   va_list ap;
+  cgi_reserve_for(zFormat);
   va_start(ap,zFormat);
   vxprintf(pContent,zFormat,ap);
   va_end(ap);
@@ -1916,6 +2028,7 @@ void cgi_printf(const char *zFormat, ...){
 ** extra formatting capabilities such as %h and %t.
 */
 void cgi_vprintf(const char *zFormat, va_list ap){
+  cgi_reserve_for(zFormat);
   vxprintf(pContent,zFormat,ap);
 }
 
@@ -2800,6 +2913,7 @@ int cgi_from_mobile(void){
 void cgi_check_for_malice(void){
   struct QParam * pParam;
   int i;
+  cgi_sort_parameters();
   for(i=0; i<nUsedQP; ++i){
     pParam = &aParamQP[i];
     if( 0==pParam->isFetched
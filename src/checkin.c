@@ -2489,6 +2489,12 @@ void commit_cmd(void){
   }
 
   hasChanges = unsaved_changes(useHash ? CKSIG_HASH : 0);
+  if( useCksum ){
+    /* The R-card is computed from the repository copy of every file */
+    char *zFiles = mprintf("SELECT rid FROM vfile WHERE vid=%d AND rid>0", vid);
+    shallow_prefetch(zFiles);
+    fossil_free(zFiles);
+  }
   db_begin_transaction();
   db_record_repository_filename(0);
   if( hasChanges==0 && !isAMerge && !allowEmpty && !forceFlag ){
@@ -79,6 +79,104 @@ void delete_private_content(void){
 }
 
 
+/*
+** Return the sequence number at which an interrupted clone into zRepo
+** should continue, or 0 if zRepo is not an interrupted clone.  The
+** sequence number is -1 if every artifact was received but the clone
+** was interrupted before the rebuild finished.
+*/
+static int clone_resume_seqno(const char *zRepo){
+  sqlite3 *db = 0;
+  sqlite3_stmt *pStmt = 0;
+  int iSeqno = 0;
+  if( sqlite3_open_v2(zRepo, &db, SQLITE_OPEN_READONLY, 0)==SQLITE_OK
+   && sqlite3_prepare_v2(db,
+        "SELECT value FROM config WHERE name='clone-seqno'", -1, &pStmt, 0)
+        ==SQLITE_OK
+   && sqlite3_step(pStmt)==SQLITE_ROW
+  ){
+    iSeqno = sqlite3_column_int(pStmt, 0);
+    if( iSeqno==0 ) iSeqno = -1;
+  }
+  sqlite3_finalize(pStmt);
+  sqlite3_close(db);
+  return iSeqno;
+}
+
+/*
+** Every artifact of an interrupted clone was received, but some deltas
+** may still refer to sources that had not arrived when the clone was
+** interrupted.  Fetch those sources.  Return the number of errors.
+**
+** The server answers a request with a delta against the parent of the
+** artifact, and the parent might be held here only as a delta against
+** the artifact that is missing.  So every artifact that cannot be
+** reconstructed is turned back into a phantom and fetched as well.
+** This is done in a single transaction, so that a fetch that is
+** interrupted leaves the repository as it was.
+*/
+static int clone_fetch_delta_sources(void){
+  int nErr = 0;
+  if( !db_exists("SELECT 1 FROM delta WHERE srcid IN phantom") ) return 0;
+  fossil_print("Fetching the sources of unresolved deltas\n");
+  db_begin_transaction();
+  db_multi_exec(
+    "CREATE TEMP TABLE unresolved(rid INTEGER PRIMARY KEY);"
+    "INSERT INTO unresolved SELECT srcid FROM delta WHERE srcid IN phantom;"
+    "WITH RECURSIVE bad(rid) AS ("
+    "  SELECT rid FROM delta WHERE srcid IN phantom"
+    "  UNION SELECT delta.rid FROM delta, bad WHERE delta.srcid=bad.rid"
+    ")"
+    "INSERT OR IGNORE INTO unresolved SELECT rid FROM bad;"
+    "UPDATE blob SET content=NULL, size=-1 WHERE rid IN unresolved;"
+    "DELETE FROM delta WHERE rid IN unresolved;"
+    "INSERT OR IGNORE INTO phantom SELECT rid FROM unresolved;"
+  );
+  g.xlinkClusterOnly = 1;
+  do{
+    db_multi_exec(
+      "INSERT OR IGNORE INTO unresolved"
+      " SELECT srcid FROM delta WHERE srcid IN phantom;"
+    );
+    if( shallow_fetch_phantoms("SELECT rid FROM unresolved")==0 ){
+      nErr++;
+      break;
+    }
+  }while( db_exists("SELECT 1 FROM unresolved WHERE rid IN phantom")
+       || db_exists("SELECT 1 FROM delta WHERE srcid IN phantom") );
+  g.xlinkClusterOnly = 0;
+  db_multi_exec("DROP TABLE unresolved;");
+  db_end_transaction(nErr>0);
+  return nErr;
+}
+
+/*
+** Create and open a new, empty repository zRepo that is ready to receive
+** the content of another repository by the clone protocol.  The project
+** code is left unset, to be supplied by the server.  A transaction is
+** left open.
+*/
+void clone_new_repository(const char *zRepo, const char *zDefaultUser){
+  db_close_config();
+  db_create_repository(zRepo);
+  db_open_repository(zRepo);
+  db_open_config(0,0);
+  db_begin_transaction();
+  db_initial_setup(0, 0, zDefaultUser);
+  user_select();
+  db_set("content-schema", CONTENT_SCHEMA, 0);
+  db_set("aux-schema", AUX_SCHEMA_MAX, 0);
+  db_set("rebuilt", get_version(), 0);
+  db_unset("hash-policy", 0);
+  db_unprotect(PROTECT_CONFIG);
+  db_multi_exec(
+    "REPLACE INTO config(name,value,mtime)"
+    " VALUES('server-code', lower(hex(randomblob(20))), now());"
+    "DELETE FROM config WHERE name='project-code';"
+  );
+  db_protect_pop();
+}
+
 /*
 ** COMMAND: clone
 **
@@ -122,9 +220,19 @@ void delete_private_content(void){
 ** admin user for the new clone. This can be overridden using
 ** the -A|--admin-user parameter.
 **
+** A clone over the network that is interrupted leaves the partial
+** repository behind.  Rerun the same command to continue the clone
+** from where it stopped.
+**
 ** Options:
 **    -A|--admin-user USERNAME   Make USERNAME the administrator
 **    -B|--httpauth USER:PASS    Add HTTP Basic Authorization to requests
+**    --blobless                 Partial clone: omit the content of files
+**                               other than those of the open leaves.  The
+**                               content is fetched from the remote when
+**                               it is first needed
+**    --depth N                  Shallow clone: only the last N check-ins
+**                               on each open branch
 **    --nested                   Allow opening a repository inside an opened
 **                               check-out
 **    --nocompress               Omit extra delta compression
@@ -132,6 +240,7 @@ void delete_private_content(void){
 **    --once                     Don't remember the URI.
 **    --private                  Also clone private branches
 **    --save-http-password       Remember the HTTP password without asking
+**    --since DATE               Shallow clone: only check-ins since DATE
 **    -c|--ssh-command SSH       Use SSH as the "ssh" command
 **    --ssl-identity FILENAME    Use the SSL identity if requested by the server
 **    --transport-command CMD    Use CMD to move messages to the server and back
@@ -146,6 +255,7 @@ void clone_cmd(void){
   char *zPassword;
   const char *zDefaultUser;   /* Optional name of the default user */
   const char *zHttpAuth;      /* HTTP Authorization user:pass information */
+  char *zOpts;                /* Shallow and blobless clone options */
   int nErr = 0;
   int urlFlags = URL_PROMPT_PW | URL_REMEMBER;
   int syncFlags = SYNC_CLONE;
@@ -154,7 +264,11 @@ void clone_cmd(void){
   int allowNested = find_option("nested",0,0)!=0; /* Used by open */
   const char *zRepo = 0;      /* Name of the new local repository file */
   const char *zWorkDir = 0;   /* Open in this directory, if not zero */
-
+  int iResume = 0;            /* Continue an interrupted clone */
+  int bCopy;                  /* Clone by copying a local file */
+  const char *zDepth;         /* --depth for a shallow clone */
+  const char *zSince;         /* --since for a shallow clone */
+  int bBlobless;              /* --blobless for a partial clone */
 
   /* Also clone private branches */
   if( find_option("private",0,0)!=0 ) syncFlags |= SYNC_PRIVATE;
@@ -174,6 +288,9 @@ void clone_cmd(void){
   zHttpAuth = find_option("httpauth","B",1);
   zDefaultUser = find_option("admin-user","A",1);
   zWorkDir = find_option("workdir", 0, 1);
+  zDepth = find_option("depth", 0, 1);
+  zSince = find_option("since", 0, 1);
+  bBlobless = find_option("blobless", 0, 0)!=0;
   clone_ssh_find_options();
   url_proxy_options();
   g.zHttpCmd = find_option("transport-command",0,1);
@@ -185,6 +302,10 @@ void clone_cmd(void){
     usage("?OPTIONS? FILE-OR-URL ?NEW-REPOSITORY?");
   }
   db_open_config(0, 0);
+  if( zDepth || zSince ){
+    shallow_set_bound(zDepth ? atoi(zDepth) : 0, zSince);
+  }
+  shallow_set_blobless(bBlobless);
   if( g.argc==4 ){
     zRepo = g.argv[3];
   }else{
@@ -202,7 +323,10 @@ void clone_cmd(void){
     fossil_free(zBase);
   }
   if( -1 != file_size(zRepo, ExtFILE) ){
-    fossil_fatal("file already exists: %s", zRepo);
+    iResume = clone_resume_seqno(zRepo);
+    if( iResume==0 ){
+      fossil_fatal("file already exists: %s", zRepo);
+    }
   }
   /* Fail before clone if open will fail because inside an open check-out */
   if( zWorkDir!=0 && zWorkDir[0]!=0 && !noOpen ){
@@ -212,10 +336,13 @@ void clone_cmd(void){
   }
   url_parse(g.argv[2], urlFlags);
   if( zDefaultUser==0 && g.url.user!=0 ) zDefaultUser = g.url.user;
-  if( g.url.isFile ){
+  bCopy = g.url.isFile && !shallow_is_requested() && !bBlobless;
+  if( bCopy ){
+    if( iResume ) file_delete(zRepo);
     file_copy(g.url.name, zRepo);
     db_close(1);
     db_open_repository(zRepo);
+    packfile_copy(g.url.name, zRepo);
     db_open_config(1,0);
     db_record_repository_filename(zRepo);
     url_remember();
@@ -228,19 +355,43 @@ void clone_cmd(void){
       g.zLogin = db_text(0, "SELECT login FROM user WHERE cap LIKE '%%s%%'");
     }
     fossil_print("Repository cloned into %s\n", zRepo);
-  }else{
+  }else if( iResume ){
+    /* Continue an interrupted clone.  Every round-trip of the clone was
+    ** committed as it arrived, together with the "clone-seqno" of the
+    ** next artifact to ask for. */
     db_close_config();
-    db_create_repository(zRepo);
     db_open_repository(zRepo);
     db_open_config(0,0);
-    db_begin_transaction();
+    if( fossil_strcmp(db_get("clone-url",""), g.url.canonical)!=0 ){
+      fossil_fatal("%s is an interrupted clone of %s",
+                   zRepo, db_get("clone-url",""));
+    }
+    zOpts = shallow_clone_options();
+    if( fossil_strcmp(db_get("clone-options","0 0.000000 0"), zOpts)!=0 ){
+      fossil_fatal("use the same --depth, --since and --blobless options"
+                   " to continue the clone");
+    }
+    fossil_free(zOpts);
+    if( zDefaultUser==0 ){
+      zDefaultUser = db_text(0,
+          "SELECT login FROM user WHERE cap LIKE '%%s%%'");
+    }
+    g.zLogin = zDefaultUser;
+    remember_or_get_http_auth(zHttpAuth, urlFlags & URL_REMEMBER, g.argv[2]);
+    url_enable_proxy(0);
+    clone_ssh_db_set_options();
+    url_get_password_if_needed();
+    if( iResume>0 ){
+      fossil_print("Continuing the clone at artifact %d\n", iResume);
+      g.xlinkClusterOnly = 1;
+      nErr = client_sync(syncFlags,CONFIGSET_ALL,0,0,0);
+      g.xlinkClusterOnly = 0;
+    }else{
+      nErr = clone_fetch_delta_sources();
+    }
+  }else{
+    clone_new_repository(zRepo, zDefaultUser);
     db_record_repository_filename(zRepo);
-    db_initial_setup(0, 0, zDefaultUser);
-    user_select();
-    db_set("content-schema", CONTENT_SCHEMA, 0);
-    db_set("aux-schema", AUX_SCHEMA_MAX, 0);
-    db_set("rebuilt", get_version(), 0);
-    db_unset("hash-policy", 0);
     remember_or_get_http_auth(zHttpAuth, urlFlags & URL_REMEMBER, g.argv[2]);
     url_remember();
     if( g.zSSLIdentity!=0 ){
@@ -253,23 +404,32 @@ void clone_cmd(void){
       db_protect_pop();
       blob_reset(&fn);
     }
-    db_unprotect(PROTECT_CONFIG);
-    db_multi_exec(
-      "REPLACE INTO config(name,value,mtime)"
-      " VALUES('server-code', lower(hex(randomblob(20))), now());"
-      "DELETE FROM config WHERE name='project-code';"
-    );
-    db_protect_pop();
     url_enable_proxy(0);
     clone_ssh_db_set_options();
     url_get_password_if_needed();
+    if( shallow_is_requested() ) shallow_schema();
+
+    /* Each round-trip of the clone commits separately, so that an
+    ** interrupted clone can be continued.  Remember where to continue. */
+    db_set("clone-url", g.url.canonical, 0);
+    zOpts = shallow_clone_options();
+    db_set("clone-options", zOpts, 0);
+    fossil_free(zOpts);
+    db_set_int("clone-seqno", 1, 0);
+    db_end_transaction(0);
     g.xlinkClusterOnly = 1;
     nErr = client_sync(syncFlags,CONFIGSET_ALL,0,0,0);
     g.xlinkClusterOnly = 0;
-    verify_cancel();
-    db_end_transaction(0);
+  }
+  if( !bCopy ){
+    int bKeep = iResume!=0 || db_get_int("clone-seqno", 1)!=1;
     db_close(1);
     if( nErr ){
+      if( bKeep ){
+        fossil_fatal(
+          "clone interrupted - rerun the same command to continue"
+        );
+      }
       file_delete(zRepo);
       if( g.fHttpTrace ){
         fossil_fatal(
@@ -292,6 +452,10 @@ void clone_cmd(void){
   }
   fossil_print("Rebuilding repository meta-data...\n");
   rebuild_db(1, 0);
+  shallow_record_boundary();
+  db_unset("clone-seqno", 0);
+  db_unset("clone-url", 0);
+  db_unset("clone-options", 0);
   if( !noCompress ){
     int nDelta = 0;
     i64 nByte;
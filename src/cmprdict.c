@@ -0,0 +1,561 @@
+/*
+** Copyright (c) 2026 D. Richard Hipp
+**
+** This program is free software; you can redistribute it and/or
+** modify it under the terms of the Simplified BSD License (also
+** known as the "2-Clause License" or "FreeBSD License".)
+**
+** This program is distributed in the hope that it will be useful,
+** but without any warranty; without even the implied warranty of
+** merchantability or fitness for a particular purpose.
+**
+** Author contact information:
+**   drh@sqlite.org
+**
+*******************************************************************************
+**
+** This file implements preset compression dictionaries for small artifacts.
+**
+** Small artifacts such as tags, ticket changes, forum posts and short
+** deltas compress poorly on their own, because zlib starts every stream
+** knowing nothing.  Yet they have a lot of text in common: card letters,
+** user names, branch names and so on.  A dictionary trained from the
+** repository itself and given to zlib in advance lets each small artifact
+** refer back to that common text.
+**
+** Dictionaries are kept in the CMPRDICT table, keyed by their Adler-32
+** checksum.  zlib records that same checksum in the header of every stream
+** that was compressed with a dictionary, so blob_uncompress() always knows
+** which dictionary it needs.  A dictionary is never deleted once it exists,
+** so artifacts compressed with an older dictionary remain readable after
+** a new one is trained.  The "compress-dict" config entry holds the
+** identifier of the dictionary used for new artifacts.
+**
+** Content sent to other repositories is never compressed with a
+** dictionary, since the other side does not have it.
+*/
+#include "config.h"
+#include "cmprdict.h"
+#include <zlib.h>
+
+/*
+** The largest useful dictionary.  zlib can only refer back 32KiB.
+*/
+#define CMPRDICT_MAX  32768
+
+/*
+** State information for preset dictionaries.
+*/
+static struct {
+  int hasTable;          /* CMPRDICT table exists: 1 yes, 0 no, -1 unknown */
+  int iLimit;            /* Cached "compress-dict-limit".  -1 if unknown */
+  unsigned int idActive; /* Dictionary for new artifacts.  0 for none */
+  int bActive;           /* True if idActive is known */
+  int nDict;             /* Number of dictionaries loaded */
+  unsigned int *aId;     /* Identifiers of the loaded dictionaries */
+  Blob *aDict;           /* Content of the loaded dictionaries */
+} dictState = { -1, -1, 0, 0, 0, 0, 0 };
+
+/*
+** SETTING: compress-dict-limit    width=10 default=4096
+**
+** Artifacts that are smaller than this many bytes are compressed using
+** the preset dictionary of the repository, if there is one.  See the
+** "fossil compress-dict" command.  A value of 0 disables the dictionary
+** for new artifacts.  Artifacts that were compressed with a dictionary
+** remain readable regardless of this setting.
+*/
+
+/*
+** Forget cached state, including the loaded dictionaries.  This is
+** called whenever the repository database is closed.  An identifier is
+** only an Adler-32 checksum, so the next repository opened may use the
+** same identifier for a different dictionary.
+*/
+void cmprdict_close(void){
+  int i;
+  for(i=0; i<dictState.nDict; i++){
+    blob_reset(&dictState.aDict[i]);
+  }
+  fossil_free(dictState.aId);
+  fossil_free(dictState.aDict);
+  dictState.aId = 0;
+  dictState.aDict = 0;
+  dictState.nDict = 0;
+  dictState.hasTable = -1;
+  dictState.iLimit = -1;
+  dictState.idActive = 0;
+  dictState.bActive = 0;
+}
+
+/*
+** Return true if the CMPRDICT table exists in the repository.
+*/
+static int cmprdict_has_table(void){
+  if( dictState.hasTable<0 ){
+    dictState.hasTable = g.repositoryOpen
+                         && db_table_exists("repository","cmprdict");
+  }
+  return dictState.hasTable;
+}
+
+/*
+** Return the dictionary with identifier id, or NULL if there is no
+** such dictionary.
+*/
+Blob *cmprdict_find(unsigned int id){
+  int i;
+  Blob dict;
+  for(i=0; i<dictState.nDict; i++){
+    if( dictState.aId[i]==id ) return &dictState.aDict[i];
+  }
+  if( !cmprdict_has_table() ) return 0;
+  blob_zero(&dict);
+  db_blob(&dict, "SELECT dict FROM repository.cmprdict WHERE dictid=%u", id);
+  if( blob_size(&dict)==0 ) return 0;
+  i = dictState.nDict++;
+  dictState.aId = fossil_realloc(dictState.aId,
+                                 dictState.nDict*sizeof(dictState.aId[0]));
+  dictState.aDict = fossil_realloc(dictState.aDict,
+                                 dictState.nDict*sizeof(dictState.aDict[0]));
+  dictState.aId[i] = id;
+  dictState.aDict[i] = dict;
+  return &dictState.aDict[i];
+}
+
+/*
+** Return the dictionary that should be used to compress an artifact
+** of nByte bytes, or NULL if it should be compressed without one.
+*/
+static Blob *cmprdict_for_size(int nByte){
+  if( dictState.iLimit<0 ){
+    dictState.iLimit = db_get_int("compress-dict-limit", 4096);
+  }
+  if( nByte>=dictState.iLimit ) return 0;
+  if( !dictState.bActive ){
+    dictState.idActive = (unsigned int)db_get_int("compress-dict", 0);
+    dictState.bActive = 1;
+  }
+  if( dictState.idActive==0 ) return 0;
+  return cmprdict_find(dictState.idActive);
+}
+
+/*
+** Compress pIn into pOut for storage in the BLOB table.  This is the
+** same as blob_compress() except that small artifacts are compressed
+** with the active dictionary, if there is one.
+*/
+void cmprdict_compress(Blob *pIn, Blob *pOut){
+  Blob *pDict = cmprdict_for_size(blob_size(pIn));
+  if( pDict ){
+    blob_compress_dict(pIn, pOut, pDict);
+  }else{
+    blob_compress(pIn, pOut);
+  }
+}
+
+/*
+** If the compressed content of pCmpr uses a dictionary, recompress it
+** without one so that it can be sent to another repository.
+*/
+void cmprdict_make_portable(Blob *pCmpr){
+  if( blob_compressed_dictid(blob_buffer(pCmpr), blob_size(pCmpr)) ){
+    blob_uncompress(pCmpr, pCmpr);
+    blob_compress(pCmpr, pCmpr);
+  }
+}
+
+/*
+** Prepare pQ to select the rid and stored (compressed) content of every
+** artifact whose stored content is smaller than mx bytes, including
+** artifacts held in pack files, for which the content column is NULL.
+** zWhere is an additional SQL constraint on the BLOB table and zTail is
+** appended to the query.  Use cmprdict_stored() to read the content of
+** each row.
+*/
+static void cmprdict_prepare_stored(
+  Stmt *pQ,                 /* Statement to prepare */
+  int mx,                   /* Only content smaller than this */
+  const char *zWhere,       /* Extra constraint on BLOB */
+  const char *zTail         /* ORDER BY and LIMIT clauses, or "" */
+){
+  if( packfile_has_table() ){
+    db_prepare(pQ,
+      "SELECT rid, content, uuid FROM blob"
+      " WHERE size>=0 AND %s"
+      "   AND coalesce(length(content),"
+                     "(SELECT sz FROM blobpack WHERE blobpack.rid=blob.rid))<%d"
+      " %s",
+      zWhere/*safe-for-%s*/, mx, zTail/*safe-for-%s*/
+    );
+  }else{
+    db_prepare(pQ,
+      "SELECT rid, content, uuid FROM blob"
+      " WHERE size>=0 AND %s AND length(content)<%d %s",
+      zWhere/*safe-for-%s*/, mx, zTail/*safe-for-%s*/
+    );
+  }
+}
+
+/*
+** Load the stored content of the current row of a statement prepared by
+** cmprdict_prepare_stored() into pOut.  Return 0 on success, or 1 if the
+** content cannot be read.  The caller must blob_reset(pOut) afterwards.
+*/
+static int cmprdict_stored(Stmt *pQ, Blob *pOut){
+  if( db_column_type(pQ, 1)!=SQLITE_NULL ){
+    db_ephemeral_blob(pQ, 1, pOut);
+    return 0;
+  }
+  blob_zero(pOut);
+  return packfile_get(db_column_int(pQ, 0), db_column_text(pQ, 2), pOut)==0;
+}
+
+/*
+** Recompress small artifacts that are not already compressed with the
+** active dictionary, or that use a dictionary although none is active.
+** Only artifacts whose rid lies between ridMin and ridMax inclusive are
+** considered.  Return the number of bytes saved and write the number of
+** artifacts rewritten into *pnChanged.
+*/
+i64 cmprdict_recompress(int ridMin, int ridMax, int *pnChanged){
+  Stmt q, s;
+  i64 nSaved = 0;
+  int nChanged = 0;
+  int mx;
+  unsigned int idWant;
+  char *zWhere;
+
+  *pnChanged = 0;
+  mx = db_get_int("compress-dict-limit", 4096);
+  idWant = (unsigned int)db_get_int("compress-dict", 0);
+  if( idWant && cmprdict_find(idWant)==0 ) idWant = 0;
+  if( idWant==0 && !cmprdict_has_table() ) return 0;
+  db_begin_transaction();
+  zWhere = mprintf("rid BETWEEN %d AND %d", ridMin, ridMax);
+  cmprdict_prepare_stored(&q, 0x7fffffff, zWhere, "");
+  fossil_free(zWhere);
+  db_prepare(&s, "UPDATE blob SET content=:c WHERE rid=:rid");
+  while( db_step(&q)==SQLITE_ROW ){
+    Blob x, y;
+    unsigned int idHave;
+    int nOut;
+    int isPacked;
+    if( cmprdict_stored(&q, &x) ) continue;
+    if( blob_size(&x)<4 ){
+      blob_reset(&x);
+      continue;
+    }
+    idHave = blob_compressed_dictid(blob_buffer(&x), blob_size(&x));
+    nOut = (int)(((unsigned char*)blob_buffer(&x))[0]<<24
+               | ((unsigned char*)blob_buffer(&x))[1]<<16
+               | ((unsigned char*)blob_buffer(&x))[2]<<8
+               | ((unsigned char*)blob_buffer(&x))[3]);
+    if( (nOut<mx ? idWant : 0)==idHave || blob_uncompress(&x, &y) ){
+      blob_reset(&x);
+      continue;
+    }
+    cmprdict_compress(&y, &y);
+    if( blob_size(&y)<blob_size(&x) || idHave!=0 ){
+      nSaved += blob_size(&x) - blob_size(&y);
+      isPacked = packfile_wanted(blob_size(&y));
+      if( isPacked ){
+        db_bind_null(&s, ":c");
+      }else{
+        db_bind_blob(&s, ":c", &y);
+      }
+      db_bind_int(&s, ":rid", db_column_int(&q, 0));
+      db_exec(&s);
+      db_reset(&s);
+      packfile_set(db_column_int(&q, 0), db_column_text(&q, 2),
+                   isPacked ? &y : 0);
+      nChanged++;
+    }
+    blob_reset(&x);
+    blob_reset(&y);
+  }
+  db_finalize(&s);
+  db_finalize(&q);
+  db_end_transaction(0);
+  *pnChanged = nChanged;
+  return nSaved;
+}
+
+/*
+** Return true if the nB bytes of b occur somewhere within the nA bytes
+** of a.
+*/
+static int cmprdict_contains(const char *a, int nA, const char *b, int nB){
+  int i;
+  for(i=0; i+nB<=nA; i++){
+    if( a[i]==b[0] && memcmp(&a[i], b, nB)==0 ) return 1;
+  }
+  return 0;
+}
+
+/*
+** Insert the n bytes of z into the DICTSEG table, or count one more
+** occurrence if it is already there.
+*/
+static void cmprdict_count(Stmt *pIns, const char *z, int n){
+  Blob seg;
+  blob_init(&seg, z, n);
+  db_bind_blob(pIns, ":txt", &seg);
+  db_step(pIns);
+  db_reset(pIns);
+}
+
+/*
+** Build a dictionary of at most mxDict bytes from a random sample of
+** up to nSample small artifacts.  The dictionary is the concatenation of
+** the lines and words that occur most often across the sample, with the
+** most valuable text last, where zlib can reach it most cheaply.
+*/
+static void cmprdict_train(Blob *pDict, int mxDict, int nSample, int mx){
+  Stmt q, ins;
+  Blob *aSeg = 0;
+  int nSeg = 0;
+  int nDict = 0;
+  int i;
+  char *zTail;
+
+  db_multi_exec(
+    "CREATE TEMP TABLE dictseg(txt BLOB PRIMARY KEY, n INT) WITHOUT ROWID;"
+  );
+  db_prepare(&ins,
+    "INSERT INTO dictseg(txt,n) VALUES(:txt,1)"
+    " ON CONFLICT(txt) DO UPDATE SET n=n+1"
+  );
+  zTail = mprintf("ORDER BY random() LIMIT %d", nSample);
+  cmprdict_prepare_stored(&q, mx, "1", zTail);
+  fossil_free(zTail);
+  while( db_step(&q)==SQLITE_ROW ){
+    Blob x, y;
+    const char *z;
+    int n, iLine, j, rc;
+    if( cmprdict_stored(&q, &x) ) continue;
+    blob_zero(&y);
+    rc = blob_uncompress(&x, &y);
+    blob_reset(&x);
+    if( rc ) continue;
+    z = blob_buffer(&y);
+    n = blob_size(&y);
+    for(iLine=0; iLine<n; iLine=j+1){
+      int iWord;
+      for(j=iLine; j<n && z[j]!='\n'; j++){}
+      if( j<n && j-iLine+1<=128 ){
+        /* A whole line, including its newline */
+        cmprdict_count(&ins, &z[iLine], j-iLine+1);
+      }
+      for(iWord=iLine; iWord<j; iWord++){
+        int k;
+        for(k=iWord; k<j && z[k]!=' '; k++){}
+        if( k<j && k-iWord>=3 && k-iWord<64 ){
+          /* A word together with the space that follows it */
+          cmprdict_count(&ins, &z[iWord], k-iWord+1);
+        }
+        iWord = k;
+      }
+    }
+    blob_reset(&y);
+  }
+  db_finalize(&q);
+  db_finalize(&ins);
+
+  /* Choose the most valuable text that is not already covered */
+  blob_zero(pDict);
+  db_prepare(&q,
+    "SELECT txt FROM dictseg WHERE n>1 ORDER BY (n-1)*length(txt) DESC"
+  );
+  while( nDict<mxDict && db_step(&q)==SQLITE_ROW ){
+    Blob seg;
+    int covered = 0;
+    blob_zero(&seg);
+    db_column_blob(&q, 0, &seg);
+    if( nDict+blob_size(&seg)>mxDict ){
+      blob_reset(&seg);
+      continue;
+    }
+    for(i=0; i<nSeg && !covered; i++){
+      if( blob_size(&aSeg[i])>=blob_size(&seg)
+       && cmprdict_contains(blob_buffer(&aSeg[i]), blob_size(&aSeg[i]),
+                            blob_buffer(&seg), blob_size(&seg))
+      ){
+        covered = 1;
+      }
+    }
+    if( covered ){
+      blob_reset(&seg);
+      continue;
+    }
+    aSeg = fossil_realloc(aSeg, (nSeg+1)*sizeof(aSeg[0]));
+    aSeg[nSeg++] = seg;
+    nDict += blob_size(&seg);
+  }
+  db_finalize(&q);
+  db_multi_exec("DROP TABLE dictseg");
+  for(i=nSeg-1; i>=0; i--){
+    blob_append(pDict, blob_buffer(&aSeg[i]), blob_size(&aSeg[i]));
+    blob_reset(&aSeg[i]);
+  }
+  fossil_free(aSeg);
+}
+
+/*
+** COMMAND: compress-dict
+**
+** Usage: %fossil compress-dict SUBCOMMAND ?OPTIONS?
+**
+** Manage the preset compression dictionary of the repository.  Artifacts
+** smaller than the "compress-dict-limit" setting are compressed using the
+** dictionary, which lets them share common text such as card letters,
+** user names and branch names instead of each spelling it out.
+**
+** Subcommands:
+**
+**   off                 Stop using a dictionary for new artifacts.
+**                       Existing artifacts remain readable.
+**
+**   status              Show the dictionaries of the repository and
+**                       the number of artifacts that use each one
+**
+**   train ?OPTIONS?     Build a new dictionary from a sample of the
+**                       small artifacts in the repository and use it
+**                       for new artifacts.  Options:
+**
+**                          --sample N   Sample at most N artifacts.
+**                                       The default is 5000.
+**                          --size N     Make the dictionary at most N
+**                                       bytes.  The default is 16384.
+**
+** Run "fossil repack" afterwards to recompress existing small artifacts
+** with the current dictionary.
+**
+** Options:
+**   -R|--repository REPO    Use REPO as the repository
+*/
+void compress_dict_cmd(void){
+  const char *zCmd;
+  int nCmd;
+  db_find_and_open_repository(0, 0);
+  if( g.argc<3 ){
+    usage("off|status|train ?OPTIONS?");
+  }
+  zCmd = g.argv[2];
+  nCmd = (int)strlen(zCmd);
+  if( strncmp(zCmd, "train", nCmd)==0 ){
+    const char *zSize = find_option("size",0,1);
+    const char *zSample = find_option("sample",0,1);
+    int mxDict = zSize ? atoi(zSize) : 16384;
+    int nSample = zSample ? atoi(zSample) : 5000;
+    Blob dict;
+    unsigned int id;
+    verify_all_options();
+    if( mxDict<256 || mxDict>CMPRDICT_MAX ){
+      fossil_fatal("--size must be between 256 and %d", CMPRDICT_MAX);
+    }
+    db_begin_transaction();
+    cmprdict_train(&dict, mxDict, nSample,
+                   db_get_int("compress-dict-limit", 4096));
+    if( blob_size(&dict)==0 ){
+      fossil_fatal("not enough small artifacts to train a dictionary");
+    }
+    db_multi_exec(
+      "CREATE TABLE IF NOT EXISTS repository.cmprdict(\n"
+      "  dictid INTEGER PRIMARY KEY,  -- Adler-32 checksum of dict\n"
+      "  dict BLOB NOT NULL,          -- The preset dictionary\n"
+      "  mtime DATETIME               -- When the dictionary was made\n"
+      ");"
+    );
+    /* The identifier must name only one dictionary.  Should a different
+    ** dictionary already have the same checksum, drop leading bytes,
+    ** which are the least valuable, until the checksum is unused. */
+    while( 1 ){
+      Blob old;
+      id = (unsigned int)adler32(1, (unsigned char*)blob_buffer(&dict),
+                                 blob_size(&dict));
+      blob_zero(&old);
+      db_blob(&old, "SELECT dict FROM cmprdict WHERE dictid=%u", id);
+      if( blob_size(&old)==0 || blob_compare(&old, &dict)==0 ){
+        blob_reset(&old);
+        break;
+      }
+      blob_reset(&old);
+      if( blob_size(&dict)<=1 ){
+        fossil_fatal("cannot find an unused dictionary identifier");
+      }
+      memmove(blob_buffer(&dict), blob_buffer(&dict)+1, blob_size(&dict)-1);
+      blob_resize(&dict, blob_size(&dict)-1);
+    }
+    if( db_exists("SELECT 1 FROM cmprdict WHERE dictid=%u", id) ){
+      fossil_print("the dictionary is unchanged\n");
+    }else{
+      Stmt ins;
+      db_prepare(&ins,
+        "INSERT INTO cmprdict(dictid,dict,mtime)"
+        " VALUES(%u,:dict,julianday('now'))", id
+      );
+      db_bind_blob(&ins, ":dict", &dict);
+      db_exec(&ins);
+      db_finalize(&ins);
+    }
+    db_set_int("compress-dict", (int)id, 0);
+    db_end_transaction(0);
+    cmprdict_close();
+    fossil_print("dictionary %08x: %d bytes\n", id, blob_size(&dict));
+    blob_reset(&dict);
+  }else if( strncmp(zCmd, "off", nCmd)==0 ){
+    verify_all_options();
+    db_unset("compress-dict", 0);
+    cmprdict_close();
+  }else if( strncmp(zCmd, "status", nCmd)==0 ){
+    Stmt q;
+    int nNone = 0;
+    i64 szNone = 0;
+    unsigned int idActive = (unsigned int)db_get_int("compress-dict", 0);
+    verify_all_options();
+    db_multi_exec("CREATE TEMP TABLE dictuse(id INTEGER PRIMARY KEY,"
+                  " n INT, sz INT)");
+    cmprdict_prepare_stored(&q, db_get_int("compress-dict-limit", 4096),
+                            "1", "");
+    while( db_step(&q)==SQLITE_ROW ){
+      Blob x;
+      unsigned int id;
+      if( cmprdict_stored(&q, &x) ) continue;
+      id = blob_compressed_dictid(blob_buffer(&x), blob_size(&x));
+      if( id==0 ){
+        nNone++;
+        szNone += blob_size(&x);
+      }else{
+        db_multi_exec(
+          "INSERT INTO dictuse VALUES(%u,1,%d)"
+          " ON CONFLICT(id) DO UPDATE SET n=n+1, sz=sz+excluded.sz",
+          id, blob_size(&x));
+      }
+      blob_reset(&x);
+    }
+    db_finalize(&q);
+    fossil_print("compress-dict-limit: %d\n",
+                 db_get_int("compress-dict-limit", 4096));
+    fossil_print("%-10s %8s %10s %12s\n", "dictionary", "size",
+                 "artifacts", "bytes");
+    fossil_print("%-10s %8s %10d %12lld\n", "(none)", "", nNone, szNone);
+    if( cmprdict_has_table() ){
+      db_prepare(&q,
+        "SELECT dictid, length(dict), coalesce(n,0), coalesce(sz,0)"
+        "  FROM cmprdict LEFT JOIN dictuse ON id=dictid ORDER BY mtime"
+      );
+      while( db_step(&q)==SQLITE_ROW ){
+        unsigned int id = (unsigned int)db_column_int64(&q,0);
+        fossil_print("%08x%s %8d %10d %12lld\n", id,
+                     id==idActive ? " *" : "  ",
+                     db_column_int(&q,1), db_column_int(&q,2),
+                     db_column_int64(&q,3));
+      }
+      db_finalize(&q);
+    }
+  }else{
+    fossil_fatal("unknown subcommand \"%s\": should be one of:"
+                 " off status train", zCmd);
+  }
+}
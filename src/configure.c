@@ -914,7 +914,10 @@ void configuration_cmd(void){
       }else if( fossil_strcmp(zName,"@forum")==0 ){
         if( db_table_exists("repository","forumpost") ){
           db_multi_exec("DELETE FROM forumpost");
-          db_multi_exec("DELETE FROM forumthread");
+        }
+        if( db_table_exists("repository","forumtopic") ){
+          db_multi_exec("DELETE FROM forumtree");
+          db_multi_exec("DELETE FROM forumtopic");
         }
       }else if( fossil_strcmp(zName,"@reportfmt")==0 ){
         db_multi_exec("DELETE FROM reportfmt");
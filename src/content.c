@@ -211,6 +211,29 @@ static void content_mark_available(int rid){
   bag_clear(&pending);
 }
 
+/*
+** Get the compressed blob.content value for blob.rid=rid, reading it
+** from a pack file if the content is stored out-of-line.  Return 1 on
+** success or 0 on failure.
+*/
+int content_raw_get(int rid, Blob *pBlob){
+  static Stmt q;
+  int rc = 0;
+  db_static_prepare(&q,
+    "SELECT content, uuid FROM blob WHERE rid=:rid AND size>=0");
+  db_bind_int(&q, ":rid", rid);
+  if( db_step(&q)==SQLITE_ROW ){
+    if( db_column_type(&q, 0)!=SQLITE_NULL ){
+      db_column_blob(&q, 0, pBlob);
+      rc = 1;
+    }else{
+      rc = packfile_get(rid, db_column_text(&q, 1), pBlob);
+    }
+  }
+  db_reset(&q);
+  return rc;
+}
+
 /*
 ** Get the blob.content value for blob.rid=rid.  Return 1 on success or
 ** 0 on failure.
@@ -218,12 +241,17 @@ static void content_mark_available(int rid){
 static int content_of_blob(int rid, Blob *pBlob){
   static Stmt q;
   int rc = 0;
-  db_static_prepare(&q, "SELECT content FROM blob WHERE rid=:rid AND size>=0");
+  db_static_prepare(&q,
+    "SELECT content, uuid FROM blob WHERE rid=:rid AND size>=0");
   db_bind_int(&q, ":rid", rid);
   if( db_step(&q)==SQLITE_ROW ){
-    db_ephemeral_blob(&q, 0, pBlob);
-    blob_uncompress(pBlob, pBlob);
-    rc = 1;
+    if( db_column_type(&q, 0)!=SQLITE_NULL ){
+      db_ephemeral_blob(&q, 0, pBlob);
+      rc = 1;
+    }else{
+      rc = packfile_get(rid, db_column_text(&q, 1), pBlob);
+    }
+    if( rc ) blob_uncompress(pBlob, pBlob);
   }
   db_reset(&q);
   return rc;
@@ -308,6 +336,10 @@ int content_get(int rid, Blob *pBlob){
     free(a);
     if( !rc ) blob_reset(pBlob);
   }
+  if( rc==0 && shallow_fetch_missing(rid) ){
+    /* File content left out of a blobless clone was fetched */
+    return content_get(rid, pBlob);
+  }
   if( rc==0 ){
     bag_insert(&contentCache.missing, rid);
   }else{
@@ -360,7 +392,7 @@ void test_content_rawget_cmd(void){
   db_must_be_within_tree();
   rid = name_to_rid(g.argv[2]);
   blob_zero(&content);
-  db_blob(&content, "SELECT content FROM blob WHERE rid=%d", rid);
+  content_raw_get(rid, &content);
   blob_uncompress(&content, &content);
   blob_write_to_file(&content, zFile);
 }
@@ -518,6 +550,7 @@ int content_put_ex(
   Blob hash;
   int markAsUnclustered = 0;
   int isDephantomize = 0;
+  int isPacked;             /* Store the content in a pack file */
 
   assert( g.repositoryOpen );
   assert( pBlob!=0 );
@@ -576,15 +609,20 @@ int content_put_ex(
   if( nBlob ){
     cmpr = pBlob[0];
   }else{
-    blob_compress(pBlob, &cmpr);
+    cmprdict_compress(pBlob, &cmpr);
   }
+  isPacked = packfile_wanted(blob_size(&cmpr));
   if( rid>0 ){
     /* We are just adding data to a phantom */
     db_prepare(&s1,
       "UPDATE blob SET rcvid=%d, size=%d, content=:data WHERE rid=%d",
        g.rcvid, size, rid
     );
-    db_bind_blob(&s1, ":data", &cmpr);
+    if( isPacked ){
+      db_bind_null(&s1, ":data");
+    }else{
+      db_bind_blob(&s1, ":data", &cmpr);
+    }
     db_exec(&s1);
     db_multi_exec("DELETE FROM phantom WHERE rid=%d", rid);
     if( srcId==0 || content_is_available(srcId) ){
@@ -598,13 +636,18 @@ int content_put_ex(
       "VALUES(%d,%d,'%q',:data)",
        g.rcvid, size, blob_str(&hash)
     );
-    db_bind_blob(&s1, ":data", &cmpr);
+    if( isPacked ){
+      db_bind_null(&s1, ":data");
+    }else{
+      db_bind_blob(&s1, ":data", &cmpr);
+    }
     db_exec(&s1);
     rid = db_last_insert_rowid();
     if( !pBlob ){
       db_multi_exec("INSERT OR IGNORE INTO phantom VALUES(%d)", rid);
     }
   }
+  packfile_set(rid, blob_str(&hash), isPacked ? &cmpr : 0);
   if( g.markPrivate || isPrivate ){
     db_multi_exec("INSERT OR IGNORE INTO private VALUES(%d)", rid);
     markAsUnclustered = 0;
@@ -727,12 +770,19 @@ void content_undelta(int rid){
     Blob x;
     if( content_get(rid, &x) ){
       Stmt s;
+      int isPacked;
       db_prepare(&s, "UPDATE blob SET content=:c, size=%d WHERE rid=%d",
                      blob_size(&x), rid);
-      blob_compress(&x, &x);
-      db_bind_blob(&s, ":c", &x);
+      cmprdict_compress(&x, &x);
+      isPacked = packfile_wanted(blob_size(&x));
+      if( isPacked ){
+        db_bind_null(&s, ":c");
+      }else{
+        db_bind_blob(&s, ":c", &x);
+      }
       db_exec(&s);
       db_finalize(&s);
+      packfile_set(rid, 0, isPacked ? &x : 0);
       blob_reset(&x);
       db_multi_exec("DELETE FROM delta WHERE rid=%d", rid);
     }
@@ -863,6 +913,7 @@ int content_deltify(int rid, int *aSrc, int nSrc, int force){
     int srcid = aSrc[i];
     if( srcid==rid ) continue;
     if( content_is_private(srcid) && !content_is_private(rid) ) continue;
+    if( !content_is_available(srcid) ) continue;
 
     /* Compute all ancestors of srcid and make sure rid is not one of them.
     ** If rid is an ancestor of srcid, then making rid a decendent of srcid
@@ -901,14 +952,22 @@ int content_deltify(int rid, int *aSrc, int nSrc, int force){
   ** make that candidate the new parent now */
   if( bestSrc>0 ){
     Stmt s1, s2;  /* Statements used to create the delta */
-    blob_compress(&bestDelta, &bestDelta);
+    int isPacked;
+    cmprdict_compress(&bestDelta, &bestDelta);
+    isPacked = packfile_wanted(blob_size(&bestDelta));
     db_prepare(&s1, "UPDATE blob SET content=:data WHERE rid=%d", rid);
     db_prepare(&s2, "REPLACE INTO delta(rid,srcid)VALUES(%d,%d)", rid, bestSrc);
-    db_bind_blob(&s1, ":data", &bestDelta);
+    if( isPacked ){
+      db_bind_null(&s1, ":data");
+    }else{
+      db_bind_blob(&s1, ":data", &bestDelta);
+    }
     db_begin_transaction();
     rc = db_int(0, "SELECT octet_length(content) FROM blob WHERE rid=%d", rid);
+    if( rc==0 ) rc = packfile_size(rid);
     db_exec(&s1);
     db_exec(&s2);
+    packfile_set(rid, 0, isPacked ? &bestDelta : 0);
     db_end_transaction(0);
     db_finalize(&s1);
     db_finalize(&s2);
@@ -1074,6 +1133,7 @@ void test_integrity(void){
   db_finalize(&q);
   fossil_print("%d non-phantom blobs (out of %d total) checked:  %d errors\n",
                n2, n1, nErr);
+  nErr += packfile_check();
   if( bParse ){
     static const char *const azType[] = { 0, "manifest", "cluster",
         "control", "wiki", "ticket", "attachment", "event" };
@@ -1065,8 +1065,9 @@ int db_multi_exec(const char *zSql, ...){
   Blob sql;
   int rc;
   va_list ap;
+  char zBuf[1000];
 
-  blob_init(&sql, 0, 0);
+  blob_init_buffer(&sql, zBuf, sizeof(zBuf));
   va_start(ap, zSql);
   blob_vappendf(&sql, zSql, ap);
   va_end(ap);
@@ -2942,10 +2943,19 @@ void db_close(int reportErrors){
     sqlite3_status(SQLITE_STATUS_PAGECACHE_OVERFLOW, &cur, &hiwtr, 0);
     fprintf(stderr, "-- PCACHE_OVFLOW          %10d %10d\n", cur, hiwtr);
     fprintf(stderr, "-- prepared statements    %10d\n", db.nPrepare);
+    {
+      sqlite3_int64 nByte, nAlloc, nChunk;
+      fossil_arena_stats(&nByte, &nAlloc, &nChunk);
+      fprintf(stderr, "-- ARENA_BYTES            %10lld %10lld\n",
+              nByte, nChunk);
+      fprintf(stderr, "-- ARENA_ALLOCS           %10lld\n", nAlloc);
+    }
   }
   while( db.pAllStmt ){
     db_finalize(db.pAllStmt);
   }
+  packfile_close();
+  cmprdict_close();
   if( db.nBegin ){
     if( reportErrors ){
       fossil_warning("Transaction started at %s:%d never commits",
@@ -3126,6 +3136,7 @@ void db_initial_setup(
   db_set("content-schema", CONTENT_SCHEMA, 0);
   db_set("aux-schema", AUX_SCHEMA_MAX, 0);
   db_set("rebuilt", get_version(), 0);
+  rebuild_derived_set_current();
   db_set("admin-log", "1", 0);
   db_set("access-log", "1", 0);
   db_multi_exec(
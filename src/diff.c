@@ -3401,6 +3401,7 @@ static void annotate_file(
   int cnt = 0;           /* Number of versions analyzed */
   int iLimit;            /* Maximum number of versions to analyze */
   sqlite3_int64 mxTime;  /* Halt at this time if not already complete */
+  char *zFiles;          /* Query for the versions to be analyzed */
 
   memset(p, 0, sizeof(*p));
 
@@ -3446,6 +3447,15 @@ static void annotate_file(
   if( fnid==0 ){
     fossil_fatal("no such file: %Q", zFilename);
   }
+  zFiles = mprintf(
+    "SELECT mlink.fid FROM mlink, ancestor"
+    " WHERE mlink.fnid=%d AND ancestor.rid=mlink.mid"
+    "   AND mlink.mid!=mlink.pid AND mlink.fid>0"
+    " ORDER BY ancestor.generation LIMIT %d",
+    fnid, iLimit>0 ? iLimit : -1
+  );
+  shallow_prefetch(zFiles);  /* Versions missing from a blobless clone */
+  fossil_free(zFiles);
 
   db_prepare(&q,
     "SELECT DISTINCT"
@@ -821,6 +821,11 @@ void diff_against_disk(
       fossil_fatal("no such check-in: %s", zFrom);
     }
     load_vfile_from_rid(rid);
+    {
+      char *zFiles = mprintf("SELECT rid FROM vfile WHERE vid=%d", rid);
+      shallow_prefetch(zFiles);
+      fossil_free(zFiles);
+    }
     blob_append_sql(&sql,
       "SELECT v2.pathname, v2.deleted, v2.chnged, v2.rid==0, v1.rid, v1.islink"
       "  FROM vfile v1, vfile v2 "
@@ -650,44 +650,52 @@ int doc_is_embedded_html(Blob *pContent, Blob *pTitle){
 ** Look for a file named zName in the check-in with RID=vid.  Load the content
 ** of that file into pContent and return the RID for the file.  Or return 0
 ** if the file is not found or could not be loaded.
+**
+** Names are resolved through the directory index, which holds several
+** check-ins at once, so that requests for /doc/trunk, /doc/tip and
+** /doc/RELEASE can all be answered without expanding a manifest.  Each
+** request marks vid as recently used, or adds it to the index, in a
+** short write transaction of its own.
 */
 int doc_load_content(int vid, const char *zName, Blob *pContent){
-  int writable;
   int rid;   /* The RID of the file being loaded */
-  if( db_is_protected(PROTECT_READONLY)
-   || !db_is_writeable("repository")
-  ){
-    writable = 0;
-  }else{
-    writable = 1;
-  }
-  if( writable ){
+  rid = dirindex_lookup(vid, zName);
+  if( !db_is_protected(PROTECT_READONLY) && db_is_writeable("repository") ){
     db_end_transaction(0);
     db_begin_write();
+    if( rid>=0 ){
+      dirindex_touch(vid);
+    }else if( dirindex_build(vid) ){
+      rid = dirindex_lookup(vid, zName);
+    }
+    db_end_transaction(0);
+    db_begin_transaction();
   }
-  if( !db_table_exists("repository", "vcache") || !writable ){
+  if( rid<0 ){
+    /* The index cannot be used.  Expand the manifest into a TEMP table
+    ** that lasts for the rest of this process. */
     db_multi_exec(
-      "CREATE %s TABLE IF NOT EXISTS vcache(\n"
+      "CREATE TEMP TABLE IF NOT EXISTS vcache(\n"
       "  vid INTEGER,         -- check-in ID\n"
       "  fname TEXT,          -- filename\n"
       "  rid INTEGER,         -- artifact ID\n"
       "  PRIMARY KEY(vid,fname)\n"
-      ") WITHOUT ROWID", writable ? "" : "TEMPORARY"
-    );
-  }
-  if( !db_exists("SELECT 1 FROM vcache WHERE vid=%d", vid) ){
-    db_multi_exec(
-      "DELETE FROM vcache;\n"
-      "CREATE VIRTUAL TABLE IF NOT EXISTS temp.foci USING files_of_checkin;\n"
-      "INSERT INTO vcache(vid,fname,rid)"
-      "  SELECT checkinID, filename, blob.rid FROM foci, blob"
-      "   WHERE blob.uuid=foci.uuid"
-      "     AND foci.checkinID=%d;",
-      vid
+      ") WITHOUT ROWID"
     );
+    if( !db_exists("SELECT 1 FROM temp.vcache WHERE vid=%d", vid) ){
+      db_multi_exec(
+        "DELETE FROM temp.vcache;\n"
+        "CREATE VIRTUAL TABLE IF NOT EXISTS temp.foci USING files_of_checkin;\n"
+        "INSERT INTO temp.vcache(vid,fname,rid)"
+        "  SELECT checkinID, filename, blob.rid FROM foci, blob"
+        "   WHERE blob.uuid=foci.uuid"
+        "     AND foci.checkinID=%d;",
+        vid
+      );
+    }
+    rid = db_int(0, "SELECT rid FROM temp.vcache"
+                    " WHERE vid=%d AND fname=%Q", vid, zName);
   }
-  rid = db_int(0, "SELECT rid FROM vcache"
-                  " WHERE vid=%d AND fname=%Q", vid, zName);
   if( rid && content_get(rid, pContent)==0 ){
     rid = 0;
   }
@@ -20,6 +20,62 @@
 #include "config.h"
 #include "encode.h"
 
+/*
+** Classes of bytes for HTML escaping.  Zero means the byte is copied
+** through unchanged.  Non-zero values index azHtmlEsc[].
+**
+**    1..5   One of < > & " ' that is replaced by an entity
+**    6      NUL, which ends the input to htmlize()
+**    7      Carriage return, which htmlize_to_blob() turns into a space
+*/
+static const unsigned char aHtmlClass[256] = {
+/*  x0  x1  x2  x3  x4  x5  x6  x7  x8  x9  xa  xb  xc  xd  xe  xf  */
+     6,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  7,  0,  0, /* 0x */
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, /* 1x */
+     0,  0,  4,  0,  0,  0,  3,  5,  0,  0,  0,  0,  0,  0,  0,  0, /* 2x */
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  1,  0,  2,  0, /* 3x */
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, /* 4x */
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, /* 5x */
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, /* 6x */
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, /* 7x */
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, /* 8x */
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, /* 9x */
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, /* ax */
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, /* bx */
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, /* cx */
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, /* dx */
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, /* ex */
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, /* fx */
+};
+static const char *const azHtmlEsc[] = {
+  "", "&lt;", "&gt;", "&amp;", "&quot;", "&#39;", "", " "
+};
+static const unsigned char anHtmlEsc[] = { 0, 4, 4, 5, 6, 5, 0, 1 };
+
+/*
+** Return the index of the first byte in z[i..n-1] whose class in
+** aClass[] is non-zero, or n if there is no such byte.  Text to be
+** escaped is mostly ordinary characters, so the loop is unrolled to
+** test four bytes per iteration and the caller copies each clean span
+** with a single memcpy().
+*/
+static int encode_span(
+  const unsigned char *aClass,
+  const unsigned char *z,
+  int i,
+  int n
+){
+  while( i+4<=n ){
+    if( aClass[z[i]] ) return i;
+    if( aClass[z[i+1]] ) return i+1;
+    if( aClass[z[i+2]] ) return i+2;
+    if( aClass[z[i+3]] ) return i+3;
+    i += 4;
+  }
+  while( i<n && aClass[z[i]]==0 ) i++;
+  return i;
+}
+
 /*
 ** Make the given string safe for HTML by converting every "<" into "&lt;",
 ** every ">" into "&gt;" and every "&" into "&amp;".  Return a pointer
@@ -29,122 +85,138 @@
 ** to markup.
 */
 char *htmlize(const char *z, int n){
-  unsigned char c;
-  int i = 0;
-  int count = 0;
-  unsigned char *zOut;
   const unsigned char *zIn = (const unsigned char*)z;
+  char *zOut;
+  int i, j, e;
+  int count = 0;
 
   if( n<0 ) n = strlen(z);
-  while( i<n ){
-    switch( zIn[i] ){
-      case '<':   count += 3;       break;
-      case '>':   count += 3;       break;
-      case '&':   count += 4;       break;
-      case '"':   count += 5;       break;
-      case '\'':  count += 4;       break;
-      case 0:     n = i;            break;
-    }
-    i++;
+  for(i=encode_span(aHtmlClass, zIn, 0, n); i<n;
+      i=encode_span(aHtmlClass, zIn, i+1, n)){
+    e = aHtmlClass[zIn[i]];
+    if( e==6 ){ n = i; break; }
+    if( e<6 ) count += anHtmlEsc[e] - 1;
   }
-  i = 0;
   zOut = fossil_malloc( count+n+1 );
   if( count==0 ){
     memcpy(zOut, zIn, n);
     zOut[n] = 0;
-    return (char*)zOut;
-  }
-  while( n-->0 ){
-    c = *(zIn++);
-    switch( c ){
-      case '<':
-        zOut[i++] = '&';
-        zOut[i++] = 'l';
-        zOut[i++] = 't';
-        zOut[i++] = ';';
-        break;
-      case '>':
-        zOut[i++] = '&';
-        zOut[i++] = 'g';
-        zOut[i++] = 't';
-        zOut[i++] = ';';
-        break;
-      case '&':
-        zOut[i++] = '&';
-        zOut[i++] = 'a';
-        zOut[i++] = 'm';
-        zOut[i++] = 'p';
-        zOut[i++] = ';';
-        break;
-      case '"':
-        zOut[i++] = '&';
-        zOut[i++] = 'q';
-        zOut[i++] = 'u';
-        zOut[i++] = 'o';
-        zOut[i++] = 't';
-        zOut[i++] = ';';
-        break;
-      case '\'':
-        zOut[i++] = '&';
-        zOut[i++] = '#';
-        zOut[i++] = '3';
-        zOut[i++] = '9';
-        zOut[i++] = ';';
-        break;
-      default:
-        zOut[i++] = c;
-        break;
+    return zOut;
+  }
+  for(i=j=0; i<n; i++){
+    int k = encode_span(aHtmlClass, zIn, i, n);
+    if( k>i ){
+      memcpy(zOut+j, zIn+i, k-i);
+      j += k-i;
+      i = k;
+      if( i>=n ) break;
+    }
+    e = aHtmlClass[zIn[i]];
+    if( e<6 ){
+      memcpy(zOut+j, azHtmlEsc[e], anHtmlEsc[e]);
+      j += anHtmlEsc[e];
+    }else{
+      zOut[j++] = zIn[i];
     }
   }
-  zOut[i] = 0;
-  return (char*)zOut;
+  zOut[j] = 0;
+  return zOut;
+}
+
+/*
+** Append the HTML-escaped form of the first n bytes of z to a Blob.
+** The output is the same as htmlize(): input stops at the first NUL
+** and n<0 means use the whole string.  Clean spans are appended in
+** bulk with no intermediate allocation.
+*/
+void htmlize_append(Blob *p, const char *z, int n){
+  const unsigned char *zIn = (const unsigned char*)z;
+  int i, j, e;
+  if( n<0 ) n = strlen(z);
+  blob_reserve_extra(p, n);
+  i = j = 0;
+  while( (i = encode_span(aHtmlClass, zIn, i, n))<n ){
+    e = aHtmlClass[zIn[i]];
+    if( e==6 ){ n = i; break; }
+    if( e<6 ){
+      if( j<i ) blob_append(p, z+j, i-j);
+      blob_append(p, azHtmlEsc[e], anHtmlEsc[e]);
+      j = i+1;
+    }
+    i++;
+  }
+  if( j<n ) blob_append(p, z+j, n-j);
 }
 
 /*
 ** Append HTML-escaped text to a Blob.
+**
+** Unlike htmlize_append(), NUL bytes are passed through and carriage
+** returns are changed into spaces.  This is used for diff output.
 */
 void htmlize_to_blob(Blob *p, const char *zIn, int n){
-  int c, i, j;
+  const unsigned char *z = (const unsigned char*)zIn;
+  int i, j, e;
   if( n<0 ) n = strlen(zIn);
-  for(i=j=0; i<n; i++){
-    c = zIn[i];
-    switch( c ){
-      case '<':
-        if( j<i ) blob_append(p, zIn+j, i-j);
-        blob_append(p, "&lt;", 4);
-        j = i+1;
-        break;
-      case '>':
-        if( j<i ) blob_append(p, zIn+j, i-j);
-        blob_append(p, "&gt;", 4);
-        j = i+1;
-        break;
-      case '&':
-        if( j<i ) blob_append(p, zIn+j, i-j);
-        blob_append(p, "&amp;", 5);
-        j = i+1;
-        break;
-      case '"':
-        if( j<i ) blob_append(p, zIn+j, i-j);
-        blob_append(p, "&quot;", 6);
-        j = i+1;
-        break;
-      case '\'':
-        if( j<i ) blob_append(p, zIn+j, i-j);
-        blob_append(p, "&#39;", 5);
-        j = i+1;
-        break;
-      case '\r':
-        if( j<i ) blob_append(p, zIn+j, i-j);
-        blob_append(p, " ", 1);
-        j = i+1;
-        break;
+  i = j = 0;
+  while( (i = encode_span(aHtmlClass, z, i, n))<n ){
+    e = aHtmlClass[z[i]];
+    if( e!=6 ){
+      if( j<i ) blob_append(p, zIn+j, i-j);
+      blob_append(p, azHtmlEsc[e], anHtmlEsc[e]);
+      j = i+1;
     }
+    i++;
   }
-  if( j<i ) blob_append(p, zIn+j, i-j);
+  if( j<n ) blob_append(p, zIn+j, n-j);
 }
 
 
+/*
+** Classes of bytes for HTTP encoding:
+**
+**    0      Always safe:  alphanumerics and . $ ~ - _
+**    1      "/" and ":", safe unless the slash is to be encoded
+**    2      Space, encoded as "+"
+**    3      Encoded as "%HH"
+**    4      NUL, which ends the input
+*/
+static const unsigned char aHttpClass[256] = {
+/*  x0  x1  x2  x3  x4  x5  x6  x7  x8  x9  xa  xb  xc  xd  xe  xf  */
+     4,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3, /* 0x */
+     3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3, /* 1x */
+     2,  3,  3,  3,  0,  3,  3,  3,  3,  3,  3,  3,  3,  0,  0,  1, /* 2x */
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  1,  3,  3,  3,  3,  3, /* 3x */
+     3,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, /* 4x */
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  3,  3,  3,  3,  0, /* 5x */
+     3,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, /* 6x */
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  3,  3,  3,  0,  3, /* 7x */
+     3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3, /* 8x */
+     3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3, /* 9x */
+     3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3, /* ax */
+     3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3, /* bx */
+     3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3, /* cx */
+     3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3, /* dx */
+     3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3, /* ex */
+     3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3, /* fx */
+};
+
+/*
+** Write the HTTP encoding of the single byte c into zOut[] and return
+** the number of bytes written.  Bytes of class 1 are only passed here
+** when the slash is being encoded.
+*/
+static int EncodeHttpByte(char *zOut, unsigned char c){
+  if( c==' ' ){
+    zOut[0] = '+';
+    return 1;
+  }
+  zOut[0] = '%';
+  zOut[1] = "0123456789ABCDEF"[(c>>4)&0xf];
+  zOut[2] = "0123456789ABCDEF"[c&0xf];
+  return 3;
+}
+
 /*
 ** Encode a string for HTTP.  This means converting lots of
 ** characters into the "%HH" where H is a hex digit.  It also
@@ -152,45 +224,63 @@ void htmlize_to_blob(Blob *p, const char *zIn, int n){
 **
 ** This is the opposite of DeHttpizeString below.
 */
-static char *EncodeHttp(const char *zIn, int n, int encodeSlash){
-  int c;
-  int i = 0;
+static char *EncodeHttp(const char *z, int n, int encodeSlash){
+  const unsigned char *zIn = (const unsigned char*)z;
+  int i, j, e;
   int count = 0;
   char *zOut;
-# define IsSafeChar(X)  \
-     (fossil_isalnum(X) || (X)=='.' || (X)=='$' \
-      || (X)=='~' || (X)=='-' || (X)=='_' \
-      || (!encodeSlash && ((X)=='/' || (X)==':')))
 
-  if( zIn==0 ) return 0;
-  if( n<0 ) n = strlen(zIn);
-  while( i<n && (c = zIn[i])!=0 ){
-    if( IsSafeChar(c) || c==' ' ){
-      count++;
-    }else{
-      count += 3;
-    }
-    i++;
+  if( z==0 ) return 0;
+  if( n<0 ) n = strlen(z);
+  for(i=encode_span(aHttpClass, zIn, 0, n); i<n;
+      i=encode_span(aHttpClass, zIn, i+1, n)){
+    e = aHttpClass[zIn[i]];
+    if( e==4 ){ n = i; break; }
+    if( e==3 || (e==1 && encodeSlash) ) count += 2;
   }
-  i = 0;
-  zOut = fossil_malloc( count+1 );
-  while( n-->0 && (c = *zIn)!=0 ){
-    if( IsSafeChar(c) ){
-      zOut[i++] = c;
-    }else if( c==' ' ){
-      zOut[i++] = '+';
+  zOut = fossil_malloc( count+n+1 );
+  for(i=j=0; i<n; i++){
+    int k = encode_span(aHttpClass, zIn, i, n);
+    if( k>i ){
+      memcpy(zOut+j, zIn+i, k-i);
+      j += k-i;
+      i = k;
+      if( i>=n ) break;
+    }
+    if( aHttpClass[zIn[i]]==1 && !encodeSlash ){
+      zOut[j++] = zIn[i];
     }else{
-      zOut[i++] = '%';
-      zOut[i++] = "0123456789ABCDEF"[(c>>4)&0xf];
-      zOut[i++] = "0123456789ABCDEF"[c&0xf];
+      j += EncodeHttpByte(zOut+j, zIn[i]);
     }
-    zIn++;
   }
-  zOut[i] = 0;
-#undef IsSafeChar
+  zOut[j] = 0;
   return zOut;
 }
 
+/*
+** Append the HTTP encoding of the first n bytes of z to a Blob, with the
+** same output as EncodeHttp().
+*/
+static void EncodeHttpToBlob(Blob *p, const char *z, int n, int encodeSlash){
+  const unsigned char *zIn = (const unsigned char*)z;
+  char zEsc[3];
+  int i, j, e;
+  if( n<0 ) n = strlen(z);
+  blob_reserve_extra(p, n);
+  i = j = 0;
+  while( (i = encode_span(aHttpClass, zIn, i, n))<n ){
+    e = aHttpClass[zIn[i]];
+    if( e==4 ){ n = i; break; }
+    if( e!=1 || encodeSlash ){
+      if( j<i ) blob_append(p, z+j, i-j);
+      blob_append(p, zEsc, EncodeHttpByte(zEsc, zIn[i]));
+      j = i+1;
+    }
+    i++;
+  }
+  if( j<n ) blob_append(p, z+j, n-j);
+}
+
 /*
 ** Convert the input string into a form that is suitable for use as
 ** a token in the HTTP protocol.  Spaces are encoded as '+' and special
@@ -213,6 +303,17 @@ char *urlize(const char *z, int n){
   return EncodeHttp(z, n, 0);
 }
 
+/*
+** Append the httpize() or urlize() encoding of z to a Blob without
+** making an intermediate copy.
+*/
+void httpize_append(Blob *p, const char *z, int n){
+  EncodeHttpToBlob(p, z, n, 1);
+}
+void urlize_append(Blob *p, const char *z, int n){
+  EncodeHttpToBlob(p, z, n, 0);
+}
+
 /*
 ** If input string does not contain quotes (neither ' nor ")
 ** then return the argument itself. Otherwise return a newly allocated
@@ -842,3 +943,85 @@ void test_obscure_cmd(void){
     free(z);
   }
 }
+
+/*
+** COMMAND: test-encode-speed
+**
+** Usage: %fossil test-encode-speed ?OPTIONS? ?FILE?
+**
+** Time the HTML and URL escaping used by the %h, %t and %T printf
+** conversions and by htmlize().  The input is FILE, or synthetic text
+** resembling source code if no file is named.  The output of each
+** printf conversion is checked against the corresponding function.
+**
+** Options:
+**    --rounds N      Encode the input N times.  Default: 100
+*/
+void test_encode_speed_cmd(void){
+  const char *z;
+  int nRound = 100;
+  int i, iTimer;
+  Blob in, out;
+  char *zIn, *zRef;
+  static const struct {
+    const char *zName;            /* Name of the test */
+    char cConv;                   /* printf conversion, or 0 */
+    char *(*xEncode)(const char*,int);  /* Equivalent function */
+  } aTest[] = {
+    { "htmlize()", 0,   htmlize },
+    { "%h",        'h', htmlize },
+    { "%t",        't', httpize },
+    { "%T",        'T', urlize  },
+  };
+
+  if( (z = find_option("rounds",0,1))!=0 ) nRound = atoi(z);
+  verify_all_options();
+  if( g.argc==3 ){
+    blob_read_from_file(&in, g.argv[2], ExtFILE);
+  }else if( g.argc==2 ){
+    blob_zero(&in);
+    for(i=0; i<2000; i++){
+      blob_appendf(&in,
+          "  if( p->a[%d]<n && zName[0]!='\"' ){ x = y & %d; }\n", i, i);
+      blob_append(&in, "  /* ordinary comment text without any markup */\n",-1);
+    }
+  }else{
+    usage("?OPTIONS? ?FILE?");
+  }
+  zIn = blob_str(&in);
+  iTimer = fossil_timer_start();
+  for(i=0; i<count(aTest); i++){
+    int j;
+    sqlite3_uint64 nUs;
+    i64 nOut = 0;
+    zRef = aTest[i].xEncode(zIn, -1);
+    fossil_timer_reset(iTimer);
+    for(j=0; j<nRound; j++){
+      if( aTest[i].cConv ){
+        blob_init(&out, 0, 0);
+        switch( aTest[i].cConv ){
+          case 'h':  blob_appendf(&out, "%h", zIn);  break;
+          case 't':  blob_appendf(&out, "%t", zIn);  break;
+          case 'T':  blob_appendf(&out, "%T", zIn);  break;
+        }
+        nOut += blob_size(&out);
+        if( j==0 && fossil_strcmp(blob_str(&out), zRef)!=0 ){
+          fossil_fatal("%s output differs from the reference",
+                       aTest[i].zName);
+        }
+        blob_reset(&out);
+      }else{
+        char *zOut = aTest[i].xEncode(zIn, -1);
+        nOut += strlen(zOut);
+        fossil_free(zOut);
+      }
+    }
+    nUs = fossil_timer_reset(iTimer);
+    fossil_print("%-10s %10lld bytes out %10.3f ms %8.1f MB/s\n",
+                 aTest[i].zName, nOut, nUs/1000.0,
+                 nUs ? (double)blob_size(&in)*nRound/nUs : 0.0);
+    fossil_free(zRef);
+  }
+  fossil_timer_stop(iTimer);
+  blob_reset(&in);
+}
@@ -47,9 +47,14 @@ struct ForumPost {
   ForumPost *pNext;      /* Next in chronological order */
   ForumPost *pPrev;      /* Previous in chronological order */
   ForumPost *pDisplay;   /* Next in display order */
+  ForumPost *pParent;    /* Displayed beneath this post */
+  ForumPost *pReply;     /* First reply displayed beneath this post */
+  ForumPost *pSibling;   /* Next reply displayed beneath pParent */
+  int iSeq;              /* Position in chronological order */
   int nEdit;             /* Number of edits to this post */
   int nIndent;           /* Number of levels of indentation for this post */
   int iClosed;           /* See forum_rid_is_closed() */
+  int isPrivate;         /* True if awaiting moderation */
 };
 
 /*
@@ -60,6 +65,8 @@ struct ForumThread {
   ForumPost *pLast;      /* Last post in chronological order */
   ForumPost *pDisplay;   /* Entries in display order */
   ForumPost *pTail;      /* Last on the display list */
+  ForumPost **apByFpid;  /* All posts, sorted by fpid */
+  int nPost;             /* Number of entries in apByFpid[] */
   int mxIndent;          /* Maximum indentation level */
 };
 #endif /* INTERFACE */
@@ -312,23 +319,36 @@ static void forumthread_delete(ForumThread *pThread){
     fossil_free(pPost->zDisplayName);
     fossil_free(pPost);
   }
+  fossil_free(pThread->apByFpid);
   fossil_free(pThread);
 }
 
 /*
-** Search a ForumPost list forwards looking for the post with fpid
+** Comparison function for sorting ForumPost pointers by fpid.
 */
-static ForumPost *forumpost_forward(ForumPost *p, int fpid){
-  while( p && p->fpid!=fpid ) p = p->pNext;
-  return p;
+static int forumpost_cmp_fpid(const void *a, const void *b){
+  const ForumPost *pA = *(const ForumPost**)a;
+  const ForumPost *pB = *(const ForumPost**)b;
+  return pA->fpid<pB->fpid ? -1 : pA->fpid>pB->fpid;
 }
 
 /*
-** Search backwards for a ForumPost
+** Return the post of pThread with the given fpid, or NULL if there
+** is no such post.
 */
-static ForumPost *forumpost_backward(ForumPost *p, int fpid){
-  while( p && p->fpid!=fpid ) p = p->pPrev;
-  return p;
+static ForumPost *forumthread_find(ForumThread *pThread, int fpid){
+  int lo = 0, hi = pThread->nPost-1;
+  while( lo<=hi ){
+    int mid = (lo+hi)/2;
+    ForumPost *p = pThread->apByFpid[mid];
+    if( p->fpid==fpid ) return p;
+    if( p->fpid<fpid ){
+      lo = mid+1;
+    }else{
+      hi = mid-1;
+    }
+  }
+  return 0;
 }
 
 /*
@@ -344,65 +364,117 @@ static void forumpost_add_to_display(ForumThread *pThread, ForumPost *p){
 }
 
 /*
-** Extend the display list for pThread by adding all entries that
-** reference fpid.  The first such post will be no earlier then
-** post "p".
+** Extend the display list for pThread by adding all replies to pBase,
+** each followed by its own replies.
 */
 static void forumthread_display_order(
   ForumThread *pThread,    /* The complete thread */
   ForumPost *pBase         /* Add replies to this post */
 ){
   ForumPost *p;
-  ForumPost *pPrev = 0;
-  ForumPost *pBaseIrt;
-  for(p=pBase->pNext; p; p=p->pNext){
-    if( !p->pEditPrev && p->pIrt ){
-      pBaseIrt = p->pIrt->pEditHead ? p->pIrt->pEditHead : p->pIrt;
-      if( pBaseIrt==pBase ){
-        if( pPrev ){
-          pPrev->nIndent = pBase->nIndent + 1;
-          forumpost_add_to_display(pThread, pPrev);
-          forumthread_display_order(pThread, pPrev);
-        }
-        pPrev = p;
-      }
+  for(p=pBase->pReply; p; p=p->pSibling){
+    p->nIndent = pBase->nIndent + 1;
+    if( p->nIndent>pThread->mxIndent ) pThread->mxIndent = p->nIndent;
+    forumpost_add_to_display(pThread, p);
+    forumthread_display_order(pThread, p);
+  }
+}
+
+/*
+** Compute the hierarchical display order of pThread.  Each reply is
+** shown beneath the original version of the post it replies to, and
+** replies to the same post are shown in chronological order.
+*/
+static void forumthread_compute_hierarchy(ForumThread *pThread){
+  ForumPost *p, *pBase;
+
+  /* Walk backwards so that each list of replies ends up in
+  ** chronological order. */
+  for(p=pThread->pLast; p; p=p->pPrev){
+    if( p->pEditPrev || p->pIrt==0 ) continue;
+    pBase = p->pIrt->pEditHead ? p->pIrt->pEditHead : p->pIrt;
+    if( pBase->iSeq>=p->iSeq ) continue;
+    p->pParent = pBase;
+    p->pSibling = pBase->pReply;
+    pBase->pReply = p;
+  }
+  p = pThread->pFirst;
+  p->nIndent = 1;
+  pThread->mxIndent = 1;
+  forumpost_add_to_display(pThread, p);
+  forumthread_display_order(pThread, p);
+}
+
+/*
+** Load the display order of pThread from the forumtree table.  Return
+** false, leaving the display list empty, if forumtree does not describe
+** the posts of this thread.
+*/
+static int forumthread_read_hierarchy(ForumThread *pThread, int froot){
+  Stmt q;
+  ForumPost *p;
+  int rc = 1;
+  if( !db_table_exists("repository","forumtree") ) return 0;
+  db_prepare(&q,
+    "SELECT fpid, fparent, fdepth FROM forumtree"
+    " WHERE froot=%d ORDER BY fkey", froot
+  );
+  while( rc && db_step(&q)==SQLITE_ROW ){
+    p = forumthread_find(pThread, db_column_int(&q,0));
+    if( p==0 || p->pEditPrev ){
+      rc = 0;
+    }else{
+      p->pParent = forumthread_find(pThread, db_column_int(&q,1));
+      p->nIndent = db_column_int(&q,2);
+      if( p->nIndent>pThread->mxIndent ) pThread->mxIndent = p->nIndent;
+      forumpost_add_to_display(pThread, p);
     }
   }
-  if( pPrev ){
-    pPrev->nIndent = pBase->nIndent + 1;
-    if( pPrev->nIndent>pThread->mxIndent ) pThread->mxIndent = pPrev->nIndent;
-    forumpost_add_to_display(pThread, pPrev);
-    forumthread_display_order(pThread, pPrev);
+  db_finalize(&q);
+  if( pThread->pDisplay!=pThread->pFirst ) rc = 0;
+  if( !rc ){
+    for(p=pThread->pFirst; p; p=p->pNext){
+      p->pDisplay = 0;
+      p->pParent = 0;
+      p->nIndent = 0;
+    }
+    pThread->pDisplay = pThread->pTail = 0;
+    pThread->mxIndent = 0;
   }
+  return rc;
 }
 
 /*
-** Construct a ForumThread object given the root record id.
+** Load every post of the thread rooted at froot, linking each post to
+** the post it replies to and to its previous and next edits.
 */
-static ForumThread *forumthread_create(int froot, int computeHierarchy){
+static ForumThread *forumthread_load(int froot){
   ForumThread *pThread;
   ForumPost *pPost;
   ForumPost *p;
   Stmt q;
   int sid = 1;
-  int firt, fprev;
+  int i;
+  int nAlloc = 0;
+  int *aLink = 0;          /* firt and fprev of each post */
+  ForumPost **apChron = 0; /* All posts in chronological order */
   pThread = fossil_malloc( sizeof(*pThread) );
   memset(pThread, 0, sizeof(*pThread));
   db_prepare(&q,
-     "SELECT fpid, firt, fprev, (SELECT uuid FROM blob WHERE rid=fpid), fmtime"
+     "SELECT fpid, firt, fprev, (SELECT uuid FROM blob WHERE rid=fpid), fmtime,"
+     "       fpid IN private"
      "  FROM forumpost"
-     " WHERE froot=%d ORDER BY fmtime",
+     " WHERE froot=%d ORDER BY fmtime, fpid",
      froot
   );
   while( db_step(&q)==SQLITE_ROW ){
     pPost = fossil_malloc( sizeof(*pPost) );
     memset(pPost, 0, sizeof(*pPost));
     pPost->fpid = db_column_int(&q, 0);
-    firt = db_column_int(&q, 1);
-    fprev = db_column_int(&q, 2);
     pPost->zUuid = fossil_strdup(db_column_text(&q,3));
     pPost->rDate = db_column_double(&q,4);
-    if( !fprev ) pPost->sid = sid++;
+    pPost->isPrivate = db_column_int(&q,5);
+    pPost->iSeq = pThread->nPost;
     pPost->pPrev = pThread->pLast;
     pPost->pNext = 0;
     if( pThread->pLast==0 ){
@@ -411,22 +483,38 @@ static ForumThread *forumthread_create(int froot, int computeHierarchy){
       pThread->pLast->pNext = pPost;
     }
     pThread->pLast = pPost;
-
-    /* Find the in-reply-to post.  Default to the topic post if the replied-to
-    ** post cannot be found. */
+    if( pThread->nPost>=nAlloc ){
+      nAlloc = nAlloc*2 + 20;
+      apChron = fossil_realloc(apChron, sizeof(apChron[0])*nAlloc);
+      aLink = fossil_realloc(aLink, sizeof(aLink[0])*2*nAlloc);
+    }
+    apChron[pThread->nPost] = pPost;
+    aLink[pThread->nPost*2] = db_column_int(&q, 1);
+    aLink[pThread->nPost*2+1] = db_column_int(&q, 2);
+    pThread->nPost++;
+  }
+  db_finalize(&q);
+  if( pThread->nPost==0 ) return pThread;
+  pThread->apByFpid = fossil_malloc(sizeof(apChron[0])*pThread->nPost);
+  memcpy(pThread->apByFpid, apChron, sizeof(apChron[0])*pThread->nPost);
+  qsort(pThread->apByFpid, pThread->nPost, sizeof(apChron[0]),
+        forumpost_cmp_fpid);
+
+  for(i=0; i<pThread->nPost; i++){
+    int firt = aLink[i*2];
+    int fprev = aLink[i*2+1];
+    pPost = apChron[i];
+
+    /* Find the in-reply-to post.  Default to the topic post if the
+    ** replied-to post cannot be found among the earlier posts. */
     if( firt ){
-      pPost->pIrt = pThread->pFirst;
-      for(p=pThread->pFirst; p; p=p->pNext){
-        if( p->fpid==firt ){
-          pPost->pIrt = p;
-          break;
-        }
-      }
+      p = forumthread_find(pThread, firt);
+      pPost->pIrt = p && p->iSeq<i ? p : pThread->pFirst;
     }
 
     /* Maintain the linked list of post edits. */
-    if( fprev ){
-      p = forumpost_backward(pPost->pPrev, fprev);
+    p = fprev ? forumthread_find(pThread, fprev) : 0;
+    if( p && p->iSeq<i ){
       p->pEditNext = pPost;
       pPost->sid = p->sid;
       pPost->rev = p->rev+1;
@@ -437,26 +525,220 @@ static ForumThread *forumthread_create(int froot, int computeHierarchy){
         p->nEdit = pPost->nEdit;
         p->pEditTail = pPost;
       }
+    }else{
+      pPost->sid = sid++;
     }
+  }
+  fossil_free(apChron);
+  fossil_free(aLink);
+  return pThread;
+}
+
+/*
+** Construct a ForumThread object given the root record id.
+*/
+static ForumThread *forumthread_create(int froot, int computeHierarchy){
+  ForumThread *pThread;
+  ForumPost *pPost;
+
+  pThread = forumthread_load(froot);
+  for(pPost=pThread->pFirst; pPost; pPost=pPost->pNext){
     pPost->iClosed = forum_rid_is_closed(pPost->pEditHead
                                          ? pPost->pEditHead->fpid
                                          : pPost->fpid, 1);
   }
-  db_finalize(&q);
-
-  if( computeHierarchy ){
-    /* Compute the hierarchical display order */
-    pPost = pThread->pFirst;
-    pPost->nIndent = 1;
-    pThread->mxIndent = 1;
-    forumpost_add_to_display(pThread, pPost);
-    forumthread_display_order(pThread, pPost);
+  if( computeHierarchy && pThread->pFirst
+   && !forumthread_read_hierarchy(pThread, froot)
+  ){
+    forumthread_compute_hierarchy(pThread);
   }
 
   /* Return the result */
   return pThread;
 }
 
+/*
+** Add post fpid of thread froot to the forumtree table, beneath post
+** fparent at indentation level fdepth.  The parent must already be in
+** the table.  Return the number of rows inserted.
+*/
+static int forumtree_insert(int froot, int fpid, int fparent, int fdepth){
+  static Stmt ins;
+  db_static_prepare(&ins,
+    "INSERT OR IGNORE INTO forumtree(fpid,froot,fparent,fkey,fdepth)"
+    " SELECT fpid, :froot, nullif(:fparent,0),"
+    "        coalesce((SELECT fkey FROM forumtree WHERE fpid=:fparent),'')"
+    "          || printf('%%016.8f%%08x',fmtime,fpid), :fdepth"
+    "   FROM forumpost WHERE fpid=:fpid"
+  );
+  db_bind_int(&ins, ":froot", froot);
+  db_bind_int(&ins, ":fpid", fpid);
+  db_bind_int(&ins, ":fparent", fparent);
+  db_bind_int(&ins, ":fdepth", fdepth);
+  db_step(&ins);
+  db_reset(&ins);
+  return db_changes();
+}
+
+/*
+** Bring the forumtree and forumtopic entries for the thread rooted
+** at froot up to date with the forumpost table.
+*/
+void forum_thread_index(int froot){
+  ForumThread *pThread;
+  ForumPost *p;
+  ForumPost *pFirstPub = 0, *pLastPub = 0;
+  int nAll = 0, nPub = 0;
+
+  if( froot==0 || !db_table_exists("repository","forumtopic") ) return;
+  pThread = forumthread_load(froot);
+  db_multi_exec("DELETE FROM forumtree WHERE froot=%d", froot);
+  if( pThread->pFirst==0 ){
+    db_multi_exec("DELETE FROM forumtopic WHERE froot=%d", froot);
+    forumthread_delete(pThread);
+    return;
+  }
+  forumthread_compute_hierarchy(pThread);
+  for(p=pThread->pDisplay; p; p=p->pDisplay){
+    forumtree_insert(froot, p->fpid, p->pParent ? p->pParent->fpid : 0,
+                     p->nIndent);
+  }
+  for(p=pThread->pFirst; p; p=p->pNext){
+    if( p->pEditPrev==0 ) nAll++;
+    if( p->isPrivate ) continue;
+    if( p->pEditPrev==0 ) nPub++;
+    if( pFirstPub==0 ) pFirstPub = p;
+    pLastPub = p;
+  }
+  db_multi_exec(
+    "REPLACE INTO forumtopic(froot,nall,ctall,mtall,lastall,"
+    "                        npub,ctpub,mtpub,lastpub)"
+    " VALUES(%d,%d,%.17g,%.17g,%d,%d,nullif(%.17g,0.0),nullif(%.17g,0.0),"
+    "        nullif(%d,0))",
+    froot, nAll, pThread->pFirst->rDate, pThread->pLast->rDate,
+    pThread->pLast->fpid, nPub,
+    pFirstPub ? pFirstPub->rDate : 0.0, pLastPub ? pLastPub->rDate : 0.0,
+    pLastPub ? pLastPub->fpid : 0
+  );
+  forumthread_delete(pThread);
+}
+
+/*
+** Return true if forum post a comes before post b of the same thread,
+** in the order in which forumthread_load() reads the thread.
+*/
+static int forumpost_precedes(int a, int b){
+  return db_exists(
+    "SELECT 1 FROM forumpost x, forumpost y"
+    " WHERE x.fpid=%d AND y.fpid=%d AND x.froot=y.froot"
+    "   AND (x.fmtime<y.fmtime OR (x.fmtime=y.fmtime AND x.fpid<y.fpid))",
+    a, b
+  );
+}
+
+/*
+** Add the newly crosslinked forum post fpid to the index of its thread.
+** Only the forumtree row of the post and the forumtopic summary of the
+** thread are written.  The whole thread is indexed again instead when
+** the post changes where other posts belong: when it is the thread root,
+** when it is earlier than the root, or when posts that refer to it
+** arrived before it did.
+**
+** Calling this more than once for the same post is harmless.
+*/
+void forum_post_index(int fpid){
+  int froot, fprev, firt, isPub;
+  int isOrig = 0;          /* True if a forumtree row was added */
+  double rDate;
+  Stmt q;
+
+  if( !db_table_exists("repository","forumtopic") ) return;
+  db_prepare(&q,
+    "SELECT froot, fprev, firt, fmtime, fpid NOT IN private"
+    "  FROM forumpost WHERE fpid=%d", fpid
+  );
+  if( db_step(&q)!=SQLITE_ROW ){
+    db_finalize(&q);
+    return;
+  }
+  froot = db_column_int(&q, 0);
+  fprev = db_column_int(&q, 1);
+  firt = db_column_int(&q, 2);
+  rDate = db_column_double(&q, 3);
+  isPub = db_column_int(&q, 4);
+  db_finalize(&q);
+  if( db_exists("SELECT 1 FROM forumtree WHERE fpid=%d", fpid) ){
+    /* Already indexed.  Fall through to the summary, which is only
+    ** changed by posts that it does not yet account for. */
+  }else if( fpid==froot
+         || !forumpost_precedes(froot, fpid)
+         || !db_exists("SELECT 1 FROM forumtopic WHERE froot=%d", froot)
+         || db_exists("SELECT 1 FROM forumpost"
+                      " WHERE froot=%d AND fpid<>%d AND (firt=%d OR fprev=%d)",
+                      froot, fpid, fpid, fpid)
+  ){
+    forum_thread_index(froot);
+    return;
+  }else if( fprev==0 || !forumpost_precedes(fprev, fpid) ){
+    /* A new post, rather than an edit.  It is shown beneath the
+    ** original version of the post it replies to, or beneath the root
+    ** if that post is not known.  A post that replies to nothing is
+    ** not shown at all, which is left for forum_thread_index(). */
+    int fbase, fdepth;
+    if( firt==0 ){
+      forum_thread_index(froot);
+      return;
+    }
+    fbase = forumpost_precedes(firt, fpid) ? firt : froot;
+    while( (fprev = db_int(0, "SELECT fprev FROM forumpost WHERE fpid=%d",
+                           fbase))!=0
+        && forumpost_precedes(fprev, fbase)
+    ){
+      fbase = fprev;
+    }
+    fdepth = db_int(0, "SELECT fdepth FROM forumtree WHERE fpid=%d", fbase);
+    if( fdepth==0 ){
+      forum_thread_index(froot);
+      return;
+    }
+    isOrig = forumtree_insert(froot, fpid, fbase, fdepth+1);
+  }
+  db_prepare(&q,
+    "UPDATE forumtopic SET"
+    "  nall=nall+:orig,"
+    "  lastall=CASE WHEN :t>mtall OR (:t=mtall AND :fpid>lastall)"
+    "               THEN :fpid ELSE lastall END,"
+    "  mtall=max(mtall,:t),"
+    "  npub=npub+(:pub AND :orig),"
+    "  ctpub=CASE WHEN :pub AND (ctpub IS NULL OR :t<ctpub)"
+    "             THEN :t ELSE ctpub END,"
+    "  lastpub=CASE WHEN :pub AND (mtpub IS NULL OR :t>mtpub"
+    "                              OR (:t=mtpub AND :fpid>lastpub))"
+    "               THEN :fpid ELSE lastpub END,"
+    "  mtpub=CASE WHEN :pub AND (mtpub IS NULL OR :t>mtpub)"
+    "             THEN :t ELSE mtpub END"
+    " WHERE froot=%d", froot
+  );
+  db_bind_int(&q, ":orig", isOrig);
+  db_bind_int(&q, ":pub", isPub);
+  db_bind_int(&q, ":fpid", fpid);
+  db_bind_double(&q, ":t", rDate);
+  db_step(&q);
+  db_finalize(&q);
+}
+
+/*
+** Fill the forumtree and forumtopic tables for every forum thread.
+*/
+void forum_thread_index_all(void){
+  Stmt q;
+  db_prepare(&q, "SELECT DISTINCT froot FROM forumpost");
+  while( db_step(&q)==SQLITE_ROW ){
+    forum_thread_index(db_column_int(&q,0));
+  }
+  db_finalize(&q);
+}
+
 /*
 ** List all forum threads to standard output.
 */
@@ -972,7 +1254,7 @@ static void forum_display_thread(
   }
 
   /* Find the selected post, or (depending on parameters) its latest edit. */
-  pSelect = fpid ? forumpost_forward(pThread->pFirst, fpid) : 0;
+  pSelect = fpid ? forumthread_find(pThread, fpid) : 0;
   if( !bHist && mode!=FD_RAW && pSelect && pSelect->pEditTail ){
     pSelect = pSelect->pEditTail;
   }
@@ -1882,6 +2164,28 @@ void forum_setup(void){
   style_finish_page();
 }
 
+/*
+** Return true if the forumtopic table is available, creating and
+** filling it first if need be and if the repository can be written.
+*/
+static int forum_index_ready(void){
+  if( db_table_exists("repository","forumtopic") ) return 1;
+  if( !db_table_exists("repository","forumpost")
+   || db_is_protected(PROTECT_READONLY)
+   || !db_is_writeable("repository")
+  ){
+    return 0;
+  }
+  if( db_transaction_nesting_depth()==0 ){
+    db_begin_write();
+  }else{
+    db_begin_transaction();
+  }
+  schema_forum();
+  db_end_transaction(0);
+  return 1;
+}
+
 /*
 ** WEBPAGE: forummain
 ** WEBPAGE: forum
@@ -1948,7 +2252,27 @@ void forum_main_page(void){
   style_submenu_entry("n","Max:",4,0);
   iOfst = atoi(PD("x","0"));
   iCnt = 0;
-  if( db_table_exists("repository","forumpost") ){
+  if( forum_index_ready() ){
+    const char *zSet = g.perm.ModForum ? "all" : "pub";
+    db_prepare(&q,
+      "SELECT"
+      "  julianday('now') - mt%s,"                            /* 0 */
+      "  mt%s - ct%s,"                                        /* 1 */
+      "  n%s,"                                                /* 2 */
+      "  blob.uuid,"                                          /* 3 */
+      "  substr(event.comment,instr(event.comment,':')+1),"   /* 4 */
+      "  last%s"                                              /* 5 */
+      " FROM forumtopic, blob, event"
+      " WHERE last%s IS NOT NULL"
+      "  AND blob.rid=last%s"
+      "  AND event.objid=last%s"
+      " ORDER BY mt%s DESC LIMIT %d OFFSET %d",
+      zSet/*safe-for-%s*/, zSet/*safe-for-%s*/, zSet/*safe-for-%s*/,
+      zSet/*safe-for-%s*/, zSet/*safe-for-%s*/, zSet/*safe-for-%s*/,
+      zSet/*safe-for-%s*/, zSet/*safe-for-%s*/, zSet/*safe-for-%s*/,
+      iLimit+1, iOfst
+    );
+  }else if( db_table_exists("repository","forumpost") ){
     db_prepare(&q,
       "WITH thread(age,duration,cnt,root,last) AS ("
       "  SELECT"
@@ -1979,6 +2303,8 @@ void forum_main_page(void){
       g.perm.ModForum ? "true" : "fpid NOT IN private" /*safe-for-%s*/,
       iLimit+1, iOfst
     );
+  }
+  if( db_table_exists("repository","forumpost") ){
     while( db_step(&q)==SQLITE_ROW ){
       char *zAge = human_readable_age(db_column_double(&q,0));
       int nMsg = db_column_int(&q, 2);
@@ -101,6 +101,11 @@ int LLVMFuzzerTestOneInput(const uint8_t *aData, size_t nByte){
   }
   blob_reset(&in);
   blob_reset(&out);
+  if( g.interp ){
+    Th_DeleteInterp(g.interp);
+    g.interp = 0;
+  }
+  fossil_arena_reset();
   return 0;
 }
 
@@ -80,6 +80,27 @@ char *glob_expr(const char *zVal, const char *zGlobList){
 }
 
 #if INTERFACE
+/*
+** One entry in the hash table of literal patterns.  The literal part
+** of the pattern is the nLit bytes at zLit.
+*/
+struct GlobLiteral {
+  const char *zLit;    /* Literal text.  NULL for an unused slot */
+  int nLit;            /* Bytes of literal text */
+  int eKind;           /* GLOB_EXACT, GLOB_PREFIX or GLOB_SUFFIX */
+  int iPattern;        /* Index of the first pattern with this literal */
+};
+
+/*
+** A kind and a literal length for which the hash table holds at least
+** one entry.  A string is tested against the hash table once for each
+** of these.
+*/
+struct GlobShape {
+  int eKind;           /* GLOB_EXACT, GLOB_PREFIX or GLOB_SUFFIX */
+  int nLit;            /* Length of the literal.  Unused for GLOB_EXACT */
+};
+
 /*
 ** A Glob object holds a set of patterns read to be matched against
 ** a string.
@@ -87,9 +108,109 @@ char *glob_expr(const char *zVal, const char *zGlobList){
 struct Glob {
   int nPattern;        /* Number of patterns */
   char **azPattern;    /* Array of pointers to patterns */
+  int nOther;          /* Number of entries in aiOther[] */
+  int *aiOther;        /* Patterns that must be tried one by one */
+  int nShape;          /* Number of entries in aShape[] */
+  GlobShape *aShape;   /* Kinds and lengths of literal patterns */
+  unsigned nHash;      /* Number of slots in aHash[].  A power of two */
+  GlobLiteral *aHash;  /* Hash table of literal patterns */
 };
 #endif /* INTERFACE */
 
+/*
+** Patterns that have no wildcards other than a single leading or
+** trailing "*" are matched by hash table lookup rather than one by one.
+*/
+#define GLOB_EXACT   1   /* "abc" */
+#define GLOB_PREFIX  2   /* "abc*" */
+#define GLOB_SUFFIX  3   /* "*abc" */
+
+/*
+** Hash nLit bytes of text at zLit for a pattern of kind eKind.
+*/
+static unsigned glob_hash(int eKind, const char *zLit, int nLit){
+  unsigned h = 2166136261u ^ (unsigned)eKind;
+  int i;
+  for(i=0; i<nLit; i++){
+    h = (h ^ (unsigned char)zLit[i])*16777619u;
+  }
+  return h;
+}
+
+/*
+** Return the index of the first pattern of kind eKind whose literal
+** text is the nLit bytes at zLit, or -1 if there is no such pattern.
+*/
+static int glob_lookup(Glob *p, int eKind, const char *zLit, int nLit){
+  unsigned h;
+  if( p->nHash==0 ) return -1;
+  h = glob_hash(eKind, zLit, nLit) & (p->nHash-1);
+  while( p->aHash[h].zLit ){
+    GlobLiteral *pLit = &p->aHash[h];
+    if( pLit->eKind==eKind && pLit->nLit==nLit
+     && memcmp(pLit->zLit, zLit, nLit)==0
+    ){
+      return pLit->iPattern;
+    }
+    h = (h+1) & (p->nHash-1);
+  }
+  return -1;
+}
+
+/*
+** Sort the patterns of a Glob that has just been parsed into those that
+** can be found by hash table lookup and those that must be tried one
+** at a time with sqlite3_strglob().
+*/
+static void glob_compile(Glob *p){
+  int i, j;
+  unsigned h;
+  p->nHash = 8;
+  while( p->nHash<2*(unsigned)p->nPattern ) p->nHash *= 2;
+  p->aHash = fossil_malloc( p->nHash*sizeof(p->aHash[0]) );
+  memset(p->aHash, 0, p->nHash*sizeof(p->aHash[0]));
+  p->aiOther = fossil_malloc( (p->nPattern+1)*sizeof(p->aiOther[0]) );
+  p->aShape = fossil_malloc( (p->nPattern+1)*sizeof(p->aShape[0]) );
+  for(i=0; i<p->nPattern; i++){
+    const char *z = p->azPattern[i];
+    int n = (int)strlen(z);
+    int nWild = 0;
+    int eKind;
+    for(j=0; j<n; j++){
+      if( z[j]=='*' || z[j]=='?' || z[j]=='[' ) nWild++;
+    }
+    if( nWild==0 ){
+      eKind = GLOB_EXACT;
+    }else if( nWild==1 && z[n-1]=='*' ){
+      eKind = GLOB_PREFIX;
+      n--;
+    }else if( nWild==1 && z[0]=='*' ){
+      eKind = GLOB_SUFFIX;
+      z++;
+      n--;
+    }else{
+      p->aiOther[p->nOther++] = i;
+      continue;
+    }
+    if( glob_lookup(p, eKind, z, n)>=0 ) continue;
+    h = glob_hash(eKind, z, n) & (p->nHash-1);
+    while( p->aHash[h].zLit ) h = (h+1) & (p->nHash-1);
+    p->aHash[h].zLit = z;
+    p->aHash[h].nLit = n;
+    p->aHash[h].eKind = eKind;
+    p->aHash[h].iPattern = i;
+    for(j=0; j<p->nShape; j++){
+      if( p->aShape[j].eKind!=eKind ) continue;
+      if( eKind==GLOB_EXACT || p->aShape[j].nLit==n ) break;
+    }
+    if( j==p->nShape ){
+      p->aShape[j].eKind = eKind;
+      p->aShape[j].nLit = n;
+      p->nShape++;
+    }
+  }
+}
+
 /*
 ** zPatternList is a comma- or whitespace-separated list of glob patterns.
 ** Parse that list and use it to create a new Glob object.
@@ -138,6 +259,7 @@ Glob *glob_create(const char *zPatternList){
     z[i] = 0;
     z += i+1;
   }
+  glob_compile(p);
   return p;
 }
 
@@ -146,15 +268,40 @@ Glob *glob_create(const char *zPatternList){
 ** the Glob.  The value returned is actually a 1-based index of the pattern
 ** that matched.  Return 0 if none of the patterns match zString.
 **
+** Patterns that are plain text, or plain text with a single leading or
+** trailing "*", are found by hash table lookup.  Only the remaining
+** patterns that come before the best match so far are tried one at a
+** time.  The result is the same as trying every pattern in order.
+**
 ** A NULL glob matches nothing.
 */
 int glob_match(Glob *pGlob, const char *zString){
   int i;
+  int n;
+  int iBest;
   if( pGlob==0 ) return 0;
-  for(i=0; i<pGlob->nPattern; i++){
-    if( sqlite3_strglob(pGlob->azPattern[i], zString)==0 ) return i+1;
+  n = (int)strlen(zString);
+  iBest = pGlob->nPattern;
+  for(i=0; i<pGlob->nShape; i++){
+    const GlobShape *pShape = &pGlob->aShape[i];
+    const char *zLit = zString;
+    int nLit = n;
+    int iPattern;
+    if( pShape->eKind!=GLOB_EXACT ){
+      nLit = pShape->nLit;
+      if( nLit>n ) continue;
+      if( pShape->eKind==GLOB_SUFFIX ) zLit += n - nLit;
+    }
+    iPattern = glob_lookup(pGlob, pShape->eKind, zLit, nLit);
+    if( iPattern>=0 && iPattern<iBest ) iBest = iPattern;
+  }
+  for(i=0; i<pGlob->nOther && pGlob->aiOther[i]<iBest; i++){
+    if( sqlite3_strglob(pGlob->azPattern[pGlob->aiOther[i]], zString)==0 ){
+      iBest = pGlob->aiOther[i];
+      break;
+    }
   }
-  return 0;
+  return iBest<pGlob->nPattern ? iBest+1 : 0;
 }
 
 /*
@@ -162,6 +309,9 @@ int glob_match(Glob *pGlob, const char *zString){
 */
 void glob_free(Glob *pGlob){
   if( pGlob ){
+    fossil_free(pGlob->aiOther);
+    fossil_free(pGlob->aShape);
+    fossil_free(pGlob->aHash);
     fossil_free(pGlob->azPattern);
     fossil_free(pGlob);
   }
@@ -159,7 +159,12 @@ static void http_build_header(
   }
   blob_appendf(pHdr, "Host: %s\r\n", g.url.hostname);
   blob_appendf(pHdr, "User-Agent: %s\r\n", get_user_agent());
-  if( g.url.isSsh ) blob_appendf(pHdr, "X-Fossil-Transport: SSH\r\n");
+  if( g.url.isSsh ){
+    blob_appendf(pHdr, "X-Fossil-Transport: SSH\r\n");
+  }else if( !g.url.isFile ){
+    /* Ask the server to keep the connection open for the next round-trip */
+    blob_appendf(pHdr, "Connection: keep-alive\r\n");
+  }
   if( nPayload ){
     if( zAltMimetype ){
       blob_appendf(pHdr, "Content-Type: %s\r\n", zAltMimetype);
@@ -444,6 +449,7 @@ int http_exchange(
   int i;                /* Loop counter */
   int isError = 0;      /* True if the reply is an error message */
   int isCompressed = 1; /* True if the reply is compressed */
+  int isReused;         /* True if reusing a connection kept alive */
 
   if( g.zHttpCmd!=0 ){
     /* Handle the --transport-command option for "fossil sync" and similar */
@@ -460,10 +466,17 @@ int http_exchange(
     g.url.flags |= URL_SSH_PATH;
   }
 
+  isReused = !g.url.isSsh && !g.url.isFile && transport_is_open();
   if( transport_open(&g.url) ){
     fossil_warning("%s", transport_errmsg(&g.url));
     return 1;
   }
+#ifdef FOSSIL_ENABLE_SSL
+  if( (mHttpFlags & HTTP_VERBOSE) && g.url.isHttps && !isReused ){
+    fossil_print("TLS %s\n",
+       ssl_session_reused() ? "session resumed" : "full handshake");
+  }
+#endif
 
   /* Construct the login card and prepare the complete payload */
   if( blob_size(pSend)==0 ){
@@ -636,6 +649,14 @@ int http_exchange(
       }
     }
   }
+  if( iHttpVersion<0 && isReused ){
+    /* The server closed a connection that was kept alive from the prior
+    ** round-trip before it saw this request.  Retry on a new connection.
+    */
+    transport_close(&g.url);
+    return http_exchange(pSend, pReply, mHttpFlags, maxRedirect,
+                         zAltMimetype);
+  }
   if( iHttpVersion<0 ){
     /* We got nothing back from the server.  If using the ssh: protocol,
     ** this might mean we need to add or remove the PATH=... argument
@@ -734,15 +755,12 @@ int http_exchange(
   if( isCompressed ) blob_uncompress(pReply, pReply);
 
   /*
-  ** Close the connection to the server if appropriate.
-  **
-  ** FIXME:  There is some bug in the lower layers that prevents the
-  ** connection from remaining open.  The easiest fix for now is to
-  ** simply close and restart the connection for each round-trip.
-  **
-  ** For SSH we will leave the connection open.
+  ** Close the connection to the server if appropriate.  Otherwise keep
+  ** it open so that the next round-trip avoids a new TCP and TLS
+  ** handshake.  A connection is only kept if the reply had a
+  ** Content-Length, so that the end of the reply is known.
   */
-  if( ! g.url.isSsh ) closeConnection = 1; /* FIX ME */
+  if( iLength<0 ) closeConnection = 1;
   if( closeConnection ){
     transport_close(&g.url);
   }else{
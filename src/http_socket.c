@@ -210,6 +210,19 @@ size_t socket_send(void *NotUsed, const void *pContent, size_t N){
   return total;
 }
 
+/*
+** Receive whatever content is available on the open socket connection,
+** up to N bytes, blocking only until at least one byte has arrived.
+** Return the number of bytes read, or 0 at end-of-file.
+**
+** This is used to read the header of a reply on a connection that the
+** server keeps open, where waiting for a full buffer would never end.
+*/
+size_t socket_receive_some(void *NotUsed, void *pContent, size_t N){
+  ssize_t got = recv(iSocket, pContent, N>65536 ? 65536 : N, 0);
+  return got>0 ? (size_t)got : 0;
+}
+
 /*
 ** Receive content back from the open socket connection.
 ** Return the number of bytes read.
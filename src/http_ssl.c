@@ -36,6 +36,7 @@
 #include <openssl/bio.h>
 #include <openssl/ssl.h>
 #include <openssl/err.h>
+#include <openssl/rand.h>
 #include <openssl/x509.h>
 
 #include <assert.h>
@@ -57,6 +58,23 @@ static struct {              /* Accept this SSL cert for this session only */
 } sException;
 static int sslNoCertVerify = 0;  /* Do not verify SSL certs */
 
+/*
+** Client-side TLS session cache.  A session ticket received from the
+** server is held here until the connection closes.  It is then saved
+** in the global configuration as "ssl-session:HOST:PORT" so that the
+** next connection to the same server, from this process or a later
+** one, can resume the session instead of doing a full handshake.
+**
+** A saved session carries the master secret of the connection that
+** created it, so it is stored with obscure(), the same as the sync
+** password and the "http-auth:" credentials.
+*/
+static struct {
+  char *zKey;                   /* HOST:PORT of the open connection */
+  SSL_SESSION *pNew;            /* Newest session not yet saved */
+  int bAccepted;                /* The server cert was accepted */
+} sSession;
+
 
 /* This is a self-signed cert in the PEM format that can be used when
 ** no other certs are available.
@@ -245,6 +263,80 @@ static const char *ssl_asn1time_to_iso8601(ASN1_TIME *asn1_time,
   }
 }
 
+/*
+** OpenSSL invokes this callback whenever the server hands the client a
+** session that can later be resumed.  With TLS 1.3 that happens after
+** the handshake, when the first application data is read.  Hold on to
+** the newest session.  It is saved by ssl_close_client().
+*/
+static int ssl_new_session_callback(SSL *s, SSL_SESSION *pSess){
+  (void)s;
+  if( sSession.pNew ) SSL_SESSION_free(sSession.pNew);
+  sSession.pNew = pSess;
+  return 1;
+}
+
+/*
+** Look for a saved session for server zKey ("HOST:PORT") in the global
+** configuration and, if it is still within its lifetime, offer it to
+** the server for resumption on connection s.
+*/
+static void ssl_load_session(SSL *s, const char *zKey){
+  char *zObscured;
+  char *zValue;
+  char *aData;
+  int nData = 0;
+  const unsigned char *p;
+  SSL_SESSION *pSess;
+
+  zObscured = db_get_mprintf(0, "ssl-session:%s", zKey);
+  if( zObscured==0 ) return;
+  zValue = unobscure(zObscured);
+  fossil_free(zObscured);
+  aData = decode64(zValue, &nData);
+  p = (const unsigned char*)aData;
+  pSess = d2i_SSL_SESSION(0, &p, nData);
+  if( pSess ){
+    if( SSL_SESSION_get_time(pSess)+SSL_SESSION_get_timeout(pSess)
+          > (long)time(0)
+    ){
+      SSL_set_session(s, pSess);
+    }
+    SSL_SESSION_free(pSess);
+  }
+  fossil_free(aData);
+  fossil_free(zValue);
+}
+
+/*
+** Save the newest session received on the connection that is closing,
+** provided the user accepted the server certificate.
+*/
+static void ssl_save_session(void){
+  if( sSession.pNew ){
+    int nData = i2d_SSL_SESSION(sSession.pNew, 0);
+    if( sSession.bAccepted && sSession.zKey && nData>0 ){
+      unsigned char *aData = fossil_malloc(nData);
+      unsigned char *p = aData;
+      char *zValue;
+      char *zObscured;
+      i2d_SSL_SESSION(sSession.pNew, &p);
+      zValue = encode64((const char*)aData, nData);
+      zObscured = obscure(zValue);
+      db_open_config(0,0);
+      db_set_mprintf(zObscured, 1, "ssl-session:%s", sSession.zKey);
+      fossil_free(zObscured);
+      fossil_free(zValue);
+      fossil_free(aData);
+    }
+    SSL_SESSION_free(sSession.pNew);
+    sSession.pNew = 0;
+  }
+  sSession.bAccepted = 0;
+  fossil_free(sSession.zKey);
+  sSession.zKey = 0;
+}
+
 /*
 ** Call this routine once before any other use of the SSL interface.
 ** This routine does initial configuration of the SSL module.
@@ -328,6 +420,11 @@ static void ssl_global_init_client(void){
     ** for a cert */
     SSL_CTX_set_client_cert_cb(sslCtx, ssl_client_cert_callback);
 
+    /* Sessions are cached in the global configuration, not by OpenSSL */
+    SSL_CTX_set_session_cache_mode(sslCtx,
+        SSL_SESS_CACHE_CLIENT|SSL_SESS_CACHE_NO_INTERNAL_STORE);
+    SSL_CTX_sess_set_new_cb(sslCtx, ssl_new_session_callback);
+
     sslIsInit = 1;
   }else{
     assert( sslIsInit==1 );
@@ -355,6 +452,15 @@ void ssl_close_client(void){
     BIO_free_all(iBio);
     iBio = NULL;
   }
+  ssl_save_session();
+}
+
+/*
+** Return true if the currently open client connection resumed a
+** previous TLS session rather than doing a full handshake.
+*/
+int ssl_session_reused(void){
+  return iBio!=NULL && ssl!=0 && SSL_session_reused(ssl);
 }
 
 /* See RFC2817 for details */
@@ -476,6 +582,9 @@ int ssl_open_client(UrlData *pUrlData){
 #endif
 
   SSL_set_mode(ssl, SSL_MODE_AUTO_RETRY);
+  sSession.zKey = mprintf("%s:%d", zRemoteHost,
+      pUrlData->useProxy ? pUrlData->proxyOrigPort : pUrlData->port);
+  ssl_load_session(ssl, sSession.zKey);
 #if OPENSSL_VERSION_NUMBER >= 0x010002000
   if( !sslNoCertVerify ){
     X509_VERIFY_PARAM *param = 0;
@@ -619,6 +728,7 @@ int ssl_open_client(UrlData *pUrlData){
 #endif
   }
 
+  sSession.bAccepted = 1;
   X509_free(cert);
   return 0;
 }
@@ -688,6 +798,19 @@ size_t ssl_send(void *NotUsed, void *pContent, size_t N){
   return total;
 }
 
+/*
+** Receive whatever content is available on the client SSL connection,
+** up to N bytes, blocking only until at least one byte has arrived.
+** Return the number of bytes read, or 0 at end-of-file.
+*/
+size_t ssl_receive_some(void *NotUsed, void *pContent, size_t N){
+  int got;
+  do{
+    got = BIO_read(iBio, pContent, N);
+  }while( got<=0 && BIO_should_retry(iBio) );
+  return got>0 ? (size_t)got : 0;
+}
+
 /*
 ** Receive content back from the client SSL connection.  In other
 ** words read the reply back from the server.
@@ -764,6 +887,28 @@ void ssl_init_server(const char *zCertFile, const char *zKeyFile){
            zKeyFile, zCertFile);
     }
     SSL_CTX_set_mode(sslCtx, SSL_MODE_AUTO_RETRY);
+
+    /* Allow clients to resume sessions.  The session-ID cache lives in
+    ** each child process and so only helps keep-alive reconnects to the
+    ** same child.  Session tickets work across children: the ticket keys
+    ** are generated here, once, before "fossil server" starts forking,
+    ** so every child can decrypt a ticket that any other child issued.
+    */
+    SSL_CTX_set_session_id_context(sslCtx, (const unsigned char*)"fossil", 6);
+    SSL_CTX_set_session_cache_mode(sslCtx, SSL_SESS_CACHE_SERVER);
+    SSL_CTX_set_timeout(sslCtx, 3600);
+    SSL_CTX_clear_options(sslCtx, SSL_OP_NO_TICKET);
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L
+    {
+      unsigned char aKey[80];  /* Key name, HMAC secret and AES key */
+      if( RAND_bytes(aKey, sizeof(aKey))!=1
+       || SSL_CTX_set_tlsext_ticket_keys(sslCtx, aKey, sizeof(aKey))!=1
+      ){
+        fossil_fatal("Error initializing the TLS session ticket key");
+      }
+      OPENSSL_cleanse(aKey, sizeof(aKey));
+    }
+#endif
     sslIsInit = 2;
   }else{
     assert( sslIsInit==2 );
@@ -913,8 +1058,9 @@ static void trust_location_usable(const char *zPath, const char **pzStore){
 **                               option is specified.
 **
 **   scrub ?--force?             Remove all SSL configuration data from the
-**                               repository. Use --force to omit the
-**                               confirmation.
+**                               repository and cached TLS sessions from the
+**                               global configuration. Use --force to omit
+**                               the confirmation.
 **
 **   show ?-v?                   Show the TLS configuration. Add -v to see
 **                               additional explanation
@@ -951,6 +1097,7 @@ void test_tlsconfig_info(void){
     db_multi_exec(
       "PRAGMA secure_delete=ON;"
       "DELETE FROM config WHERE name GLOB 'ssl-*';"
+      "DELETE FROM global_config WHERE name GLOB 'ssl-session:*';"
     );
     db_protect_pop();
   }else
@@ -1089,6 +1236,16 @@ void test_tlsconfig_info(void){
       );
     }
 
+    fossil_print("ssl-session:          %d servers\n",
+       db_int(0, "SELECT count(*) FROM global_config"
+                 " WHERE name GLOB 'ssl-session:*'"));
+    if( verbose ){
+      fossil_print("\n"
+         "  The number of servers for which a TLS session is cached so\n"
+         "  that the next connection can skip the full handshake.\n\n"
+      );
+    }
+
   }else
   if( strncmp("remove-exception",zCmd,nCmd)==0 ){
     int i;
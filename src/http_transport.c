@@ -38,10 +38,26 @@ static struct {
   char *zOutFile;         /* Name of outbound file for FILE: */
   char *zInFile;          /* Name of inbound file for FILE: */
   FILE *pLog;             /* Log output here */
+  char *zPeer;            /* Server of an open HTTP or HTTPS connection */
 } transport = {
-  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
 };
 
+/*
+** Artificial network conditions imposed on the client side of a sync,
+** and traffic counts that the sync logic does not reset.  These are
+** used by "test-sync-bench" to measure the protocol reproducibly.
+*/
+static struct {
+  int msLatency;          /* Delay added to each round-trip and connect */
+  int nBandwidth;         /* Bytes per second each way.  0 for no limit */
+  int mxPacket;           /* Largest single write or read.  0 for no limit */
+  i64 nOwed;              /* Bytes not yet paid for with a delay */
+  int nRound;             /* Number of round-trips */
+  i64 nSent;              /* Number of bytes sent */
+  i64 nRcvd;              /* Number of bytes received */
+} shape;
+
 /*
 ** Information about the connection to the SSH subprocess when
 ** using the ssh:// sync method.
@@ -76,6 +92,56 @@ void transport_stats(i64 *pnSent, i64 *pnRcvd, int resetFlag){
   }
 }
 
+/*
+** Impose a delay of msLatency milliseconds on every round-trip and
+** every new connection, limit traffic in each direction to nBandwidth
+** bytes per second, and move data across the wire in pieces of at most
+** mxPacket bytes.  Zero for any of these means no limit.
+*/
+void transport_shape(int msLatency, int nBandwidth, int mxPacket){
+  shape.msLatency = msLatency>0 ? msLatency : 0;
+  shape.nBandwidth = nBandwidth>0 ? nBandwidth : 0;
+  shape.mxPacket = mxPacket>0 ? mxPacket : 0;
+  shape.nOwed = 0;
+}
+
+/*
+** Retrieve the number of round-trips and bytes sent and received since
+** the last reset.  Unlike transport_stats(), these counts are not reset
+** by the sync logic.  Any of the pointers may be NULL.
+*/
+void transport_shape_stats(
+  int *pnRound,
+  i64 *pnSent,
+  i64 *pnRcvd,
+  int resetFlag
+){
+  if( pnRound ) *pnRound = shape.nRound;
+  if( pnSent ) *pnSent = shape.nSent;
+  if( pnRcvd ) *pnRcvd = shape.nRcvd;
+  if( resetFlag ){
+    shape.nRound = 0;
+    shape.nSent = 0;
+    shape.nRcvd = 0;
+  }
+}
+
+/*
+** Account for N bytes moved across the wire, sleeping as needed to
+** keep within the bandwidth limit.
+*/
+static void transport_throttle(int N){
+  if( shape.nBandwidth>0 && N>0 ){
+    int ms;
+    shape.nOwed += N;
+    ms = (int)(shape.nOwed*1000/shape.nBandwidth);
+    if( ms>0 ){
+      sqlite3_sleep(ms);
+      shape.nOwed -= (i64)ms*shape.nBandwidth/1000;
+    }
+  }
+}
+
 /*
 ** Check zFossil to see if it is a reasonable "fossil" command to
 ** run on the server.  Do not allow an attacker to substitute something
@@ -174,6 +240,14 @@ int transport_ssh_open(UrlData *pUrlData){
 */
 int transport_open(UrlData *pUrlData){
   int rc = 0;
+  if( transport.isOpen && transport.zPeer ){
+    /* A connection kept open by a prior round-trip is reused only if
+    ** it goes to the same server */
+    char *zPeer = mprintf("%s:%d:%d", pUrlData->name, pUrlData->port,
+                          pUrlData->isHttps);
+    if( fossil_strcmp(zPeer, transport.zPeer)!=0 ) transport_close(pUrlData);
+    fossil_free(zPeer);
+  }
   if( transport.isOpen==0 ){
     if( pUrlData->isSsh ){
       rc = transport_ssh_open(pUrlData);
@@ -201,10 +275,25 @@ int transport_open(UrlData *pUrlData){
       rc = socket_open(pUrlData);
       if( rc==0 ) transport.isOpen = 1;
     }
+    if( transport.isOpen && !pUrlData->isFile && shape.msLatency ){
+      sqlite3_sleep(shape.msLatency);
+    }
+    if( transport.isOpen && !pUrlData->isSsh && !pUrlData->isFile ){
+      transport.zPeer = mprintf("%s:%d:%d", pUrlData->name, pUrlData->port,
+                                pUrlData->isHttps);
+    }
   }
   return rc;
 }
 
+/*
+** Return true if a connection is open.  This is the case between
+** round-trips when the server agreed to keep the connection alive.
+*/
+int transport_is_open(void){
+  return transport.isOpen;
+}
+
 /*
 ** Close the current connection
 */
@@ -237,17 +326,16 @@ void transport_close(UrlData *pUrlData){
     }else{
       socket_close();
     }
+    fossil_free(transport.zPeer);
+    transport.zPeer = 0;
     transport.isOpen = 0;
   }
 }
 
 /*
-** Send content over the wire.
+** Write N bytes directly to the wire.
 */
-void transport_send(UrlData *pUrlData, Blob *toSend){
-  char *z = blob_buffer(toSend);
-  int n = blob_size(toSend);
-  transport.nSent += n;
+static void transport_write(UrlData *pUrlData, char *z, int n){
   if( pUrlData->isSsh ){
     fwrite(z, 1, n, sshOut);
     fflush(sshOut);
@@ -258,6 +346,7 @@ void transport_send(UrlData *pUrlData, Blob *toSend){
       sent = ssl_send(0, z, n);
       /* printf("Sent %d of %d bytes\n", sent, n); fflush(stdout); */
       if( sent<=0 ) break;
+      z += sent;
       n -= sent;
     }
 #endif
@@ -269,16 +358,37 @@ void transport_send(UrlData *pUrlData, Blob *toSend){
       sent = socket_send(0, z, n);
       /* printf("Sent %d of %d bytes\n", sent, n); fflush(stdout); */
       if( sent<=0 ) break;
+      z += sent;
       n -= sent;
     }
   }
 }
 
+/*
+** Send content over the wire.
+*/
+void transport_send(UrlData *pUrlData, Blob *toSend){
+  char *z = blob_buffer(toSend);
+  int n = blob_size(toSend);
+  transport.nSent += n;
+  shape.nSent += n;
+  while( n>0 ){
+    int k = n;
+    if( shape.mxPacket>0 && k>shape.mxPacket ) k = shape.mxPacket;
+    transport_write(pUrlData, z, k);
+    transport_throttle(k);
+    z += k;
+    n -= k;
+  }
+}
+
 /*
 ** This routine is called when the outbound message is complete and
 ** it is time to begin receiving a reply.
 */
 void transport_flip(UrlData *pUrlData){
+  shape.nRound++;
+  if( shape.msLatency ) sqlite3_sleep(shape.msLatency);
   if( pUrlData->isFile ){
     char *zCmd;
     fclose(transport.pFile);
@@ -317,9 +427,11 @@ void transport_rewind(UrlData *pUrlData){
 
 /*
 ** Read N bytes of content directly from the wire and write into
-** the buffer.
+** the buffer.  If bSome is true, return as soon as any content has
+** arrived from an HTTP or HTTPS server, rather than waiting for all
+** N bytes.
 */
-static int transport_fetch(UrlData *pUrlData, char *zBuf, int N){
+static int transport_read(UrlData *pUrlData, char *zBuf, int N, int bSome){
   int got;
   if( pUrlData->isSsh ){
     int x;
@@ -333,12 +445,14 @@ static int transport_fetch(UrlData *pUrlData, char *zBuf, int N){
     }
   }else if( pUrlData->isHttps ){
     #ifdef FOSSIL_ENABLE_SSL
-    got = ssl_receive(0, zBuf, N);
+    got = bSome ? ssl_receive_some(0, zBuf, N) : ssl_receive(0, zBuf, N);
     #else
     got = 0;
     #endif
   }else if( pUrlData->isFile ){
     got = fread(zBuf, 1, N, transport.pFile);
+  }else if( bSome ){
+    got = socket_receive_some(0, zBuf, N);
   }else{
     got = socket_receive(0, zBuf, N, 0);
   }
@@ -350,6 +464,25 @@ static int transport_fetch(UrlData *pUrlData, char *zBuf, int N){
   return got;
 }
 
+/*
+** Like transport_read() but in pieces no larger than the packet size
+** limit and at no more than the bandwidth limit.
+*/
+static int transport_fetch(UrlData *pUrlData, char *zBuf, int N, int bSome){
+  int got = 0;
+  while( got<N ){
+    int k = N - got;
+    if( shape.mxPacket>0 && k>shape.mxPacket ) k = shape.mxPacket;
+    k = transport_read(pUrlData, &zBuf[got], k, bSome);
+    if( k<=0 ) break;
+    got += k;
+    shape.nRcvd += k;
+    transport_throttle(k);
+    if( bSome ) break;
+  }
+  return got;
+}
+
 /*
 ** Read N bytes of content from the wire and store in the supplied buffer.
 ** Return the number of bytes actually received.
@@ -378,7 +511,7 @@ int transport_receive(UrlData *pUrlData, char *zBuf, int N){
     nByte += toMove;
   }
   if( N>0 ){
-    int got = transport_fetch(pUrlData, zBuf, N);
+    int got = transport_fetch(pUrlData, zBuf, N, 0);
     if( got>0 ){
       nByte += got;
       transport.nRcvd += got;
@@ -392,6 +525,9 @@ int transport_receive(UrlData *pUrlData, char *zBuf, int N){
 ** Load up to N new bytes of content into the transport.pBuf buffer.
 ** The buffer itself might be moved.  And the transport.iCursor value
 ** might be reset to 0.
+**
+** This returns as soon as some content arrives, since the server might
+** keep the connection open after a reply shorter than N bytes.
 */
 static void transport_load_buffer(UrlData *pUrlData, int N){
   int i, j;
@@ -415,7 +551,7 @@ static void transport_load_buffer(UrlData *pUrlData, int N){
     transport.pBuf = pNew;
   }
   if( N>0 ){
-    i = transport_fetch(pUrlData, &transport.pBuf[transport.nUsed], N);
+    i = transport_fetch(pUrlData, &transport.pBuf[transport.nUsed], N, 1);
     if( i>0 ){
       transport.nRcvd += i;
       transport.nUsed += i;
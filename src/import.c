@@ -171,7 +171,7 @@ static int fast_insert_content(
     );
     db_bind_text(&ins, ":uuid", blob_str(&hash));
     db_bind_int(&ins, ":size", gg.nData);
-    blob_compress(pContent, &cmpr);
+    cmprdict_compress(pContent, &cmpr);
     db_bind_blob(&ins, ":content", &cmpr);
     db_step(&ins);
     db_reset(&ins);
@@ -20,6 +20,7 @@ SRC = \
   $(SRCDIR)/ajax.c \
   $(SRCDIR)/alerts.c \
   $(SRCDIR)/allrepo.c \
+  $(SRCDIR)/arena.c \
   $(SRCDIR)/attach.c \
   $(SRCDIR)/backlink.c \
   $(SRCDIR)/backoffice.c \
@@ -39,6 +40,7 @@ SRC = \
   $(SRCDIR)/checkout.c \
   $(SRCDIR)/clearsign.c \
   $(SRCDIR)/clone.c \
+  $(SRCDIR)/cmprdict.c \
   $(SRCDIR)/color.c \
   $(SRCDIR)/comformat.c \
   $(SRCDIR)/configure.c \
@@ -106,6 +108,7 @@ SRC = \
   $(SRCDIR)/merge3.c \
   $(SRCDIR)/moderate.c \
   $(SRCDIR)/name.c \
+  $(SRCDIR)/packfile.c \
   $(SRCDIR)/patch.c \
   $(SRCDIR)/path.c \
   $(SRCDIR)/piechart.c \
@@ -129,6 +132,7 @@ SRC = \
   $(SRCDIR)/sha1.c \
   $(SRCDIR)/sha1hard.c \
   $(SRCDIR)/sha3.c \
+  $(SRCDIR)/shallow.c \
   $(SRCDIR)/shun.c \
   $(SRCDIR)/sitemap.c \
   $(SRCDIR)/skins.c \
@@ -139,6 +143,7 @@ SRC = \
   $(SRCDIR)/statrep.c \
   $(SRCDIR)/style.c \
   $(SRCDIR)/sync.c \
+  $(SRCDIR)/syncbench.c \
   $(SRCDIR)/tag.c \
   $(SRCDIR)/tar.c \
   $(SRCDIR)/terminal.c \
@@ -283,6 +288,7 @@ TRANS_SRC = \
   $(OBJDIR)/ajax_.c \
   $(OBJDIR)/alerts_.c \
   $(OBJDIR)/allrepo_.c \
+  $(OBJDIR)/arena_.c \
   $(OBJDIR)/attach_.c \
   $(OBJDIR)/backlink_.c \
   $(OBJDIR)/backoffice_.c \
@@ -302,6 +308,7 @@ TRANS_SRC = \
   $(OBJDIR)/checkout_.c \
   $(OBJDIR)/clearsign_.c \
   $(OBJDIR)/clone_.c \
+  $(OBJDIR)/cmprdict_.c \
   $(OBJDIR)/color_.c \
   $(OBJDIR)/comformat_.c \
   $(OBJDIR)/configure_.c \
@@ -369,6 +376,7 @@ TRANS_SRC = \
   $(OBJDIR)/merge3_.c \
   $(OBJDIR)/moderate_.c \
   $(OBJDIR)/name_.c \
+  $(OBJDIR)/packfile_.c \
   $(OBJDIR)/patch_.c \
   $(OBJDIR)/path_.c \
   $(OBJDIR)/piechart_.c \
@@ -392,6 +400,7 @@ TRANS_SRC = \
   $(OBJDIR)/sha1_.c \
   $(OBJDIR)/sha1hard_.c \
   $(OBJDIR)/sha3_.c \
+  $(OBJDIR)/shallow_.c \
   $(OBJDIR)/shun_.c \
   $(OBJDIR)/sitemap_.c \
   $(OBJDIR)/skins_.c \
@@ -402,6 +411,7 @@ TRANS_SRC = \
   $(OBJDIR)/statrep_.c \
   $(OBJDIR)/style_.c \
   $(OBJDIR)/sync_.c \
+  $(OBJDIR)/syncbench_.c \
   $(OBJDIR)/tag_.c \
   $(OBJDIR)/tar_.c \
   $(OBJDIR)/terminal_.c \
@@ -432,6 +442,7 @@ OBJ = \
  $(OBJDIR)/ajax.o \
  $(OBJDIR)/alerts.o \
  $(OBJDIR)/allrepo.o \
+ $(OBJDIR)/arena.o \
  $(OBJDIR)/attach.o \
  $(OBJDIR)/backlink.o \
  $(OBJDIR)/backoffice.o \
@@ -451,6 +462,7 @@ OBJ = \
  $(OBJDIR)/checkout.o \
  $(OBJDIR)/clearsign.o \
  $(OBJDIR)/clone.o \
+ $(OBJDIR)/cmprdict.o \
  $(OBJDIR)/color.o \
  $(OBJDIR)/comformat.o \
  $(OBJDIR)/configure.o \
@@ -518,6 +530,7 @@ OBJ = \
  $(OBJDIR)/merge3.o \
  $(OBJDIR)/moderate.o \
  $(OBJDIR)/name.o \
+ $(OBJDIR)/packfile.o \
  $(OBJDIR)/patch.o \
  $(OBJDIR)/path.o \
  $(OBJDIR)/piechart.o \
@@ -541,6 +554,7 @@ OBJ = \
  $(OBJDIR)/sha1.o \
  $(OBJDIR)/sha1hard.o \
  $(OBJDIR)/sha3.o \
+ $(OBJDIR)/shallow.o \
  $(OBJDIR)/shun.o \
  $(OBJDIR)/sitemap.o \
  $(OBJDIR)/skins.o \
@@ -551,6 +565,7 @@ OBJ = \
  $(OBJDIR)/statrep.o \
  $(OBJDIR)/style.o \
  $(OBJDIR)/sync.o \
+ $(OBJDIR)/syncbench.o \
  $(OBJDIR)/tag.o \
  $(OBJDIR)/tar.o \
  $(OBJDIR)/terminal.o \
@@ -638,7 +653,6 @@ SQLITE_OPTIONS = -DNDEBUG=1 \
                  -DSQLITE_LIKE_DOESNT_MATCH_BLOBS \
                  -DSQLITE_OMIT_DECLTYPE \
                  -DSQLITE_OMIT_DEPRECATED \
-                 -DSQLITE_OMIT_PROGRESS_CALLBACK \
                  -DSQLITE_OMIT_SHARED_CACHE \
                  -DSQLITE_OMIT_LOAD_EXTENSION \
                  -DSQLITE_MAX_EXPR_DEPTH=0 \
@@ -663,7 +677,6 @@ SHELL_OPTIONS = -DNDEBUG=1 \
                 -DSQLITE_LIKE_DOESNT_MATCH_BLOBS \
                 -DSQLITE_OMIT_DECLTYPE \
                 -DSQLITE_OMIT_DEPRECATED \
-                -DSQLITE_OMIT_PROGRESS_CALLBACK \
                 -DSQLITE_OMIT_SHARED_CACHE \
                 -DSQLITE_OMIT_LOAD_EXTENSION \
                 -DSQLITE_MAX_EXPR_DEPTH=0 \
@@ -767,6 +780,7 @@ $(OBJDIR)/headers:	$(OBJDIR)/page_index.h $(OBJDIR)/builtin_data.h $(OBJDIR)/mak
 	$(OBJDIR)/ajax_.c:$(OBJDIR)/ajax.h \
 	$(OBJDIR)/alerts_.c:$(OBJDIR)/alerts.h \
 	$(OBJDIR)/allrepo_.c:$(OBJDIR)/allrepo.h \
+	$(OBJDIR)/arena_.c:$(OBJDIR)/arena.h \
 	$(OBJDIR)/attach_.c:$(OBJDIR)/attach.h \
 	$(OBJDIR)/backlink_.c:$(OBJDIR)/backlink.h \
 	$(OBJDIR)/backoffice_.c:$(OBJDIR)/backoffice.h \
@@ -786,6 +800,7 @@ $(OBJDIR)/headers:	$(OBJDIR)/page_index.h $(OBJDIR)/builtin_data.h $(OBJDIR)/mak
 	$(OBJDIR)/checkout_.c:$(OBJDIR)/checkout.h \
 	$(OBJDIR)/clearsign_.c:$(OBJDIR)/clearsign.h \
 	$(OBJDIR)/clone_.c:$(OBJDIR)/clone.h \
+	$(OBJDIR)/cmprdict_.c:$(OBJDIR)/cmprdict.h \
 	$(OBJDIR)/color_.c:$(OBJDIR)/color.h \
 	$(OBJDIR)/comformat_.c:$(OBJDIR)/comformat.h \
 	$(OBJDIR)/configure_.c:$(OBJDIR)/configure.h \
@@ -853,6 +868,7 @@ $(OBJDIR)/headers:	$(OBJDIR)/page_index.h $(OBJDIR)/builtin_data.h $(OBJDIR)/mak
 	$(OBJDIR)/merge3_.c:$(OBJDIR)/merge3.h \
 	$(OBJDIR)/moderate_.c:$(OBJDIR)/moderate.h \
 	$(OBJDIR)/name_.c:$(OBJDIR)/name.h \
+	$(OBJDIR)/packfile_.c:$(OBJDIR)/packfile.h \
 	$(OBJDIR)/patch_.c:$(OBJDIR)/patch.h \
 	$(OBJDIR)/path_.c:$(OBJDIR)/path.h \
 	$(OBJDIR)/piechart_.c:$(OBJDIR)/piechart.h \
@@ -876,6 +892,7 @@ $(OBJDIR)/headers:	$(OBJDIR)/page_index.h $(OBJDIR)/builtin_data.h $(OBJDIR)/mak
 	$(OBJDIR)/sha1_.c:$(OBJDIR)/sha1.h \
 	$(OBJDIR)/sha1hard_.c:$(OBJDIR)/sha1hard.h \
 	$(OBJDIR)/sha3_.c:$(OBJDIR)/sha3.h \
+	$(OBJDIR)/shallow_.c:$(OBJDIR)/shallow.h \
 	$(OBJDIR)/shun_.c:$(OBJDIR)/shun.h \
 	$(OBJDIR)/sitemap_.c:$(OBJDIR)/sitemap.h \
 	$(OBJDIR)/skins_.c:$(OBJDIR)/skins.h \
@@ -886,6 +903,7 @@ $(OBJDIR)/headers:	$(OBJDIR)/page_index.h $(OBJDIR)/builtin_data.h $(OBJDIR)/mak
 	$(OBJDIR)/statrep_.c:$(OBJDIR)/statrep.h \
 	$(OBJDIR)/style_.c:$(OBJDIR)/style.h \
 	$(OBJDIR)/sync_.c:$(OBJDIR)/sync.h \
+	$(OBJDIR)/syncbench_.c:$(OBJDIR)/syncbench.h \
 	$(OBJDIR)/tag_.c:$(OBJDIR)/tag.h \
 	$(OBJDIR)/tar_.c:$(OBJDIR)/tar.h \
 	$(OBJDIR)/terminal_.c:$(OBJDIR)/terminal.h \
@@ -950,6 +968,14 @@ $(OBJDIR)/allrepo.o:	$(OBJDIR)/allrepo_.c $(OBJDIR)/allrepo.h $(SRCDIR)/config.h
 
 $(OBJDIR)/allrepo.h:	$(OBJDIR)/headers
 
+$(OBJDIR)/arena_.c:	$(SRCDIR)/arena.c $(OBJDIR)/translate
+	$(OBJDIR)/translate $(SRCDIR)/arena.c >$@
+
+$(OBJDIR)/arena.o:	$(OBJDIR)/arena_.c $(OBJDIR)/arena.h $(SRCDIR)/config.h
+	$(XTCC) -o $(OBJDIR)/arena.o -c $(OBJDIR)/arena_.c
+
+$(OBJDIR)/arena.h:	$(OBJDIR)/headers
+
 $(OBJDIR)/attach_.c:	$(SRCDIR)/attach.c $(OBJDIR)/translate
 	$(OBJDIR)/translate $(SRCDIR)/attach.c >$@
 
@@ -1102,6 +1128,14 @@ $(OBJDIR)/clone.o:	$(OBJDIR)/clone_.c $(OBJDIR)/clone.h $(SRCDIR)/config.h
 
 $(OBJDIR)/clone.h:	$(OBJDIR)/headers
 
+$(OBJDIR)/cmprdict_.c:	$(SRCDIR)/cmprdict.c $(OBJDIR)/translate
+	$(OBJDIR)/translate $(SRCDIR)/cmprdict.c >$@
+
+$(OBJDIR)/cmprdict.o:	$(OBJDIR)/cmprdict_.c $(OBJDIR)/cmprdict.h $(SRCDIR)/config.h
+	$(XTCC) -o $(OBJDIR)/cmprdict.o -c $(OBJDIR)/cmprdict_.c
+
+$(OBJDIR)/cmprdict.h:	$(OBJDIR)/headers
+
 $(OBJDIR)/color_.c:	$(SRCDIR)/color.c $(OBJDIR)/translate
 	$(OBJDIR)/translate $(SRCDIR)/color.c >$@
 
@@ -1638,6 +1672,14 @@ $(OBJDIR)/name.o:	$(OBJDIR)/name_.c $(OBJDIR)/name.h $(SRCDIR)/config.h
 
 $(OBJDIR)/name.h:	$(OBJDIR)/headers
 
+$(OBJDIR)/packfile_.c:	$(SRCDIR)/packfile.c $(OBJDIR)/translate
+	$(OBJDIR)/translate $(SRCDIR)/packfile.c >$@
+
+$(OBJDIR)/packfile.o:	$(OBJDIR)/packfile_.c $(OBJDIR)/packfile.h $(SRCDIR)/config.h
+	$(XTCC) -o $(OBJDIR)/packfile.o -c $(OBJDIR)/packfile_.c
+
+$(OBJDIR)/packfile.h:	$(OBJDIR)/headers
+
 $(OBJDIR)/patch_.c:	$(SRCDIR)/patch.c $(OBJDIR)/translate
 	$(OBJDIR)/translate $(SRCDIR)/patch.c >$@
 
@@ -1822,6 +1864,14 @@ $(OBJDIR)/sha3.o:	$(OBJDIR)/sha3_.c $(OBJDIR)/sha3.h $(SRCDIR)/config.h
 
 $(OBJDIR)/sha3.h:	$(OBJDIR)/headers
 
+$(OBJDIR)/shallow_.c:	$(SRCDIR)/shallow.c $(OBJDIR)/translate
+	$(OBJDIR)/translate $(SRCDIR)/shallow.c >$@
+
+$(OBJDIR)/shallow.o:	$(OBJDIR)/shallow_.c $(OBJDIR)/shallow.h $(SRCDIR)/config.h
+	$(XTCC) -o $(OBJDIR)/shallow.o -c $(OBJDIR)/shallow_.c
+
+$(OBJDIR)/shallow.h:	$(OBJDIR)/headers
+
 $(OBJDIR)/shun_.c:	$(SRCDIR)/shun.c $(OBJDIR)/translate
 	$(OBJDIR)/translate $(SRCDIR)/shun.c >$@
 
@@ -1902,6 +1952,14 @@ $(OBJDIR)/sync.o:	$(OBJDIR)/sync_.c $(OBJDIR)/sync.h $(SRCDIR)/config.h
 
 $(OBJDIR)/sync.h:	$(OBJDIR)/headers
 
+$(OBJDIR)/syncbench_.c:	$(SRCDIR)/syncbench.c $(OBJDIR)/translate
+	$(OBJDIR)/translate $(SRCDIR)/syncbench.c >$@
+
+$(OBJDIR)/syncbench.o:	$(OBJDIR)/syncbench_.c $(OBJDIR)/syncbench.h $(SRCDIR)/config.h
+	$(XTCC) -o $(OBJDIR)/syncbench.o -c $(OBJDIR)/syncbench_.c
+
+$(OBJDIR)/syncbench.h:	$(OBJDIR)/headers
+
 $(OBJDIR)/tag_.c:	$(SRCDIR)/tag.c $(OBJDIR)/translate
 	$(OBJDIR)/translate $(SRCDIR)/tag.c >$@
 
@@ -1453,6 +1453,104 @@ ManifestFile *manifest_file_next(
   return pOut;
 }
 
+/*
+** While a sequence of manifest_crosslink() calls is running, filename
+** and artifact hash lookups made for F-cards are remembered in these
+** maps so that a name that appears in many check-ins is only looked up
+** in the FILENAME or BLOB table once.  The maps are cleared by
+** manifest_crosslink_begin() and manifest_crosslink_end().
+**
+** Each map is an open-addressing hash table with linear probing.  The
+** keys are copies owned by the map.
+*/
+typedef struct XlinkMap XlinkMap;
+struct XlinkMap {
+  int nUsed;                /* Number of slots in use */
+  int nSlot;                /* Size of a[].  Zero or a power of two */
+  struct XlinkMapEntry {
+    char *zKey;               /* Filename or artifact hash.  NULL if unused */
+    int id;                   /* The fnid or rid for zKey */
+  } *a;
+};
+static XlinkMap xlinkFnid;  /* Filename to fnid */
+static XlinkMap xlinkRid;   /* Artifact hash to rid */
+
+/*
+** Hash a map key.
+*/
+static unsigned int xlink_map_hash(const char *z){
+  unsigned int h = 2166136261u;
+  while( *z ){
+    h = (h ^ (unsigned char)*(z++))*16777619u;
+  }
+  return h;
+}
+
+/*
+** Return the id stored for zKey, or 0 if zKey is not in the map.
+*/
+static int xlink_map_find(XlinkMap *p, const char *zKey){
+  unsigned int i, mask;
+  if( p->nSlot==0 ) return 0;
+  mask = p->nSlot - 1;
+  for(i=xlink_map_hash(zKey)&mask; p->a[i].zKey; i=(i+1)&mask){
+    if( strcmp(p->a[i].zKey, zKey)==0 ) return p->a[i].id;
+  }
+  return 0;
+}
+
+/*
+** Add zKey to the map with the given id.  zKey must not already
+** be in the map.
+*/
+static void xlink_map_insert(XlinkMap *p, const char *zKey, int id){
+  unsigned int i, mask;
+  if( (p->nUsed+1)*2>p->nSlot ){
+    struct XlinkMapEntry *aOld = p->a;
+    int nOld = p->nSlot;
+    int j;
+    p->nSlot = nOld ? nOld*2 : 1024;
+    p->a = fossil_malloc_zero( sizeof(p->a[0])*p->nSlot );
+    mask = p->nSlot - 1;
+    for(j=0; j<nOld; j++){
+      if( aOld[j].zKey==0 ) continue;
+      for(i=xlink_map_hash(aOld[j].zKey)&mask; p->a[i].zKey; i=(i+1)&mask){}
+      p->a[i] = aOld[j];
+    }
+    fossil_free(aOld);
+  }
+  mask = p->nSlot - 1;
+  for(i=xlink_map_hash(zKey)&mask; p->a[i].zKey; i=(i+1)&mask){}
+  p->a[i].zKey = fossil_strdup(zKey);
+  p->a[i].id = id;
+  p->nUsed++;
+}
+
+/*
+** Remove all entries from the map and free its memory.
+*/
+static void xlink_map_clear(XlinkMap *p){
+  int i;
+  for(i=0; i<p->nSlot; i++) fossil_free(p->a[i].zKey);
+  fossil_free(p->a);
+  memset(p, 0, sizeof(*p));
+}
+
+/*
+** Translate an artifact hash from an F-card into a record ID, creating
+** a phantom if the artifact is not yet known.
+*/
+static int xlink_uuid_to_rid(const char *zUuid){
+  int rid;
+  if( !manifest_crosslink_busy ) return uuid_to_rid(zUuid, 1);
+  rid = xlink_map_find(&xlinkRid, zUuid);
+  if( rid==0 ){
+    rid = uuid_to_rid(zUuid, 1);
+    if( rid ) xlink_map_insert(&xlinkRid, zUuid, rid);
+  }
+  return rid;
+}
+
 /*
 ** Translate a filename into a filename-id (fnid).  Create a new fnid
 ** if no previously exists.
@@ -1460,6 +1558,10 @@ ManifestFile *manifest_file_next(
 static int filename_to_fnid(const char *zFilename){
   static Stmt q1, s1;
   int fnid;
+  if( manifest_crosslink_busy ){
+    fnid = xlink_map_find(&xlinkFnid, zFilename);
+    if( fnid ) return fnid;
+  }
   db_static_prepare(&q1, "SELECT fnid FROM filename WHERE name=:fn");
   db_bind_text(&q1, ":fn", zFilename);
   fnid = 0;
@@ -1473,9 +1575,63 @@ static int filename_to_fnid(const char *zFilename){
     db_exec(&s1);
     fnid = db_last_insert_rowid();
   }
+  if( manifest_crosslink_busy ){
+    xlink_map_insert(&xlinkFnid, zFilename, fnid);
+  }
   return fnid;
 }
 
+/*
+** New MLINK rows are collected here by add_one_mlink() and written by
+** mlink_flush() using a single multi-row INSERT when the batch is full.
+** Each row holds mid, fid, pmid, pid, fnid, pfnid, mperm and isaux,
+** in that order.
+*/
+#define MLINK_BATCH 64
+static struct {
+  int n;                      /* Number of rows pending */
+  int a[MLINK_BATCH][8];      /* The pending rows */
+} mlinkPending;
+
+/*
+** Write all pending MLINK rows into the database.
+*/
+static void mlink_flush(void){
+  static Stmt sAll, s1;
+  int i, j;
+  if( mlinkPending.n==MLINK_BATCH ){
+    if( !db_static_stmt_is_init(&sAll) ){
+      Blob sql;
+      blob_init(&sql, 0, 0);
+      blob_append(&sql,
+        "INSERT INTO mlink(mid,fid,pmid,pid,fnid,pfnid,mperm,isaux)VALUES", -1);
+      for(i=0; i<MLINK_BATCH; i++){
+        blob_append(&sql, i ? ",(?,?,?,?,?,?,?,?)" : "(?,?,?,?,?,?,?,?)", -1);
+      }
+      db_static_prepare(&sAll, "%s", blob_sql_text(&sql));
+      blob_reset(&sql);
+    }
+    for(i=0; i<MLINK_BATCH; i++){
+      for(j=0; j<8; j++){
+        sqlite3_bind_int(sAll.pStmt, i*8+j+1, mlinkPending.a[i][j]);
+      }
+    }
+    db_exec(&sAll);
+  }else{
+    db_static_prepare(&s1,
+      "INSERT INTO mlink(mid,fid,pmid,pid,fnid,pfnid,mperm,isaux)"
+      "VALUES(?,?,?,?,?,?,?,?)"
+    );
+    for(i=0; i<mlinkPending.n; i++){
+      for(j=0; j<8; j++){
+        sqlite3_bind_int(s1.pStmt, j+1, mlinkPending.a[i][j]);
+      }
+      db_exec(&s1);
+    }
+  }
+  mlinkPending.n = 0;
+}
+
 /*
 ** Compute an appropriate mlink.mperm integer for the permission string
 ** of a file.
@@ -1514,7 +1670,7 @@ static void add_one_mlink(
 ){
   int fnid, pfnid, pid, fid;
   int doInsert;
-  static Stmt s1, s2;
+  static Stmt s2;
 
   fnid = filename_to_fnid(zFilename);
   if( zPrior==0 ){
@@ -1525,17 +1681,18 @@ static void add_one_mlink(
   if( zFromUuid==0 || zFromUuid[0]==0 ){
     pid = 0;
   }else{
-    pid = uuid_to_rid(zFromUuid, 1);
+    pid = xlink_uuid_to_rid(zFromUuid);
   }
   if( zToUuid==0 || zToUuid[0]==0 ){
     fid = 0;
   }else{
-    fid = uuid_to_rid(zToUuid, 1);
+    fid = xlink_uuid_to_rid(zToUuid);
     if( isPublic ) content_make_public(fid);
   }
   if( isPrimary ){
     doInsert = 1;
   }else{
+    mlink_flush();
     db_static_prepare(&s2,
       "SELECT 1 FROM mlink WHERE mid=:m AND fnid=:n AND NOT isaux"
     );
@@ -1545,19 +1702,16 @@ static void add_one_mlink(
     db_reset(&s2);
   }
   if( doInsert ){
-    db_static_prepare(&s1,
-      "INSERT INTO mlink(mid,fid,pmid,pid,fnid,pfnid,mperm,isaux)"
-      "VALUES(:m,:f,:pm,:p,:n,:pfn,:mp,:isaux)"
-    );
-    db_bind_int(&s1, ":m", mid);
-    db_bind_int(&s1, ":f", fid);
-    db_bind_int(&s1, ":pm", pmid);
-    db_bind_int(&s1, ":p", pid);
-    db_bind_int(&s1, ":n", fnid);
-    db_bind_int(&s1, ":pfn", pfnid);
-    db_bind_int(&s1, ":mp", mperm);
-    db_bind_int(&s1, ":isaux", isPrimary==0);
-    db_exec(&s1);
+    int *aRow = mlinkPending.a[mlinkPending.n++];
+    aRow[0] = mid;
+    aRow[1] = fid;
+    aRow[2] = pmid;
+    aRow[3] = pid;
+    aRow[4] = fnid;
+    aRow[5] = pfnid;
+    aRow[6] = mperm;
+    aRow[7] = isPrimary==0;
+    if( mlinkPending.n==MLINK_BATCH ) mlink_flush();
   }
   if( pid && fid ){
     content_deltify(pid, &fid, 1, 0);
@@ -1842,6 +1996,7 @@ static void add_mlink(
       }
     }
   }
+  mlink_flush();
   manifest_cache_insert(*ppOther);
 
   /* If pParent is the primary parent of pChild, also run this analysis
@@ -1930,6 +2085,7 @@ static int manifest_add_checkin_linkages(
       add_one_mlink(0, 0, rid, p->aFile[i].zUuid, p->aFile[i].zName, 0,
                     isPublic, 1, manifest_file_mperm(&p->aFile[i]));
     }
+    mlink_flush();
   }
   return parentid;
 }
@@ -1969,6 +2125,7 @@ void manifest_reparent_checkin(int rid, const char *zValue){
        rid, rid
     );
     manifest_add_checkin_linkages(rid,p,nParent,azParent);
+    fileage_index_reset();
     manifest_destroy(p);
   }
 reparent_abort:
@@ -1987,6 +2144,8 @@ reparent_abort:
 void manifest_crosslink_begin(void){
   assert( manifest_crosslink_busy==0 );
   manifest_crosslink_busy = 1;
+  xlink_map_clear(&xlinkFnid);
+  xlink_map_clear(&xlinkRid);
   manifest_create_event_triggers();
   db_begin_transaction();
   db_multi_exec(
@@ -2060,7 +2219,7 @@ int manifest_crosslink_end(int flags){
     cType = zId[0];
     zId++;
     if( cType=='t' ){
-      ticket_rebuild_entry(zId);
+      ticket_update_entry(zId);
       if( permitHooks && rc==TH_OK ){
         rc = xfer_run_script(zScript, zId, 0);
       }
@@ -2069,6 +2228,21 @@ int manifest_crosslink_end(int flags){
     }
   }
   db_finalize(&q);
+
+  /* Index new forum posts oldest first, so that each reply finds the
+  ** post it replies to already in place */
+  if( db_exists("SELECT 1 FROM pending_xlink WHERE id GLOB 'f*'") ){
+    db_prepare(&q,
+      "SELECT fpid FROM forumpost"
+      " WHERE fpid IN (SELECT CAST(substr(id,2) AS INT) FROM pending_xlink"
+      "                 WHERE id GLOB 'f*')"
+      " ORDER BY fmtime, fpid"
+    );
+    while( db_step(&q)==SQLITE_ROW ){
+      forum_post_index(db_column_int(&q, 0));
+    }
+    db_finalize(&q);
+  }
   db_multi_exec("DROP TABLE pending_xlink");
 
   /* If multiple check-ins happen close together in time, adjust their
@@ -2104,6 +2278,8 @@ int manifest_crosslink_end(int flags){
 
   db_end_transaction(0);
   manifest_crosslink_busy = 0;
+  xlink_map_clear(&xlinkFnid);
+  xlink_map_clear(&xlinkRid);
   return ( rc!=TH_ERROR );
 }
 
@@ -2411,6 +2587,7 @@ int manifest_crosslink(int rid, Blob *pContent, int flags){
       );
       backlink_extract(zCom, MT_NONE, rid, BKLNK_COMMENT, p->rDate, 1);
       fossil_free(zCom);
+      fileage_crosslink(rid);
 
       /* If this is a delta-manifest, record the fact that this repository
       ** contains delta manifests, to free the "commit" logic to generate
@@ -2817,6 +2994,13 @@ int manifest_crosslink(int rid, Blob *pContent, int flags){
       "VALUES(%d,%d,nullif(%d,0),nullif(%d,0),%.17g)",
       p->rid, froot, fprev, firt, p->rDate
     );
+    if( manifest_crosslink_busy ){
+      char zRid[20];
+      sqlite3_snprintf(sizeof(zRid), zRid, "%d", rid);
+      add_pending_crosslink('f', zRid);
+    }else{
+      forum_post_index(rid);
+    }
     if( firt==0 ){
       /* This is the start of a new thread, either the initial entry
       ** or an edit of the initial entry. */
@@ -759,6 +759,10 @@ void merge_cmd(void){
     debug_fv_dump( debugFlag>=2 );
   }
 
+  /* Fetch missing content of a blobless clone in one go */
+  shallow_prefetch("SELECT ridm FROM fv WHERE ridm>0 AND ridm!=ridp"
+                   " UNION SELECT ridp FROM fv WHERE ridp>0 AND ridm!=ridp");
+
   /************************************************************************
   ** All of the information needed to do the merge is now contained in the
   ** FV table.  Starting here, we begin to actually carry out the merge.
@@ -128,7 +128,9 @@ void moderation_disapprove(int objid){
       rid, rid, rid, rid, rid, rid
     );
     if( db_table_exists("repository","forumpost") ){
+      int froot = db_int(0, "SELECT froot FROM forumpost WHERE fpid=%d", rid);
       db_multi_exec("DELETE FROM forumpost WHERE fpid=%d", rid);
+      if( froot ) forum_thread_index(froot);
     }
     zTktid = db_text(0, "SELECT tktid FROM modreq WHERE objid=%d", rid);
     if( zTktid && zTktid[0] ){
@@ -159,6 +161,11 @@ void moderation_approve(char class, int rid){
     rid, rid, rid
   );
   db_multi_exec("DELETE FROM modreq WHERE objid=%d", rid);
+  if( class=='f' ){
+    forum_thread_index(
+      db_int(0, "SELECT froot FROM forumpost WHERE fpid=%d", rid)
+    );
+  }
   admin_log("Approved moderation of rid %c-%d.", class, rid);
   if( class!='a' ) search_doc_touch(class, rid, 0);
   setup_incr_cfgcnt();
@@ -1911,17 +1911,18 @@ void bigbloblist_page(void){
     "CREATE TEMP TABLE toshow(rid INTEGER PRIMARY KEY);"
     "INSERT INTO toshow(rid)"
     "  SELECT rid FROM blob"
-    "   ORDER BY length(content) DESC"
-    "   LIMIT %d;", n
+    "   ORDER BY %s DESC"
+    "   LIMIT %d;", packfile_stored_size_sql()/*safe-for-%s*/, n
   );
   describe_artifacts("IN toshow");
   db_prepare(&q,
     "SELECT description.rid, description.uuid, description.summary,"
-    "       length(blob.content), coalesce(delta.srcid,''),"
+    "       %s AS sz, coalesce(delta.srcid,''),"
     "       datetime(description.ctime)"
     "  FROM description, blob LEFT JOIN delta ON delta.rid=blob.rid"
     " WHERE description.rid=blob.rid"
-    " ORDER BY length(content) DESC"
+    " ORDER BY sz DESC",
+    packfile_stored_size_sql()/*safe-for-%s*/
   );
   @ <table cellpadding="2" cellspacing="0" border="1" \
   @  class='sortable' data-column-types='NnnttT' data-init-sort='0'>
@@ -1994,12 +1995,13 @@ void deltachain_page(void){
   describe_artifacts("IN (SELECT rid FROM toshow)");
   db_prepare(&q,
     "SELECT description.rid, description.uuid, description.summary,"
-    "       length(blob.content), coalesce(delta.srcid,''),"
+    "       %s, coalesce(delta.srcid,''),"
     "       datetime(description.ctime), toshow.gen, blob.size"
     "  FROM description, toshow, blob LEFT JOIN delta ON delta.rid=blob.rid"
     " WHERE description.rid=blob.rid"
     "   AND toshow.rid=description.rid"
-    " ORDER BY toshow.gen, description.ctime"
+    " ORDER BY toshow.gen, description.ctime",
+    packfile_stored_size_sql()/*safe-for-%s*/
   );
   @ <table cellpadding="2" cellspacing="0" border="1" \
   @  class='sortable' data-column-types='nNnnttT' data-init-sort='0'>
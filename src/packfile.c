@@ -0,0 +1,821 @@
+/*
+** Copyright (c) 2026 D. Richard Hipp
+**
+** This program is free software; you can redistribute it and/or
+** modify it under the terms of the Simplified BSD License (also
+** known as the "2-Clause License" or "FreeBSD License".)
+**
+** This program is distributed in the hope that it will be useful,
+** but without any warranty; without even the implied warranty of
+** merchantability or fitness for a particular purpose.
+**
+** Author contact information:
+**   drh@sqlite.org
+**
+*******************************************************************************
+**
+** This file implements out-of-line storage of large artifacts in
+** append-only pack files.
+**
+** When the "pack-threshold" setting is positive, any artifact whose
+** compressed content is at least that many bytes is written into a
+** pack file in the "REPO.packs" directory beside the repository database
+** instead of into BLOB.CONTENT.  The BLOB.CONTENT column is then NULL
+** and the BLOBPACK table records where the content can be found.
+**
+** Each pack file starts with an 8-byte magic string, followed by any
+** number of records.  Each record is:
+**
+**     1 byte          N, the length of the artifact hash
+**     N bytes         The artifact hash, as hexadecimal text
+**     4 bytes         S, the size of the content, big-endian
+**     S bytes         The compressed content, exactly as it would
+**                     otherwise appear in BLOB.CONTENT
+**
+** Records are never modified in place.  Space belonging to records that
+** are no longer referenced is reclaimed by "fossil repack".
+**
+** A NULL BLOB.CONTENT therefore no longer marks a phantom by itself.
+** Phantoms are the artifacts with BLOB.SIZE<0.  The same holds for the
+** CONTENT column of the ARTIFACT view.
+*/
+#include "config.h"
+#include "packfile.h"
+#include <assert.h>
+#ifdef _WIN32
+# include <io.h>
+#else
+# include <unistd.h>
+#endif
+
+/*
+** Every pack file begins with this magic string.
+*/
+#define PACK_MAGIC     "FRYPACK1"
+#define PACK_MAGIC_SZ  8
+
+/*
+** Start a new pack file once the current one grows beyond this many
+** bytes.  Keep this below 2GiB so that offsets fit in a "long".
+*/
+#define PACK_MAX_SIZE  1073741824
+
+/*
+** State information for the pack file subsystem.
+*/
+static struct {
+  int iThreshold;        /* Cached "pack-threshold" value.  -1 if unknown */
+  int hasTable;          /* BLOBPACK table exists: 1 yes, 0 no, -1 unknown */
+  int inCommitHook;      /* True if the commit hook has been installed */
+  int idWrite;           /* Pack file currently open for writing */
+  FILE *pWrite;          /* Open handle for pack idWrite */
+  int idRead;            /* Pack file currently open for reading */
+  FILE *pRead;           /* Open handle for pack idRead */
+} packState = { -1, -1, 0, 0, 0, 0, 0 };
+
+/*
+** Return the name of the directory that holds pack files for the
+** repository database zRepo.  The directory name is the name of the
+** repository with its suffix changed to ".packs", similar to the way
+** that the web cache database is named.
+*/
+static char *packfile_dir_of(const char *zRepo){
+  int i;
+  int n;
+
+  if( zRepo==0 ) return 0;
+  n = (int)strlen(zRepo);
+  for(i=n-1; i>=0; i--){
+    if( zRepo[i]=='/' ){ i = n; break; }
+    if( zRepo[i]=='.' ) break;
+  }
+  if( i<0 ) i = n;
+  return mprintf("%.*s.packs", i, zRepo);
+}
+
+/*
+** Return the name of the directory that holds pack files for the
+** currently open repository.
+*/
+char *packfile_dir(void){
+  return packfile_dir_of(g.zRepositoryName);
+}
+
+/*
+** Return the name of pack file number id.  The caller must free
+** the returned string.
+*/
+static char *packfile_name(int id){
+  char *zDir = packfile_dir();
+  char *zName = mprintf("%s/%06d.pack", zDir, id);
+  fossil_free(zDir);
+  return zName;
+}
+
+/*
+** SETTING: pack-threshold    width=10 default=0
+**
+** Artifacts whose compressed size is this many bytes or larger are
+** stored in append-only pack files in the REPO.packs directory beside
+** the repository database, rather than inside the repository database
+** itself.  This keeps very large binary artifacts from bloating the
+** database file.  A value of 0 disables pack file storage for new
+** artifacts.  Artifacts that are already in pack files remain readable
+** regardless of this setting.  Run "fossil repack" after changing this
+** setting to move existing artifacts to match.
+*/
+
+/*
+** Return the current value of the "pack-threshold" setting, or 0 if
+** new artifacts should never be written to pack files.
+*/
+int packfile_threshold(void){
+  if( packState.iThreshold<0 ){
+    packState.iThreshold = db_get_int("pack-threshold", 0);
+    if( packState.iThreshold<0 ) packState.iThreshold = 0;
+  }
+  return packState.iThreshold;
+}
+
+/*
+** Return true if compressed content of nByte bytes should be written
+** into a pack file.
+*/
+int packfile_wanted(int nByte){
+  int mx = packfile_threshold();
+  return mx>0 && nByte>=mx;
+}
+
+/*
+** Return true if the BLOBPACK table exists in the repository.
+*/
+int packfile_has_table(void){
+  if( packState.hasTable<0 ){
+    packState.hasTable = db_table_exists("repository","blobpack");
+  }
+  return packState.hasTable;
+}
+
+/*
+** Create the BLOBPACK table if it does not already exist.
+*/
+static void packfile_create_table(void){
+  if( packfile_has_table() ) return;
+  db_multi_exec(
+    "CREATE TABLE IF NOT EXISTS repository.blobpack(\n"
+    "  rid INTEGER PRIMARY KEY,    -- BLOB.RID of the artifact\n"
+    "  packid INTEGER NOT NULL,    -- Pack file number\n"
+    "  ofst INTEGER NOT NULL,      -- Offset of the record in the pack\n"
+    "  sz INTEGER NOT NULL         -- Size of the compressed content\n"
+    ");\n"
+    "CREATE INDEX IF NOT EXISTS repository.blobpack_packid"
+    " ON blobpack(packid);"
+  );
+  packState.hasTable = 1;
+}
+
+/*
+** Flush f and make sure its content has reached persistent storage.
+** Return non-zero on failure.
+*/
+static int packfile_fsync(FILE *f){
+  if( fflush(f) ) return 1;
+#ifdef _WIN32
+  return _commit(_fileno(f))!=0;
+#else
+  return fsync(fileno(f))!=0;
+#endif
+}
+
+/*
+** Flush the pack file that is open for writing to persistent storage
+** and close it.  This is called as a commit hook so that every pack
+** record referenced by the BLOBPACK table is durable before the
+** transaction that references it commits.
+*/
+static int packfile_sync_at_commit(void){
+  if( packState.pWrite ){
+    if( fflush(packState.pWrite) ){
+      fossil_warning("cannot flush pack file %d", packState.idWrite);
+      return 1;
+    }
+    packfile_fsync(packState.pWrite);
+    fclose(packState.pWrite);
+    packState.pWrite = 0;
+    packState.idWrite = 0;
+  }
+  return 0;
+}
+
+/*
+** Close all open pack files and forget cached state.  This is called
+** whenever the repository database is closed.
+*/
+void packfile_close(void){
+  if( packState.pWrite ){
+    fclose(packState.pWrite);
+    packState.pWrite = 0;
+  }
+  if( packState.pRead ){
+    fclose(packState.pRead);
+    packState.pRead = 0;
+  }
+  packState.idWrite = 0;
+  packState.idRead = 0;
+  packState.iThreshold = -1;
+  packState.hasTable = -1;
+}
+
+/*
+** Open the pack file that new records should be appended to and return
+** its handle.  The id of the pack is written into *pId.  If bFresh is
+** true, always start a new pack file rather than appending to the
+** newest existing one.
+*/
+static FILE *packfile_writer(int *pId, int bFresh){
+  int id;
+  char *zName;
+  i64 sz;
+
+  if( !packState.inCommitHook ){
+    db_commit_hook(packfile_sync_at_commit, 1100);
+    packState.inCommitHook = 1;
+  }
+  id = db_int(0, "SELECT max(packid) FROM blobpack");
+  if( packState.pWrite && packState.idWrite>id ) id = packState.idWrite;
+  if( bFresh ) id++;
+  if( id==0 ) id = 1;
+  for(;;){
+    if( packState.pWrite && packState.idWrite==id ){
+      long ofst = ftell(packState.pWrite);
+      zName = packfile_name(id);
+      sz = file_size(zName, ExtFILE);
+      fossil_free(zName);
+      if( sz==ofst ){
+        /* The cached handle is still positioned at the end of the file
+        ** on disk, so it is safe to keep appending to it */
+        if( ofst<PACK_MAX_SIZE ) break;
+        id++;
+        continue;
+      }
+      fclose(packState.pWrite);
+      packState.pWrite = 0;
+      packState.idWrite = 0;
+    }
+    if( packState.pWrite ){
+      fflush(packState.pWrite);
+      packfile_sync_at_commit();
+    }
+    zName = packfile_name(id);
+    sz = file_size(zName, ExtFILE);
+    if( sz>=PACK_MAX_SIZE ){
+      fossil_free(zName);
+      id++;
+      continue;
+    }
+    if( sz<0 ){
+      char *zDir = packfile_dir();
+      file_mkdir(zDir, ExtFILE, 0);
+      fossil_free(zDir);
+    }
+    packState.pWrite = fossil_fopen(zName, "ab");
+    if( packState.pWrite==0 ){
+      fossil_fatal("cannot open pack file \"%s\" for writing", zName);
+    }
+    fossil_free(zName);
+    packState.idWrite = id;
+    fseek(packState.pWrite, 0, SEEK_END);
+    if( ftell(packState.pWrite)==0 ){
+      fwrite(PACK_MAGIC, 1, PACK_MAGIC_SZ, packState.pWrite);
+    }
+    break;
+  }
+  *pId = id;
+  return packState.pWrite;
+}
+
+/*
+** Record where the compressed content for artifact rid is stored.
+**
+** If pCmpr is not NULL, append pCmpr as a new record to the current
+** pack file and point the BLOBPACK entry for rid at it.  The caller is
+** responsible for setting BLOB.CONTENT to NULL.
+**
+** If pCmpr is NULL, the caller is storing the content of rid directly
+** in BLOB.CONTENT, so remove any stale BLOBPACK entry for rid.
+**
+** zUuid is the hash of rid.  It may be NULL, in which case it is looked
+** up in the BLOB table.
+*/
+void packfile_set(int rid, const char *zUuid, Blob *pCmpr){
+  static Stmt q;
+  FILE *out;
+  int id;
+  long ofst;
+  int nUuid;
+  unsigned int sz;
+  unsigned char aHdr[5];
+  char *zToFree = 0;
+
+  if( pCmpr==0 ){
+    if( packfile_has_table() ){
+      db_multi_exec("DELETE FROM blobpack WHERE rid=%d", rid);
+    }
+    return;
+  }
+  packfile_create_table();
+  if( zUuid==0 ){
+    zUuid = zToFree = db_text(0, "SELECT uuid FROM blob WHERE rid=%d", rid);
+    if( zUuid==0 ) fossil_panic("no artifact with rid %d", rid);
+  }
+  nUuid = (int)strlen(zUuid);
+  assert( nUuid<256 );
+  sz = blob_size(pCmpr);
+  out = packfile_writer(&id, 0);
+  ofst = ftell(out);
+  aHdr[0] = (unsigned char)nUuid;
+  aHdr[1] = (sz>>24) & 0xff;
+  aHdr[2] = (sz>>16) & 0xff;
+  aHdr[3] = (sz>>8) & 0xff;
+  aHdr[4] = sz & 0xff;
+  if( fwrite(aHdr, 1, 1, out)!=1
+   || fwrite(zUuid, 1, nUuid, out)!=(size_t)nUuid
+   || fwrite(&aHdr[1], 1, 4, out)!=4
+   || fwrite(blob_buffer(pCmpr), 1, sz, out)!=sz
+   || fflush(out)
+  ){
+    fossil_fatal("write to pack file %d failed", id);
+  }
+  db_static_prepare(&q,
+    "REPLACE INTO blobpack(rid,packid,ofst,sz) VALUES(:rid,:id,:ofst,:sz)"
+  );
+  db_bind_int(&q, ":rid", rid);
+  db_bind_int(&q, ":id", id);
+  db_bind_int64(&q, ":ofst", ofst);
+  db_bind_int(&q, ":sz", (int)sz);
+  db_exec(&q);
+  fossil_free(zToFree);
+}
+
+/*
+** Open pack file id for reading.
+*/
+static FILE *packfile_reader(int id, int bReopen){
+  if( packState.pRead && (packState.idRead!=id || bReopen) ){
+    fclose(packState.pRead);
+    packState.pRead = 0;
+  }
+  if( packState.pRead==0 ){
+    char *zName = packfile_name(id);
+    if( packState.pWrite && packState.idWrite==id ){
+      fflush(packState.pWrite);
+    }
+    packState.pRead = fossil_fopen(zName, "rb");
+    fossil_free(zName);
+    packState.idRead = packState.pRead ? id : 0;
+  }
+  return packState.pRead;
+}
+
+/*
+** Read the record at offset ofst of pack file id into pOut.  If zUuid
+** is not NULL, the hash stored in the record must match zUuid.  Return
+** 1 on success and 0 if the record is unreadable.
+*/
+static int packfile_read_record(
+  int id,                /* Pack file number */
+  i64 ofst,              /* Offset of the record */
+  int sz,                /* Expected size of the content */
+  const char *zUuid,     /* Expected hash, or NULL */
+  Blob *pOut             /* Write the compressed content here */
+){
+  FILE *in;
+  unsigned char aHdr[5];
+  char zHash[256];
+  int nHash;
+  int attempt;
+
+  for(attempt=0; attempt<2; attempt++){
+    in = packfile_reader(id, attempt);
+    if( in==0 ) return 0;
+    if( fseek(in, (long)ofst, SEEK_SET) ) continue;
+    if( fread(aHdr, 1, 1, in)!=1 ) continue;
+    nHash = aHdr[0];
+    if( fread(zHash, 1, nHash, in)!=(size_t)nHash ) continue;
+    zHash[nHash] = 0;
+    if( fread(&aHdr[1], 1, 4, in)!=4 ) continue;
+    if( ((aHdr[1]<<24) | (aHdr[2]<<16) | (aHdr[3]<<8) | aHdr[4])!=sz ){
+      continue;
+    }
+    if( zUuid && fossil_strcmp(zHash, zUuid)!=0 ) continue;
+    blob_zero(pOut);
+    blob_resize(pOut, sz);
+    if( fread(blob_buffer(pOut), 1, sz, in)==(size_t)sz ) return 1;
+    blob_reset(pOut);
+  }
+  return 0;
+}
+
+/*
+** Load the compressed content of artifact rid from its pack file into
+** pOut.  Return 1 on success or 0 if rid is not in any pack file or
+** if its pack record cannot be read.
+*/
+int packfile_get(int rid, const char *zUuid, Blob *pOut){
+  static Stmt q;
+  int rc = 0;
+  if( !packfile_has_table() ) return 0;
+  db_static_prepare(&q, "SELECT packid, ofst, sz FROM blobpack WHERE rid=:rid");
+  db_bind_int(&q, ":rid", rid);
+  if( db_step(&q)==SQLITE_ROW ){
+    rc = packfile_read_record(db_column_int(&q,0), db_column_int64(&q,1),
+                              db_column_int(&q,2), zUuid, pOut);
+  }
+  db_reset(&q);
+  return rc;
+}
+
+/*
+** Return the number of bytes of compressed content held in a pack file
+** for artifact rid, or 0 if rid is not stored in a pack file.
+*/
+int packfile_size(int rid){
+  if( !packfile_has_table() ) return 0;
+  return db_int(0, "SELECT sz FROM blobpack WHERE rid=%d", rid);
+}
+
+/*
+** Return an SQL expression for the number of bytes of stored content of
+** the BLOB row that is in scope as "blob", whether the content is held
+** in BLOB.CONTENT or in a pack file.
+*/
+const char *packfile_stored_size_sql(void){
+  if( !packfile_has_table() ) return "octet_length(blob.content)";
+  return "coalesce(octet_length(blob.content),"
+         "(SELECT sz FROM blobpack WHERE blobpack.rid=blob.rid))";
+}
+
+/*
+** Return an SQL expression that is true if the BLOB row that is in scope
+** as "blob" has its content stored, either in BLOB.CONTENT or in a pack
+** file.  Only phantoms are left out.
+*/
+const char *packfile_is_stored_sql(void){
+  if( !packfile_has_table() ) return "(blob.content IS NOT NULL)";
+  return "(blob.content IS NOT NULL"
+         " OR blob.rid IN (SELECT rid FROM blobpack))";
+}
+
+/*
+** If artifact rid is stored in a pack file, move its content back
+** into BLOB.CONTENT.  Use this before copying BLOB rows wholesale
+** with SQL.
+*/
+void packfile_unpack(int rid){
+  Blob x;
+  char *zUuid;
+  if( !packfile_has_table() ) return;
+  zUuid = db_text(0, "SELECT uuid FROM blob WHERE rid=%d"
+                     " AND content IS NULL AND size>=0", rid);
+  if( zUuid && packfile_get(rid, zUuid, &x) ){
+    Stmt s;
+    db_prepare(&s, "UPDATE blob SET content=:c WHERE rid=%d", rid);
+    db_bind_blob(&s, ":c", &x);
+    db_exec(&s);
+    db_finalize(&s);
+    blob_reset(&x);
+    packfile_set(rid, zUuid, 0);
+  }
+  fossil_free(zUuid);
+}
+
+/*
+** Move artifacts between BLOB.CONTENT and pack files so that storage
+** agrees with the current "pack-threshold" setting, then rewrite any
+** pack files that contain a significant amount of unreferenced space.
+** Pack files that are no longer referenced are deleted after the
+** changes commit.
+**
+** Return the number of bytes of pack file space reclaimed.  The number
+** of artifacts moved or rewritten is written into *pnMoved.
+*/
+i64 packfile_repack(int *pnMoved){
+  Stmt q, s;
+  int nMoved = 0;
+  i64 nReclaim = 0;
+  int mx = packfile_threshold();
+  int bFresh = 1;
+  int idHigh = 0;        /* Largest pack id that might exist on disk */
+  char *zDir;
+
+  db_begin_transaction();
+
+  /* Move large artifacts out of the database into pack files */
+  if( mx>0 ){
+    db_multi_exec(
+      "CREATE TEMP TABLE packmove AS"
+      " SELECT rid FROM blob WHERE size>=0 AND octet_length(content)>=%d", mx
+    );
+    db_prepare(&q,
+      "SELECT rid, uuid, content FROM blob WHERE rid IN packmove"
+    );
+    db_prepare(&s, "UPDATE blob SET content=NULL WHERE rid=:rid");
+    while( db_step(&q)==SQLITE_ROW ){
+      Blob x;
+      int rid = db_column_int(&q, 0);
+      db_ephemeral_blob(&q, 2, &x);
+      packfile_set(rid, db_column_text(&q,1), &x);
+      db_bind_int(&s, ":rid", rid);
+      db_exec(&s);
+      db_reset(&s);
+      nMoved++;
+    }
+    db_finalize(&s);
+    db_finalize(&q);
+    db_multi_exec("DROP TABLE packmove");
+  }
+  if( !packfile_has_table() ){
+    db_end_transaction(0);
+    if( pnMoved ) *pnMoved = nMoved;
+    return 0;
+  }
+  idHigh = db_int(0, "SELECT max(packid) FROM blobpack");
+
+  /* Move small artifacts back into the database */
+  db_multi_exec(
+    "CREATE TEMP TABLE packmove AS"
+    " SELECT rid, uuid FROM blobpack JOIN blob USING(rid)"
+    "  WHERE blob.content IS NULL AND blob.size>=0"
+    "    AND (%d<=0 OR blobpack.sz<%d)", mx, mx
+  );
+  db_prepare(&q, "SELECT rid FROM packmove");
+  while( db_step(&q)==SQLITE_ROW ){
+    packfile_unpack(db_column_int(&q,0));
+    nMoved++;
+  }
+  db_finalize(&q);
+  db_multi_exec("DROP TABLE packmove");
+
+  /* Forget records for artifacts that have been removed or that
+  ** have since been stored directly in the database */
+  db_multi_exec(
+    "DELETE FROM blobpack WHERE rid NOT IN"
+    " (SELECT rid FROM blob WHERE content IS NULL AND size>=0)"
+  );
+
+  /* Rewrite pack files where at least a quarter of the space is no
+  ** longer referenced */
+  db_multi_exec(
+    "CREATE TEMP TABLE packlive(packid INTEGER PRIMARY KEY, nLive INT);"
+    "INSERT INTO packlive"
+    " SELECT packid, %d+sum(sz+5+length(blob.uuid))"
+    "   FROM blobpack JOIN blob USING(rid) GROUP BY packid;",
+    PACK_MAGIC_SZ
+  );
+  db_prepare(&q, "SELECT packid, nLive FROM packlive ORDER BY packid");
+  while( db_step(&q)==SQLITE_ROW ){
+    int id = db_column_int(&q, 0);
+    i64 nLive = db_column_int64(&q, 1);
+    char *zName = packfile_name(id);
+    i64 sz = file_size(zName, ExtFILE);
+    fossil_free(zName);
+    if( sz<=0 || nLive*4 > sz*3 ) continue;
+    nReclaim += sz - nLive;
+    if( bFresh ){
+      /* Start a new pack so that the rewritten records never land in a
+      ** pack that is itself being rewritten */
+      int idNew;
+      packfile_writer(&idNew, 1);
+      if( idNew>idHigh ) idHigh = idNew;
+      bFresh = 0;
+    }
+    db_prepare(&s,
+      "SELECT rid, uuid, ofst, sz FROM blobpack JOIN blob USING(rid)"
+      " WHERE packid=%d ORDER BY ofst", id
+    );
+    while( db_step(&s)==SQLITE_ROW ){
+      Blob x;
+      if( packfile_read_record(id, db_column_int64(&s,2),
+                               db_column_int(&s,3),
+                               db_column_text(&s,1), &x) ){
+        packfile_set(db_column_int(&s,0), db_column_text(&s,1), &x);
+        blob_reset(&x);
+        nMoved++;
+      }
+    }
+    db_finalize(&s);
+  }
+  db_finalize(&q);
+  db_multi_exec("DROP TABLE packlive");
+  db_end_transaction(0);
+
+  /* Delete pack files that are no longer referenced.  Hold a write
+  ** transaction while doing so, so that no other process can be
+  ** appending to one of the packs that is being removed. */
+  zDir = packfile_dir();
+  if( zDir && file_isdir(zDir, ExtFILE)==1 ){
+    int id;
+    db_begin_write();
+    for(id=1; id<=idHigh; id++){
+      char *zName;
+      if( db_exists("SELECT 1 FROM blobpack WHERE packid=%d", id) ) continue;
+      zName = packfile_name(id);
+      if( file_size(zName, ExtFILE)>=0 ){
+        if( id==packState.idRead && packState.pRead ){
+          fclose(packState.pRead);
+          packState.pRead = 0;
+          packState.idRead = 0;
+        }
+        file_delete(zName);
+      }
+      fossil_free(zName);
+    }
+    db_end_transaction(0);
+  }
+  fossil_free(zDir);
+  if( pnMoved ) *pnMoved = nMoved;
+  return nReclaim;
+}
+
+/*
+** Verify that every artifact stored in a pack file can be located and
+** that its pack record carries the expected hash.  Report problems on
+** standard output and return the number of errors seen.
+*/
+int packfile_check(void){
+  Stmt q;
+  int nErr = 0;
+  int nArtifact = 0;
+  int nPack;
+
+  if( !packfile_has_table() ) return 0;
+  db_prepare(&q,
+    "SELECT blob.rid, blob.uuid, packid, ofst, sz, blob.content IS NULL"
+    "  FROM blobpack LEFT JOIN blob USING(rid)"
+    " ORDER BY packid, ofst"
+  );
+  while( db_step(&q)==SQLITE_ROW ){
+    Blob x;
+    int rid = db_column_int(&q, 0);
+    int id = db_column_int(&q, 2);
+    if( rid==0 ) continue;
+    if( !db_column_int(&q, 5) ){
+      fossil_print("artifact %d is stored both inline and in pack %d\n",
+                   rid, id);
+      nErr++;
+      continue;
+    }
+    if( !packfile_read_record(id, db_column_int64(&q,3), db_column_int(&q,4),
+                              db_column_text(&q,1), &x) ){
+      fossil_print("artifact %d missing or damaged in pack %d"
+                   " at offset %lld\n", rid, id, db_column_int64(&q,3));
+      nErr++;
+      continue;
+    }
+    blob_reset(&x);
+    nArtifact++;
+  }
+  db_finalize(&q);
+  nPack = db_int(0, "SELECT count(DISTINCT packid) FROM blobpack");
+  fossil_print("%d artifacts in %d pack files checked: %d errors\n",
+               nArtifact, nPack, nErr);
+  return nErr;
+}
+
+/*
+** Copy the pack files of repository zSrc into the pack file directory of
+** repository zDest.  The currently open repository must be a copy of
+** zSrc, as its BLOBPACK table determines which pack files are copied.
+** This is used by "fossil backup" and by cloning from a local file so
+** that the new repository is complete.
+*/
+void packfile_copy(const char *zSrc, const char *zDest){
+  Stmt q;
+  char *zSrcDir;
+  char *zDestDir;
+
+  if( !packfile_has_table() || !db_exists("SELECT 1 FROM blobpack") ) return;
+  zSrcDir = packfile_dir_of(zSrc);
+  zDestDir = packfile_dir_of(zDest);
+  file_mkdir(zDestDir, ExtFILE, 0);
+  db_prepare(&q, "SELECT DISTINCT packid FROM blobpack ORDER BY 1");
+  while( db_step(&q)==SQLITE_ROW ){
+    int id = db_column_int(&q, 0);
+    char *zFrom = mprintf("%s/%06d.pack", zSrcDir, id);
+    char *zTo = mprintf("%s/%06d.pack", zDestDir, id);
+    file_copy(zFrom, zTo);
+    fossil_free(zFrom);
+    fossil_free(zTo);
+  }
+  db_finalize(&q);
+  fossil_free(zSrcDir);
+  fossil_free(zDestDir);
+}
+
+/*
+** Copy the rest of the open file in to the open file out, starting at
+** the current positions of both, and sync out to persistent storage.
+** zTo is the name of out, for error messages.  Return the number of
+** bytes copied.
+*/
+static i64 packfile_copy_rest(FILE *in, FILE *out, const char *zTo){
+  char aBuf[65536];
+  size_t n;
+  i64 nCopy = 0;
+  while( (n = fread(aBuf, 1, sizeof(aBuf), in))>0 ){
+    if( fwrite(aBuf, 1, n, out)!=n ){
+      fossil_fatal("cannot write \"%s\"", zTo);
+    }
+    nCopy += n;
+  }
+  if( packfile_fsync(out) ) fossil_fatal("cannot sync \"%s\"", zTo);
+  return nCopy;
+}
+
+/*
+** Bring the copy of pack file zFrom at zTo up to date, and sync it to
+** persistent storage.  Pack files are only ever appended to, so if zTo
+** is shorter than zFrom only the missing tail is copied.  The last bytes
+** already in zTo are compared against zFrom first, in case the pack
+** number has been reused for a new pack since the copy was made.  A pack
+** that has to be copied in full is written under a temporary name and
+** then renamed, so the earlier copy stays intact until the new one is
+** complete.  Return the number of bytes written.
+*/
+static i64 packfile_copy_tail(const char *zFrom, const char *zTo){
+  i64 szFrom = file_size(zFrom, ExtFILE);
+  i64 szTo = file_size(zTo, ExtFILE);
+  FILE *in, *out = 0;
+  char aNew[4096], aOld[4096];
+  i64 nCheck, nCopy = 0;
+  int bSame = 0;
+  char *zTmp;
+
+  if( szFrom<0 ) return 0;
+  if( szTo==szFrom ) return 0;
+  in = fossil_fopen(zFrom, "rb");
+  if( in==0 ) fossil_fatal("cannot open \"%s\"", zFrom);
+  if( szTo>=PACK_MAGIC_SZ && szTo<szFrom ){
+    out = fossil_fopen(zTo, "r+b");
+  }
+  if( out ){
+    nCheck = szTo<(i64)sizeof(aOld) ? szTo : (i64)sizeof(aOld);
+    fseek(in, (long)(szTo-nCheck), SEEK_SET);
+    fseek(out, (long)(szTo-nCheck), SEEK_SET);
+    bSame = fread(aNew, 1, (size_t)nCheck, in)==(size_t)nCheck
+         && fread(aOld, 1, (size_t)nCheck, out)==(size_t)nCheck
+         && memcmp(aNew, aOld, (size_t)nCheck)==0;
+  }
+  if( bSame ){
+    fseek(out, (long)szTo, SEEK_SET);
+    nCopy = packfile_copy_rest(in, out, zTo);
+    fclose(out);
+    fclose(in);
+    return nCopy;
+  }
+  if( out ) fclose(out);
+  zTmp = mprintf("%s-new", zTo);
+  out = fossil_fopen(zTmp, "wb");
+  if( out==0 ) fossil_fatal("cannot open \"%s\" for writing", zTmp);
+  fseek(in, 0, SEEK_SET);
+  nCopy = packfile_copy_rest(in, out, zTmp);
+  fclose(out);
+  fclose(in);
+  if( file_rename(zTmp, zTo, 0, 0) ){
+    fossil_fatal("cannot rename \"%s\" to \"%s\"", zTmp, zTo);
+  }
+  fossil_free(zTmp);
+  return nCopy;
+}
+
+/*
+** Like packfile_copy(), except that zDest may already hold an earlier
+** copy of the pack files of zSrc, as left by a previous incremental
+** backup.  Only new pack files and the new tails of existing ones are
+** copied, and every pack that is written is synced to persistent storage
+** before this routine returns.  Return the number of bytes written.
+*/
+i64 packfile_copy_incremental(const char *zSrc, const char *zDest){
+  Stmt q;
+  char *zSrcDir;
+  char *zDestDir;
+  i64 nByte = 0;
+
+  if( !packfile_has_table() || !db_exists("SELECT 1 FROM blobpack") ) return 0;
+  zSrcDir = packfile_dir_of(zSrc);
+  zDestDir = packfile_dir_of(zDest);
+  file_mkdir(zDestDir, ExtFILE, 0);
+  db_prepare(&q, "SELECT DISTINCT packid FROM blobpack ORDER BY 1");
+  while( db_step(&q)==SQLITE_ROW ){
+    int id = db_column_int(&q, 0);
+    char *zFrom = mprintf("%s/%06d.pack", zSrcDir, id);
+    char *zTo = mprintf("%s/%06d.pack", zDestDir, id);
+    nByte += packfile_copy_tail(zFrom, zTo);
+    fossil_free(zFrom);
+    fossil_free(zTo);
+  }
+  db_finalize(&q);
+  fossil_free(zSrcDir);
+  fossil_free(zDestDir);
+  return nByte;
+}
@@ -784,6 +784,14 @@ int vxprintf(
         int limit = flag_alternateform ? va_arg(ap,int) : -1;
         char *zMem = va_arg(ap,char*);
         if( zMem==0 ) zMem = "";
+        if( pBlob && precision<0 && width==0 ){
+          /* Common case: encode straight into the output */
+          int nOld = blob_size(pBlob);
+          htmlize_append(pBlob, zMem, limit);
+          count += blob_size(pBlob) - nOld;
+          length = 0;
+          break;
+        }
         zExtra = bufpt = htmlize(zMem, limit);
         length = strlen(bufpt);
         if( precision>=0 && precision<length ) length = precision;
@@ -793,6 +801,14 @@ int vxprintf(
         int limit = flag_alternateform ? va_arg(ap,int) : -1;
         char *zMem = va_arg(ap,char*);
         if( zMem==0 ) zMem = "";
+        if( pBlob && precision<0 && width==0 ){
+          /* Common case: encode straight into the output */
+          int nOld = blob_size(pBlob);
+          httpize_append(pBlob, zMem, limit);
+          count += blob_size(pBlob) - nOld;
+          length = 0;
+          break;
+        }
         zExtra = bufpt = httpize(zMem, limit);
         length = strlen(bufpt);
         if( precision>=0 && precision<length ) length = precision;
@@ -802,6 +818,14 @@ int vxprintf(
         int limit = flag_alternateform ? va_arg(ap,int) : -1;
         char *zMem = va_arg(ap,char*);
         if( zMem==0 ) zMem = "";
+        if( pBlob && precision<0 && width==0 ){
+          /* Common case: encode straight into the output */
+          int nOld = blob_size(pBlob);
+          urlize_append(pBlob, zMem, limit);
+          count += blob_size(pBlob) - nOld;
+          length = 0;
+          break;
+        }
         zExtra = bufpt = urlize(zMem, limit);
         length = strlen(bufpt);
         if( precision>=0 && precision<length ) length = precision;
@@ -908,7 +932,9 @@ char *mprintf(const char *zFormat, ...){
   return z;
 }
 char *vmprintf(const char *zFormat, va_list ap){
-  Blob blob = empty_blob;
+  Blob blob;
+  char zBuf[200];
+  blob_init_buffer(&blob, zBuf, sizeof(zBuf));
   blob_vappendf(&blob, zFormat, ap);
   blob_materialize(&blob);
   return blob.aData;
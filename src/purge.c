@@ -156,6 +156,11 @@ int purge_artifact_list(
       content_undelta(rid);
     }
     db_finalize(&q);
+    db_prepare(&q, "SELECT rid FROM blob WHERE rid IN \"%w\"", zTab);
+    while( db_step(&q)==SQLITE_ROW ){
+      packfile_unpack(db_column_int(&q, 0));
+    }
+    db_finalize(&q);
     db_multi_exec(
       "INSERT INTO purgeitem(peid,orid,uuid,sz,isPrivate,desc,data)"
       "  SELECT %d, rid, uuid, size,"
@@ -195,6 +200,11 @@ int purge_artifact_list(
                 "    OR origid IN \"%w\"", zTab, zTab, zTab);
   db_multi_exec("DELETE FROM backlink WHERE srctype=0 AND srcid IN \"%w\"",
                 zTab);
+  fileage_index_reset();
+  if( db_table_exists("repository","dirent") ){
+    db_multi_exec("DELETE FROM dirent WHERE mid IN \"%w\"", zTab);
+    db_multi_exec("DELETE FROM dirindex WHERE mid IN \"%w\"", zTab);
+  }
   db_multi_exec(
     "CREATE TEMP TABLE \"%w_tickets\" AS"
     " SELECT DISTINCT tkt_uuid FROM ticket WHERE tkt_id IN"
@@ -21,6 +21,7 @@
 #include "rebuild.h"
 #include <assert.h>
 #include <errno.h>
+#include <time.h>
 
 /*
 ** Update the schema as necessary
@@ -173,6 +174,13 @@ void rebuild_schema_update_2_0(void){
     }
     fossil_free(z);
   }
+  /* The ARTIFACT view is for use by outside tools that read the
+  ** repository directly, so it is kept free of application-defined
+  ** SQL functions.  Its CONTENT column is NULL for an artifact that is
+  ** stored in a pack file, just as BLOB.CONTENT is.  Such artifacts are
+  ** the rows with SIZE>=0 and a matching BLOBPACK entry.  Use
+  ** "fossil test-content-rawget" or "fossil artifact" to get at their
+  ** content. */
   db_multi_exec(
     "CREATE VIEW IF NOT EXISTS "
     "  repository.artifact(rid,rcvid,size,atype,srcid,hash,content) AS "
@@ -320,7 +328,11 @@ static void rebuild_step(int rid, int size, Blob *pBase){
       db_bind_int(&q2, ":rid", cid);
       if( db_step(&q2)==SQLITE_ROW && (sz = db_column_int(&q2,1))>=0 ){
         Blob delta, next;
-        db_ephemeral_blob(&q2, 0, &delta);
+        if( db_column_type(&q2, 0)!=SQLITE_NULL ){
+          db_ephemeral_blob(&q2, 0, &delta);
+        }else{
+          content_raw_get(cid, &delta);
+        }
         blob_uncompress(&delta, &delta);
         blob_delta_apply(pBase, &delta, &next);
         blob_reset(&delta);
@@ -364,6 +376,134 @@ static void rebuild_tag_trunk(void){
   tag_add_artifact("", "branch", zUuid, "trunk", 2, 0, 0);
 }
 
+/*
+** Recompute the TICKET and TICKETCHNG tables from ticket artifacts.
+*/
+static void rebuild_derived_ticket(void){
+  ticket_rebuild();
+}
+
+/*
+** Recompute the forum thread index from the FORUMPOST table, if the
+** index has been created.
+*/
+static void rebuild_derived_forum(void){
+  if( !db_table_exists("repository","forumtopic") ) return;
+  db_begin_transaction();
+  db_multi_exec("DELETE FROM forumtree; DELETE FROM forumtopic;");
+  forum_thread_index_all();
+  db_end_transaction(0);
+}
+
+/*
+** Recompute the full-text search index, if there is one.
+*/
+static void rebuild_derived_search(void){
+  if( search_index_exists() ){
+    search_drop_index();
+    search_rebuild_index();
+  }
+}
+
+/*
+** Groups of derived tables that can be recomputed without a full
+** rebuild.  Each group has a version number that must be increased
+** whenever the way its tables are computed changes.  The versions in
+** effect are kept in the "derived-schema" config entry as a list of
+** NAME:VERSION pairs separated by spaces.  All other derived tables
+** (MLINK, PLINK, EVENT, TAGXREF, BACKLINK and so forth) are covered by
+** AUX_SCHEMA_MAX and are only recomputed by a full rebuild.
+*/
+static const struct RebuildDerived {
+  const char *zName;         /* Name used in "derived-schema" */
+  int iVersion;              /* Current version of these tables */
+  const char *zTables;       /* Tables recomputed */
+  const char *zSource;       /* What they are computed from */
+  void (*xRederive)(void);   /* Recompute the tables */
+} aDerived[] = {
+  { "ticket", 1, "TICKET and TICKETCHNG", "ticket artifacts",
+    rebuild_derived_ticket },
+  { "forum",  1, "FORUMTREE and FORUMTOPIC", "forum posts",
+    rebuild_derived_forum },
+  { "search", 1, "full-text search index", "all indexed documents",
+    rebuild_derived_search },
+};
+
+/*
+** Record that every group of derived tables is current.
+*/
+void rebuild_derived_set_current(void){
+  Blob x;
+  int i;
+  blob_init(&x, 0, 0);
+  for(i=0; i<count(aDerived); i++){
+    blob_appendf(&x, "%s%s:%d", i ? " " : "", aDerived[i].zName,
+                 aDerived[i].iVersion);
+  }
+  db_unprotect(PROTECT_CONFIG);
+  db_set("derived-schema", blob_str(&x), 0);
+  db_protect_pop();
+  blob_reset(&x);
+}
+
+/*
+** Return true if the NAME:VERSION pair for aDerived[i] appears in the
+** space-separated list zList.
+*/
+static int rebuild_derived_is_current(const char *zList, int i){
+  char *zWant = mprintf("%s:%d", aDerived[i].zName, aDerived[i].iVersion);
+  int n = (int)strlen(zWant);
+  int rc = 0;
+  while( zList[0] ){
+    int k;
+    while( zList[0]==' ' ) zList++;
+    for(k=0; zList[k] && zList[k]!=' '; k++){}
+    if( k==n && strncmp(zList, zWant, n)==0 ){
+      rc = 1;
+      break;
+    }
+    zList += k;
+  }
+  fossil_free(zWant);
+  return rc;
+}
+
+/*
+** Bring the derived tables up to date when the aux schema is already
+** current.  Only groups of tables whose version differs from the one
+** recorded in "derived-schema" are recomputed, each from just the
+** artifacts that feed it.
+**
+** A repository with no "derived-schema" entry was last rebuilt before
+** the entry was introduced, when every group was at version 1.  It is
+** treated as being at version 1 rather than forcing a full rebuild.
+*/
+static void rebuild_derived_update(void){
+  char *zList = db_get("derived-schema", 0);
+  int i;
+  int nDone = 0;
+  if( zList==0 ){
+    Blob x;
+    blob_init(&x, 0, 0);
+    for(i=0; i<count(aDerived); i++){
+      blob_appendf(&x, " %s:1", aDerived[i].zName);
+    }
+    zList = blob_str(&x);
+    nDone = 1;
+  }
+  for(i=0; i<count(aDerived); i++){
+    if( rebuild_derived_is_current(zList, i) ) continue;
+    if( !g.fQuiet ){
+      fossil_print("recomputing %s from %s\n",
+                   aDerived[i].zTables, aDerived[i].zSource);
+    }
+    aDerived[i].xRederive();
+    nDone++;
+  }
+  fossil_free(zList);
+  if( nDone ) rebuild_derived_set_current();
+}
+
 /*
 ** Core function to rebuild the information in the derived tables of a
 ** fossil repository from the blobs. This function is shared between
@@ -394,7 +534,8 @@ int rebuild_db(int doOut, int doClustering){
                        "'config','shun','private','reportfmt',"
                        "'concealed','accesslog','modreq',"
                        "'purgeevent','purgeitem','unversioned',"
-                       "'subscriber','pending_alert','chat')"
+                       "'subscriber','pending_alert','chat','blobpack',"
+                       "'shallow','shallowtag','cmprdict')"
      " AND name NOT GLOB 'sqlite_*'"
      " AND name NOT GLOB 'fx_*'"
   );
@@ -465,7 +606,11 @@ int rebuild_db(int doOut, int doClustering){
   }
   db_finalize(&s);
   manifest_crosslink_end(MC_NONE);
-  rebuild_tag_trunk();
+  if( shallow_is_clone() ){
+    shallow_apply_tags();
+  }else{
+    rebuild_tag_trunk();
+  }
   if( ttyOutput && !g.fQuiet && totalSize>0 ){
     processCnt += incrSize;
     percent_complete((processCnt*1000)/totalSize);
@@ -479,6 +624,7 @@ int rebuild_db(int doOut, int doClustering){
     percent_complete(1000);
     fossil_print("\n");
   }
+  rebuild_derived_set_current();
   db_protect_pop();
   return errCnt;
 }
@@ -575,6 +721,152 @@ i64 extra_deltification(int *pnDelta){
 }
 
 
+/*
+** SETTING: auto-repack               width=10 default=0
+** If this setting is a positive integer N, then the backoffice looks
+** at up to N artifacts on each run and tries to store them as deltas
+** against newer artifacts, the way the "repack" command does.  Each run
+** resumes where the previous one stopped and is also limited to a few
+** seconds of work.  Space that is freed is returned to the filesystem
+** if the repository uses incremental auto-vacuum, which the "repack"
+** command turns on while this setting is positive.  Zero disables
+** this background repacking.
+*/
+
+/*
+** Number of artifacts examined per transaction, and the maximum number
+** of seconds spent by a single call to repack_backoffice().
+*/
+#define REPACK_CHUNK       50
+#define REPACK_TIME_LIMIT  5
+
+/*
+** Try to deltify the single undeltaed artifact rid against up to
+** N_NEIGHBOR newer undeltaed artifacts of the same kind, choosing
+** neighbors the same way as extra_deltification().  Return the number
+** of bytes saved.
+*/
+static int repack_one(int rid){
+  Stmt q;
+  int aSrc[N_NEIGHBOR];
+  int nSrc = 0;
+  if( db_exists("SELECT 1 FROM event WHERE objid=%d AND type='ci'", rid) ){
+    db_prepare(&q,
+       "SELECT blob.rid FROM event, blob"
+       " WHERE blob.rid=event.objid"
+       "   AND event.type='ci'"
+       "   AND event.mtime>(SELECT mtime FROM event WHERE objid=%d)"
+       "   AND NOT EXISTS(SELECT 1 FROM delta WHERE rid=blob.rid)"
+       " ORDER BY event.mtime LIMIT %d", rid, N_NEIGHBOR
+    );
+  }else{
+    int fnid = 0;
+    double mtime = 0.0;
+    db_prepare(&q,
+       "SELECT mlink.fnid, max(plink.mtime) FROM mlink, plink"
+       " WHERE mlink.fid=%d AND plink.cid=mlink.mid"
+       " GROUP BY mlink.fnid ORDER BY 2 DESC LIMIT 1", rid
+    );
+    if( db_step(&q)==SQLITE_ROW ){
+      fnid = db_column_int(&q, 0);
+      mtime = db_column_double(&q, 1);
+    }
+    db_finalize(&q);
+    if( fnid==0 ) return 0;
+    db_prepare(&q,
+       "SELECT mlink.fid FROM mlink, plink"
+       " WHERE mlink.fnid=%d"
+       "   AND plink.cid=mlink.mid"
+       "   AND plink.mtime>%.17g"
+       "   AND mlink.fid<>%d"
+       "   AND NOT EXISTS(SELECT 1 FROM delta WHERE rid=mlink.fid)"
+       " GROUP BY mlink.fid"
+       " ORDER BY min(plink.mtime) LIMIT %d", fnid, mtime, rid, N_NEIGHBOR
+    );
+  }
+  while( db_step(&q)==SQLITE_ROW ){
+    aSrc[nSrc++] = db_column_int(&q, 0);
+  }
+  db_finalize(&q);
+  if( nSrc==0 ) return 0;
+  return content_deltify(rid, aSrc, nSrc, 0);
+}
+
+/*
+** This routine is called by the backoffice.  If the "auto-repack"
+** setting is positive, do a bounded amount of the work of the "repack"
+** command: deltify undeltaed artifacts and recompress small ones,
+** starting after the rid recorded in the "repack-cursor" config entry
+** and working in short transactions.  The cursor returns to zero when a
+** pass finishes and "repack-end" records the largest rid it covered.
+** A new pass over the repository begins only after new artifacts have
+** arrived since the previous pass finished.  Artifacts are not moved in
+** or out of pack files here.
+**
+** Return the number of artifacts that were made smaller.
+*/
+int repack_backoffice(void){
+  int nBudget;
+  int ridCursor, ridEnd, ridMax;
+  int nExamined = 0;
+  int nChanged = 0;
+  int nDone = 0;
+  sqlite3_int64 iStop;
+
+  if( !db_is_writeable("repository") ) return 0;
+  nBudget = db_get_int("auto-repack", 0);
+  if( nBudget<=0 ) return 0;
+  ridMax = db_int(0, "SELECT max(rid) FROM blob");
+  ridCursor = db_get_int("repack-cursor", 0);
+  ridEnd = db_get_int("repack-end", 0);
+  if( ridCursor==0 && ridMax<=ridEnd ){
+    /* Nothing new since the previous pass finished */
+    return 0;
+  }
+  iStop = time(0) + REPACK_TIME_LIMIT;
+  db_unprotect(PROTECT_ALL);
+  while( !nDone && nExamined<nBudget && time(0)<iStop ){
+    Stmt q;
+    int ridFirst = ridCursor+1;
+    int n = 0;
+    int nMoved = 0;
+    db_begin_write();
+    db_prepare(&q,
+       "SELECT rid FROM blob"
+       " WHERE rid>%d AND size>=0"
+       "   AND NOT EXISTS(SELECT 1 FROM delta WHERE delta.rid=blob.rid)"
+       " ORDER BY rid LIMIT %d",
+       ridCursor, REPACK_CHUNK<nBudget-nExamined ? REPACK_CHUNK
+                                                 : nBudget-nExamined
+    );
+    while( db_step(&q)==SQLITE_ROW ){
+      ridCursor = db_column_int(&q, 0);
+      if( repack_one(ridCursor)>0 ) nChanged++;
+      n++;
+    }
+    db_finalize(&q);
+    if( n==0 || ridCursor>=ridMax ){
+      nDone = 1;
+      ridCursor = ridMax;
+    }
+    cmprdict_recompress(ridFirst, ridCursor, &nMoved);
+    nChanged += nMoved;
+    nExamined += n;
+    if( nDone ){
+      db_set_int("repack-cursor", 0, 0);
+      db_set_int("repack-end", ridMax, 0);
+    }else{
+      db_set_int("repack-cursor", ridCursor, 0);
+    }
+    db_end_transaction(0);
+  }
+  db_protect_pop();
+  if( nChanged>0 && db_int(0, "PRAGMA repository.auto_vacuum")==2 ){
+    db_multi_exec("PRAGMA repository.incremental_vacuum");
+  }
+  return nChanged;
+}
+
 /* Reconstruct the private table.  The private table contains the rid
 ** of every manifest that is tagged with "private" and every file that
 ** is not used by a manifest that is not private.
@@ -603,6 +895,15 @@ static void reconstruct_private_table(void){
 **
 **     fossil rebuild --compress-only
 **
+** If the repository stores large artifacts in pack files (see the
+** "pack-threshold" setting) then artifacts are also moved in or out of
+** pack files to agree with the current threshold, and pack files that
+** contain a lot of unreferenced space are rewritten.
+**
+** Small artifacts are recompressed with the current preset dictionary,
+** or without one if the dictionary has been turned off.  See the
+** "compress-dict" command.
+**
 ** The name for this command is stolen from the "git repack" command that
 ** does approximately the same thing in Git.
 */
@@ -610,6 +911,7 @@ void repack_command(void){
   i64 nByte = 0;
   int nDelta = 0;
   int runVacuum = 0;
+  int nMoved = 0;
   verify_all_options();
   if( g.argc==3 ){
     db_open_repository(g.argv[2]);
@@ -636,6 +938,25 @@ void repack_command(void){
     fossil_print("no new compression opportunities found\n");
     runVacuum = db_int(0, "PRAGMA repository.freelist_count")>0;
   }
+  nByte = packfile_repack(&nMoved);
+  if( nMoved>0 ){
+    fossil_print("%d artifacts moved between pack files and the database,"
+                 " %,lld bytes of pack file space reclaimed\n", nMoved, nByte);
+    runVacuum = 1;
+  }
+  nByte = cmprdict_recompress(0, 0x7fffffff, &nMoved);
+  if( nMoved>0 ){
+    fossil_print("%d small artifacts recompressed, %,lld bytes saved\n",
+                 nMoved, nByte);
+    runVacuum = 1;
+  }
+  if( db_get_int("auto-repack", 0)>0
+   && db_int(0, "PRAGMA repository.auto_vacuum")!=2
+  ){
+    /* Let the backoffice give space back with incremental_vacuum */
+    db_multi_exec("PRAGMA repository.auto_vacuum=INCREMENTAL");
+    runVacuum = 1;
+  }
   if( runVacuum ){
     fossil_print("Vacuuming the database... "); fflush(stdout);
     db_multi_exec("VACUUM");
@@ -659,7 +980,9 @@ void repack_command(void){
 **   --compress        Strive to make the database as small as possible
 **   --compress-only   Skip the rebuilding step. Do --compress only
 **   --force           Force the rebuild to complete even if errors are seen
-**   --ifneeded        Only do the rebuild if it would change the schema version
+**   --ifneeded        Only do the rebuild if it would change the schema
+**                     version.  If only some derived tables are out of
+**                     date, recompute just those tables
 **   --index           Always add in the full-text search index
 **   --noverify        Skip the verification of changes to the BLOB table
 **   --noindex         Always omit the full-text search index
@@ -725,6 +1048,7 @@ void rebuild_database(void){
   if( optIndex ) runReindex = 1;
   if( optNoIndex ) runReindex = 0;
   if( optIfNeeded && fossil_strcmp(db_get("aux-schema",""),AUX_SCHEMA_MAX)==0 ){
+    rebuild_derived_update();
     return;
   }
 
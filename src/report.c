@@ -29,6 +29,21 @@ static void report_format_hints(void);
 #  define SQLITE_RECURSIVE            33
 #endif
 
+/*
+** True if the report query most recently passed through the authorizer
+** reads some table other than TICKET, TICKETCHNG or an "fx_" table, or
+** calls a function such as datetime('now') or random().  The results of
+** such a query are not cached, since they can change without any change
+** to a ticket.
+*/
+static int reportReadsOther = 0;
+
+/*
+** A report query checks its budget of virtual machine steps every
+** this many steps.
+*/
+#define REPORT_PROGRESS_STEPS 1000
+
 /* Settings that can be used to control ticket reports */
 /*
 ** SETTING: ticket-default-report   width=80
@@ -36,6 +51,18 @@ static void report_format_hints(void);
 ** search page query is blank, the report with this title is shown.
 ** If the setting is blank (default), then no report is shown.
 */
+/*
+** SETTING: report-max-steps        width=16 default=100000000
+** A ticket report shown in the web interface is stopped with an
+** error once its query has run this many SQLite virtual machine
+** steps.  This keeps a poorly written report from tying up the
+** server.  Zero or a negative value means no limit.
+*/
+/*
+** SETTING: report-max-rows         width=16 default=10000
+** A ticket report shown in the web interface shows no more than
+** this many rows.  Zero or a negative value means no limit.
+*/
 
 /*
 ** WEBPAGE: reportlist
@@ -192,8 +219,52 @@ static int report_query_authorizer(
   }
   switch( code ){
     case SQLITE_SELECT:
-    case SQLITE_RECURSIVE:
+    case SQLITE_RECURSIVE: {
+      break;
+    }
     case SQLITE_FUNCTION: {
+      /* Functions whose result depends on something other than their
+      ** arguments, such as the clock, the login, or the rest of the
+      ** repository.  A report that uses one of them is not cached. */
+      static const char *const azVolatile[] = {
+         "cgi",
+         "changes",
+         "checkin_mtime",
+         "current_date",
+         "current_time",
+         "current_timestamp",
+         "date",
+         "datetime",
+         "fromlocal",
+         "julianday",
+         "last_insert_rowid",
+         "now",
+         "random",
+         "randomblob",
+         "strftime",
+         "symbolic_name_to_rid",
+         "time",
+         "timediff",
+         "tolocal",
+         "total_changes",
+         "unixepoch",
+         "user",
+      };
+      int lwr = 0;
+      int upr = count(azVolatile) - 1;
+      if( zArg2==0 ) break;
+      while( lwr<=upr ){
+        int i = (lwr+upr)/2;
+        int cmp = fossil_stricmp(zArg2, azVolatile[i]);
+        if( cmp<0 ){
+          upr = i - 1;
+        }else if( cmp>0 ){
+          lwr = i + 1;
+        }else{
+          reportReadsOther = 1;
+          break;
+        }
+      }
       break;
     }
     case SQLITE_READ: {
@@ -240,7 +311,16 @@ static int report_query_authorizer(
       if( cmp ){
         *(char**)pError = mprintf("access to table \"%s\" is restricted",zArg1);
         rc = SQLITE_DENY;
-      }else if( !g.perm.RdAddr && sqlite3_strnicmp(zArg2, "private_", 8)==0 ){
+        break;
+      }
+      if( fossil_stricmp(zArg1,"ticket")!=0
+       && fossil_stricmp(zArg1,"ticketchng")!=0
+       && sqlite3_strnicmp(zArg1,"fx_",3)!=0
+       && sqlite3_strnicmp(zArg1,"json_",5)!=0
+      ){
+        reportReadsOther = 1;
+      }
+      if( !g.perm.RdAddr && sqlite3_strnicmp(zArg2, "private_", 8)==0 ){
         rc = SQLITE_IGNORE;
       }
       break;
@@ -273,6 +353,7 @@ void report_update_reportfmt_table(void){
 ** eventual call to report_unrestrict_sql().
 */
 void report_restrict_sql(char **pzErr){
+  reportReadsOther = 0;
   db_set_authorizer(report_query_authorizer,(void*)pzErr,"Ticket-Report");
   sqlite3_limit(g.db, SQLITE_LIMIT_VDBE_OP, 10000);
 }
@@ -1026,9 +1107,109 @@ void output_color_key(const char *zClrKey, int horiz, char *zTabArgs){
   @ </table>
 }
 
+/*
+** Limits and caching applied to a report query by db_exec_readonly().
+*/
+typedef struct ReportLimit ReportLimit;
+struct ReportLimit {
+  i64 nStepMax;     /* Stop after this many VM steps.  0 for no limit */
+  int nRowMax;      /* Stop after this many rows.  0 for no limit */
+  int rn;           /* Report number used in the cache key.  0 for no cache */
+  i64 nStep;        /* VM steps used so far */
+  int bInterrupt;   /* True if the query was interrupted */
+};
+
+/*
+** Progress handler that interrupts a report query that has used up
+** its budget of virtual machine steps.
+*/
+static int report_progress(void *pArg){
+  ReportLimit *pLimit = (ReportLimit*)pArg;
+  pLimit->nStep += REPORT_PROGRESS_STEPS;
+  if( pLimit->nStep<=pLimit->nStepMax ) return 0;
+  if( !pLimit->bInterrupt ){
+    /* The error message is shown with the report.  Keep the SQLite
+    ** error log from reporting the interrupt a second time. */
+    pLimit->bInterrupt = 1;
+    g.dbIgnoreErrors++;
+  }
+  return 1;
+}
+
+/*
+** Append a single value, which might be NULL, to the encoding of a
+** cached report result.
+*/
+static void report_cache_append(Blob *pOut, const char *z){
+  if( z==0 ){
+    blob_append(pOut, "-", 1);
+  }else{
+    int n = (int)strlen(z);
+    blob_appendf(pOut, "%d:", n);
+    blob_append(pOut, z, n+1);
+  }
+}
+
+/*
+** Replay a cached report result, previously encoded by calls to
+** report_cache_append(), through xCallback().  The first nCol values
+** are the column names.  Return false if the encoding is malformed.
+*/
+static int report_cache_replay(
+  Blob *pIn,                  /* The encoded result.  Modified in place */
+  int (*xCallback)(void*,int,const char**, const char**),
+  void *pArg,
+  ReportLimit *pLimit,        /* Row limit to apply */
+  char **pzErrMsg             /* Write error messages here */
+){
+  char *z = blob_buffer(pIn);
+  char *zEnd = z + blob_size(pIn);
+  const char **azVals;
+  int nCol, i, rc = 1;
+  int nRow = 0;
+
+  nCol = atoi(z);
+  while( z<zEnd && *z!='\n' ) z++;
+  if( z>=zEnd || nCol<=0 ) return 0;
+  z++;
+  azVals = fossil_malloc(2*nCol*sizeof(const char*) + 1);
+  for(i=0; rc && z<zEnd; i++){
+    if( z[0]=='-' ){
+      azVals[i%nCol] = 0;
+      z++;
+    }else{
+      int n = atoi(z);
+      while( z<zEnd && *z!=':' ) z++;
+      if( n<0 || z+n+1>=zEnd ){
+        rc = 0;
+        break;
+      }
+      azVals[i%nCol] = z+1;
+      z += n+2;
+    }
+    if( i<nCol ){
+      azVals[nCol+i] = azVals[i];
+    }else if( i%nCol==nCol-1 ){
+      if( pLimit->nRowMax>0 && nRow>=pLimit->nRowMax ){
+        *pzErrMsg = mprintf("report stopped after %d rows", nRow);
+        break;
+      }
+      nRow++;
+      if( xCallback(pArg, nCol, azVals, &azVals[nCol]) ) break;
+    }
+  }
+  fossil_free((void*)azVals);
+  return rc;
+}
+
 /*
 ** Execute a single read-only SQL statement.  Invoke xCallback() on each
 ** row.
+**
+** If pLimit is not NULL, the statement is stopped with an error once it
+** exceeds the step or row budget in pLimit.  If pLimit->rn is not zero,
+** the result is also looked for in and saved to the web cache, keyed on
+** the SQL text, the values of its parameters and the ticket change count.
 */
 static int db_exec_readonly(
   sqlite3 *db,                /* The database on which the SQL executes */
@@ -1036,6 +1217,7 @@ static int db_exec_readonly(
   int (*xCallback)(void*,int,const char**, const char**),
                               /* Invoke this callback routine */
   void *pArg,                 /* First argument to xCallback() */
+  ReportLimit *pLimit,        /* Limits and caching.  Might be NULL */
   char **pzErrMsg             /* Write error messages here */
 ){
   int rc = SQLITE_OK;         /* Return code */
@@ -1046,6 +1228,11 @@ static int db_exec_readonly(
   const char **azVals = 0;    /* Text of all output columns */
   int i;                      /* Loop counter */
   int nVar;                   /* Number of parameters */
+  int nRow = 0;               /* Number of rows delivered */
+  int bCache;                 /* True to use the web cache */
+  Blob key;                   /* Inputs to the cache key */
+  Blob result;                /* Encoded result to be saved in the cache */
+  char *zKey = 0;             /* The cache key */
 
   pStmt = 0;
   rc = sqlite3_prepare_v2(db, zSql, -1, &pStmt, &zLeftover);
@@ -1062,21 +1249,73 @@ static int db_exec_readonly(
     return SQLITE_ERROR;
   }
 
+  /* The authorizer has finished its work on pStmt.  Turn it off so that
+  ** the settings and the cache can be read below. */
+  db_clear_authorizer();
+
+  bCache = pLimit && pLimit->rn>0 && !reportReadsOther;
+  blob_init(&key, 0, 0);
+  blob_init(&result, 0, 0);
+  if( bCache ){
+    blob_appendf(&key, "%d\n%d\n%d\n%s\n", pLimit->rn, g.perm.RdAddr,
+                 db_get_int("tkt-change-count",0), zSql);
+  }
   nVar = sqlite3_bind_parameter_count(pStmt);
   for(i=1; i<=nVar; i++){
     const char *zVar = sqlite3_bind_parameter_name(pStmt, i);
+    const char *zVal;
     if( zVar==0 ) continue;
     if( zVar[0]!='$' && zVar[0]!='@' && zVar[0]!=':' ) continue;
     if( !fossil_islower(zVar[1]) ) continue;
     if( strcmp(zVar, "$login")==0 ){
-      sqlite3_bind_text(pStmt, i, g.zLogin, -1, SQLITE_TRANSIENT);
+      zVal = g.zLogin;
     }else{
-      sqlite3_bind_text(pStmt, i, P(zVar+1), -1, SQLITE_TRANSIENT);
+      zVal = P(zVar+1);
+    }
+    sqlite3_bind_text(pStmt, i, zVal, -1, SQLITE_TRANSIENT);
+    if( bCache ){
+      blob_appendf(&key, "%s=", zVar);
+      report_cache_append(&key, zVal);
+    }
+  }
+  if( bCache ){
+    Blob cksum;
+    sha1sum_blob(&key, &cksum);
+    zKey = mprintf("rptview-%d-%s", pLimit->rn, blob_str(&cksum));
+    blob_reset(&cksum);
+    if( cache_read(&result, zKey) ){
+      int ok = report_cache_replay(&result, xCallback, pArg,
+                                   pLimit, pzErrMsg);
+      blob_reset(&result);
+      if( ok ){
+        sqlite3_finalize(pStmt);
+        blob_reset(&key);
+        fossil_free(zKey);
+        return SQLITE_OK;
+      }
     }
   }
+  if( pLimit && pLimit->nStepMax>0 ){
+    pLimit->nStep = 0;
+    pLimit->bInterrupt = 0;
+    sqlite3_progress_handler(db, REPORT_PROGRESS_STEPS,
+                             report_progress, pLimit);
+  }
   nCol = sqlite3_column_count(pStmt);
   azVals = fossil_malloc(2*nCol*sizeof(const char*) + 1);
+  if( bCache ){
+    blob_appendf(&result, "%d\n", nCol);
+    for(i=0; i<nCol; i++){
+      report_cache_append(&result, sqlite3_column_name(pStmt, i));
+    }
+  }
   while( (rc = sqlite3_step(pStmt))==SQLITE_ROW ){
+    if( pLimit && pLimit->nRowMax>0 && nRow>=pLimit->nRowMax ){
+      *pzErrMsg = mprintf("report stopped after %d rows", nRow);
+      bCache = 0;
+      break;
+    }
+    nRow++;
     if( azCols==0 ){
       azCols = &azVals[nCol];
       for(i=0; i<nCol; i++){
@@ -1085,13 +1324,29 @@ static int db_exec_readonly(
     }
     for(i=0; i<nCol; i++){
       azVals[i] = (const char *)sqlite3_column_text(pStmt, i);
+      if( bCache ) report_cache_append(&result, azVals[i]);
     }
     if( xCallback(pArg, nCol, azVals, azCols) ){
+      bCache = 0;
       break;
     }
   }
+  if( pLimit && pLimit->bInterrupt ){
+    *pzErrMsg = mprintf("report stopped after %d rows because it exceeded"
+                        " the report-max-steps limit", nRow);
+  }
+  if( bCache && rc==SQLITE_DONE ){
+    cache_write(&result, zKey);
+  }
+  if( pLimit && pLimit->nStepMax>0 ){
+    sqlite3_progress_handler(db, 0, 0, 0);
+  }
   rc = sqlite3_finalize(pStmt);
+  if( pLimit && pLimit->bInterrupt ) g.dbIgnoreErrors--;
   fossil_free((void *)azVals);
+  blob_reset(&key);
+  blob_reset(&result);
+  fossil_free(zKey);
   return rc;
 }
 
@@ -1128,6 +1383,7 @@ void rptview_page_content(
   Stmt q;
   char *zErr1 = 0;
   char *zErr2 = 0;
+  ReportLimit sLimit;
 
   login_check_credentials();
   if( !g.perm.RdTkt ){ login_needed(g.anon.RdTkt); return; }
@@ -1180,6 +1436,10 @@ void rptview_page_content(
     }
   }
 
+  memset(&sLimit, 0, sizeof(sLimit));
+  sLimit.nStepMax = db_get_int("report-max-steps", 100000000);
+  sLimit.nRowMax = db_get_int("report-max-rows", 10000);
+  sLimit.rn = rn;
   count = 0;
   if( !tabs ){
     struct GenerateHTML sState = { 0, 0, 0, 0, 0, 0, 0, 0, 0 };
@@ -1231,7 +1491,7 @@ void rptview_page_content(
     sState.rn = rn;
     sState.nCount = 0;
     report_restrict_sql(&zErr1);
-    db_exec_readonly(g.db, zSql, generate_html, &sState, &zErr2);
+    db_exec_readonly(g.db, zSql, generate_html, &sState, &sLimit, &zErr2);
     report_unrestrict_sql();
     @ </tbody></table>
     if( zErr1 ){
@@ -1245,7 +1505,8 @@ void rptview_page_content(
     }
   }else{
     report_restrict_sql(&zErr1);
-    db_exec_readonly(g.db, zSql, output_tab_separated, &count, &zErr2);
+    db_exec_readonly(g.db, zSql, output_tab_separated, &count, &sLimit,
+                     &zErr2);
     report_unrestrict_sql();
     cgi_set_content_type("text/plain");
   }
@@ -1397,7 +1658,7 @@ void rptshow(
   tktEncode = enc;
   zSep = zSepIn;
   report_restrict_sql(&zErr1);
-  db_exec_readonly(g.db, zSql, output_separated_file, &count, &zErr2);
+  db_exec_readonly(g.db, zSql, output_separated_file, &count, 0, &zErr2);
   report_unrestrict_sql();
   if( zFilter ){
     free(zSql);
@@ -656,9 +656,116 @@ static const char zForumSchema[] =
 @ CREATE INDEX repository.forumthread ON forumpost(froot,fmtime);
 ;
 
+/*
+** The following tables are an index of the forumpost table.  Forumtree
+** holds the hierarchical display order of each thread and forumtopic
+** holds a summary of each thread for the /forum page.  Both are brought
+** up to date whenever a forum post is crosslinked.
+**
+** The FKEY of a post is the FKEY of the post it is shown beneath with
+** the time and fpid of the post appended in fixed-width form.  Sorting
+** by FKEY thus puts every post after its parent and before any later
+** replies to that parent, so a new post never moves the others.
+*/
+static const char zForumIndexSchema[] =
+@ CREATE TABLE repository.forumtree(
+@   fpid INTEGER PRIMARY KEY,  -- Original version of a post
+@   froot INT,                 -- fpid of the thread root
+@   fparent INT,               -- Post this one is shown beneath.  NULL for root
+@   fkey TEXT,                 -- Sorts in the display order of the thread
+@   fdepth INT                 -- Indentation level.  1 for the root
+@ );
+@ CREATE INDEX repository.forumtreekey ON forumtree(froot,fkey);
+@ CREATE TABLE repository.forumtopic(
+@   froot INTEGER PRIMARY KEY, -- fpid of the thread root
+@   nall INT,                  -- Number of posts, not counting edits
+@   ctall REAL,                -- Time of the first post
+@   mtall REAL,                -- Time of the most recent post or edit
+@   lastall INT,               -- fpid of the most recent post or edit
+@   npub INT,                  -- The same four values for only those
+@   ctpub REAL,                -- posts that are not awaiting moderation.
+@   mtpub REAL,                -- NULL if every post of the thread is
+@   lastpub INT                -- awaiting moderation
+@ );
+@ CREATE INDEX repository.forumtopicall ON forumtopic(mtall);
+@ CREATE INDEX repository.forumtopicpub ON forumtopic(mtpub);
+;
+
 /* Create the forum-post schema if it does not already exist */
 void schema_forum(void){
   if( !db_table_exists("repository","forumpost") ){
     db_multi_exec("%s",zForumSchema/*safe-for-%s*/);
   }
+  if( !db_table_exists("repository","forumtopic") ){
+    db_multi_exec("%s",zForumIndexSchema/*safe-for-%s*/);
+    forum_thread_index_all();
+  }
+}
+
+/*
+** The following tables remember, for each check-in, the check-in in
+** which each of its files was last changed.  They are created on-demand
+** by the first request for file ages and are kept up to date as new
+** check-ins are crosslinked.
+**
+** Most check-ins only record the files that differ from their primary
+** parent and point back at that parent through ckinagebase.base.  Every
+** so often along a line of descent a check-in records the full list of
+** its files instead, so that finding the ages for any check-in never
+** needs to look at more than a bounded number of check-ins.
+*/
+static const char zFileAgeSchema[] =
+@ CREATE TABLE repository.ckinagebase(
+@   mid INTEGER PRIMARY KEY,   -- The check-in
+@   base INT,                  -- Continue with this check-in.  0 if full
+@   depth INT                  -- Number of steps from a full list
+@ );
+@ CREATE TABLE repository.ckinage(
+@   mid INT,                   -- The check-in
+@   fnid INT,                  -- Name of the file
+@   fid INT,                   -- Content of the file.  0 if deleted
+@   amid INT,                  -- Check-in in which fid was last changed
+@   PRIMARY KEY(mid,fnid)
+@ ) WITHOUT ROWID;
+;
+
+/* Create the file-age index schema if it does not already exist */
+void schema_fileage(void){
+  if( !db_table_exists("repository","ckinage") ){
+    db_multi_exec("%s",zFileAgeSchema/*safe-for-%s*/);
+  }
+}
+
+/*
+** The following tables hold the directory hierarchy of recently browsed
+** check-ins, so that the /dir page can list one directory without
+** parsing the whole manifest.  They are created on-demand.  Only the
+** "max-dir-index" most recently used check-ins are kept.
+*/
+static const char zDirIndexSchema[] =
+@ CREATE TABLE repository.dirindex(
+@   mid INTEGER PRIMARY KEY,   -- The check-in
+@   atime REAL                 -- When last used.  Julian day
+@ );
+@ CREATE TABLE repository.dirent(
+@   mid INT,                   -- The check-in
+@   dname TEXT,                -- Directory.  Empty string for top-level
+@   ename TEXT,                -- File or subdirectory within dname
+@   fid INT,                   -- Content of the file.  0 for a subdirectory
+@   nfile INT,                 -- Number of files at or below this entry
+@   sz INT,                    -- Total size of those files
+@   PRIMARY KEY(mid,dname,ename)
+@ ) WITHOUT ROWID;
+;
+
+/*
+** Create the directory index schema if it does not already exist.  The
+** index replaces the single-check-in VCACHE table that older versions
+** kept in the repository, so drop that table at the same time.
+*/
+void schema_dirindex(void){
+  if( !db_table_exists("repository","dirent") ){
+    db_multi_exec("%s",zDirIndexSchema/*safe-for-%s*/);
+    db_multi_exec("DROP TABLE IF EXISTS repository.vcache");
+  }
 }
@@ -688,7 +688,7 @@ void secaudit0_page(void){
     @ To suppress unnecessary sync traffic caused by phantoms, add the RID
     @ of each phantom to the "private" table.  Example:
     @ <blockquote><pre>
-    @    INSERT INTO private SELECT rid FROM blob WHERE content IS NULL;
+    @    INSERT INTO private SELECT rid FROM blob WHERE size<0;
     @ </pre></blockquote>
     @ </p>
     table_of_public_phantoms();
@@ -0,0 +1,782 @@
+/*
+** Copyright (c) 2026 D. Richard Hipp
+**
+** This program is free software; you can redistribute it and/or
+** modify it under the terms of the Simplified BSD License (also
+** known as the "2-Clause License" or "FreeBSD License".)
+**
+** This program is distributed in the hope that it will be useful,
+** but without any warranty; without even the implied warranty of
+** merchantability or fitness for a particular purpose.
+**
+** Author contact information:
+**   drh@sqlite.org
+**
+*******************************************************************************
+**
+** This file implements shallow clones:  clones that hold only the recent
+** part of the check-in history.
+**
+** The client asks for a shallow clone by sending a card of the form
+**
+**      pragma shallow DEPTH SINCE
+**
+** ahead of its "clone" card.  DEPTH is the number of check-ins to keep
+** along each open branch, counting the leaf as 1, and SINCE is the
+** earliest check-in time to keep as a julian day number.  Either may
+** be 0 to mean "no limit".  The server works out which artifacts fall
+** inside that bound and sends only those:  the check-ins inside the
+** bound, every file needed to reconstruct their trees, and all other
+** artifacts (wiki, tickets, tags, forum posts and so forth) except
+** clusters.  An artifact that is stored as a delta against something
+** outside the bound is sent in full.
+**
+** Once every artifact is sent, the server also sends a "shallow-tag"
+** card for each propagating tag on a check-in at the edge of the clone,
+** such as the branch name, since the artifact that set the tag was left
+** behind.  Rebuild reapplies those tags.
+**
+** When the clone is done, the client records every artifact that is
+** still a phantom in the SHALLOW table.  Those are the ancestors and
+** other history that were deliberately left behind, and later pulls
+** do not ask for them.  The time of the oldest check-in is kept in the
+** "shallow-since" setting, and every later pull sends it in a
+** "pragma shallow" card so that the server neither announces nor sends
+** anything older.  The history is thus extended by new check-ins only.
+**
+** A blobless clone is a partial clone of a different kind.  It holds
+** every check-in and every other control artifact but no file content
+** except the files of the open leaves.  The client asks for it with
+**
+**      pragma blobless ?TIP?
+**
+** and the server then leaves out every artifact that is used as a file
+** by some check-in.  If TIP is 1, the files of the open leaves are sent
+** anyway.  The client sets the "blobless" setting and sends the same
+** card, without TIP, on every later pull.  The files that were left out
+** remain phantoms that are not requested by a sync.  Instead,
+** content_get() fetches them from the remote in small batches the first
+** time they are needed, and a checkout or update fetches all the files
+** it is about to write in a single request.  A clone may be both
+** shallow and blobless.
+*/
+#include "config.h"
+#include "shallow.h"
+#include <assert.h>
+
+/*
+** The bound requested by the "clone --depth" and "--since" options.
+*/
+static int shallowDepth = 0;        /* Check-ins to keep per branch */
+static double shallowSince = 0.0;   /* Oldest check-in time to keep */
+static int shallowBlobless = 0;     /* The "clone --blobless" option */
+
+/*
+** True on the server once the SHALLOW_KEEP table has been computed
+** for the current request, and the time bound used to compute it.
+*/
+static int shallowActive = 0;
+static double shallowKeepSince = 0.0;
+
+/*
+** True on the server if a "pragma blobless" card is in effect, and 2
+** if the TEMP.SHALLOW_TIP table of files to send anyway is computed.
+*/
+static int shallowOmitFiles = 0;
+
+/*
+** SQL code to create the tables that describe a shallow clone.  The
+** SHALLOW table holds artifacts that were left out and are not to be
+** requested.  The SHALLOWTAG table holds the propagating tags that the
+** check-ins at the edge of the clone inherit from history that was
+** left out.
+*/
+static const char zShallowInit[] =
+@ CREATE TABLE IF NOT EXISTS repository.shallow(
+@   rid INTEGER PRIMARY KEY      -- Phantom that is not to be requested
+@ );
+@ CREATE TABLE IF NOT EXISTS repository.shallowtag(
+@   uuid TEXT,                   -- Check-in at the edge of the clone
+@   tagname TEXT,                -- Name of an inherited propagating tag
+@   mtime DATETIME,              -- Time the tag took effect
+@   value TEXT,                  -- Value of the tag, or NULL
+@   PRIMARY KEY(uuid,tagname)
+@ ) WITHOUT ROWID;
+;
+
+/*
+** Make sure the tables for a shallow clone exist in the repository.
+*/
+void shallow_schema(void){
+  if( !db_table_exists("repository", "shallowtag") ){
+    db_multi_exec(zShallowInit/*works-like:""*/);
+  }
+}
+
+/*
+** Set the bound for a shallow clone.  zSince is a date or date/time
+** string, or NULL.  Raise an error if zSince cannot be understood.
+*/
+void shallow_set_bound(int nDepth, const char *zSince){
+  if( nDepth<0 ){
+    fossil_fatal("--depth must be a positive integer");
+  }
+  shallowDepth = nDepth;
+  shallowSince = 0.0;
+  if( zSince ){
+    /* No repository is open yet during a clone, so use a private
+    ** in-memory database to convert the date */
+    sqlite3 *db = 0;
+    sqlite3_stmt *pStmt = 0;
+    if( sqlite3_open(":memory:", &db)==SQLITE_OK
+     && sqlite3_prepare_v2(db, "SELECT julianday(?1)", -1, &pStmt, 0)
+          ==SQLITE_OK
+    ){
+      sqlite3_bind_text(pStmt, 1, zSince, -1, SQLITE_STATIC);
+      if( sqlite3_step(pStmt)==SQLITE_ROW ){
+        shallowSince = sqlite3_column_double(pStmt, 0);
+      }
+    }
+    sqlite3_finalize(pStmt);
+    sqlite3_close(db);
+    if( shallowSince<=0.0 ){
+      fossil_fatal("unknown date/time: %s", zSince);
+    }
+  }
+}
+
+/*
+** Ask for a blobless clone.
+*/
+void shallow_set_blobless(int bBlobless){
+  shallowBlobless = bBlobless;
+}
+
+/*
+** Return true if a blobless clone was asked for.
+*/
+int shallow_is_blobless_requested(void){
+  return shallowBlobless;
+}
+
+/*
+** Return true if a bound was set by shallow_set_bound().
+*/
+int shallow_is_requested(void){
+  return shallowDepth>0 || shallowSince>0.0;
+}
+
+/*
+** Return a description of the --depth, --since and --blobless options
+** of the clone being made, in memory obtained from fossil_malloc().  An
+** interrupted clone may only be continued with the same options.
+*/
+char *shallow_clone_options(void){
+  return mprintf("%d %.6f %d", shallowDepth, shallowSince, shallowBlobless);
+}
+
+/*
+** On the client, append the "pragma shallow" card that asks for
+** the bound set by shallow_set_bound().
+*/
+void shallow_send_bound(Blob *pOut){
+  if( shallow_is_requested() ){
+    blob_appendf(pOut, "pragma shallow %d %.6f\n", shallowDepth,
+                 shallowSince);
+  }
+  if( shallowBlobless ){
+    blob_append(pOut, "pragma blobless 1\n", -1);
+  }
+}
+
+/*
+** On the client of a shallow clone, append the "pragma shallow" card
+** that keeps a pull from announcing or sending history older than the
+** clone.  On the client of a blobless clone, append the "pragma blobless"
+** card that keeps a pull from sending file content.
+*/
+void shallow_send_since(Blob *pOut){
+  double rSince;
+  if( db_get_boolean("blobless", 0) ){
+    blob_append(pOut, "pragma blobless\n", -1);
+  }
+  if( !shallow_is_clone() ) return;
+  rSince = db_double(0.0,
+     "SELECT julianday(value) FROM config WHERE name='shallow-since'");
+  if( rSince>0.0 ){
+    blob_appendf(pOut, "pragma shallow 0 %.6f\n", rSince);
+  }
+}
+
+/*
+** SQL code to create the tables in which a server keeps the results of
+** shallow_compute_keep() for the most recently used bounds.  Every
+** round-trip of a shallow clone or of a pull into one sends the same
+** "pragma shallow" card, so all rounds after the first can reuse the
+** result as long as the repository has not changed in between.
+*/
+static const char zShallowCacheInit[] =
+@ CREATE TABLE IF NOT EXISTS repository.shallowbound(
+@   bound TEXT PRIMARY KEY,      -- DEPTH and SINCE of "pragma shallow"
+@   stamp TEXT,                  -- State of the BLOB table when computed
+@   mtime REAL                   -- When last used.  Julian day
+@ );
+@ CREATE TABLE IF NOT EXISTS repository.shallowkeep(
+@   bound TEXT,                  -- The bound
+@   rid INT,                     -- An artifact inside the bound
+@   ckin INT,                    -- 0: not a check-in 1: check-in 2: boundary
+@   PRIMARY KEY(bound,rid)
+@ ) WITHOUT ROWID;
+;
+
+/*
+** The number of bounds for which shallow_compute_keep() results are
+** kept.
+*/
+#define SHALLOW_CACHE_SIZE 8
+
+/*
+** On the server, fill the TEMP.SHALLOW_KEEP and TEMP.SHALLOW_CKIN
+** tables from what was saved for zBound, if anything was saved since
+** the repository last changed.  Return true on success.
+*/
+static int shallow_keep_load(const char *zBound, const char *zStamp){
+  if( !db_table_exists("repository","shallowkeep")
+   || !db_exists("SELECT 1 FROM shallowbound WHERE bound=%Q AND stamp=%Q",
+                 zBound, zStamp)
+  ){
+    return 0;
+  }
+  db_multi_exec(
+    "INSERT INTO shallow_ckin(rid,isBoundary)"
+    " SELECT rid, ckin==2 FROM shallowkeep WHERE bound=%Q AND ckin>0;"
+    "INSERT INTO shallow_keep"
+    " SELECT rid FROM shallowkeep WHERE bound=%Q;"
+    "UPDATE shallowbound SET mtime=julianday('now') WHERE bound=%Q;",
+    zBound, zBound, zBound
+  );
+  return 1;
+}
+
+/*
+** On the server, save the TEMP.SHALLOW_KEEP and TEMP.SHALLOW_CKIN
+** tables for zBound, forgetting the least recently used bounds.
+*/
+static void shallow_keep_save(const char *zBound, const char *zStamp){
+  db_multi_exec(zShallowCacheInit/*works-like:""*/);
+  db_multi_exec(
+    "DELETE FROM shallowkeep WHERE bound=%Q;"
+    "INSERT INTO shallowkeep(bound,rid,ckin)"
+    " SELECT %Q, rid, coalesce((SELECT 1+isBoundary FROM shallow_ckin"
+    "                            WHERE shallow_ckin.rid=shallow_keep.rid),0)"
+    "   FROM shallow_keep;"
+    "REPLACE INTO shallowbound(bound,stamp,mtime)"
+    " VALUES(%Q,%Q,julianday('now'));"
+    "DELETE FROM shallowbound WHERE bound NOT IN"
+    " (SELECT bound FROM shallowbound ORDER BY mtime DESC LIMIT %d);"
+    "DELETE FROM shallowkeep WHERE bound NOT IN"
+    " (SELECT bound FROM shallowbound);",
+    zBound, zBound, zBound, zStamp, SHALLOW_CACHE_SIZE
+  );
+}
+
+/*
+** On the server, compute the TEMP.SHALLOW_KEEP table holding the rid
+** of every artifact that falls inside the bound given by a
+** "pragma shallow" card.
+**
+** The result is saved in the repository, when it can be written, so
+** that the later round-trips of the same clone or pull load it instead
+** of parsing the manifest of every check-in inside the bound again.
+** Any new or removed artifact, or a phantom that receives its content,
+** makes the saved result stale.
+*/
+void shallow_compute_keep(int nDepth, double rSince){
+  Stmt q;
+  char *zOpen;
+  char *zBound;
+  char *zStamp;
+  int bSave;
+  if( nDepth<=0 && rSince<=0.0 ) return;
+  db_multi_exec(
+    "CREATE TEMP TABLE IF NOT EXISTS shallow_keep(rid INTEGER PRIMARY KEY);"
+    "CREATE TEMP TABLE IF NOT EXISTS shallow_ckin("
+    "  rid INTEGER PRIMARY KEY,"
+    "  isBoundary BOOLEAN"
+    ");"
+    "DELETE FROM shallow_keep;"
+    "DELETE FROM shallow_ckin;"
+  );
+  shallowActive = 1;
+  shallowKeepSince = rSince;
+  zBound = mprintf("%d %.6f", nDepth, rSince);
+  zStamp = db_text("", "SELECT max(rid)||' '||count(*)||' '||"
+                       "(SELECT count(*) FROM phantom) FROM blob");
+  bSave = !db_is_protected(PROTECT_READONLY) && db_is_writeable("repository");
+  if( bSave && shallow_keep_load(zBound, zStamp) ){
+    fossil_free(zBound);
+    fossil_free(zStamp);
+    return;
+  }
+
+  /* Check-ins inside the bound */
+  if( nDepth>0 ){
+    zOpen = leaf_is_closed_sql("leaf.rid");
+    db_multi_exec(
+      "WITH RECURSIVE anc(rid,depth) AS ("
+      "  SELECT leaf.rid, 1 FROM leaf, event"
+      "   WHERE event.objid=leaf.rid AND event.mtime>=%.17g AND NOT %s"
+      "  UNION"
+      "  SELECT plink.pid, anc.depth+1 FROM anc, plink, event"
+      "   WHERE plink.cid=anc.rid AND anc.depth<%d"
+      "     AND event.objid=plink.pid AND event.mtime>=%.17g"
+      ")"
+      "INSERT OR IGNORE INTO shallow_ckin(rid) SELECT rid FROM anc;",
+      rSince, zOpen/*safe-for-%s*/, nDepth, rSince
+    );
+    fossil_free(zOpen);
+  }else{
+    db_multi_exec(
+      "INSERT INTO shallow_ckin(rid)"
+      " SELECT objid FROM event WHERE type='ci' AND mtime>=%.17g;",
+      rSince
+    );
+  }
+  db_multi_exec(
+    "UPDATE shallow_ckin SET isBoundary=NOT EXISTS("
+    "  SELECT 1 FROM plink, shallow_ckin AS p"
+    "   WHERE plink.cid=shallow_ckin.rid AND plink.isprim"
+    "     AND p.rid=plink.pid);"
+    "INSERT INTO shallow_keep SELECT rid FROM shallow_ckin;"
+  );
+
+  /* Files needed by those check-ins.  A check-in whose primary parent
+  ** is also kept needs only the files it changed.  A boundary check-in
+  ** needs its whole tree. */
+  db_multi_exec(
+    "INSERT OR IGNORE INTO shallow_keep"
+    " SELECT fid FROM mlink, shallow_ckin"
+    "  WHERE mlink.mid=shallow_ckin.rid AND NOT isBoundary AND fid>0;"
+  );
+  db_prepare(&q, "SELECT rid, isBoundary FROM shallow_ckin");
+  while( db_step(&q)==SQLITE_ROW ){
+    int rid = db_column_int(&q, 0);
+    int isBoundary = db_column_int(&q, 1);
+    Manifest *p = manifest_get(rid, CFTYPE_MANIFEST, 0);
+    ManifestFile *pFile;
+    if( p==0 ) continue;
+    if( p->zBaseline ){
+      db_multi_exec(
+        "INSERT OR IGNORE INTO shallow_keep"
+        " SELECT rid FROM blob WHERE uuid=%Q", p->zBaseline
+      );
+    }
+    if( isBoundary ){
+      manifest_file_rewind(p);
+      while( (pFile = manifest_file_next(p, 0))!=0 ){
+        db_multi_exec(
+          "INSERT OR IGNORE INTO shallow_keep"
+          " SELECT rid FROM blob WHERE uuid=%Q", pFile->zUuid
+        );
+      }
+    }
+    manifest_destroy(p);
+  }
+  db_finalize(&q);
+
+  /* Everything that is neither a check-in nor a file, except clusters.
+  ** A cluster would turn the whole of the history into phantoms on the
+  ** client. */
+  db_multi_exec(
+    "INSERT OR IGNORE INTO shallow_keep"
+    " SELECT rid FROM blob"
+    "  WHERE NOT EXISTS(SELECT 1 FROM event"
+    "                    WHERE objid=blob.rid AND type='ci')"
+    "    AND NOT EXISTS(SELECT 1 FROM mlink WHERE fid=blob.rid)"
+    "    AND NOT EXISTS(SELECT 1 FROM mlink WHERE pid=blob.rid)"
+    "    AND NOT EXISTS(SELECT 1 FROM tagxref"
+    "                    WHERE rid=blob.rid AND tagid=%d);",
+    TAG_CLUSTER
+  );
+  if( bSave ) shallow_keep_save(zBound, zStamp);
+  fossil_free(zBound);
+  fossil_free(zStamp);
+}
+
+/*
+** On the server, leave out file content as asked for by a "pragma
+** blobless" card.  If bTip is true, the files of the open leaves are
+** sent anyway, so that a new clone can be checked out without a further
+** round-trip.
+*/
+void shallow_omit_files(int bTip){
+  Stmt q;
+  char *zOpen;
+  shallowOmitFiles = 1;
+  if( !bTip ) return;
+  db_multi_exec(
+    "CREATE TEMP TABLE IF NOT EXISTS shallow_tip(rid INTEGER PRIMARY KEY);"
+    "DELETE FROM shallow_tip;"
+  );
+  zOpen = leaf_is_closed_sql("leaf.rid");
+  db_prepare(&q, "SELECT rid FROM leaf WHERE NOT %s", zOpen/*safe-for-%s*/);
+  fossil_free(zOpen);
+  while( db_step(&q)==SQLITE_ROW ){
+    Manifest *p = manifest_get(db_column_int(&q, 0), CFTYPE_MANIFEST, 0);
+    ManifestFile *pFile;
+    if( p==0 ) continue;
+    manifest_file_rewind(p);
+    while( (pFile = manifest_file_next(p, 0))!=0 ){
+      db_multi_exec(
+        "INSERT OR IGNORE INTO shallow_tip"
+        " SELECT rid FROM blob WHERE uuid=%Q", pFile->zUuid
+      );
+    }
+    manifest_destroy(p);
+  }
+  db_finalize(&q);
+  shallowOmitFiles = 2;
+}
+
+/*
+** On the server, return true if a "pragma shallow" card is in effect.
+*/
+int shallow_is_active(void){
+  return shallowActive;
+}
+
+/*
+** On the server, return the time bound of the "pragma shallow" card
+** in effect, as a julian day number, or 0.0 if there is none.
+*/
+double shallow_since(void){
+  return shallowKeepSince;
+}
+
+/*
+** On the server, return true if artifact rid is outside the bound of
+** a shallow clone and should not be sent.
+*/
+int shallow_omits(int rid){
+  static Stmt q1, q2;
+  int rc;
+  if( shallowActive ){
+    db_static_prepare(&q1, "SELECT 1 FROM shallow_keep WHERE rid=:rid");
+    db_bind_int(&q1, ":rid", rid);
+    rc = db_step(&q1);
+    db_reset(&q1);
+    if( rc!=SQLITE_ROW ) return 1;
+  }
+  if( shallowOmitFiles ){
+    db_static_prepare(&q2,
+      "SELECT 1 FROM blob WHERE rid=:rid%s",
+      shallow_blob_filter()/*safe-for-%s*/
+    );
+    db_bind_int(&q2, ":rid", rid);
+    rc = db_step(&q2);
+    db_reset(&q2);
+    if( rc!=SQLITE_ROW ) return 1;
+  }
+  return 0;
+}
+
+/*
+** On the server, return an SQL term that limits a query on the BLOB
+** table to artifacts inside the bound of a shallow clone and that are
+** not file content left out of a blobless clone, or an empty string if
+** there is no such limit.
+*/
+const char *shallow_blob_filter(void){
+  static const char zKeep[] = " AND blob.rid IN shallow_keep";
+  static const char zNoFile[] =
+    " AND NOT EXISTS(SELECT 1 FROM mlink WHERE fid=blob.rid)"
+    " AND NOT EXISTS(SELECT 1 FROM mlink WHERE pid=blob.rid)";
+  static const char zNoFileTip[] =
+    " AND (blob.rid IN shallow_tip"
+    "      OR (NOT EXISTS(SELECT 1 FROM mlink WHERE fid=blob.rid)"
+    "          AND NOT EXISTS(SELECT 1 FROM mlink WHERE pid=blob.rid)))";
+  static char *zBoth = 0;
+  const char *zFile;
+  if( shallowOmitFiles==0 ) return shallowActive ? zKeep : "";
+  zFile = shallowOmitFiles==2 ? zNoFileTip : zNoFile;
+  if( !shallowActive ) return zFile;
+  if( zBoth==0 ) zBoth = mprintf("%s%s", zKeep, zFile);
+  return zBoth;
+}
+
+/*
+** On the server, return the smallest rid that is inside the bound and
+** is no less than iFrom.  Return 0 if there is none.
+*/
+int shallow_next_rid(int iFrom){
+  return db_int(0, "SELECT min(rid) FROM blob WHERE rid>=%d%s",
+                iFrom, shallow_blob_filter()/*safe-for-%s*/);
+}
+
+/*
+** On the server, once a shallow clone has sent all of its artifacts,
+** send a card of the form
+**
+**      shallow-tag HASH TAGNAME MTIME ?VALUE?
+**
+** for every propagating tag on a check-in at the edge of the clone.
+** Those tags were set by history that the client does not have.
+*/
+void shallow_send_tags(Blob *pOut){
+  Stmt q;
+  if( !shallowActive ) return;
+  db_prepare(&q,
+    "SELECT blob.uuid, tag.tagname, tagxref.mtime, tagxref.value"
+    "  FROM shallow_ckin, tagxref, tag, blob"
+    " WHERE shallow_ckin.isBoundary"
+    "   AND tagxref.rid=shallow_ckin.rid AND tagxref.tagtype=2"
+    "   AND tag.tagid=tagxref.tagid"
+    "   AND blob.rid=shallow_ckin.rid"
+  );
+  while( db_step(&q)==SQLITE_ROW ){
+    blob_appendf(pOut, "shallow-tag %s %F %.17g",
+                 db_column_text(&q, 0), db_column_text(&q, 1),
+                 db_column_double(&q, 2));
+    if( db_column_type(&q, 3)!=SQLITE_NULL ){
+      blob_appendf(pOut, " %F", db_column_text(&q, 3));
+    }
+    blob_append(pOut, "\n", 1);
+  }
+  db_finalize(&q);
+}
+
+/*
+** On the client, remember a tag received in a "shallow-tag" card.
+** zValue may be NULL.
+*/
+void shallow_accept_tag(
+  const char *zUuid,       /* Check-in at the edge of the clone */
+  const char *zTag,        /* Name of the tag */
+  double mtime,            /* Time the tag took effect */
+  const char *zValue       /* Value of the tag, or NULL */
+){
+  shallow_schema();
+  db_multi_exec(
+    "REPLACE INTO shallowtag(uuid,tagname,mtime,value)"
+    " VALUES(%Q,%Q,%.17g,%Q)", zUuid, zTag, mtime, zValue
+  );
+}
+
+/*
+** Apply the tags in the SHALLOWTAG table.  This is called by rebuild
+** after all artifacts have been crosslinked.
+*/
+void shallow_apply_tags(void){
+  Stmt q;
+  if( !shallow_is_clone() ) return;
+  db_prepare(&q,
+    "SELECT blob.rid, tagname, mtime, value FROM shallowtag, blob"
+    " WHERE blob.uuid=shallowtag.uuid AND blob.size>=0"
+  );
+  while( db_step(&q)==SQLITE_ROW ){
+    tag_insert(db_column_text(&q, 1), 2, db_column_text(&q, 3), 0,
+               db_column_double(&q, 2), db_column_int(&q, 0));
+  }
+  db_finalize(&q);
+}
+
+/*
+** On the client, after a shallow clone has been rebuilt, record every
+** remaining phantom as an artifact that is not to be requested.
+*/
+void shallow_record_boundary(void){
+  char *zSince;
+  if( shallowBlobless ) db_set("blobless", "1", 0);
+  if( !shallow_is_requested() ) return;
+  shallow_schema();
+  db_multi_exec(
+    "INSERT OR IGNORE INTO shallow SELECT rid FROM phantom AS blob"
+    " WHERE 1%s", shallow_phantom_filter()/*safe-for-%s*/
+  );
+  db_set_int("shallow-depth", shallowDepth, 0);
+  if( shallowSince>0.0 ){
+    zSince = db_text(0, "SELECT strftime('%%Y-%%m-%%d %%H:%%M:%%f',%.17g)",
+                     shallowSince);
+  }else{
+    zSince = db_text(0, "SELECT strftime('%%Y-%%m-%%d %%H:%%M:%%f',"
+                        "min(mtime)) FROM event WHERE type='ci'");
+  }
+  if( zSince ) db_set("shallow-since", zSince, 0);
+  fossil_free(zSince);
+}
+
+/*
+** Return true if this repository is a shallow clone.
+*/
+int shallow_is_clone(void){
+  return db_table_exists("repository", "shallowtag");
+}
+
+/*
+** On the client, return an SQL term that limits a query on the BLOB
+** table to phantoms that a sync should request.  History left out of a
+** shallow clone and file content left out of a blobless clone are not
+** requested.
+*/
+const char *shallow_phantom_filter(void){
+  static const char zNoShallow[] =
+    " AND NOT EXISTS(SELECT 1 FROM shallow WHERE rid=blob.rid)";
+  static const char zNoFile[] =
+    " AND NOT EXISTS(SELECT 1 FROM mlink WHERE fid=blob.rid)"
+    " AND NOT EXISTS(SELECT 1 FROM mlink WHERE pid=blob.rid)";
+  static char *zBoth = 0;
+  int bShallow = shallow_is_clone();
+  if( !shallowBlobless && !db_get_boolean("blobless", 0) ){
+    return bShallow ? zNoShallow : "";
+  }
+  if( !bShallow ) return zNoFile;
+  if( zBoth==0 ) zBoth = mprintf("%s%s", zNoShallow, zNoFile);
+  return zBoth;
+}
+
+/*
+** Put the artifacts chosen by the SQL query zRidQuery, which must yield
+** a single column of rids, into the TEMP.FETCHLIST table, creating or
+** clearing that table first.  Return the number of those artifacts
+** that are phantoms.
+*/
+static int shallow_fetchlist(const char *zRidQuery){
+  db_multi_exec(
+    "CREATE TEMP TABLE IF NOT EXISTS fetchlist(rid INTEGER PRIMARY KEY);"
+    "DELETE FROM fetchlist;"
+    "INSERT OR IGNORE INTO fetchlist %s;", zRidQuery/*safe-for-%s*/
+  );
+  return db_int(0,
+    "SELECT count(*) FROM fetchlist JOIN blob USING(rid) WHERE size<0");
+}
+
+/*
+** Return true if file content missing from this repository may be
+** fetched from the remote on demand.
+*/
+static int shallow_can_fetch(void){
+  return !g.isHTTP && db_get_boolean("blobless", 0);
+}
+
+/*
+** Return true if rid is file content that was left out of this blobless
+** clone and can still be fetched from the remote on demand.
+*/
+int shallow_is_fetchable(int rid){
+  if( !shallow_can_fetch() ) return 0;
+  if( !db_exists("SELECT 1 FROM phantom WHERE rid=%d", rid) ) return 0;
+  if( shallow_is_clone()
+   && db_exists("SELECT 1 FROM shallow WHERE rid=%d", rid)
+  ){
+    return 0;
+  }
+  return db_exists("SELECT 1 FROM mlink WHERE fid=%d", rid);
+}
+
+/*
+** Artifact rid is a phantom that content_get() was asked for.  If this
+** is a blobless clone, fetch it from the remote, together with the
+** other missing files of the check-ins that use it and the missing
+** prior versions of the same file, which are likely to be wanted next
+** by a diff or an annotate.  Return true if rid is no longer a phantom.
+**
+** content_get() is called from many places, so nothing is fetched if
+** the caller holds a transaction or a sync is already talking to a
+** remote.  A network round-trip must not run inside a transaction that
+** the caller might still roll back, nor reuse the transport of a sync
+** in progress.  Commands that know in advance which content they need
+** use shallow_prefetch() before they read it.  A file that is still
+** missing inside a transaction is a fatal error rather than empty
+** content, which the caller might otherwise merge, stash or commit.
+** The sync code copes with missing content on its own.
+*/
+int shallow_fetch_missing(int rid){
+  static int busy = 0;
+  char *zQuery;
+  int n;
+  if( busy || !shallow_can_fetch() || client_sync_active() ) return 0;
+  if( db_int(0, "SELECT size FROM blob WHERE rid=%d", rid)>=0 ) return 0;
+  if( db_transaction_nesting_depth()>0 ){
+    if( shallow_is_fetchable(rid) ){
+      char *zUuid = rid_to_uuid(rid);
+      fossil_fatal("content not available in blobless clone: %s\n"
+                   "run \"%s artifact %S\" to fetch it and try again",
+                   zUuid, g.argv[0], zUuid);
+    }
+    return 0;
+  }
+  busy = 1;
+  zQuery = mprintf(
+    "SELECT %d"
+    " UNION SELECT * FROM ("
+    "   SELECT m2.fid FROM mlink AS m1, mlink AS m2, phantom"
+    "    WHERE m1.fid=%d AND m2.mid=m1.mid AND phantom.rid=m2.fid"
+    "    LIMIT 100)"
+    " UNION SELECT * FROM ("
+    "   SELECT m2.fid FROM mlink AS m1, mlink AS m2, phantom"
+    "    WHERE m1.fid=%d AND m2.fnid=m1.fnid AND phantom.rid=m2.fid"
+    "    LIMIT 100)",
+    rid, rid, rid
+  );
+  n = shallow_fetchlist(zQuery);
+  fossil_free(zQuery);
+  if( n>0 ) client_fetch_phantoms();
+  busy = 0;
+  return db_int(-1, "SELECT size FROM blob WHERE rid=%d", rid)>=0;
+}
+
+/*
+** If this is a blobless clone, fetch every artifact chosen by the SQL
+** query zRidQuery that is a phantom.  This is used before writing many
+** files to disk, so that they arrive in a few large requests rather than
+** many small ones.
+*/
+void shallow_prefetch(const char *zRidQuery){
+  if( !shallow_can_fetch() ) return;
+  if( shallow_fetchlist(zRidQuery)>0 ){
+    client_fetch_phantoms();
+  }
+}
+
+/*
+** Fetch from the remote every artifact chosen by the SQL query zRidQuery
+** that is a phantom, whether or not this is a blobless clone.  Return
+** the number of artifacts received.
+*/
+int shallow_fetch_phantoms(const char *zRidQuery){
+  if( shallow_fetchlist(zRidQuery)==0 ) return 0;
+  return client_fetch_phantoms();
+}
+
+/*
+** COMMAND: test-shallow-keep
+**
+** Usage: %fossil test-shallow-keep ?--depth N? ?--since DATE?
+**
+** Compute the set of artifacts that a shallow clone with the given bound
+** would receive from this repository and show how many there are,
+** together with the number of check-ins and bytes.
+*/
+void test_shallow_keep_cmd(void){
+  const char *zDepth = find_option("depth",0,1);
+  const char *zSince = find_option("since",0,1);
+  db_find_and_open_repository(0, 0);
+  verify_all_options();
+  shallow_set_bound(zDepth ? atoi(zDepth) : 0, zSince);
+  if( !shallow_is_requested() ){
+    usage("?--depth N? ?--since DATE?");
+  }
+  shallow_compute_keep(shallowDepth, shallowSince);
+  fossil_print("check-ins:   %d of %d\n",
+    db_int(0, "SELECT count(*) FROM shallow_ckin"),
+    db_int(0, "SELECT count(*) FROM event WHERE type='ci'"));
+  fossil_print("boundary:    %d\n",
+    db_int(0, "SELECT count(*) FROM shallow_ckin WHERE isBoundary"));
+  fossil_print("artifacts:   %d of %d\n",
+    db_int(0, "SELECT count(*) FROM shallow_keep"),
+    db_int(0, "SELECT count(*) FROM blob WHERE size>=0"));
+  fossil_print("bytes:       %lld of %lld\n",
+    db_int64(0, "SELECT sum(size) FROM blob"
+                " WHERE rid IN shallow_keep AND size>0"),
+    db_int64(0, "SELECT sum(size) FROM blob WHERE size>0"));
+}
@@ -114,6 +114,19 @@ static void sqlcmd_decompress(
   if( pIn==0 ) return;
   nIn = sqlite3_value_bytes(argv[0]);
   if( nIn<4 ) return;
+  if( blob_compressed_dictid((const char*)pIn, nIn) ){
+    /* Compressed with a preset dictionary of the repository */
+    Blob x, y;
+    blob_init(&x, (const char*)pIn, nIn);
+    if( blob_uncompress(&x, &y) ){
+      sqlite3_result_error(context, "unknown compression dictionary", -1);
+    }else{
+      sqlite3_result_blob(context, blob_buffer(&y), blob_size(&y),
+                          SQLITE_TRANSIENT);
+      blob_reset(&y);
+    }
+    return;
+  }
   nOut = (pIn[0]<<24) + (pIn[1]<<16) + (pIn[2]<<8) + pIn[3];
   pOut = sqlite3_malloc( nOut+1 );
   rc = uncompress(pOut, &nOut, &pIn[4], nIn-4);
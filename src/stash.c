@@ -159,6 +159,26 @@ void stash_rid_renumbering_event(void){
   }
 }
 
+/*
+** Fetch the artifacts chosen by the SQL query zSql, if they are missing
+** from a blobless clone, and free zSql.  The stash command reads them
+** inside its transaction, where content_get() will not fetch them.
+*/
+static void stash_prefetch_sql(char *zSql){
+  shallow_prefetch(zSql);
+  fossil_free(zSql);
+}
+
+/*
+** Fetch the baseline files of stash stashid that are missing from a
+** blobless clone.
+*/
+static void stash_prefetch(int stashid){
+  stash_prefetch_sql(mprintf(
+    "SELECT blob.rid FROM stashfile, blob"
+    " WHERE stashid=%d AND blob.uuid=stashfile.hash", stashid));
+}
+
 /*
 ** Add zFName to the stash given by stashid.  zFName might be the name of a
 ** file or a directory.  If a directory, add all changed files contained
@@ -175,6 +195,9 @@ static void stash_add_file_or_dir(int stashid, int vid, const char *zFName){
   zFile = mprintf("%/", zFName);
   file_tree_name(zFile, &fname, 0, 1);
   zTreename = blob_str(&fname);
+  stash_prefetch_sql(mprintf(
+    "SELECT mrid FROM vfile WHERE vid=%d AND chnged AND NOT deleted"
+    "   AND mrid>0", vid));
   blob_zero(&sql);
   blob_append_sql(&sql,
     "SELECT deleted, isexe, islink, mrid, pathname, coalesce(origname,pathname)"
@@ -308,6 +331,7 @@ static int stash_create(void){
 static void stash_apply(int stashid, int nConflict){
   int vid;
   Stmt q;
+  stash_prefetch(stashid);
   db_prepare(&q,
      "SELECT blob.rid, isRemoved, isExec, isLink, origname, newname, delta"
      "  FROM stashfile, blob WHERE stashid=%d AND blob.uuid=stashfile.hash"
@@ -413,6 +437,7 @@ static void stash_diff(
   Blob empty;
   int bWebpage = (pCfg->diffFlags & (DIFF_WEBPAGE|DIFF_JSON|DIFF_TCL))!=0;
   blob_zero(&empty);
+  stash_prefetch(stashid);
   diff_begin(pCfg);
   db_prepare(&q,
      "SELECT blob.rid, isRemoved, isExec, isLink, origname, newname, delta"
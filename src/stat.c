@@ -176,7 +176,8 @@ void stat_page(void){
   @ </td></tr>
   if( !brief ){
     @ <tr><th>Number&nbsp;Of&nbsp;Artifacts:</th><td>
-    n = db_int(0, "SELECT count(*) FROM blob WHERE content IS NOT NULL");
+    n = db_int(0, "SELECT count(*) FROM blob WHERE %s",
+               packfile_is_stored_sql()/*safe-for-%s*/);
     m = db_int(0, "SELECT count(*) FROM delta");
     @ %,d(n) (%,d(n-m) fulltext and %,d(m) deltas)
     if( g.perm.Write ){
@@ -188,7 +189,8 @@ void stat_page(void){
       Stmt q;
       @ <tr><th>Uncompressed&nbsp;Artifact&nbsp;Size:</th><td>
       db_prepare(&q, "SELECT total(size), avg(size), max(size)"
-                     " FROM blob WHERE content IS NOT NULL /*scan*/");
+                     " FROM blob WHERE %s /*scan*/",
+                     packfile_is_stored_sql()/*safe-for-%s*/);
       db_step(&q);
       t = db_column_int64(&q, 0);
       szAvg = db_column_int(&q, 1);
@@ -382,7 +384,8 @@ void dbstat_cmd(void){
   fsize = file_size(g.zRepositoryName, ExtFILE);
   fossil_print( "%*s%,lld bytes\n", colWidth, "repository-size:", fsize);
   if( !brief ){
-    n = db_int(0, "SELECT count(*) FROM blob WHERE content IS NOT NULL");
+    n = db_int(0, "SELECT count(*) FROM blob WHERE %s",
+               packfile_is_stored_sql()/*safe-for-%s*/);
     m = db_int(0, "SELECT count(*) FROM delta");
     fossil_print("%*s%,d (stored as %,d full text and %,d deltas)\n",
                  colWidth, "artifact-count:",
@@ -944,12 +947,6 @@ void gather_artifact_stats(int bWithTypes){
     @   szExp,                    -- expanded, uncompressed size
     @   szCmpr                    -- size as stored on disk
     @ );
-    @ INSERT INTO artstat(id,atype,isDelta,szExp,szCmpr)
-    @    SELECT blob.rid, NULL,
-    @           delta.rid IS NOT NULL,
-    @           size, octet_length(content)
-    @      FROM blob LEFT JOIN delta ON blob.rid=delta.rid
-    @     WHERE content IS NOT NULL;
   ;
   static const char zSql2[] =
     @ UPDATE artstat SET atype='file'
@@ -991,6 +988,16 @@ void gather_artifact_stats(int bWithTypes){
     @ UPDATE artstat SET atype='unused' WHERE atype IS NULL;
   ;
   db_multi_exec("%s", zSql/*safe-for-%s*/);
+  db_multi_exec(
+    "INSERT INTO artstat(id,atype,isDelta,szExp,szCmpr)"
+    "   SELECT blob.rid, NULL,"
+    "          delta.rid IS NOT NULL,"
+    "          size, %s"
+    "     FROM blob LEFT JOIN delta ON blob.rid=delta.rid"
+    "    WHERE %s",
+    packfile_stored_size_sql()/*safe-for-%s*/,
+    packfile_is_stored_sql()/*safe-for-%s*/
+  );
   if( bWithTypes ){
     db_multi_exec("%s", zSql2/*safe-for-%s*/);
   }
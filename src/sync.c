@@ -20,6 +20,15 @@
 #include "config.h"
 #include "sync.h"
 #include <assert.h>
+#if !defined(_WIN32)
+# include <unistd.h>
+# include <sys/types.h>
+# include <sys/wait.h>
+# include <poll.h>
+# include <signal.h>
+#else
+# include <io.h>
+#endif
 
 /*
 ** Explain what type of sync operation is about to occur
@@ -43,10 +52,402 @@ static void sync_explain(unsigned syncFlags){
 }
 
 
+/*
+** In a child process of a concurrent sync, the pipes that carry cards
+** relayed by client_sync() to the parent process and the replies back.
+** Both are -1 in any other process.
+*/
+static int relayFdOut = -1;
+static int relayFdIn = -1;
+
+/*
+** Return true if this process is a child of a concurrent sync, which
+** relays received content to its parent instead of writing it.
+*/
+int sync_relay_active(void){
+  return relayFdOut>=0;
+}
+
+#if !defined(_WIN32)
+/*
+** Write the content of p to fd, preceded by its size.  Return 0 on
+** success.
+*/
+static int sync_relay_send(int fd, Blob *p){
+  i64 n = blob_size(p);
+  const char *z = blob_buffer(p);
+  if( write(fd, &n, sizeof(n))!=(ssize_t)sizeof(n) ) return 1;
+  while( n>0 ){
+    ssize_t k = write(fd, z, n);
+    if( k<=0 ) return 1;
+    z += k;
+    n -= k;
+  }
+  return 0;
+}
+
+/*
+** Read a message written by sync_relay_send() from fd into p, which
+** must be empty.  Return 0 on success, or 1 at end of file.
+*/
+static int sync_relay_recv(int fd, Blob *p){
+  i64 n;
+  char *z;
+  ssize_t k = read(fd, &n, sizeof(n));
+  if( k!=(ssize_t)sizeof(n) || n<0 ) return 1;
+  blob_resize(p, (unsigned int)n);
+  z = blob_buffer(p);
+  while( n>0 ){
+    k = read(fd, z, n);
+    if( k<=0 ) return 1;
+    z += k;
+    n -= k;
+  }
+  return 0;
+}
+#endif /* !defined(_WIN32) */
+
+/*
+** Called by client_sync() in a child of a concurrent sync.  Have the
+** parent process merge the relayed cards in pCards, and wait until it
+** has committed them.  Return non-zero if the parent reports errors,
+** which are then described in pErr.
+*/
+int sync_relay_merge(Blob *pCards, Blob *pErr){
+#if !defined(_WIN32)
+  if( sync_relay_send(relayFdOut, pCards)
+   || sync_relay_recv(relayFdIn, pErr)
+  ){
+    fossil_fatal("lost contact with the parent sync process");
+  }
+#endif
+  return blob_size(pErr)>0;
+}
+
+#if !defined(_WIN32)
+/*
+** Sync with every remote aUrl[i] for which aVisit[i] is true, all at
+** the same time.  Each remote is handled by a child process with its
+** own connection to the repository, but the children never write to
+** it.  The cards of each reply that would change the repository are
+** relayed to this process, which is the only writer.  It merges the
+** relayed cards of one child at a time, each batch in its own
+** transaction, and then lets that child continue.  The children hold
+** no transaction while they wait on the network or on this process, so
+** their round-trips overlap and the merges never wait on them.
+**
+** Output from each child is captured and shown in the order of aUrl[]
+** after all of the children have finished.  On return, aRc[i] is the
+** error count for remote i and aRcvd[i] is true if remote i delivered
+** new artifacts.  A remote whose child cannot be started is synced by
+** this process once the others are done.
+**
+** The children are not interactive.  Their standard input is /dev/null,
+** so a password prompt or an unverified SSL certificate fails that
+** remote instead of waiting on a reply that nobody can see.  Use
+** --serial to answer such prompts.
+**
+** The repository is closed while the children are started and is
+** reopened before any merging.  The caller must not be holding a
+** transaction or any prepared statements it means to keep.
+*/
+static void sync_urls_concurrently(
+  unsigned syncFlags,      /* Mask of SYNC_* flags */
+  unsigned configRcvMask,  /* Receive these configuration items */
+  unsigned configSendMask, /* Send these configuration items */
+  const char *zAltPCode,   /* Alternative project code (usually NULL) */
+  int iPass,               /* Which pass through the remotes.  0 or 1 */
+  int nUrl,                /* Number of remotes */
+  UrlData *aUrl,           /* Parsed URL of each remote */
+  const int *aVisit,       /* Only visit remotes for which this is true */
+  int *aRc,                /* OUT: Error count for each remote */
+  int *aRcvd               /* OUT: True if the remote sent new artifacts */
+){
+  pid_t *aPid;             /* Child process for each remote.  0 if none */
+  FILE **aOut;             /* Captured output of each child */
+  int *aFdReq;             /* Read relayed cards from each child */
+  int *aFdAck;             /* Reply to each child */
+  struct pollfd *aPoll;    /* Children still relaying */
+  char *zRepo;             /* Name of the repository file */
+  int bLocal;              /* True if a check-out was open */
+  int nLive = 0;           /* Number of children still relaying */
+  int i, j;
+
+  aPid = fossil_malloc(sizeof(aPid[0])*nUrl);
+  aOut = fossil_malloc(sizeof(aOut[0])*nUrl);
+  aFdReq = fossil_malloc(sizeof(int)*nUrl*2);
+  aFdAck = &aFdReq[nUrl];
+  aPoll = fossil_malloc(sizeof(aPoll[0])*nUrl);
+  memset(aPid, 0, sizeof(aPid[0])*nUrl);
+  memset(aOut, 0, sizeof(aOut[0])*nUrl);
+  zRepo = fossil_strdup(g.zRepositoryName);
+  bLocal = g.localOpen;
+
+  /* An SQLite connection must not be carried across fork() */
+  db_close(1);
+  fflush(stdout);
+  fflush(stderr);
+  for(i=0; i<nUrl; i++){
+    int fdReq[2], fdAck[2];
+    aRc[i] = 0;
+    aRcvd[i] = 0;
+    aFdReq[i] = aFdAck[i] = -1;
+    if( !aVisit[i] ) continue;
+    aOut[i] = tmpfile();
+    if( aOut[i]==0 ) continue;
+    if( pipe(fdReq) ){
+      fclose(aOut[i]);
+      aOut[i] = 0;
+      continue;
+    }
+    if( pipe(fdAck) ){
+      close(fdReq[0]);
+      close(fdReq[1]);
+      fclose(aOut[i]);
+      aOut[i] = 0;
+      continue;
+    }
+    aPid[i] = fork();
+    if( aPid[i]==0 ){
+      /* This is the child.  Sync with remote i and report the outcome
+      ** in the exit status. */
+      int rc;
+      int nRcvd = 0;
+      for(j=0; j<i; j++){
+        if( aFdReq[j]>=0 ) close(aFdReq[j]);
+        if( aFdAck[j]>=0 ) close(aFdAck[j]);
+      }
+      close(fdReq[0]);
+      close(fdAck[1]);
+      relayFdOut = fdReq[1];
+      relayFdIn = fdAck[0];
+      if( freopen("/dev/null", "rb", stdin)==0 ) exit(1);
+      dup2(fileno(aOut[i]), 1);
+      dup2(fileno(aOut[i]), 2);
+      if( bLocal ){
+        db_open_local(0);
+      }else{
+        db_open_repository(zRepo);
+      }
+      db_open_config(0, 1);
+      url_move_parse(&g.url, &aUrl[i]);
+      if( i>0 || iPass>0 ) sync_explain(syncFlags);
+      rc = client_sync(syncFlags, configRcvMask, configSendMask,
+                       zAltPCode, &nRcvd);
+      db_close(1);
+      fflush(stdout);
+      fflush(stderr);
+      exit((rc ? 1 : 0) | (nRcvd>0 ? 2 : 0));
+    }
+    close(fdReq[1]);
+    close(fdAck[0]);
+    if( aPid[i]<0 ){
+      aPid[i] = 0;
+      close(fdReq[0]);
+      close(fdAck[1]);
+      fclose(aOut[i]);
+      aOut[i] = 0;
+      continue;
+    }
+    aFdReq[i] = fdReq[0];
+    aFdAck[i] = fdAck[1];
+    nLive++;
+  }
+
+  if( bLocal ){
+    db_open_local(0);
+  }else{
+    db_open_repository(zRepo);
+  }
+  db_open_config(0, 1);
+  db_record_repository_filename(0);
+
+  /* Merge what the children relay until all of them are done.  A child
+  ** that has gone away must not take this process with it. */
+  signal(SIGPIPE, SIG_IGN);
+  while( nLive>0 ){
+    int nPoll = 0;
+    for(i=0; i<nUrl; i++){
+      if( aFdReq[i]<0 ) continue;
+      aPoll[nPoll].fd = aFdReq[i];
+      aPoll[nPoll].events = POLLIN;
+      aPoll[nPoll].revents = 0;
+      nPoll++;
+    }
+    if( poll(aPoll, nPoll, -1)<0 ) continue;
+    for(j=0; j<nPoll; j++){
+      Blob cards, err;
+      if( aPoll[j].revents==0 ) continue;
+      for(i=0; aFdReq[i]!=aPoll[j].fd; i++){}
+      blob_zero(&cards);
+      blob_zero(&err);
+      if( sync_relay_recv(aFdReq[i], &cards) ){
+        close(aFdReq[i]);
+        close(aFdAck[i]);
+        aFdReq[i] = aFdAck[i] = -1;
+        nLive--;
+      }else{
+        client_sync_merge(&cards, syncFlags, configRcvMask, &err);
+        sync_relay_send(aFdAck[i], &err);
+      }
+      blob_reset(&cards);
+      blob_reset(&err);
+    }
+  }
+
+  /* Collect the results in order */
+  for(i=0; i<nUrl; i++){
+    char zBuf[4096];
+    size_t n;
+    int status = 0;
+    if( aPid[i]==0 ) continue;
+    if( waitpid(aPid[i], &status, 0)==aPid[i] && WIFEXITED(status) ){
+      aRc[i] = WEXITSTATUS(status) & 1;
+      aRcvd[i] = (WEXITSTATUS(status) & 2)!=0;
+    }else{
+      aRc[i] = 1;
+    }
+    rewind(aOut[i]);
+    while( (n = fread(zBuf, 1, sizeof(zBuf), aOut[i]))>0 ){
+      fwrite(zBuf, 1, n, stdout);
+    }
+    fflush(stdout);
+    fclose(aOut[i]);
+  }
+  content_clear_cache(0);
+
+  /* Remotes that could not be given a child are synced here */
+  for(i=0; i<nUrl; i++){
+    int nRcvd = 0;
+    if( !aVisit[i] || aPid[i]!=0 ) continue;
+    url_move_parse(&g.url, &aUrl[i]);
+    if( i>0 || iPass>0 ) sync_explain(syncFlags);
+    aRc[i] = client_sync(syncFlags, configRcvMask, configSendMask,
+                         zAltPCode, &nRcvd);
+    aRcvd[i] = nRcvd>0;
+    url_move_parse(&aUrl[i], &g.url);
+  }
+  fossil_free(zRepo);
+  fossil_free(aPid);
+  fossil_free(aOut);
+  fossil_free(aFdReq);
+  fossil_free(aPoll);
+}
+
+/*
+** Sync with the default remote, held in pBase, and with the nOther
+** remotes named in azOther[], all at the same time.  When both pushing
+** and pulling, a second pass carries the artifacts received from each
+** remote to the others.  The children leave the unsent table alone,
+** since each only speaks for one remote, so it is cleared here once
+** every remote has been sent its content.  Return the number of errors.
+*/
+static int client_sync_concurrently(
+  unsigned syncFlags,      /* Mask of SYNC_* flags */
+  unsigned configRcvMask,  /* Receive these configuration items */
+  unsigned configSendMask, /* Send these configuration items */
+  const char *zAltPCode,   /* Alternative project code (usually NULL) */
+  UrlData *pBase,          /* Parse of the default remote */
+  int nOther,              /* Number of extra remote URLs */
+  char **azOther           /* Text of extra remote URLs */
+){
+  int nUrl = nOther+1;     /* Number of remotes */
+  UrlData *aUrl;           /* Parse of every remote.  aUrl[0] is default */
+  int *aVisit;             /* True for remotes to visit on this pass */
+  int *aRc;                /* Error count for each remote */
+  int *aRcvd;              /* True if the remote sent new artifacts */
+  int nRcvd = 0;           /* Number of remotes that sent new artifacts */
+  int nErr = 0;            /* Number of errors seen */
+  Bag unsent;              /* Content of the unsent table at the start */
+  Stmt q;
+  int i;
+
+  bag_init(&unsent);
+  db_prepare(&q, "SELECT rid FROM unsent");
+  while( db_step(&q)==SQLITE_ROW ){
+    bag_insert(&unsent, db_column_int(&q, 0));
+  }
+  db_finalize(&q);
+  aUrl = fossil_malloc(sizeof(aUrl[0])*nUrl);
+  memset(aUrl, 0, sizeof(aUrl[0])*nUrl);
+  aVisit = fossil_malloc(sizeof(int)*nUrl*3);
+  aRc = &aVisit[nUrl];
+  aRcvd = &aRc[nUrl];
+
+  /* Parse every URL up front so that any password prompts happen
+  ** one at a time, before the children start */
+  url_move_parse(&aUrl[0], pBase);
+  for(i=1; i<nUrl; i++){
+    url_parse(azOther[i-1],
+              URL_PROMPT_PW|URL_ASK_REMEMBER_PW|URL_USE_CONFIG);
+    url_move_parse(&aUrl[i], &g.url);
+  }
+  for(i=0; i<nUrl; i++) aVisit[i] = 1;
+  sync_urls_concurrently(syncFlags, configRcvMask, configSendMask, zAltPCode,
+                         0, nUrl, aUrl, aVisit, aRc, aRcvd);
+  for(i=0; i<nUrl; i++){
+    nErr += aRc[i];
+    if( aRcvd[i] ) nRcvd++;
+    if( aRc[i] ) continue;
+    if( i==0 ){
+      url_move_parse(&g.url, &aUrl[0]);
+      url_remember();
+      url_move_parse(&aUrl[0], &g.url);
+    }else if( (aUrl[i].flags & URL_REMEMBER_PW)!=0 ){
+      char *zKey = mprintf("sync-pw:%s", azOther[i-1]);
+      char *zPw = obscure(aUrl[i].passwd);
+      if( zPw && zPw[0] ){
+        db_set(zKey/*works-like:""*/, zPw, 0);
+      }
+      fossil_free(zPw);
+      fossil_free(zKey);
+    }
+  }
+
+  /* No remote saw what the others sent during the first pass.  Visit
+  ** them all again, except a remote that was the only one to send
+  ** anything new. */
+  if( nRcvd>0
+   && (syncFlags & (SYNC_PUSH|SYNC_PULL))==(SYNC_PUSH|SYNC_PULL)
+  ){
+    for(i=0; i<nUrl; i++){
+      aVisit[i] = nRcvd>1 || !aRcvd[i];
+    }
+    sync_urls_concurrently(syncFlags, configRcvMask, configSendMask,
+                           zAltPCode, 1, nUrl, aUrl, aVisit, aRc, aRcvd);
+    for(i=0; i<nUrl; i++) nErr += aRc[i];
+  }
+  if( nErr==0 && bag_count(&unsent)>0 ){
+    int rid;
+    db_begin_transaction();
+    for(rid=bag_first(&unsent); rid>0; rid=bag_next(&unsent, rid)){
+      db_multi_exec("DELETE FROM unsent WHERE rid=%d", rid);
+    }
+    db_end_transaction(0);
+  }
+  bag_clear(&unsent);
+  if( g.rcvid && fossil_any_has_fork(g.rcvid) ){
+    fossil_warning("***** WARNING: a fork has occurred *****\n"
+                   "use \"fossil leaves -multiple\" for more details.");
+  }
+
+  url_move_parse(pBase, &aUrl[0]);
+  for(i=1; i<nUrl; i++) url_unparse(&aUrl[i]);
+  fossil_free(aUrl);
+  fossil_free(aVisit);
+  return nErr;
+}
+#endif /* !defined(_WIN32) */
+
 /*
 ** Call client_sync() one or more times in order to complete a
 ** sync operation.  Usually, client_sync() is called only once, though
 ** is can be called multiple times if the SYNC_ALLURL flags is set.
+**
+** With SYNC_ALLURL and SYNC_CONCURRENT, the remotes are visited at the
+** same time rather than one after another.  Syncs of unversioned files,
+** share links, or check-in locks still visit one remote at a time, as
+** those are not relayed to the single writer.
 */
 static int client_sync_all_urls(
   unsigned syncFlags,      /* Mask of SYNC_* flags */
@@ -92,6 +493,16 @@ static int client_sync_all_urls(
   iEnd = nOther+1;
   nextIEnd = 0;
   nPass = 1 + ((syncFlags & (SYNC_PUSH|SYNC_PULL))==(SYNC_PUSH|SYNC_PULL));
+#if !defined(_WIN32)
+  if( (syncFlags & SYNC_CONCURRENT)!=0 && nOther>0
+   && (syncFlags & (SYNC_UNVERSIONED|SYNC_SHARE_LINKS|SYNC_CKIN_LOCK))==0
+   && db_transaction_nesting_depth()==0
+  ){
+    nErr = client_sync_concurrently(syncFlags, configRcvMask, configSendMask,
+                                    zAltPCode, &baseUrl, nOther, azOther);
+    nPass = 0;  /* Skip the one-at-a-time passes below */
+  }
+#endif
   for(iPass=0; iPass<nPass; iPass++){
     for(i=0; i<iEnd; i++){
       int rc;
@@ -288,6 +699,9 @@ static void process_sync_args(
   if( find_option("all",0,0)!=0 ){
     *pSyncFlags |= SYNC_ALLURL;
   }
+  if( find_option("serial",0,0)==0 ){
+    *pSyncFlags |= SYNC_CONCURRENT;
+  }
 
   /* Undocumented option to cause links transitive links to other
   ** repositories to be shared */
@@ -383,6 +797,7 @@ static void process_sync_args(
 **   --project-code CODE        Use CODE as the project code
 **   --proxy PROXY              Use the specified HTTP proxy
 **   -R|--repository REPO       Local repository to pull into
+**   --serial                   With --all, visit one remote at a time
 **   --ssl-identity FILE        Local SSL credentials, if requested by remote
 **   --ssh-command SSH          Use SSH as the "ssh" command
 **   --transport-command CMD    Use external command CMD to move messages
@@ -436,6 +851,7 @@ void pull_cmd(void){
 **   --proxy PROXY              Use the specified HTTP proxy
 **   --private                  Push private branches too
 **   -R|--repository REPO       Local repository to push from
+**   --serial                   With --all, visit one remote at a time
 **   --ssl-identity FILE        Local SSL credentials, if requested by remote
 **   --ssh-command SSH          Use SSH as the "ssh" command
 **   --transport-command CMD    Use external command CMD to communicate with
@@ -485,6 +901,7 @@ void push_cmd(void){
 **   --proxy PROXY              Use the specified HTTP proxy
 **   --private                  Sync private branches too
 **   -R|--repository REPO       Local repository to sync with
+**   --serial                   With --all, visit one remote at a time
 **   --ssl-identity FILE        Local SSL credentials, if requested by remote
 **   --ssh-command SSH          Use SSH as the "ssh" command
 **   --transport-command CMD    Use external command CMD to move message
@@ -869,6 +1286,495 @@ remote_delete_default:
                "add delete hyperlink list off scrub", zArg);
 }
 
+/*
+** Return true if zDest is an SQLite database whose project code is
+** the same as that of the open repository.
+*/
+static int backup_is_same_project(const char *zDest){
+  sqlite3 *db = 0;
+  sqlite3_stmt *pStmt = 0;
+  int rc = 0;
+  char *zCode = db_get("project-code", 0);
+  if( zCode
+   && sqlite3_open_v2(zDest, &db, SQLITE_OPEN_READONLY, 0)==SQLITE_OK
+   && sqlite3_prepare_v2(db,
+        "SELECT value FROM config WHERE name='project-code'", -1, &pStmt, 0)
+        ==SQLITE_OK
+   && sqlite3_step(pStmt)==SQLITE_ROW
+  ){
+    rc = fossil_strcmp((const char*)sqlite3_column_text(pStmt, 0), zCode)==0;
+  }
+  sqlite3_finalize(pStmt);
+  sqlite3_close(db);
+  fossil_free(zCode);
+  return rc;
+}
+
+/*
+** Flush f and make sure its content has reached the disk.
+*/
+static void backup_sync(FILE *f, const char *zName){
+  int rc = fflush(f);
+#if defined(_WIN32)
+  if( rc==0 ) rc = _commit(_fileno(f));
+#else
+  if( rc==0 ) rc = fsync(fileno(f));
+#endif
+  if( rc ) fossil_fatal("cannot sync \"%s\"", zName);
+}
+
+/*
+** Alongside a page-for-page backup FILE is FILE-pagesum, holding the
+** SHA1 hash of every repository page in FILE, so that the next
+** incremental backup can tell which pages changed without reading FILE
+** back.  The BACKUP_SUM_HDR byte header holds the magic string, the page
+** size and the page count as 4-byte big-endian integers, the modification
+** time of FILE as an 8-byte big-endian integer and the hash of page 1 of
+** FILE as it is on disk.  The header is followed by the hash of each
+** repository page.  The file is only used if FILE still matches the
+** header.
+*/
+#define BACKUP_SUM_MAGIC  "frybox-pagesum-1"
+#define BACKUP_SUM_SZ     20
+#define BACKUP_SUM_HDR    (16+4+4+8+BACKUP_SUM_SZ)
+
+/*
+** Page hashes of a backup.
+*/
+typedef struct BackupSum BackupSum;
+struct BackupSum {
+  int szPage;              /* Page size in bytes */
+  int nPage;               /* Number of pages */
+  unsigned char *a;        /* BACKUP_SUM_SZ bytes for each page */
+};
+
+/*
+** Store the nByte-byte big-endian integer v in a[], or read it back.
+*/
+static void backup_put_int(unsigned char *a, i64 v, int nByte){
+  while( nByte-- ){ a[nByte] = v & 0xff; v >>= 8; }
+}
+static i64 backup_get_int(const unsigned char *a, int nByte){
+  i64 v = 0;
+  int i;
+  for(i=0; i<nByte; i++) v = (v<<8) | a[i];
+  return v;
+}
+
+/*
+** Write the SHA1 hash of the szPage bytes in aPage into aOut.
+*/
+static void backup_hash(const unsigned char *aPage, int szPage,
+                        unsigned char *aOut){
+  sha1sum_step_text((const char*)aPage, szPage);
+  decode16((const unsigned char*)sha1sum_finish(0), aOut, BACKUP_SUM_SZ*2);
+}
+
+/*
+** Write the hash of page 1 of the database file zDest into aOut.
+** Return 0 if the page cannot be read.
+*/
+static int backup_hash_page1(const char *zDest, int szPage,
+                             unsigned char *aOut){
+  unsigned char *aPage = fossil_malloc(szPage);
+  FILE *in = fossil_fopen(zDest, "rb");
+  int rc = in!=0 && fread(aPage, 1, szPage, in)==(size_t)szPage;
+  if( in ) fclose(in);
+  if( rc ) backup_hash(aPage, szPage, aOut);
+  fossil_free(aPage);
+  return rc;
+}
+
+/*
+** Initialize p to hold the hashes of nPage pages of szPage bytes.
+*/
+static void backup_sum_init(BackupSum *p, int szPage, int nPage){
+  p->szPage = szPage;
+  p->nPage = nPage;
+  p->a = fossil_malloc((i64)(nPage>0 ? nPage : 1)*BACKUP_SUM_SZ);
+}
+
+/*
+** Load the page hashes of the backup zDest into p.  Return 1 on success,
+** or 0 if there are none or if zDest has been changed since they were
+** saved.  p is only initialized on success.
+*/
+static int backup_sum_load(const char *zDest, int szPage, BackupSum *p){
+  char *zName = mprintf("%s-pagesum", zDest);
+  unsigned char aPage1[BACKUP_SUM_SZ];
+  const unsigned char *z;
+  Blob x;
+  int nPage;
+  int rc = 0;
+
+  blob_zero(&x);
+  if( file_size(zName, ExtFILE)>=BACKUP_SUM_HDR ){
+    blob_read_from_file(&x, zName, ExtFILE);
+  }
+  z = (const unsigned char*)blob_buffer(&x);
+  if( blob_size(&x)>=BACKUP_SUM_HDR
+   && memcmp(z, BACKUP_SUM_MAGIC, 16)==0
+   && backup_get_int(z+16, 4)==szPage
+  ){
+    nPage = (int)backup_get_int(z+20, 4);
+    if( blob_size(&x)==BACKUP_SUM_HDR + (i64)nPage*BACKUP_SUM_SZ
+     && file_size(zDest, ExtFILE)==(i64)nPage*szPage
+     && backup_get_int(z+24, 8)==file_mtime(zDest, ExtFILE)
+     && backup_hash_page1(zDest, szPage, aPage1)
+     && memcmp(z+32, aPage1, BACKUP_SUM_SZ)==0
+    ){
+      backup_sum_init(p, szPage, nPage);
+      memcpy(p->a, z+BACKUP_SUM_HDR, (size_t)nPage*BACKUP_SUM_SZ);
+      rc = 1;
+    }
+  }
+  blob_reset(&x);
+  fossil_free(zName);
+  return rc;
+}
+
+/*
+** Save the page hashes in p for the backup zDest, which must be complete
+** and synced to disk.  The hashes are written to a temporary file which
+** is then renamed into place.
+*/
+static void backup_sum_save(const char *zDest, BackupSum *p){
+  char *zName = mprintf("%s-pagesum", zDest);
+  char *zTmp = mprintf("%s-new", zName);
+  unsigned char aHdr[BACKUP_SUM_HDR];
+  FILE *out;
+
+  memcpy(aHdr, BACKUP_SUM_MAGIC, 16);
+  backup_put_int(aHdr+16, p->szPage, 4);
+  backup_put_int(aHdr+20, p->nPage, 4);
+  backup_put_int(aHdr+24, file_mtime(zDest, ExtFILE), 8);
+  out = fossil_fopen(zTmp, "wb");
+  if( out
+   && backup_hash_page1(zDest, p->szPage, aHdr+32)
+   && fwrite(aHdr, 1, BACKUP_SUM_HDR, out)==BACKUP_SUM_HDR
+   && fwrite(p->a, BACKUP_SUM_SZ, p->nPage, out)==(size_t)p->nPage
+  ){
+    backup_sync(out, zTmp);
+    fclose(out);
+    out = 0;
+    file_rename(zTmp, zName, 0, 0);
+  }
+  if( out ){
+    fclose(out);
+    file_delete(zTmp);
+  }
+  fossil_free(zTmp);
+  fossil_free(zName);
+}
+
+/*
+** Remove the page hashes of the backup zDest, which is about to change.
+*/
+static void backup_sum_delete(const char *zDest){
+  char *zName = mprintf("%s-pagesum", zDest);
+  file_delete(zName);
+  fossil_free(zName);
+}
+
+/*
+** Copy the page in the current row of pQ into aPage, marking page 1 as
+** using the legacy (non-WAL) file format, and record its hash in pSum.
+** Column 0 of pQ is the page number and column 1 is the page content.
+** Return the page number, or 0 if the page is not szPage bytes in size
+** or is past the end of pSum.
+*/
+static int backup_page_load(Stmt *pQ, unsigned char *aPage, BackupSum *pSum){
+  int pgno = db_column_int(pQ, 0);
+  if( db_column_bytes(pQ, 1)!=pSum->szPage ) return 0;
+  if( pgno<1 || pgno>pSum->nPage ) return 0;
+  memcpy(aPage, db_column_raw(pQ, 1), pSum->szPage);
+  if( pgno==1 ) aPage[18] = aPage[19] = 1;
+  backup_hash(aPage, pSum->szPage, &pSum->a[(pgno-1)*BACKUP_SUM_SZ]);
+  return pgno;
+}
+
+/*
+** Write every page of the repository into zDest, replacing whatever was
+** there.  The pages go into a temporary file, which is synced to disk
+** and then renamed over zDest, so an earlier backup is never left half
+** overwritten.  Return the number of pages written.
+*/
+static int backup_pages_full(const char *zDest, int szPage, int nPage){
+  Stmt q;
+  FILE *out;
+  char *zTmp = mprintf("%s-new", zDest);
+  unsigned char *aPage = fossil_malloc(szPage);
+  BackupSum sum;
+  int nWrite = 0;
+
+  backup_sum_delete(zDest);
+  backup_sum_init(&sum, szPage, nPage);
+  out = fossil_fopen(zTmp, "wb");
+  if( out==0 ) fossil_fatal("cannot open \"%s\" for writing", zTmp);
+  db_prepare(&q,
+    "SELECT pgno, data FROM sqlite_dbpage('repository') ORDER BY pgno"
+  );
+  while( db_step(&q)==SQLITE_ROW ){
+    if( backup_page_load(&q, aPage, &sum)==0 ) continue;
+    if( fwrite(aPage, 1, szPage, out)!=(size_t)szPage ){
+      fossil_fatal("cannot write \"%s\"", zTmp);
+    }
+    nWrite++;
+  }
+  db_finalize(&q);
+  backup_sync(out, zTmp);
+  fclose(out);
+  if( file_rename(zTmp, zDest, 0, 0) ){
+    fossil_fatal("cannot rename \"%s\" to \"%s\"", zTmp, zDest);
+  }
+  if( nWrite==nPage ) backup_sum_save(zDest, &sum);
+  fossil_free(sum.a);
+  fossil_free(aPage);
+  fossil_free(zTmp);
+  return nWrite;
+}
+
+/*
+** Return the integer result of the one-row query zSql run against db.
+*/
+static i64 backup_int(sqlite3 *db, const char *zSql){
+  sqlite3_stmt *pStmt = 0;
+  i64 v = -1;
+  if( sqlite3_prepare_v2(db, zSql, -1, &pStmt, 0)==SQLITE_OK
+   && sqlite3_step(pStmt)==SQLITE_ROW
+  ){
+    v = sqlite3_column_int64(pStmt, 0);
+  }
+  sqlite3_finalize(pStmt);
+  return v;
+}
+
+/*
+** Return true if the header of the database file zDest records its own
+** size in pages, and that size is nPage.
+*/
+static int backup_header_ok(const char *zDest, int nPage){
+  unsigned char aHdr[100];
+  FILE *in = fossil_fopen(zDest, "rb");
+  int rc = in!=0 && fread(aHdr, 1, sizeof(aHdr), in)==sizeof(aHdr)
+        && memcmp(aHdr+24, aHdr+92, 4)==0
+        && backup_get_int(aHdr+28, 4)==nPage;
+  if( in ) fclose(in);
+  return rc;
+}
+
+/*
+** Bring the earlier page-for-page backup in zDest up to date by
+** rewriting only the pages that differ from the repository.
+**
+** The hashes saved by the previous backup tell which pages have changed,
+** so zDest is not read back.  Without them, each page of zDest is read
+** and compared instead.  If the repository is not in WAL mode and its
+** page count and page 1 (which holds the change counter) are unchanged
+** since the previous backup, nothing else is read at all.
+**
+** zDest is opened as an SQLite database and the changed pages are
+** written through its sqlite_dbpage table in a single transaction, so
+** the rollback journal keeps the old backup intact until the new one
+** is complete and synced.  sqlite_dbpage cannot add pages, so pages past
+** the end of the old backup are first appended to the file directly.
+** SQLite goes by the page count in the header of page 1 and ignores them
+** until the new page 1 is committed.  Page 1 is written last, since
+** changing the schema cookie before then would invalidate the prepared
+** statements.  Any pages left over past the end are unused once the new
+** page 1 is committed and are then truncated away.  A backup in full
+** auto-vacuum mode is switched to incremental mode first, so that SQLite
+** does not rearrange its pages while committing.
+**
+** Return the number of pages written, or -1 if zDest cannot be updated
+** this way.  zDest is unchanged in that case.
+*/
+static int backup_pages_incremental(const char *zDest, int szPage, int nPage){
+  sqlite3 *db = 0;
+  sqlite3_stmt *pRead = 0;
+  sqlite3_stmt *pWrite = 0;
+  Stmt q;
+  BackupSum old, sum;
+  unsigned char *aPage, *aPage1;
+  int hasOld;
+  int pgno;
+  int nWrite = 0;
+  int rc = SQLITE_DONE;
+  i64 nOld;
+  char *zMode;
+
+  memset(&old, 0, sizeof(old));
+  hasOld = backup_sum_load(zDest, szPage, &old);
+  backup_sum_init(&sum, szPage, nPage);
+  aPage = fossil_malloc(szPage*2);
+  aPage1 = aPage + szPage;
+  memset(aPage1, 0, szPage);
+  zMode = db_text(0, "PRAGMA repository.journal_mode");
+  if( hasOld && old.nPage==nPage && fossil_strcmp(zMode, "wal")!=0 ){
+    db_prepare(&q, "SELECT pgno, data FROM sqlite_dbpage('repository')"
+                   " WHERE pgno=1");
+    if( db_step(&q)==SQLITE_ROW && backup_page_load(&q, aPage, &sum)==1
+     && memcmp(sum.a, old.a, BACKUP_SUM_SZ)==0
+    ){
+      nPage = -1;
+    }
+    db_finalize(&q);
+  }
+  fossil_free(zMode);
+  if( nPage<0 ){
+    fossil_free(aPage);
+    fossil_free(old.a);
+    fossil_free(sum.a);
+    return 0;
+  }
+
+  if( sqlite3_open_v2(zDest, &db, SQLITE_OPEN_READWRITE, 0)!=SQLITE_OK
+   || sqlite3_busy_timeout(db, 5000)!=SQLITE_OK
+   || backup_int(db, "PRAGMA page_size")!=szPage
+   || sqlite3_exec(db, "PRAGMA journal_mode=DELETE;"
+                       "PRAGMA synchronous=FULL;"
+                       "BEGIN IMMEDIATE;", 0, 0, 0)!=SQLITE_OK
+   || (nOld = backup_int(db, "PRAGMA page_count"))<1
+   || !backup_header_ok(zDest, (int)nOld)
+  ){
+    sqlite3_close(db);
+    fossil_free(aPage);
+    if( hasOld ) fossil_free(old.a);
+    fossil_free(sum.a);
+    return -1;
+  }
+  if( hasOld && old.nPage!=nOld ){
+    fossil_free(old.a);
+    hasOld = 0;
+  }
+  if( backup_int(db, "PRAGMA auto_vacuum")==1
+   && sqlite3_exec(db, "PRAGMA auto_vacuum=INCREMENTAL", 0, 0, 0)
+  ){
+    goto backup_error;
+  }
+  backup_sum_delete(zDest);
+
+  if( nOld<nPage ){
+    FILE *out = fossil_fopen(zDest, "r+b");
+    if( out==0 ) fossil_fatal("cannot open \"%s\" for writing", zDest);
+    fseek(out, (long)(nOld*szPage), SEEK_SET);
+    db_prepare(&q, "SELECT pgno, data FROM sqlite_dbpage('repository')"
+                   " WHERE pgno>%lld ORDER BY pgno", nOld);
+    while( db_step(&q)==SQLITE_ROW ){
+      if( backup_page_load(&q, aPage, &sum)==0 ) continue;
+      if( fwrite(aPage, 1, szPage, out)!=(size_t)szPage ){
+        fossil_fatal("cannot write \"%s\"", zDest);
+      }
+      nWrite++;
+    }
+    db_finalize(&q);
+    backup_sync(out, zDest);
+    fclose(out);
+  }
+
+  if( (!hasOld && sqlite3_prepare_v2(db,
+        "SELECT data FROM sqlite_dbpage WHERE pgno=?1", -1, &pRead, 0))
+   || sqlite3_prepare_v2(db,
+        "UPDATE sqlite_dbpage SET data=?2 WHERE pgno=?1", -1, &pWrite, 0)
+  ){
+    goto backup_error;
+  }
+  db_prepare(&q, "SELECT pgno, data FROM sqlite_dbpage('repository')"
+                 " WHERE pgno<=%lld", nOld);
+  while( rc==SQLITE_DONE && db_step(&q)==SQLITE_ROW ){
+    int bSame;
+    pgno = backup_page_load(&q, aPage, &sum);
+    if( pgno==0 ) continue;
+    if( pgno==1 ){
+      memcpy(aPage1, aPage, szPage);
+      continue;
+    }
+    if( hasOld ){
+      bSame = memcmp(&sum.a[(pgno-1)*BACKUP_SUM_SZ],
+                     &old.a[(pgno-1)*BACKUP_SUM_SZ], BACKUP_SUM_SZ)==0;
+    }else{
+      sqlite3_bind_int(pRead, 1, pgno);
+      bSame = sqlite3_step(pRead)==SQLITE_ROW
+           && sqlite3_column_bytes(pRead, 0)==szPage
+           && memcmp(sqlite3_column_blob(pRead, 0), aPage, szPage)==0;
+      sqlite3_reset(pRead);
+    }
+    if( bSame ) continue;
+    sqlite3_bind_int(pWrite, 1, pgno);
+    sqlite3_bind_blob(pWrite, 2, aPage, szPage, SQLITE_STATIC);
+    rc = sqlite3_step(pWrite);
+    sqlite3_reset(pWrite);
+    nWrite++;
+  }
+  db_finalize(&q);
+  if( rc==SQLITE_DONE ){
+    sqlite3_bind_int(pWrite, 1, 1);
+    sqlite3_bind_blob(pWrite, 2, aPage1, szPage, SQLITE_STATIC);
+    rc = sqlite3_step(pWrite);
+    nWrite++;
+  }
+  fossil_free(aPage);
+  if( hasOld ) fossil_free(old.a);
+  if( rc!=SQLITE_DONE ) goto backup_error;
+  sqlite3_finalize(pRead);
+  sqlite3_finalize(pWrite);
+  pRead = pWrite = 0;
+  if( sqlite3_exec(db, "COMMIT", 0, 0, 0)!=SQLITE_OK ) goto backup_error;
+  sqlite3_close(db);
+
+  if( file_size(zDest, ExtFILE)>(i64)nPage*szPage ){
+    FILE *out = fossil_fopen(zDest, "r+b");
+    if( out ){
+#if defined(_WIN32)
+      _chsize_s(_fileno(out), (i64)nPage*szPage);
+#else
+      if( ftruncate(fileno(out), (off_t)nPage*szPage) ){
+        fossil_warning("cannot truncate \"%s\"", zDest);
+      }
+#endif
+      backup_sync(out, zDest);
+      fclose(out);
+    }
+  }
+  backup_sum_save(zDest, &sum);
+  fossil_free(sum.a);
+  return nWrite;
+
+backup_error:
+  fossil_fatal("cannot update \"%s\": %s", zDest, sqlite3_errmsg(db));
+  return -1;
+}
+
+/*
+** Bring the page-for-page copy of the repository in zDest up to date.
+** All pages are read from a single snapshot of the repository, using the
+** sqlite_dbpage virtual table, and only pages that differ from those
+** already in zDest are written.  If zDest does not exist, or cannot be
+** updated in place, it is written out in full instead.  Return the
+** number of pages written.
+**
+** Either way, an interruption leaves the earlier copy in zDest intact,
+** and the new copy is synced to disk before this routine returns.  The
+** copy is always in rollback-journal mode, even if the repository uses
+** WAL.
+*/
+static int backup_pages(const char *zDest){
+  int szPage, nPage;
+  int nWrite = -1;
+
+  db_begin_transaction();
+  szPage = db_int(0, "PRAGMA repository.page_size");
+  nPage = db_int(0, "PRAGMA repository.page_count");
+  if( file_size(zDest, ExtFILE)>0 ){
+    nWrite = backup_pages_incremental(zDest, szPage, nPage);
+  }
+  if( nWrite<0 ){
+    nWrite = backup_pages_full(zDest, szPage, nPage);
+  }
+  db_end_transaction(0);
+  return nWrite;
+}
+
 /*
 ** COMMAND: backup*
 **
@@ -881,17 +1787,32 @@ remote_delete_default:
 **
 ** Only the main repository database is backed up by this command.  The
 ** open check-out file (if any) is not saved.  Nor is the global configuration
-** database.
+** database.  Pack files holding large artifacts (see the "pack-threshold"
+** setting) are copied alongside the backup.
+**
+** With the --incremental option, the backup is a page-for-page copy of the
+** repository, and an existing backup of the same repository is brought up
+** to date by rewriting only the database pages that have changed and
+** copying only new pack file content.  A hash of every page is kept in
+** FILE-pagesum, so the backup is not read back, and a repository that is
+** not in WAL mode is not read at all if it has not changed since the last
+** backup.  New pack file content is synced before the database is
+** updated, and the update is made in a single transaction, so if it is
+** interrupted the earlier backup is left as it was.  The result is an
+** ordinary repository database, not compacted the way a full backup is.
 **
 ** Options:
+**    --incremental            Update an earlier backup in place
 **    --overwrite              OK to overwrite an existing file
 **    -R NAME                  Filename of the repository to backup
 */
 void backup_cmd(void){
   char *zDest;
   int bOverwrite = 0;
+  int bIncremental = 0;
   db_find_and_open_repository(OPEN_ANY_SCHEMA, 0);
   bOverwrite = find_option("overwrite",0,0)!=0;
+  bIncremental = find_option("incremental",0,0)!=0;
   verify_all_options();
   if( g.argc!=3 ){
     usage("FILE|DIRECTORY");
@@ -900,6 +1821,24 @@ void backup_cmd(void){
   if( file_isdir(zDest, ExtFILE)==1 ){
     zDest = mprintf("%s/%s", zDest, file_tail(g.zRepositoryName));
   }
+  if( bIncremental ){
+    if( file_isfile(zDest, ExtFILE)
+     && !backup_is_same_project(zDest)
+     && !bOverwrite
+    ){
+      fossil_fatal("\"%s\" is not a backup of this repository", zDest);
+    }
+    db_unprotect(PROTECT_ALL);
+    /* Read the schema version to start the read transaction, so that the
+    ** pack files copied below hold everything the copied pages refer to.
+    ** They are synced before the pages are committed. */
+    db_begin_transaction();
+    db_int(0, "PRAGMA repository.schema_version");
+    packfile_copy_incremental(g.zRepositoryName, zDest);
+    backup_pages(zDest);
+    db_end_transaction(0);
+    return;
+  }
   if( file_isfile(zDest, ExtFILE) ){
     if( bOverwrite ){
       if( file_delete(zDest) ){
@@ -911,4 +1850,5 @@ void backup_cmd(void){
   }
   db_unprotect(PROTECT_ALL);
   db_multi_exec("VACUUM repository INTO %Q", zDest);
+  packfile_copy(g.zRepositoryName, zDest);
 }
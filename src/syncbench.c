@@ -0,0 +1,442 @@
+/*
+** Copyright (c) 2026 D. Richard Hipp
+**
+** This program is free software; you can redistribute it and/or
+** modify it under the terms of the Simplified BSD License (also
+** known as the "2-Clause License" or "FreeBSD License".)
+**
+** This program is distributed in the hope that it will be useful,
+** but without any warranty; without even the implied warranty of
+** merchantability or fitness for a particular purpose.
+**
+** Author contact information:
+**   drh@sqlite.org
+**
+*******************************************************************************
+**
+** This file implements the "test-sync-bench" command, which measures the
+** performance of the sync protocol reproducibly.
+**
+** The server is a scratch copy of a repository reached through a file:
+** URL, so page_xfer() runs in a "fossil http" subprocess for each
+** round-trip, exactly as it would behind a real web server.  The client
+** runs client_sync() in this process.  Network latency, bandwidth and
+** packet size are simulated by the transport layer.  See transport_shape().
+*/
+#include "config.h"
+#include "syncbench.h"
+#if !defined(_WIN32)
+# include <sys/time.h>
+# include <sys/resource.h>
+#endif
+
+/*
+** Name of the file that is changed by each check-in made by the benchmark
+*/
+#define BENCH_FILE "sync-bench.txt"
+
+/*
+** Measurements of a single scenario
+*/
+typedef struct BenchResult BenchResult;
+struct BenchResult {
+  const char *zName;          /* Name of the scenario */
+  int nRound;                 /* Round-trips */
+  i64 nSent;                  /* Bytes sent by the client */
+  i64 nRcvd;                  /* Bytes received by the client */
+  sqlite3_uint64 usClient;    /* Client CPU time in microseconds */
+  sqlite3_uint64 usServer;    /* Server CPU time in microseconds */
+  sqlite3_int64 msWall;       /* Elapsed time in milliseconds */
+};
+
+/* Return the current time as milliseconds since the Julian epoch */
+static sqlite3_int64 bench_now(void){
+  static sqlite3_vfs *clockVfs = 0;
+  sqlite3_int64 t;
+  if( clockVfs==0 ) clockVfs = sqlite3_vfs_find(0);
+  if( clockVfs->iVersion>=2 && clockVfs->xCurrentTimeInt64!=0 ){
+    clockVfs->xCurrentTimeInt64(clockVfs, &t);
+  }else{
+    double r;
+    clockVfs->xCurrentTime(clockVfs, &r);
+    t = (sqlite3_int64)(r*86400000.0);
+  }
+  return t;
+}
+
+/*
+** Return the CPU time, in microseconds, used by this process and,
+** separately, by all of its child processes that have been waited for.
+** The server side of a file: URL sync runs in such child processes.
+*/
+static void bench_cpu(sqlite3_uint64 *pusSelf, sqlite3_uint64 *pusChild){
+  sqlite3_uint64 u = 0, s = 0;
+  fossil_cpu_times(&u, &s);
+  *pusSelf = u + s;
+  *pusChild = 0;
+#if !defined(_WIN32)
+  {
+    struct rusage r;
+    getrusage(RUSAGE_CHILDREN, &r);
+    *pusChild = ((sqlite3_uint64)r.ru_utime.tv_sec)*1000000
+                  + r.ru_utime.tv_usec
+              + ((sqlite3_uint64)r.ru_stime.tv_sec)*1000000
+                  + r.ru_stime.tv_usec;
+  }
+#endif
+}
+
+/*
+** Start measuring scenario zName.
+*/
+static void bench_begin(BenchResult *p, const char *zName){
+  memset(p, 0, sizeof(*p));
+  p->zName = zName;
+  transport_shape_stats(0, 0, 0, 1);
+  bench_cpu(&p->usClient, &p->usServer);
+  p->msWall = bench_now();
+}
+
+/*
+** Finish measuring the scenario started by bench_begin().
+*/
+static void bench_end(BenchResult *p){
+  sqlite3_uint64 usClient, usServer;
+  p->msWall = bench_now() - p->msWall;
+  bench_cpu(&usClient, &usServer);
+  p->usClient = usClient - p->usClient;
+  p->usServer = usServer - p->usServer;
+  transport_shape_stats(&p->nRound, &p->nSent, &p->nRcvd, 1);
+}
+
+/*
+** Close the repository and forget everything cached about it, so that
+** a different repository can be opened next.
+*/
+static void bench_close(void){
+  db_close(1);
+  content_clear_cache(1);
+  manifest_cache_clear();
+}
+
+/*
+** Append nByte bytes of random text to p.
+*/
+static void bench_random_text(Blob *p, int nByte){
+  static const char zChar[] =
+    "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789 ";
+  unsigned char a[64];
+  int i;
+  while( nByte>0 ){
+    sqlite3_randomness(sizeof(a), a);
+    for(i=0; i<(int)sizeof(a)-1 && nByte>1; i++, nByte--){
+      blob_append_char(p, zChar[a[i]%(sizeof(zChar)-1)]);
+    }
+    blob_append_char(p, '\n');
+    nByte--;
+  }
+}
+
+/*
+** Add a check-in on top of the most recent check-in in the open
+** repository.  The check-in appends nByte bytes of random text to
+** BENCH_FILE.  It is a delta-manifest whenever there is a parent.
+*/
+static void bench_checkin(int iSeq, int nByte){
+  int pid;
+  int rid;
+  int frid;
+  int prevFrid = 0;
+  Manifest *pParent = 0;
+  ManifestFile *pFile;
+  Blob content;
+  Blob manifest;
+  Blob cksum;
+  char *zDate;
+  char *zComment;
+  char *zFileUuid;
+  char *zParentUuid = 0;
+  int bDone = 0;
+  int i;
+
+  pid = db_int(0, "SELECT objid FROM event WHERE type='ci'"
+                  " ORDER BY mtime DESC LIMIT 1");
+  blob_zero(&content);
+  if( pid ){
+    pParent = manifest_get(pid, CFTYPE_MANIFEST, 0);
+    if( pParent==0 ) fossil_fatal("cannot parse check-in %d", pid);
+    zParentUuid = rid_to_uuid(pid);
+    pFile = manifest_file_find(pParent, BENCH_FILE);
+    if( pFile && pFile->zUuid ){
+      prevFrid = uuid_to_rid(pFile->zUuid, 0);
+      if( prevFrid ) content_get(prevFrid, &content);
+    }
+  }
+  bench_random_text(&content, nByte);
+  frid = content_put(&content);
+  db_add_unsent(frid);
+  if( prevFrid ) content_deltify(prevFrid, &frid, 1, 0);
+  zFileUuid = rid_to_uuid(frid);
+  blob_reset(&content);
+
+  blob_zero(&manifest);
+  if( pParent ){
+    blob_appendf(&manifest, "B %s\n",
+       pParent->zBaseline ? pParent->zBaseline : zParentUuid);
+  }
+  zComment = mprintf("sync-bench check-in %d", iSeq);
+  blob_appendf(&manifest, "C %F\n", zComment);
+  zDate = date_in_standard_format("now");
+  blob_appendf(&manifest, "D %s\n", zDate);
+  if( pParent && pParent->zBaseline ){
+    /* The parent is itself a delta-manifest, so carry forward all of
+    ** its changes against the common baseline */
+    for(i=0; i<pParent->nFile; i++){
+      ManifestFile *pF = &pParent->aFile[i];
+      int c = fossil_strcmp(pF->zName, BENCH_FILE);
+      if( c>=0 && !bDone ){
+        blob_appendf(&manifest, "F %F %s\n", BENCH_FILE, zFileUuid);
+        bDone = 1;
+      }
+      if( c==0 ) continue;
+      if( pF->zUuid==0 ){
+        blob_appendf(&manifest, "F %F\n", pF->zName);
+      }else if( pF->zPerm && pF->zPerm[0] ){
+        blob_appendf(&manifest, "F %F %s %s\n",
+                     pF->zName, pF->zUuid, pF->zPerm);
+      }else{
+        blob_appendf(&manifest, "F %F %s\n", pF->zName, pF->zUuid);
+      }
+    }
+  }
+  if( !bDone ){
+    blob_appendf(&manifest, "F %F %s\n", BENCH_FILE, zFileUuid);
+  }
+  if( zParentUuid ){
+    blob_appendf(&manifest, "P %s\n", zParentUuid);
+  }
+  blob_appendf(&manifest, "U %F\n", login_name());
+  md5sum_blob(&manifest, &cksum);
+  blob_appendf(&manifest, "Z %b\n", &cksum);
+  blob_reset(&cksum);
+
+  rid = content_put(&manifest);
+  if( rid==0 ) fossil_fatal("cannot store check-in: %s", g.zErrMsg);
+  db_add_unsent(rid);
+  if( manifest_crosslink(rid, &manifest, MC_NONE)==0 ){
+    fossil_fatal("%s", g.zErrMsg);
+  }
+  if( pid ) content_deltify(pid, &rid, 1, 0);
+  manifest_destroy(pParent);
+  fossil_free(zComment);
+  fossil_free(zDate);
+  fossil_free(zFileUuid);
+  fossil_free(zParentUuid);
+}
+
+/*
+** Open repository zRepo and add nCommit check-ins to it.
+*/
+static void bench_add_checkins(const char *zRepo, int nCommit, int nByte){
+  int i;
+  db_open_repository(zRepo);
+  db_begin_transaction();
+  for(i=1; i<=nCommit; i++){
+    bench_checkin(i, nByte);
+  }
+  db_end_transaction(0);
+  bench_close();
+}
+
+/*
+** Delete repository zRepo together with its journal and pack files.
+*/
+static void bench_delete_repository(const char *zRepo){
+  if( file_size(zRepo, ExtFILE)<0 ) return;
+  db_open_repository(zRepo);
+  if( db_table_exists("repository","blobpack") ){
+    Stmt q;
+    char *zDir = packfile_dir();
+    db_prepare(&q, "SELECT DISTINCT packid FROM blobpack");
+    while( db_step(&q)==SQLITE_ROW ){
+      char *zPack = mprintf("%s/%06d.pack", zDir, db_column_int(&q,0));
+      file_delete(zPack);
+      fossil_free(zPack);
+    }
+    db_finalize(&q);
+    file_rmdir(zDir);
+    fossil_free(zDir);
+  }
+  bench_close();
+  file_delete(zRepo);
+}
+
+/*
+** Run client_sync() with syncFlags against the server repository zServer
+** from the repository that is currently open, and record the result.
+*/
+static void bench_sync(
+  BenchResult *p,
+  const char *zName,
+  const char *zServer,
+  unsigned syncFlags,
+  unsigned configRcvMask
+){
+  int nErr;
+  url_parse(zServer, 0);
+  bench_begin(p, zName);
+  nErr = client_sync(syncFlags, configRcvMask, 0, 0, 0);
+  bench_end(p);
+  if( nErr ) fossil_fatal("%s failed", zName);
+}
+
+/*
+** COMMAND: test-sync-bench
+**
+** Usage: %fossil test-sync-bench ?OPTIONS?
+**
+** Measure the performance of the sync protocol under simulated network
+** conditions, so that changes to the protocol can be judged against a
+** stable baseline.  A scratch copy of the repository acts as the server.
+** It is reached through a file: URL, so the server side of each round-trip
+** runs in a separate "fossil http" process.  The following scenarios run
+** in order:
+**
+**    clone      Clone the server into a new, empty repository
+**    pull       Add check-ins to the server, then pull them
+**    push       Add check-ins to the clone, then push them
+**
+** For each scenario, report the number of round-trips, the bytes sent
+** and received by the client, the CPU time of the client and of the
+** server, and the elapsed time.  For a clone, only the transfer is
+** measured and not the rebuild that follows it.
+**
+** If there is no repository, a new one with the number of check-ins
+** given by --seed is generated to act as the server.  All repositories
+** are scratch files which are deleted afterwards unless --keep is used.
+**
+** Options:
+**    --bandwidth N          Limit traffic to N bytes per second each way
+**    --commits N            Check-ins for the pull and push scenarios.
+**                           The default is 10.
+**    --file-size N          Bytes of new text in each check-in.  The
+**                           default is 4096.
+**    --keep                 Keep the scratch repositories
+**    --latency MS           Add MS milliseconds to each round-trip and
+**                           to each new connection
+**    --packet-size N        Move at most N bytes per read or write
+**    -R|--repository REPO   Copy REPO to act as the server
+**    --scenario LIST        Comma-separated list of the scenarios to run.
+**                           The clone scenario always runs, because the
+**                           others need its result.
+**    --seed N               Check-ins in a generated server repository.
+**                           The default is 50.
+*/
+void test_sync_bench_cmd(void){
+  const char *zLatency = find_option("latency",0,1);
+  const char *zBandwidth = find_option("bandwidth",0,1);
+  const char *zPacket = find_option("packet-size",0,1);
+  const char *zCommits = find_option("commits",0,1);
+  const char *zFileSize = find_option("file-size",0,1);
+  const char *zSeed = find_option("seed",0,1);
+  const char *zScenario = find_option("scenario",0,1);
+  int bKeep = find_option("keep",0,0)!=0;
+  int nCommit = zCommits ? atoi(zCommits) : 10;
+  int nByte = zFileSize ? atoi(zFileSize) : 4096;
+  int nSeed = zSeed ? atoi(zSeed) : 50;
+  char *zTemp;
+  char *zServer;
+  char *zClient;
+  BenchResult aResult[3];
+  int nResult = 0;
+  int i;
+
+  db_find_and_open_repository(OPEN_OK_NOT_FOUND|OPEN_ANY_SCHEMA, 0);
+  verify_all_options();
+  if( g.argc!=2 ) usage("?OPTIONS?");
+  if( zScenario==0 ) zScenario = "clone,pull,push";
+  if( nByte<1 ) nByte = 1;
+
+  zTemp = fossil_temp_filename();
+  zServer = mprintf("%s-server.fossil", zTemp);
+  zClient = mprintf("%s-client.fossil", zTemp);
+  sqlite3_free(zTemp);
+
+  /* Set up the server repository */
+  if( g.repositoryOpen ){
+    char *zSrc = mprintf("%s", g.zRepositoryName);
+    fossil_print("Copying %s to act as the server...\n", zSrc);
+    bench_close();
+    file_copy(zSrc, zServer);
+    db_open_repository(zServer);
+    packfile_copy(zSrc, zServer);
+    bench_close();
+    fossil_free(zSrc);
+  }else{
+    fossil_print("Generating a server repository with %d check-ins...\n",
+                 nSeed);
+    db_create_repository(zServer);
+    db_open_repository(zServer);
+    db_open_config(0,0);
+    db_begin_transaction();
+    db_initial_setup(0, "now", 0);
+    db_end_transaction(0);
+    bench_close();
+    bench_add_checkins(zServer, nSeed, nByte);
+  }
+  transport_shape(zLatency ? atoi(zLatency) : 0,
+                  zBandwidth ? atoi(zBandwidth) : 0,
+                  zPacket ? atoi(zPacket) : 0);
+
+  /* Clone.  The rebuild afterwards is not part of the measurement. */
+  clone_new_repository(zClient, 0);
+  db_set_int("clone-seqno", 1, 0);
+  db_end_transaction(0);
+  g.xlinkClusterOnly = 1;
+  bench_sync(&aResult[nResult++], "clone", zServer,
+             SYNC_CLONE, CONFIGSET_ALL);
+  g.xlinkClusterOnly = 0;
+  db_begin_transaction();
+  rebuild_db(0, 0);
+  db_unset("clone-seqno", 0);
+  db_end_transaction(0);
+  bench_close();
+
+  if( strstr(zScenario, "pull") && nCommit>0 ){
+    bench_add_checkins(zServer, nCommit, nByte);
+    db_open_repository(zClient);
+    bench_sync(&aResult[nResult++], "pull", zServer, SYNC_PULL, 0);
+    bench_close();
+  }
+  if( strstr(zScenario, "push") && nCommit>0 ){
+    bench_add_checkins(zClient, nCommit, nByte);
+    db_open_repository(zClient);
+    bench_sync(&aResult[nResult++], "push", zServer, SYNC_PUSH, 0);
+    bench_close();
+  }
+  transport_shape(0, 0, 0);
+
+  fossil_print("\nlatency: %d ms  bandwidth: %d B/s  packet-size: %d"
+               "  commits: %d  file-size: %d\n",
+               zLatency ? atoi(zLatency) : 0,
+               zBandwidth ? atoi(zBandwidth) : 0,
+               zPacket ? atoi(zPacket) : 0, nCommit, nByte);
+  fossil_print("%-8s %6s %12s %12s %10s %10s %10s\n",
+               "scenario", "rounds", "sent", "received",
+               "client-cpu", "server-cpu", "wall");
+  for(i=0; i<nResult; i++){
+    BenchResult *p = &aResult[i];
+    fossil_print("%-8s %6d %12lld %12lld %9.3fs %9.3fs %9.3fs\n",
+                 p->zName, p->nRound, p->nSent, p->nRcvd,
+                 p->usClient/1e6, p->usServer/1e6, p->msWall/1e3);
+  }
+
+  if( bKeep ){
+    fossil_print("\nserver: %s\nclient: %s\n", zServer, zClient);
+  }else{
+    bench_delete_repository(zClient);
+    bench_delete_repository(zServer);
+  }
+  fossil_free(zServer);
+  fossil_free(zClient);
+}
@@ -141,11 +141,11 @@ void *Th_DbgMalloc(Th_Interp *, int);
 void Th_DbgFree(Th_Interp *, void *);
 #endif
 
-void *fossil_malloc_zero(size_t);
+void *fossil_arena_malloc_zero(size_t);
 void *fossil_realloc(void *, size_t);
 void fossil_free(void *);
 
-#define Th_SysMalloc(I,N)     fossil_malloc_zero((N))
+#define Th_SysMalloc(I,N)     fossil_arena_malloc_zero((N))
 #define Th_SysRealloc(I,P,N)  fossil_realloc((P),(N))
 #define Th_SysFree(I,P)       fossil_free((P))
 
@@ -436,6 +436,46 @@ int ticket_need_moderation(
   return g.perm.ModTkt==0 && db_get_boolean("modreq-tkt",0)==1;
 }
 
+/*
+** Increment the tkt-change-count value in the CONFIG table.  Cached
+** ticket report results are keyed on this value, so changing it makes
+** every cached report result obsolete.
+*/
+static void ticket_incr_change_count(void){
+  db_unprotect(PROTECT_CONFIG);
+  db_multi_exec(
+    "UPDATE config SET value=value+1 WHERE name='tkt-change-count'"
+  );
+  if( db_changes()==0 ){
+    db_multi_exec(
+      "INSERT INTO config(name,value) VALUES('tkt-change-count',1)"
+    );
+  }
+  db_protect_pop();
+}
+
+/*
+** Extract backlinks from the most recent values of TICKET fields, as
+** collected in the fields[] array by ticket_insert(), and empty the array.
+*/
+static void ticket_field_backlinks(Blob *fields){
+  int i;
+  for(i=0; i<nField; i++){
+    Blob *cards = fields + i;
+    if( blob_size(cards) ){
+      struct jCardInfo *x = (struct jCardInfo *)blob_buffer(cards);
+      struct jCardInfo *end = x + blob_count(cards,struct jCardInfo);
+      for(; x!=end; x++){
+        assert( x->zValue );
+        backlink_extract(x->zValue,x->mimetype,
+                         x->rid,BKLNK_TICKET,x->mtime,0);
+        fossil_free( x->zValue );
+      }
+    }
+    blob_truncate(cards,0);
+  }
+}
+
 /*
 ** Rebuild an entire entry in the TICKET table
 */
@@ -444,13 +484,14 @@ void ticket_rebuild_entry(const char *zTktUuid){
   int tagid = tag_findid(zTag, 1);
   Stmt q;
   Manifest *pTicket;
-  int tktid, i;
+  int tktid;
   int createFlag = 1;
   Blob *fields;  /* array of blobs; each blob holds array of jCardInfo */
 
   fossil_free(zTag);
   getAllTicketFields();
   if( haveTicket==0 ) return;
+  ticket_incr_change_count();
   tktid = db_int(0, "SELECT tkt_id FROM ticket WHERE tkt_uuid=%Q", zTktUuid);
   if( tktid!=0 ) search_doc_touch('t', tktid, 0);
   if( haveTicketChng ){
@@ -474,22 +515,101 @@ void ticket_rebuild_entry(const char *zTktUuid){
   }
   db_finalize(&q);
   search_doc_touch('t', tktid, 0);
-  /* Extract backlinks from the most recent values of TICKET fields */
-  for(i=0; i<nField; i++){
-    Blob *cards = fields + i;
-    if( blob_size(cards) ){
-      struct jCardInfo *x = (struct jCardInfo *)blob_buffer(cards);
-      struct jCardInfo *end = x + blob_count(cards,struct jCardInfo);
-      for(; x!=end; x++){
-        assert( x->zValue );
-        backlink_extract(x->zValue,x->mimetype,
-                         x->rid,BKLNK_TICKET,x->mtime,0);
-        fossil_free( x->zValue );
-      }
+  ticket_field_backlinks(fields);
+  blobarray_delete(fields,nField);
+}
+
+/*
+** Bring the TICKET and TICKETCHNG entries for a ticket up to date after
+** new change artifacts for it have been crosslinked.
+**
+** A change artifact has already been applied if it has an EVENT entry.
+** When every change that has not been applied is strictly newer than the
+** tkt_mtime of the existing TICKET row, those changes are applied on top
+** of that row in mtime order.  Otherwise, or if a change would overwrite
+** a TICKET field whose current value might be the source of backlinks,
+** fall back to ticket_rebuild_entry() and replay the whole history.
+*/
+void ticket_update_entry(const char *zTktUuid){
+  char *zTag = mprintf("tkt-%s", zTktUuid);
+  int tagid = tag_findid(zTag, 1);
+  Stmt q;
+  int tktid, i, j;
+  int nNew = 0;
+  int isInOrder = 1;
+  Manifest **apNew = 0;
+  int *aRid = 0;
+  char *aSeen;
+  Blob *fields;
+
+  fossil_free(zTag);
+  getAllTicketFields();
+  if( haveTicket==0 ) return;
+  tktid = db_int(0, "SELECT tkt_id FROM ticket WHERE tkt_uuid=%Q", zTktUuid);
+  if( tktid==0 ){
+    ticket_rebuild_entry(zTktUuid);
+    return;
+  }
+  db_prepare(&q,
+    "SELECT rid, mtime>(SELECT tkt_mtime FROM ticket WHERE tkt_id=%d)"
+    "  FROM tagxref"
+    " WHERE tagid=%d"
+    "   AND NOT EXISTS(SELECT 1 FROM event"
+                     " WHERE objid=tagxref.rid AND type='t')"
+    " ORDER BY mtime, rid",
+    tktid, tagid
+  );
+  while( db_step(&q)==SQLITE_ROW ){
+    if( !db_column_int(&q, 1) ){
+      isInOrder = 0;
+      break;
     }
-    blob_truncate(cards,0);
+    apNew = fossil_realloc(apNew, sizeof(apNew[0])*(nNew+1));
+    aRid = fossil_realloc(aRid, sizeof(aRid[0])*(nNew+1));
+    aRid[nNew] = db_column_int(&q, 0);
+    apNew[nNew] = manifest_get(aRid[nNew], CFTYPE_TICKET, 0);
+    nNew++;
   }
-  blobarray_delete(fields,nField);
+  db_finalize(&q);
+
+  /* A replaced TICKET field value loses its backlinks.  Only values that
+  ** cannot contain a hyperlink are safe to replace without a replay. */
+  aSeen = fossil_malloc_zero( nField );
+  for(i=0; isInOrder && i<nNew; i++){
+    const Manifest *p = apNew[i];
+    if( p==0 ) continue;
+    for(j=0; j<p->nField; j++){
+      const char *zName = p->aField[j].zName;
+      int k = fieldId(zName);
+      char *zOld;
+      if( zName[0]=='+' || k<0 || aSeen[k] ) continue;
+      if( aField[k].mUsed & USEDBY_TICKETCHNG ) continue;
+      aSeen[k] = 1;
+      zOld = db_text(0, "SELECT \"%w\" FROM ticket WHERE tkt_id=%d",
+                     zName, tktid);
+      if( zOld && strchr(zOld, '[')!=0 ) isInOrder = 0;
+      fossil_free(zOld);
+      if( !isInOrder ) break;
+    }
+  }
+  fossil_free(aSeen);
+
+  if( isInOrder ){
+    ticket_incr_change_count();
+    search_doc_touch('t', tktid, 0);
+    fields = blobarray_new( nField );
+    for(i=0; i<nNew; i++){
+      if( apNew[i]==0 ) continue;
+      tktid = ticket_insert(apNew[i], aRid[i], tktid, fields);
+      manifest_ticket_event(aRid[i], apNew[i], 0, tagid);
+    }
+    ticket_field_backlinks(fields);
+    blobarray_delete(fields,nField);
+  }
+  for(i=0; i<nNew; i++) manifest_destroy(apNew[i]);
+  fossil_free(apNew);
+  fossil_free(aRid);
+  if( !isInOrder ) ticket_rebuild_entry(zTktUuid);
 }
 
 
@@ -405,6 +405,11 @@ void update_cmd(void){
   assert( g.zLocalRoot!=0 );
   assert( strlen(g.zLocalRoot)>0 );
   assert( g.zLocalRoot[strlen(g.zLocalRoot)-1]=='/' );
+  if( !dryRunFlag ){
+    /* Fetch missing content of a blobless clone in one go */
+    shallow_prefetch("SELECT ridt FROM fv WHERE ridt>0 AND ridt<>ridv"
+                     " UNION SELECT ridv FROM fv WHERE chnged AND ridv>0");
+  }
   while( db_step(&q)==SQLITE_ROW ){
     const char *zName = db_column_text(&q, 0);  /* The filename from root */
     int idv = db_column_int(&q, 1);             /* VFILE entry for current */
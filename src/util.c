@@ -69,9 +69,14 @@ void *fossil_malloc_zero(size_t n){
   return p;
 }
 void fossil_free(void *p){
-  free(p);
+  if( fossil_arena_owns(p) ){
+    fossil_arena_free(p);
+  }else{
+    free(p);
+  }
 }
 void *fossil_realloc(void *p, size_t n){
+  if( fossil_arena_owns(p) ) return fossil_arena_realloc(p, n);
   p = realloc(p, n);
   if( p==0 ) fossil_fatal("out of memory");
   return p;
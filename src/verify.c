@@ -34,8 +34,12 @@
 **
 ** Panic if anything goes wrong.  If this procedure returns it means
 ** that everything is OK.
+**
+** If bKeep is true, the verified content is left in the content cache
+** so that artifacts stored as deltas against it can be verified without
+** rebuilding it again.
 */
-static void verify_rid(int rid){
+static void verify_rid(int rid, int bKeep){
   Blob uuid, content;
   if( content_size(rid, 0)<0 ){
     return;  /* No way to verify phantoms */
@@ -50,7 +54,11 @@ static void verify_rid(int rid){
       fossil_panic("hash of rid %d does not match its uuid (%b)",
                     rid, &uuid);
     }
-    blob_reset(&content);
+    if( bKeep ){
+      content_cache_insert(rid, &content);
+    }else{
+      blob_reset(&content);
+    }
   }
   blob_reset(&uuid);
 }
@@ -62,21 +70,91 @@ static void verify_rid(int rid){
 static Bag toVerify;
 static int inFinalVerify = 0;
 
+/*
+** One record waiting to be verified.
+*/
+struct VerifyItem {
+  int rid;          /* The record */
+  int iSrc;         /* Index of the delta source if it is also pending */
+  int iChild;       /* First pending record that is a delta against this one */
+  int iSibling;     /* Next pending record with the same delta source */
+  int bDone;        /* True after this record has been verified */
+};
+
+/*
+** Comparison function for sorting VerifyItems by rid.
+*/
+static int verify_item_cmp(const void *a, const void *b){
+  int x = ((const struct VerifyItem*)a)->rid;
+  int y = ((const struct VerifyItem*)b)->rid;
+  return x<y ? -1 : x>y;
+}
+
 /*
 ** This routine is called just prior to each commit operation.
 **
 ** Invoke verify_rid() on every record that has been added or modified
 ** in the repository, in order to make sure that the repository is sane.
+**
+** Records are visited in delta order, so that each record is verified
+** before any pending record that is stored as a delta against it.  The
+** content of such a record is kept in the content cache while its
+** dependents are verified.  Each record is then rebuilt by applying a
+** single delta to freshly verified content, rather than by replaying
+** its whole delta chain from the baseline.
 */
 static int verify_at_commit(void){
   int rid;
+  int i, n, iTop;
+  struct VerifyItem *a;
+  int *aStack;
   content_clear_cache(0);
   inFinalVerify = 1;
-  rid = bag_first(&toVerify);
-  while( rid>0 ){
-    verify_rid(rid);
-    rid = bag_next(&toVerify, rid);
+  n = bag_count(&toVerify);
+  a = fossil_malloc( sizeof(a[0])*(n+1) );
+  aStack = fossil_malloc( sizeof(aStack[0])*(n+1) );
+  for(i=0, rid=bag_first(&toVerify); rid>0; rid=bag_next(&toVerify, rid)){
+    a[i++].rid = rid;
+  }
+  n = i;
+  qsort(a, n, sizeof(a[0]), verify_item_cmp);
+  for(i=0; i<n; i++){
+    a[i].iChild = -1;
+    a[i].iSibling = -1;
+    a[i].bDone = 0;
+  }
+  for(i=n-1; i>=0; i--){
+    struct VerifyItem key, *pSrc;
+    key.rid = delta_source_rid(a[i].rid);
+    pSrc = key.rid>0 ?
+       bsearch(&key, a, n, sizeof(a[0]), verify_item_cmp) : 0;
+    a[i].iSrc = pSrc ? (int)(pSrc - a) : -1;
+    if( pSrc ){
+      a[i].iSibling = pSrc->iChild;
+      pSrc->iChild = i;
+    }
+  }
+  for(i=0; i<n; i++){
+    if( a[i].iSrc>=0 ) continue;
+    aStack[0] = i;
+    iTop = 1;
+    while( iTop>0 ){
+      int j = aStack[--iTop];
+      int k;
+      verify_rid(a[j].rid, a[j].iChild>=0);
+      a[j].bDone = 1;
+      for(k=a[j].iChild; k>=0; k=a[k].iSibling){
+        aStack[iTop++] = k;
+      }
+    }
+  }
+  for(i=0; i<n; i++){
+    /* Only records caught in a delta loop are left.  Verifying them
+    ** one by one reports the loop. */
+    if( !a[i].bDone ) verify_rid(a[i].rid, 0);
   }
+  fossil_free(aStack);
+  fossil_free(a);
   bag_clear(&toVerify);
   inFinalVerify = 0;
   return 0;
@@ -71,7 +71,8 @@ int uuid_to_rid(const char *zUuid, int phantomize){
 
 /*
 ** Load a vfile from a record ID.  Return the number of files with
-** missing content.
+** missing content.  Files left out of a blobless clone are not counted
+** as missing, since they are fetched from the remote when needed.
 */
 int load_vfile_from_rid(int vid){
   int rid, size, nMissing;
@@ -107,7 +108,7 @@ int load_vfile_from_rid(int vid){
       size = 0;
     }
     db_reset(&ridq);
-    if( rid==0 || size<0 ){
+    if( rid==0 || (size<0 && !shallow_is_fetchable(rid)) ){
       fossil_warning("content missing for %s", pFile->zName);
       nMissing++;
       continue;
@@ -298,6 +299,9 @@ void vfile_to_disk(
   int nRepos = strlen(g.zLocalRoot);
 
   if( vid>0 && id==0 ){
+    char *zFiles = mprintf("SELECT mrid FROM vfile WHERE vid=%d", vid);
+    shallow_prefetch(zFiles);
+    fossil_free(zFiles);
     db_prepare(&q, "SELECT id, %Q || pathname, mrid, isexe, islink"
                    "  FROM vfile"
                    " WHERE vid=%d AND mrid>0",
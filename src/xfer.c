@@ -450,6 +450,7 @@ static int send_delta_parent(
   }
   if( srcId>0
    && (pXfer->syncPrivate || !content_is_private(srcId))
+   && !shallow_omits(srcId)
    && content_get(srcId, &src)
   ){
     char *zUuid = db_text(0, "SELECT uuid FROM blob WHERE rid=%d", srcId);
@@ -492,6 +493,7 @@ static int send_delta_native(
   srcId = db_int(0, "SELECT srcid FROM delta WHERE rid=%d", rid);
   if( srcId>0
    && (pXfer->syncPrivate || !content_is_private(srcId))
+   && !shallow_omits(srcId)
   ){
     blob_zero(&src);
     db_blob(&src, "SELECT uuid FROM blob WHERE rid=%d", srcId);
@@ -500,7 +502,7 @@ static int send_delta_native(
       return 0;
     }
     blob_zero(&delta);
-    db_blob(&delta, "SELECT content FROM blob WHERE rid=%d", rid);
+    content_raw_get(rid, &delta);
     blob_uncompress(&delta, &delta);
     if( isPrivate ) blob_append(pXfer->pOut, "private\n", -1);
     blob_appendf(pXfer->pOut, "file %b %b %d\n",
@@ -635,14 +637,16 @@ static void send_compressed_file(Xfer *pXfer, int rid){
   int rc;
   int isPrivate;
   int srcIsPrivate;
+  int bFull;
   static Stmt q1;
   Blob fullContent;
+  Blob packed;
 
   isPrivate = content_is_private(rid);
   if( isPrivate && pXfer->syncPrivate==0 ) return;
   db_static_prepare(&q1,
     "SELECT uuid, size, content, delta.srcid IN private,"
-         "  (SELECT uuid FROM blob WHERE rid=delta.srcid)"
+         "  (SELECT uuid FROM blob WHERE rid=delta.srcid), delta.srcid"
     " FROM blob LEFT JOIN delta ON (blob.rid=delta.rid)"
     " WHERE blob.rid=:rid"
     "   AND blob.size>=0"
@@ -655,16 +659,35 @@ static void send_compressed_file(Xfer *pXfer, int rid){
     szU = db_column_int(&q1, 1);
     szC = db_column_bytes(&q1, 2);
     zContent = db_column_raw(&q1, 2);
+    blob_zero(&packed);
+    if( db_column_type(&q1, 2)==SQLITE_NULL
+     && packfile_get(rid, zUuid, &packed)
+    ){
+      szC = blob_size(&packed);
+      zContent = blob_buffer(&packed);
+    }
+    if( blob_compressed_dictid(zContent, szC) ){
+      /* The other side does not have our compression dictionary */
+      if( blob_size(&packed)==0 ) blob_append(&packed, zContent, szC);
+      cmprdict_make_portable(&packed);
+      szC = blob_size(&packed);
+      zContent = blob_buffer(&packed);
+    }
     srcIsPrivate = db_column_int(&q1, 3);
     zDelta = db_column_text(&q1, 4);
+    /* Send the full content if the delta source is private or is
+    ** not part of a shallow clone */
+    bFull = zDelta!=0 && ((!isPrivate && srcIsPrivate)
+                          || shallow_omits(db_column_int(&q1, 5)));
     if( isPrivate ) blob_append(pXfer->pOut, "private\n", -1);
     if( pXfer->remoteVersion<20000 && db_column_bytes(&q1,0)!=HNAME_LEN_SHA1 ){
       xfer_cannot_send_sha3_error(pXfer);
+      blob_reset(&packed);
       db_reset(&q1);
       return;
     }
     blob_appendf(pXfer->pOut, "cfile %s ", zUuid);
-    if( !isPrivate && srcIsPrivate ){
+    if( bFull ){
       content_get(rid, &fullContent);
       szU = blob_size(&fullContent);
       blob_compress(&fullContent, &fullContent);
@@ -683,9 +706,10 @@ static void send_compressed_file(Xfer *pXfer, int rid){
     if( blob_buffer(pXfer->pOut)[blob_size(pXfer->pOut)-1]!='\n' ){
       blob_append(pXfer->pOut, "\n", 1);
     }
-    if( !isPrivate && srcIsPrivate ){
+    if( bFull ){
       blob_reset(&fullContent);
     }
+    blob_reset(&packed);
   }
   db_reset(&q1);
 }
@@ -760,16 +784,19 @@ static void send_unversioned_file(
 ** Send a gimme message for every phantom.
 **
 ** Except: do not request shunned artifacts.  And do not request
-** private artifacts if we are not doing a private transfer.
+** private artifacts if we are not doing a private transfer.  And do
+** not request history that was left out of a shallow clone or file
+** content that was left out of a blobless clone.
 */
 static void request_phantoms(Xfer *pXfer, int maxReq){
   Stmt q;
   db_prepare(&q,
     "SELECT uuid FROM phantom CROSS JOIN blob USING(rid) /*scan*/"
     " WHERE NOT EXISTS(SELECT 1 FROM unk WHERE unk.uuid=blob.uuid)"
-    "   AND NOT EXISTS(SELECT 1 FROM shun WHERE uuid=blob.uuid) %s",
+    "   AND NOT EXISTS(SELECT 1 FROM shun WHERE uuid=blob.uuid) %s%s",
     (pXfer->syncPrivate ? "" :
-         "   AND NOT EXISTS(SELECT 1 FROM private WHERE rid=blob.rid)")
+         "   AND NOT EXISTS(SELECT 1 FROM private WHERE rid=blob.rid)"),
+    shallow_phantom_filter() /*safe-for-%s*/
   );
   while( db_step(&q)==SQLITE_ROW && maxReq-- > 0 ){
     const char *zUuid = db_column_text(&q, 0);
@@ -887,13 +914,14 @@ static int check_login(Blob *pLogin, Blob *pNonce, Blob *pSig){
 }
 
 /*
-** Send the content of all files in the unsent table.
+** Send the content of all files in the unsent table, then clear the
+** table unless bKeep is true.
 **
 ** This is really just an optimization.  If you clear the
 ** unsent table, all the right files will still get transferred.
 ** It just might require an extra round trip or two.
 */
-static void send_unsent(Xfer *pXfer){
+static void send_unsent(Xfer *pXfer, int bKeep){
   Stmt q;
   db_prepare(&q, "SELECT rid FROM unsent EXCEPT SELECT rid FROM private");
   while( db_step(&q)==SQLITE_ROW ){
@@ -901,7 +929,7 @@ static void send_unsent(Xfer *pXfer){
     send_file(pXfer, rid, 0, 0);
   }
   db_finalize(&q);
-  db_multi_exec("DELETE FROM unsent");
+  if( !bKeep ) db_multi_exec("DELETE FROM unsent");
 }
 
 /*
@@ -1017,18 +1045,34 @@ static int send_unclustered(Xfer *pXfer){
       "SELECT uuid, rid FROM blob"
       " WHERE NOT EXISTS(SELECT 1 FROM shun WHERE uuid=blob.uuid)"
       "   AND NOT EXISTS(SELECT 1 FROM phantom WHERE rid=blob.rid)"
-      "   AND NOT EXISTS(SELECT 1 FROM private WHERE rid=blob.rid)%s"
+      "   AND NOT EXISTS(SELECT 1 FROM private WHERE rid=blob.rid)%s%s"
       "   AND blob.rid<=%d"
       " ORDER BY blob.rid DESC",
-      zExtra /*safe-for-%s*/, pXfer->resync
+      zExtra /*safe-for-%s*/, shallow_blob_filter() /*safe-for-%s*/,
+      pXfer->resync
+    );
+  }else if( shallow_is_active() ){
+    /* A shallow clone does not get clusters, so also announce everything
+    ** inside the bound that arrived after the oldest check-in of the
+    ** clone, whether or not it has since been clustered. */
+    db_prepare(&q,
+      "SELECT uuid FROM shallow_keep JOIN blob USING(rid)"
+      " WHERE (rid IN unclustered"
+      "        OR blob.rcvid IN (SELECT rcvid FROM rcvfrom"
+      "                           WHERE mtime>=%.17g))"
+      "   AND NOT EXISTS(SELECT 1 FROM shun WHERE uuid=blob.uuid)"
+      "   AND NOT EXISTS(SELECT 1 FROM phantom WHERE rid=blob.rid)"
+      "   AND NOT EXISTS(SELECT 1 FROM private WHERE rid=blob.rid)%s%s",
+      shallow_since(), zExtra /*safe-for-%s*/,
+      shallow_blob_filter() /*safe-for-%s*/
     );
   }else{
     db_prepare(&q,
       "SELECT uuid FROM unclustered JOIN blob USING(rid) /*scan*/"
       " WHERE NOT EXISTS(SELECT 1 FROM shun WHERE uuid=blob.uuid)"
       "   AND NOT EXISTS(SELECT 1 FROM phantom WHERE rid=blob.rid)"
-      "   AND NOT EXISTS(SELECT 1 FROM private WHERE rid=blob.rid)%s",
-      zExtra /*safe-for-%s*/
+      "   AND NOT EXISTS(SELECT 1 FROM private WHERE rid=blob.rid)%s%s",
+      zExtra /*safe-for-%s*/, shallow_blob_filter() /*safe-for-%s*/
     );
   }
   while( db_step(&q)==SQLITE_ROW ){
@@ -1052,7 +1096,8 @@ static void send_all(Xfer *pXfer){
     "SELECT uuid FROM blob "
     " WHERE NOT EXISTS(SELECT 1 FROM shun WHERE uuid=blob.uuid)"
     "   AND NOT EXISTS(SELECT 1 FROM private WHERE rid=blob.rid)"
-    "   AND NOT EXISTS(SELECT 1 FROM phantom WHERE rid=blob.rid)"
+    "   AND NOT EXISTS(SELECT 1 FROM phantom WHERE rid=blob.rid)%s",
+    shallow_blob_filter() /*safe-for-%s*/
   );
   while( db_step(&q)==SQLITE_ROW ){
     blob_appendf(pXfer->pOut, "igot %s\n", db_column_text(&q, 0));
@@ -1331,7 +1376,7 @@ void page_xfer(void){
       remote_unk(&xfer.aToken[1]);
       if( isPull ){
         int rid = rid_from_uuid(&xfer.aToken[1], 0, 0);
-        if( rid ){
+        if( rid && !shallow_omits(rid) ){
           send_file(&xfer, rid, &xfer.aToken[1], deltaFlag);
         }
       }
@@ -1466,6 +1511,11 @@ void page_xfer(void){
         max = db_int(0, "SELECT max(rid) FROM blob");
         while( xfer.mxSend>(int)blob_size(xfer.pOut) && seqno<=max){
           if( time(NULL) >= xfer.maxTime ) break;
+          if( shallow_omits(seqno) ){
+            seqno = shallow_next_rid(seqno);
+            if( seqno==0 ) seqno = max+1;
+            continue;
+          }
           if( iVers>=3 ){
             send_compressed_file(&xfer, seqno);
           }else{
@@ -1473,7 +1523,10 @@ void page_xfer(void){
           }
           seqno++;
         }
-        if( seqno>max ) seqno = 0;
+        if( seqno>max ){
+          seqno = 0;
+          shallow_send_tags(xfer.pOut);
+        }
         @ clone_seqno %d(seqno)
       }else{
         isClone = 1;
@@ -1760,6 +1813,36 @@ void page_xfer(void){
       */
       if( blob_eq(&xfer.aToken[1], "req-links") ){
         bSendLinks = 1;
+      }else
+
+      /*    pragma shallow DEPTH SINCE
+      **
+      ** The client wants a shallow clone.  Only send artifacts that are
+      ** within DEPTH check-ins of an open leaf and no older than the
+      ** julian day SINCE.  Either bound may be 0 for no limit.
+      */
+      if( blob_eq(&xfer.aToken[1], "shallow") && xfer.nToken==4 ){
+        int nDepth = 0;
+        login_check_credentials();
+        if( g.perm.Clone || g.perm.Read ){
+          blob_is_int(&xfer.aToken[2], &nDepth);
+          shallow_compute_keep(nDepth, atof(blob_str(&xfer.aToken[3])));
+        }
+      }else
+
+      /*    pragma blobless ?TIP?
+      **
+      ** The client wants a blobless clone or is pulling into one.  Do not
+      ** send artifacts that are used as files, except for the files of the
+      ** open leaves if TIP is 1.
+      */
+      if( blob_eq(&xfer.aToken[1], "blobless") && xfer.nToken<=3 ){
+        int bTip = 0;
+        login_check_credentials();
+        if( g.perm.Clone || g.perm.Read ){
+          if( xfer.nToken==3 ) blob_is_int(&xfer.aToken[2], &bTip);
+          shallow_omit_files(bTip);
+        }
       }
 
     }else
@@ -1930,8 +2013,21 @@ static const char zBriefFormat[] =
 #define SYNC_ALLURL         0x08000    /* The --all flag - sync to all URLs */
 #define SYNC_SHARE_LINKS    0x10000    /* Request alternate repo links */
 #define SYNC_XVERBOSE       0x20000    /* Extra verbose.  Network traffic */
+#define SYNC_CONCURRENT     0x40000    /* Sync all remotes at the same time */
 #endif
 
+/*
+** Number of client_sync() and client_fetch_phantoms() calls now running
+*/
+static int nClientSync = 0;
+
+/*
+** Return true if this process is in the middle of a sync with a remote.
+*/
+int client_sync_active(void){
+  return nClientSync>0;
+}
+
 /*
 ** Floating-point absolute value
 */
@@ -1939,6 +2035,27 @@ static double fossil_fabs(double x){
   return x>0.0 ? x : -x;
 }
 
+/*
+** Append the card in pXfer->aToken[] to pOut for the parent process of
+** a concurrent sync to merge, followed by the nByte bytes of content
+** that come after the card in pXfer->pIn and a newline.
+*/
+static void xfer_relay_card(Xfer *pXfer, Blob *pOut, int nByte){
+  int i;
+  for(i=0; i<pXfer->nToken; i++){
+    blob_appendf(pOut, "%s%b", i ? " " : "", &pXfer->aToken[i]);
+  }
+  blob_append(pOut, "\n", 1);
+  if( nByte>0 ){
+    Blob content;
+    blob_zero(&content);
+    blob_extract(pXfer->pIn, nByte, &content);
+    blob_append(pOut, blob_buffer(&content), blob_size(&content));
+    blob_append(pOut, "\n", 1);
+    blob_reset(&content);
+  }
+}
+
 /*
 ** Sync to the host identified in g.url.name and g.url.path.  This
 ** routine is called by the client.
@@ -1946,6 +2063,13 @@ static double fossil_fabs(double x){
 ** Records are pushed to the server if pushFlag is true.  Records
 ** are pulled if pullFlag is true.  A full sync occurs if both are
 ** true.
+**
+** In a child process of a concurrent sync (sync_relay_active() is true)
+** nothing is written to the repository.  The cards of each reply that
+** would change it are relayed to the parent process, which merges them
+** with client_sync_merge() and replies once they are committed.  The
+** child holds no transaction while waiting on the network or on the
+** parent, so it never blocks the merges of the other children.
 */
 int client_sync(
   unsigned syncFlags,      /* Mask of SYNC_* flags */
@@ -1991,6 +2115,8 @@ int client_sync(
   const char *zCkinLock;  /* Name of check-in to lock.  NULL for none */
   const char *zClientId;  /* A unique identifier for this check-out */
   unsigned int mHttpFlags;/* Flags for the http_exchange() subsystem */
+  int bRelay;             /* Relay received content to the parent process */
+  Blob relayed;           /* Cards relayed on this cycle */
 
   if( pnRcvd ) *pnRcvd = 0;
   if( db_get_boolean("dont-push", 0) ) syncFlags &= ~SYNC_PUSH;
@@ -2027,6 +2153,7 @@ int client_sync(
     zAltPCode = 0;
   }
 
+  nClientSync++;
   transport_stats(0, 0, 1);
   socket_global_init();
   memset(&xfer, 0, sizeof(xfer));
@@ -2045,8 +2172,10 @@ int client_sync(
   blob_zero(&recv);
   blob_zero(&xfer.err);
   blob_zero(&xfer.line);
+  blob_zero(&relayed);
   origConfigRcvMask = 0;
   nUncSent = nUncRcvd = 0;
+  bRelay = sync_relay_active();
 
   /* Send the send-private pragma if we are trying to sync private data */
   if( syncFlags & SYNC_PRIVATE ){
@@ -2090,6 +2219,9 @@ int client_sync(
                RELEASE_VERSION_NUMBER, MANIFEST_NUMERIC_DATE,
                MANIFEST_NUMERIC_TIME);
   if( syncFlags & SYNC_CLONE ){
+    /* An interrupted clone continues from where it stopped */
+    cloneSeqno = db_get_int("clone-seqno", 1);
+    shallow_send_bound(&send);
     blob_appendf(&send, "clone 3 %d\n", cloneSeqno);
     syncFlags &= ~(SYNC_PUSH|SYNC_PULL);
     nCardSent++;
@@ -2099,6 +2231,7 @@ int client_sync(
   }else if( syncFlags & SYNC_PULL ){
     blob_appendf(&send, "pull %s %s\n", zSCode,
                  zAltPCode ? zAltPCode : zPCode);
+    shallow_send_since(&send);
     nCardSent++;
     zOpType = (syncFlags & SYNC_PUSH)?"Sync":"Pull";
     if( (syncFlags & SYNC_RESYNC)!=0 && nCycle<2 ){
@@ -2137,12 +2270,12 @@ int client_sync(
     int newPhantom = 0;
     char *zRandomness;
     db_begin_transaction();
-    db_record_repository_filename(0);
+    if( !bRelay ) db_record_repository_filename(0);
     db_multi_exec(
       "CREATE TEMP TABLE onremote(rid INTEGER PRIMARY KEY);"
       "CREATE TEMP TABLE unk(uuid TEXT PRIMARY KEY) WITHOUT ROWID;"
     );
-    manifest_crosslink_begin();
+    if( !bRelay ) manifest_crosslink_begin();
 
 
     /* Client sends the most recently received cookie back to the server.
@@ -2161,7 +2294,7 @@ int client_sync(
       request_phantoms(&xfer, mxPhantomReq);
     }
     if( syncFlags & SYNC_PUSH ){
-      send_unsent(&xfer);
+      send_unsent(&xfer, bRelay);
       nCardSent += send_unclustered(&xfer);
       if( syncFlags & SYNC_PRIVATE ) send_private(&xfer);
     }
@@ -2286,16 +2419,22 @@ int client_sync(
     }
 
     /* Do the round-trip to the server */
+    if( bRelay ) db_end_transaction(0);
     if( http_exchange(&send, &recv, mHttpFlags, MAX_REDIRECTS, 0) ){
       nErr++;
       go = 2;
       break;
     }
+    if( bRelay ) db_begin_transaction();
 
     /* Remember the URL of the sync target in the config file on the
     ** first successful round-trip */
     if( nCycle==0 && db_is_writeable("repository") ){
-      xfer_syncwith(g.url.canonical, 0);
+      if( bRelay ){
+        blob_appendf(&relayed, "syncwith %F\n", g.url.canonical);
+      }else{
+        xfer_syncwith(g.url.canonical, 0);
+      }
     }
 
     /* Output current stats */
@@ -2336,6 +2475,7 @@ int client_sync(
     if( syncFlags & SYNC_PULL ){
       blob_appendf(&send, "pull %s %s\n", zSCode,
                    zAltPCode ? zAltPCode : zPCode);
+      shallow_send_since(&send);
       nCardSent++;
     }
     if( syncFlags & SYNC_PUSH ){
@@ -2383,7 +2523,21 @@ int client_sync(
       ** Client receives a file transmitted from the server.
       */
       if( blob_eq(&xfer.aToken[0],"file") ){
-        xfer_accept_file(&xfer, (syncFlags & SYNC_CLONE)!=0, 0, 0);
+        if( !bRelay ){
+          xfer_accept_file(&xfer, (syncFlags & SYNC_CLONE)!=0, 0, 0);
+        }else if( (xfer.nToken==3 || xfer.nToken==4)
+               && blob_is_int(&xfer.aToken[xfer.nToken-1], &size)
+               && size>=0
+        ){
+          xfer_relay_card(&xfer, &relayed, size);
+          if( xfer.nToken==4 ){
+            xfer.nDeltaRcvd++;
+          }else{
+            xfer.nFileRcvd++;
+          }
+        }else{
+          blob_appendf(&xfer.err, "malformed file line");
+        }
         nArtifactRcvd++;
       }else
 
@@ -2393,7 +2547,21 @@ int client_sync(
       ** Client receives a compressed file transmitted from the server.
       */
       if( blob_eq(&xfer.aToken[0],"cfile") ){
-        xfer_accept_compressed_file(&xfer, 0, 0);
+        if( !bRelay ){
+          xfer_accept_compressed_file(&xfer, 0, 0);
+        }else if( (xfer.nToken==4 || xfer.nToken==5)
+               && blob_is_int(&xfer.aToken[xfer.nToken-1], &size)
+               && size>=0
+        ){
+          xfer_relay_card(&xfer, &relayed, size);
+          if( xfer.nToken==5 ){
+            xfer.nDeltaRcvd++;
+          }else{
+            xfer.nFileRcvd++;
+          }
+        }else{
+          blob_appendf(&xfer.err, "malformed cfile line");
+        }
         nArtifactRcvd++;
       }else
 
@@ -2449,16 +2617,25 @@ int client_sync(
         int isPriv = xfer.nToken>=3 && blob_eq(&xfer.aToken[2],"1");
         rid = rid_from_uuid(&xfer.aToken[1], 0, 0);
         if( rid>0 ){
-          if( isPriv ){
-            content_make_private(rid);
-          }else{
-            content_make_public(rid);
+          if( !bRelay ){
+            if( isPriv ){
+              content_make_private(rid);
+            }else{
+              content_make_public(rid);
+            }
+          }else if( content_is_private(rid)!=isPriv ){
+            xfer_relay_card(&xfer, &relayed, 0);
           }
         }else if( isPriv && !g.perm.Private ){
           /* ignore private files */
         }else if( (syncFlags & (SYNC_PULL|SYNC_CLONE))!=0 ){
-          rid = content_new(blob_str(&xfer.aToken[1]), isPriv);
-          if( rid ) newPhantom = 1;
+          if( bRelay ){
+            xfer_relay_card(&xfer, &relayed, 0);
+            newPhantom = 1;
+          }else{
+            rid = content_new(blob_str(&xfer.aToken[1]), isPriv);
+            if( rid ) newPhantom = 1;
+          }
         }
         remote_has(rid);
       }else
@@ -2556,8 +2733,14 @@ int client_sync(
         if( zPCode==0 ){
           zPCode = mprintf("%b", &xfer.aToken[2]);
           db_set("project-code", zPCode, 0);
+        }else if( !blob_eq_str(&xfer.aToken[2], zPCode, -1) ){
+          /* An interrupted clone is continued from a different project */
+          blob_appendf(&xfer.err, "wrong project: %b", &xfer.aToken[2]);
+        }
+        if( cloneSeqno>0 ){
+          shallow_send_bound(&send);
+          blob_appendf(&send, "clone 3 %d\n", cloneSeqno);
         }
-        if( cloneSeqno>0 ) blob_appendf(&send, "clone 3 %d\n", cloneSeqno);
         nCardSent++;
       }else
 
@@ -2572,13 +2755,21 @@ int client_sync(
           && blob_is_int(&xfer.aToken[2], &size) ){
         const char *zName = blob_str(&xfer.aToken[1]);
         Blob content;
-        blob_zero(&content);
-        blob_extract(xfer.pIn, size, &content);
-        g.perm.Admin = g.perm.RdAddr = 1;
-        configure_receive(zName, &content, origConfigRcvMask);
+        if( bRelay ){
+          if( origConfigRcvMask ){
+            xfer_relay_card(&xfer, &relayed, size);
+          }else{
+            blob_seek(xfer.pIn, size, BLOB_SEEK_CUR);
+          }
+        }else{
+          blob_zero(&content);
+          blob_extract(xfer.pIn, size, &content);
+          g.perm.Admin = g.perm.RdAddr = 1;
+          configure_receive(zName, &content, origConfigRcvMask);
+          blob_reset(&content);
+        }
         nCardRcvd++;
         nArtifactRcvd++;
-        blob_reset(&content);
         blob_seek(xfer.pIn, 1, BLOB_SEEK_CUR);
       }else
 
@@ -2593,7 +2784,11 @@ int client_sync(
       ** same server.
       */
       if( blob_eq(&xfer.aToken[0], "cookie") && xfer.nToken==2 ){
-        db_set("cookie", blob_str(&xfer.aToken[1]), 0);
+        if( bRelay ){
+          xfer_relay_card(&xfer, &relayed, 0);
+        }else{
+          db_set("cookie", blob_str(&xfer.aToken[1]), 0);
+        }
       }else
 
 
@@ -2603,7 +2798,11 @@ int client_sync(
       ** contain private content.
       */
       if( blob_eq(&xfer.aToken[0], "private") ){
-        xfer.nextIsPrivate = 1;
+        if( bRelay ){
+          xfer_relay_card(&xfer, &relayed, 0);
+        }else{
+          xfer.nextIsPrivate = 1;
+        }
       }else
 
 
@@ -2616,6 +2815,28 @@ int client_sync(
       */
       if( blob_eq(&xfer.aToken[0], "clone_seqno") && xfer.nToken==2 ){
         blob_is_int(&xfer.aToken[1], &cloneSeqno);
+        db_set_int("clone-seqno", cloneSeqno, 0);
+      }else
+
+      /*    shallow-tag HASH TAGNAME MTIME ?VALUE?
+      **
+      ** At the end of a shallow clone, the server names a propagating
+      ** tag that check-in HASH inherits from history that was not sent.
+      */
+      if( blob_eq(&xfer.aToken[0], "shallow-tag")
+       && (xfer.nToken==4 || xfer.nToken==5)
+       && (syncFlags & SYNC_CLONE)!=0
+       && blob_is_hname(&xfer.aToken[1])
+      ){
+        char *zValue = 0;
+        defossilize(blob_str(&xfer.aToken[2]));
+        if( xfer.nToken==5 ){
+          zValue = blob_str(&xfer.aToken[4]);
+          defossilize(zValue);
+        }
+        shallow_accept_tag(blob_str(&xfer.aToken[1]),
+                           blob_str(&xfer.aToken[2]),
+                           atof(blob_str(&xfer.aToken[3])), zValue);
       }else
 
       /*   message MESSAGE
@@ -2814,6 +3035,25 @@ int client_sync(
     blob_reset(&recv);
     nCycle++;
 
+    /* Have the parent process merge what was received, then continue
+    ** with a view of the repository that includes it */
+    if( bRelay ){
+      db_end_transaction(0);
+      if( blob_size(&relayed)>0 ){
+        Blob err;
+        blob_zero(&err);
+        if( sync_relay_merge(&relayed, &err) ){
+          fossil_force_newline();
+          fossil_warning("%b", &err);
+          nErr++;
+          go = 0;
+        }
+        blob_reset(&err);
+        blob_reset(&relayed);
+      }
+      db_begin_transaction();
+    }
+
     /* Set go to 1 if we need to continue the sync/push/pull/clone for
     ** another round.  Set go to 0 if it is time to quit. */
     nFileRecv = xfer.nFileRcvd + xfer.nDeltaRcvd + xfer.nDanglingFile;
@@ -2847,11 +3087,13 @@ int client_sync(
     xfer.nDeltaRcvd = 0;
     xfer.nDanglingFile = 0;
     db_multi_exec("DROP TABLE onremote; DROP TABLE unk;");
-    if( go ){
-      manifest_crosslink_end(MC_PERMIT_HOOKS);
-    }else{
-      manifest_crosslink_end(MC_PERMIT_HOOKS);
-      content_enable_dephantomize(1);
+    if( !bRelay ) manifest_crosslink_end(MC_PERMIT_HOOKS);
+    if( !go ) content_enable_dephantomize(1);
+    if( syncFlags & SYNC_CLONE ){
+      /* A clone commits each round-trip so that it can be continued if
+      ** interrupted, but skips the per-artifact checks at commit the
+      ** same as when the whole clone was a single transaction */
+      verify_cancel();
     }
     db_end_transaction(0);
   };
@@ -2893,10 +3135,11 @@ int client_sync(
   transport_global_shutdown(&g.url);
   if( nErr && go==2 ){
     db_multi_exec("DROP TABLE onremote; DROP TABLE unk;");
-    manifest_crosslink_end(MC_PERMIT_HOOKS);
+    if( !bRelay ) manifest_crosslink_end(MC_PERMIT_HOOKS);
     content_enable_dephantomize(1);
-    db_end_transaction(0);
+    if( !bRelay ) db_end_transaction(0);
   }
+  blob_reset(&relayed);
   if( nErr && autopushFailed ){
     fossil_warning(
       "Warning: The check-in was successful and is saved locally but you\n"
@@ -2910,5 +3153,203 @@ int client_sync(
     fossil_warning("***** WARNING: a fork has occurred *****\n"
                    "use \"fossil leaves -multiple\" for more details.");
   }
+  nClientSync--;
+  return nErr;
+}
+
+/*
+** Merge into the repository the cards that a child process of a
+** concurrent sync relayed from client_sync() instead of applying them
+** itself.  syncFlags and configRcvMask are those the child was given.
+** Everything in pIn is merged in a single transaction, which also
+** crosslinks the artifacts received.  Return the number of errors, with
+** a description of each appended to pErr.
+*/
+int client_sync_merge(
+  Blob *pIn,               /* Relayed cards */
+  unsigned syncFlags,      /* Mask of SYNC_* flags */
+  unsigned configRcvMask,  /* Receive these configuration items */
+  Blob *pErr               /* Write error messages here */
+){
+  Xfer xfer;
+  int size;
+  int nErr = 0;
+
+  memset(&xfer, 0, sizeof(xfer));
+  xfer.pIn = pIn;
+  blobarray_zero(xfer.aToken, count(xfer.aToken));
+  blob_zero(&xfer.err);
+  blob_zero(&xfer.line);
+  if( syncFlags & SYNC_PRIVATE ) g.perm.Private = 1;
+  db_begin_transaction();
+  db_multi_exec("CREATE TEMP TABLE onremote(rid INTEGER PRIMARY KEY);");
+  manifest_crosslink_begin();
+  while( blob_line(pIn, &xfer.line) ){
+    xfer.nToken = blob_tokenize(&xfer.line, xfer.aToken, count(xfer.aToken));
+    if( xfer.nToken==0 ){
+      /* The newline that follows content */
+    }else if( blob_eq(&xfer.aToken[0], "file") ){
+      xfer_accept_file(&xfer, 0, 0, 0);
+    }else if( blob_eq(&xfer.aToken[0], "cfile") ){
+      xfer_accept_compressed_file(&xfer, 0, 0);
+    }else if( blob_eq(&xfer.aToken[0], "private") ){
+      xfer.nextIsPrivate = 1;
+    }else if( blob_eq(&xfer.aToken[0], "igot")
+           && xfer.nToken>=2
+           && blob_is_hname(&xfer.aToken[1])
+    ){
+      int isPriv = xfer.nToken>=3 && blob_eq(&xfer.aToken[2],"1");
+      int rid = rid_from_uuid(&xfer.aToken[1], 0, 0);
+      if( rid==0 ){
+        content_new(blob_str(&xfer.aToken[1]), isPriv);
+      }else if( isPriv ){
+        content_make_private(rid);
+      }else{
+        content_make_public(rid);
+      }
+    }else if( blob_eq(&xfer.aToken[0], "config")
+           && xfer.nToken==3
+           && blob_is_int(&xfer.aToken[2], &size)
+    ){
+      Blob content;
+      blob_zero(&content);
+      blob_extract(pIn, size, &content);
+      g.perm.Admin = g.perm.RdAddr = 1;
+      configure_receive(blob_str(&xfer.aToken[1]), &content, configRcvMask);
+      blob_reset(&content);
+      blob_seek(pIn, 1, BLOB_SEEK_CUR);
+    }else if( blob_eq(&xfer.aToken[0], "cookie") && xfer.nToken==2 ){
+      db_set("cookie", blob_str(&xfer.aToken[1]), 0);
+    }else if( blob_eq(&xfer.aToken[0], "syncwith") && xfer.nToken==2 ){
+      char *zUrl = blob_str(&xfer.aToken[1]);
+      defossilize(zUrl);
+      xfer_syncwith(zUrl, 0);
+    }else{
+      blob_appendf(&xfer.err, "unknown relayed card: [%b]", &xfer.aToken[0]);
+    }
+    if( blob_size(&xfer.err) ){
+      blob_appendf(pErr, "%b\n", &xfer.err);
+      blob_reset(&xfer.err);
+      nErr++;
+    }
+    blobarray_reset(xfer.aToken, xfer.nToken);
+    blob_reset(&xfer.line);
+  }
+  db_multi_exec("DROP TABLE onremote;");
+  manifest_crosslink_end(MC_PERMIT_HOOKS);
+  db_end_transaction(0);
   return nErr;
 }
+
+/*
+** Fetch from the default remote repository every artifact listed in
+** the TEMP.FETCHLIST table that is still a phantom.  This is how a
+** blobless clone obtains file content on demand.  Artifacts are asked
+** for with ordinary "gimme" cards and the loop continues for as long
+** as the server keeps sending them.  Return the number of artifacts
+** received.
+*/
+int client_fetch_phantoms(void){
+  Xfer xfer;              /* Transfer data */
+  Blob send;              /* Text we are sending to the server */
+  Blob recv;              /* Reply we got back from the server */
+  UrlData savedUrl;       /* Prior content of g.url */
+  Stmt q;                 /* Phantoms still wanted */
+  int nRcvd = 0;          /* Total artifacts received */
+  int nErr = 0;           /* Number of errors */
+  int bTempTables;        /* True if the TEMP tables are created here */
+  const char *zSCode = db_get("server-code", "x");
+  const char *zPCode = db_get("project-code", 0);
+
+  savedUrl = g.url;
+  url_parse(0, URL_USE_CONFIG);
+  if( g.url.name==0 || zPCode==0 ){
+    url_unparse(0);
+    g.url = savedUrl;
+    return 0;
+  }
+  nClientSync++;
+  socket_global_init();
+  memset(&xfer, 0, sizeof(xfer));
+  xfer.pIn = &recv;
+  xfer.pOut = &send;
+  xfer.mxSend = db_get_int("max-upload", 250000);
+  xfer.maxTime = -1;
+  xfer.remoteVersion = RELEASE_VERSION_NUMBER;
+  blobarray_zero(xfer.aToken, count(xfer.aToken));
+  blob_zero(&send);
+  blob_zero(&recv);
+  blob_zero(&xfer.err);
+  blob_zero(&xfer.line);
+  db_begin_transaction();
+  bTempTables = !db_table_exists("temp", "onremote");
+  if( bTempTables ){
+    db_multi_exec(
+      "CREATE TEMP TABLE onremote(rid INTEGER PRIMARY KEY);"
+      "CREATE TEMP TABLE unk(uuid TEXT PRIMARY KEY) WITHOUT ROWID;"
+    );
+  }
+  while( nErr==0 ){
+    int nGimme = 0;
+    int nFile = 0;
+    blob_reset(&send);
+    blob_appendf(&send, "pragma client-version %d %d %d\n",
+                 RELEASE_VERSION_NUMBER, MANIFEST_NUMERIC_DATE,
+                 MANIFEST_NUMERIC_TIME);
+    blob_appendf(&send, "pull %s %s\n", zSCode, zPCode);
+    db_prepare(&q,
+      "SELECT uuid FROM fetchlist JOIN blob USING(rid)"
+      " WHERE blob.size<0"
+      "   AND NOT EXISTS(SELECT 1 FROM shun WHERE uuid=blob.uuid)"
+      " LIMIT 1000"
+    );
+    while( db_step(&q)==SQLITE_ROW ){
+      blob_appendf(&send, "gimme %s\n", db_column_text(&q, 0));
+      nGimme++;
+    }
+    db_finalize(&q);
+    if( nGimme==0 ) break;
+    if( http_exchange(&send, &recv, HTTP_USE_LOGIN, MAX_REDIRECTS, 0) ){
+      nErr++;
+      break;
+    }
+    while( blob_line(&recv, &xfer.line) ){
+      if( blob_buffer(&xfer.line)[0]=='#' ) continue;
+      xfer.nToken = blob_tokenize(&xfer.line, xfer.aToken, count(xfer.aToken));
+      if( blob_eq(&xfer.aToken[0],"file") ){
+        xfer_accept_file(&xfer, 0, 0, 0);
+        nFile++;
+      }else if( blob_eq(&xfer.aToken[0],"cfile") ){
+        xfer_accept_compressed_file(&xfer, 0, 0);
+        nFile++;
+      }else if( blob_eq(&xfer.aToken[0],"error") && xfer.nToken==2 ){
+        char *zMsg = blob_terminate(&xfer.aToken[1]);
+        defossilize(zMsg);
+        blob_appendf(&xfer.err, "server says: %s", zMsg);
+      }
+      blobarray_reset(xfer.aToken, xfer.nToken);
+      blob_reset(&xfer.line);
+      if( blob_size(&xfer.err) ){
+        fossil_warning("%b", &xfer.err);
+        nErr++;
+        break;
+      }
+    }
+    blob_reset(&recv);
+    nRcvd += nFile;
+    if( nFile==0 ) break;
+  }
+  if( bTempTables ){
+    db_multi_exec("DROP TABLE onremote; DROP TABLE unk;");
+  }
+  db_end_transaction(0);
+  blob_reset(&send);
+  blob_reset(&recv);
+  blob_reset(&xfer.err);
+  transport_close(&g.url);
+  transport_global_shutdown(&g.url);
+  url_unparse(0);
+  g.url = savedUrl;
+  nClientSync--;
+  return nRcvd;
+}
@@ -920,10 +920,12 @@ proc random_changes {body blocksize count index prob} {
 # is a list comprised of the new process identifier and the port on which
 # the server started.  The varName argument refers to a variable
 # where the "stop argument" is to be stored.  This value must eventually be
-# passed to the [test_stop_server] procedure.
-proc test_start_server { repository {varName ""} } {
+# passed to the [test_stop_server] procedure.  Any further arguments are
+# passed on to "fossil server" as options.
+proc test_start_server { repository {varName ""} args } {
   global fossilexe tempPath
   set command [list exec $fossilexe server --localhost]
+  eval lappend command $args
   if {[string length $varName] > 0} {
     upvar 1 $varName stopArg
   }
@@ -54,6 +54,7 @@ set src {
   ajax
   alerts
   allrepo
+  arena
   attach
   backlink
   backoffice
@@ -73,6 +74,7 @@ set src {
   checkout
   clearsign
   clone
+  cmprdict
   color
   comformat
   configure
@@ -139,6 +141,7 @@ set src {
   merge3
   moderate
   name
+  packfile
   patch
   path
   piechart
@@ -162,6 +165,7 @@ set src {
   sha1
   sha1hard
   sha3
+  shallow
   shun
   sitemap
   skins
@@ -172,6 +176,7 @@ set src {
   statrep
   style
   sync
+  syncbench
   tag
   tar
   terminal
@@ -234,7 +239,6 @@ set SQLITE_OPTIONS {
   -DSQLITE_LIKE_DOESNT_MATCH_BLOBS
   -DSQLITE_OMIT_DECLTYPE
   -DSQLITE_OMIT_DEPRECATED
-  -DSQLITE_OMIT_PROGRESS_CALLBACK
   -DSQLITE_OMIT_SHARED_CACHE
   -DSQLITE_OMIT_LOAD_EXTENSION
   -DSQLITE_MAX_EXPR_DEPTH=0